@@ -1,5 +1,6 @@
 import 'dart:convert';
 import 'dart:io';
+import 'dart:math';
 import 'package:flutter/material.dart';
 import 'package:mqtt_client/mqtt_client.dart';
 import 'package:mqtt_client/mqtt_server_client.dart';
@@ -554,6 +555,10 @@ class MqttController extends ChangeNotifier {
   late String _deviceStateTopic;
   late String _sysOnlineTopic;
 
+  // Command sequence number: the device drops a redelivered "seq". Random
+  // start so the app and the web page don't reuse each other's numbers.
+  int _commandSeq = Random().nextInt(1 << 30);
+
   // Getters
   bool get brokerConnected => _brokerConnected;
   bool get deviceOnline => _deviceOnline;
@@ -733,7 +738,14 @@ class MqttController extends ChangeNotifier {
       return;
     }
 
-    final command = jsonEncode({device: 'toggle'});
+    // Correlation id + send time: the device echoes both on device/ack
+    final sentAt = DateTime.now().millisecondsSinceEpoch;
+    final command = jsonEncode({
+      device: 'toggle',
+      'id': 'app-${sentAt.toRadixString(36)}',
+      'ts': sentAt,
+      'seq': ++_commandSeq,
+    });
     print('Sending command: $command to $_deviceCmdTopic');
 
     final builder = MqttClientPayloadBuilder();
@@ -102,8 +102,17 @@ class _IoTControllerPageState extends State<IoTControllerPage> {
         const topic = '$topicNamespace/device/cmd';
         const command = {};
         command[device] = action;
+        // Correlation id + send time: the device echoes both on device/ack
+        const sentAt = Date.now();
+        command.id = 'app-' + sentAt.toString(36);
+        command.ts = sentAt;
+        // Sequence number (the device drops a redelivered "seq"), QoS1 so
+        // the broker queues the command while the device is reconnecting
+        window.flutterCommandSeq = (window.flutterCommandSeq ||
+            Math.floor(Math.random() * 0x40000000)) + 1;
+        command.seq = window.flutterCommandSeq;
         const payload = JSON.stringify(command);
-        window.flutterMqttClient.publish(topic, payload);
+        window.flutterMqttClient.publish(topic, payload, { qos: 1 });
         console.log('Sent command:', device, action);
       };
     ''']);
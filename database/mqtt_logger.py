@@ -9,6 +9,11 @@ import time
 from datetime import datetime
 import paho.mqtt.client as mqtt
 
+try:
+    import msgpack  # pip install msgpack - chỉ cần cho topic */mp
+except ImportError:
+    msgpack = None
+
 # =============================================================================
 # CONFIGURATION
 # =============================================================================
@@ -23,6 +28,9 @@ TOPIC_NS = "demo/room1"
 # Database Configuration
 DB_FILE = "iot_data.db"
 
+# Topic JSON đã có bản /mp (MSGPACK_PAYLOADS gửi cả hai): chỉ lưu bản /mp
+msgpack_twins = set()
+
 # =============================================================================
 # DATABASE SETUP
 # =============================================================================
@@ -45,6 +53,26 @@ def init_database():
         )
     """)
     
+    # Bảng sensor_summary - Thống kê theo cửa sổ (sensor/summary, summary mode)
+    cursor.execute("""
+        CREATE TABLE IF NOT EXISTS sensor_summary (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+            device_timestamp INTEGER,
+            duration_ms INTEGER,
+            count INTEGER,
+            temp_min REAL,
+            temp_max REAL,
+            temp_mean REAL,
+            temp_sd REAL,
+            hum_min REAL,
+            hum_max REAL,
+            hum_mean REAL,
+            hum_sd REAL,
+            rssi INTEGER
+        )
+    """)
+    
     # Bảng device_state - Lưu trạng thái thiết bị
     cursor.execute("""
         CREATE TABLE IF NOT EXISTS device_state (
@@ -70,6 +98,41 @@ def init_database():
         )
     """)
     
+    # Bảng device_boot - Thời gian từng bước khởi động (object boot trong sys/online)
+    cursor.execute("""
+        CREATE TABLE IF NOT EXISTS device_boot (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+            device_id TEXT,
+            firmware TEXT,
+            wifi_ms INTEGER,
+            ip_ms INTEGER,
+            mqtt_ms INTEGER,
+            publish_ms INTEGER,
+            cached_ap BOOLEAN,
+            cached_ip BOOLEAN
+        )
+    """)
+    
+    # Bảng device_metrics - Sức khoẻ runtime (sys/metrics, mỗi 60 s)
+    cursor.execute("""
+        CREATE TABLE IF NOT EXISTS device_metrics (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+            uptime_s INTEGER,
+            heap_free INTEGER,
+            heap_min INTEGER,
+            heap_largest INTEGER,
+            loop_p99_us INTEGER,
+            loop_max_us INTEGER,
+            wifi_reconnects INTEGER,
+            mqtt_reconnects INTEGER,
+            publish_failures INTEGER,
+            dht_failures INTEGER,
+            payload TEXT
+        )
+    """)
+    
     # Bảng commands - Lưu lịch sử điều khiển
     cursor.execute("""
         CREATE TABLE IF NOT EXISTS commands (
@@ -96,8 +159,13 @@ def on_connect(client, userdata, flags, rc):
         
         # Subscribe to all topics
         client.subscribe(f"{TOPIC_NS}/sensor/state")
+        client.subscribe(f"{TOPIC_NS}/sensor/state/mp")
+        client.subscribe(f"{TOPIC_NS}/sensor/batch")
+        client.subscribe(f"{TOPIC_NS}/sensor/summary")
         client.subscribe(f"{TOPIC_NS}/device/state")
+        client.subscribe(f"{TOPIC_NS}/device/state/mp")
         client.subscribe(f"{TOPIC_NS}/sys/online")
+        client.subscribe(f"{TOPIC_NS}/sys/metrics")
         client.subscribe(f"{TOPIC_NS}/device/cmd")
         
         print(f"📡 Subscribed to: {TOPIC_NS}/*")
@@ -107,6 +175,27 @@ def on_connect(client, userdata, flags, rc):
 def on_message(client, userdata, msg):
     """Callback khi nhận được message từ MQTT"""
     topic = msg.topic
+
+    # Payload MessagePack (binary) - đổi sang dict giống JSON rồi lưu như cũ
+    if topic.endswith("/mp"):
+        if msgpack is None:
+            print(f"⚠️  msgpack not installed, skipping {topic}")
+            return
+        msgpack_twins.add(topic[:-len("/mp")])
+        try:
+            fields = msgpack.unpackb(msg.payload)
+            if topic.endswith("/sensor/state/mp"):
+                save_sensor_data(decode_sensor_msgpack(fields))
+            elif topic.endswith("/device/state/mp"):
+                save_device_state(decode_device_msgpack(fields))
+        except Exception as e:
+            print(f"❌ Invalid MessagePack from {topic}: {e}")
+        return
+
+    # Bản JSON của message vừa lưu từ /mp (firmware gửi /mp trước)
+    if topic in msgpack_twins:
+        return
+
     payload = msg.payload.decode()
     
     try:
@@ -115,10 +204,16 @@ def on_message(client, userdata, msg):
         # Xử lý theo topic
         if topic.endswith("/sensor/state"):
             save_sensor_data(data)
+        elif topic.endswith("/sensor/batch"):
+            save_sensor_batch(data)
+        elif topic.endswith("/sensor/summary"):
+            save_sensor_summary(data)
         elif topic.endswith("/device/state"):
             save_device_state(data)
         elif topic.endswith("/sys/online"):
             save_online_status(data)
+        elif topic.endswith("/sys/metrics"):
+            save_metrics(data, payload)
         elif topic.endswith("/device/cmd"):
             save_command(data)
             
@@ -153,6 +248,115 @@ def save_sensor_data(data):
     
     print(f"🌡️  Sensor: {temperature}°C, {humidity}%, {rssi}dBm - Saved to DB")
 
+def decode_sensor_msgpack(fields):
+    """Giải mã sensor/state/mp thành dict như JSON
+
+    Format: [timestamp, nhiệt độ x10, độ ẩm x10, rssi, lux]
+    Các phần tử cuối có thể thiếu hoặc nil (firmware C3 không có lux)
+    """
+    ts, temp10, hum10, rssi, lux = (list(fields) + [None] * 5)[:5]
+    return {
+        "timestamp": ts,
+        "temperature": temp10 / 10.0 if temp10 is not None else None,
+        "humidity": hum10 / 10.0 if hum10 is not None else None,
+        "rssi": rssi,
+        "lux": lux,
+    }
+
+def decode_device_msgpack(fields):
+    """Giải mã device/state/mp thành dict như JSON
+
+    Format: [timestamp, đèn bật (bool), quạt bật (bool), rssi, duty đích, duty hiện tại]
+    Hai phần tử cuối (ramp quạt, duty 0-255) có thể thiếu ở firmware cũ
+    """
+    ts, light, fan, rssi, target, duty = (list(fields) + [None] * 6)[:6]
+    state = {
+        "timestamp": ts,
+        "light": "on" if light else "off",
+        "fan": "on" if fan else "off",
+        "rssi": rssi,
+    }
+    if target is not None:
+        state["fanSpeed"] = {"target": target, "duty": duty}
+    return state
+
+def decode_sensor_batch(data):
+    """Giải mã message sensor/batch thành danh sách mẫu
+
+    Format (xem flushSensorBatch() trong firmware_esp32c3):
+    {"ts":<millis mẫu đầu>,"n":3,"rssi":-57,"dt":[0,3000,6001],"t":[251,252,252],"h":[602,601,603]}
+    dt = offset (ms) so với ts, t/h = nhiệt độ/độ ẩm x10
+    Replay từ offline journal có thêm "replay":true (và "prevBoot":true nếu
+    timestamp thuộc lần boot trước của thiết bị)
+    """
+    base = data.get('ts', 0)
+    offsets = data.get('dt', [])
+    temps = data.get('t', [])
+    hums = data.get('h', [])
+    rssi = data.get('rssi')
+
+    count = min(len(offsets), len(temps), len(hums))
+    if count != data.get('n', count):
+        print(f"⚠️  Batch header says n={data.get('n')}, decoded {count} samples")
+
+    return [
+        (base + offsets[i], temps[i] / 10.0, hums[i] / 10.0, None, rssi)
+        for i in range(count)
+    ]
+
+def save_sensor_batch(data):
+    """Lưu một batch nhiều mẫu cảm biến vào database (1 transaction)"""
+    rows = decode_sensor_batch(data)
+    if not rows:
+        return
+
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+
+    cursor.executemany("""
+        INSERT INTO sensor_data (device_timestamp, temperature, humidity, lux, rssi)
+        VALUES (?, ?, ?, ?, ?)
+    """, rows)
+
+    conn.commit()
+    conn.close()
+
+    first, last = rows[0], rows[-1]
+    if data.get('replay'):
+        boot = " (previous boot)" if data.get('prevBoot') else ""
+        print(f"📼 Replay: {len(rows)} samples{boot}, {first[1]}-{last[1]}°C - Saved to DB")
+    else:
+        print(f"📦 Batch: {len(rows)} samples, {first[1]}-{last[1]}°C - Saved to DB")
+
+def save_sensor_summary(data):
+    """Lưu một cửa sổ thống kê (min/max/mean/sd/n) vào database
+
+    Format (xem publishSensorSummary() trong firmware_esp32c3):
+    {"ts":<millis mẫu đầu>,"durMs":60000,"n":60,"rssi":-57,
+     "t":{"min":24.1,"max":24.6,"mean":24.32,"sd":0.12},"h":{...}}
+    """
+    temp = data.get('t', {})
+    hum = data.get('h', {})
+    row = (
+        data.get('ts'), data.get('durMs'), data.get('n'),
+        temp.get('min'), temp.get('max'), temp.get('mean'), temp.get('sd'),
+        hum.get('min'), hum.get('max'), hum.get('mean'), hum.get('sd'),
+        data.get('rssi'),
+    )
+
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    cursor.execute("""
+        INSERT INTO sensor_summary (device_timestamp, duration_ms, count,
+                                    temp_min, temp_max, temp_mean, temp_sd,
+                                    hum_min, hum_max, hum_mean, hum_sd, rssi)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    """, row)
+    conn.commit()
+    conn.close()
+
+    print(f"📈 Summary: {row[2]} readings, {row[3]}-{row[4]}°C (mean {row[5]}, sd {row[6]}) - Saved to DB")
+
 def save_device_state(data):
     """Lưu trạng thái thiết bị vào database"""
     conn = sqlite3.connect(DB_FILE)
@@ -195,6 +399,74 @@ def save_online_status(data):
     status = "🟢 Online" if online else "🔴 Offline"
     print(f"{status}: {device_id} - Saved to DB")
 
+    save_boot_times(data)
+
+def save_boot_times(data):
+    """Lưu boot timeline, chỉ từ sys/online đầu tiên sau boot (chưa reconnect lần nào)"""
+    boot = data.get('boot')
+    if not data.get('online') or not boot:
+        return
+    if metric(data, 'wifiReconnects', 'wifi_reconnects') or metric(data, 'mqttReconnects', 'mqtt_reconnects'):
+        return
+
+    row = (
+        data.get('deviceId'),
+        data.get('firmware'),
+        metric(boot, 'wifiMs', 'wifi_ms'),
+        metric(boot, 'ipMs', 'ip_ms'),
+        metric(boot, 'mqttMs', 'mqtt_ms'),
+        metric(boot, 'publishMs', 'publish_ms'),
+        metric(boot, 'cachedAp', 'cached_ap'),
+        metric(boot, 'cachedIp', 'cached_ip'),
+    )
+
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    cursor.execute("""
+        INSERT INTO device_boot (device_id, firmware, wifi_ms, ip_ms, mqtt_ms, publish_ms, cached_ap, cached_ip)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+    """, row)
+    conn.commit()
+    conn.close()
+
+    print(f"🚀 Boot: WiFi {row[2]} ms, IP {row[3]} ms, MQTT {row[4]} ms, first publish {row[5]} ms"
+          f"{' (cached AP)' if row[6] else ''} - Saved to DB")
+
+def metric(data, camel, snake):
+    """Đọc field sys/metrics: C3 dùng camelCase, S3 dùng snake_case"""
+    value = data.get(camel)
+    return data.get(snake) if value is None else value
+
+def save_metrics(data, payload):
+    """Lưu sys/metrics vào database (payload đầy đủ, gồm histogram, lưu ở cột payload)"""
+    loop = metric(data, 'loopUs', 'loop_us') or {}
+    row = (
+        metric(data, 'uptimeS', 'uptime_s'),
+        metric(data, 'heapFree', 'heap_free'),
+        metric(data, 'heapMin', 'heap_min'),
+        metric(data, 'heapLargest', 'heap_largest'),
+        loop.get('p99'),
+        loop.get('max'),
+        metric(data, 'wifiReconnects', 'wifi_reconnects'),
+        metric(data, 'mqttReconnects', 'mqtt_reconnects'),
+        metric(data, 'publishFailures', 'publish_failures'),
+        metric(data, 'dhtFailures', 'dht_failures'),
+        payload,
+    )
+
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    cursor.execute("""
+        INSERT INTO device_metrics (uptime_s, heap_free, heap_min, heap_largest, loop_p99_us, loop_max_us,
+                                    wifi_reconnects, mqtt_reconnects, publish_failures, dht_failures, payload)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    """, row)
+    conn.commit()
+    conn.close()
+
+    print(f"🩺 Metrics: heap {row[1]} B (min {row[2]}, largest {row[3]}), "
+          f"loop p99 {row[4]} us / max {row[5]} us - Saved to DB")
+
 def save_command(data):
     """Lưu lệnh điều khiển vào database"""
     conn = sqlite3.connect(DB_FILE)
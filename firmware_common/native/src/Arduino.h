@@ -0,0 +1,179 @@
+/*
+ * Arduino.h (host build) - the subset of the Arduino-ESP32 core the firmware uses
+ *
+ * Time is simulated: millis()/micros() only move when the harness calls
+ * NativeHal::advanceMs()/advanceUs() (delay() advances it too). GPIO and LEDC
+ * writes are recorded, Serial output is counted and only echoed to stderr
+ * when NativeHal::setSerialEcho(true). See NativeHal.h.
+ */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+#define digitalPinToInterrupt(pin) (pin)
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Time (simulated)
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// Math
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// GPIO and LEDC (recorded, see NativeHal::pinLevel()/ledcDuty())
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolutionBits);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+uint32_t ledcRead(uint8_t channel);
+
+// GPIO interrupts: a FALLING handler on the NativeHal::attachDht() pin is
+// fed a whole DHT frame (simulated edge timing) while it is being attached
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+class String
+{
+public:
+    String(const char *text = "") : text_(text ? text : "") {}
+    String(const std::string &text) : text_(text) {}
+    const char *c_str() const { return text_.c_str(); }
+    unsigned int length() const { return (unsigned int)text_.size(); }
+    bool operator==(const char *other) const { return text_ == other; }
+
+private:
+    std::string text_;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+    size_t print(const String &text) { return write(text.c_str()); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (length < 0)
+        {
+            return 0;
+        }
+        return write((const uint8_t *)line, min((size_t)length, sizeof(line) - 1));
+    }
+};
+
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void flush() {}
+    using Print::write;
+    size_t write(const uint8_t *buffer, size_t size) override;
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getCpuFreqMHz() { return 160; }
+    uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+    void restart();
+};
+extern EspClass ESP;
+
+class IPAddress
+{
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : address_(address) {}
+
+    bool fromString(const char *text);
+    String toString() const;
+    operator uint32_t() const { return address_; } // network byte order, like the core
+    uint8_t operator[](int index) const { return (address_ >> (8 * index)) & 0xFF; }
+
+private:
+    uint32_t address_ = 0;
+};
+
+class Client : public Print
+{
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeout) = 0;
+    virtual int connect(const char *host, uint16_t port, int32_t timeout) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+    using Print::write;
+};
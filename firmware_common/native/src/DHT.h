@@ -0,0 +1,19 @@
+/*
+ * DHT.h (host build) - returns the reading set by NativeHal::setDhtReading()
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#define DHT11 11
+#define DHT22 22
+
+class DHT
+{
+public:
+    DHT(uint8_t pin, uint8_t type, uint8_t count = 6) { (void)pin, (void)type, (void)count; }
+    void begin(uint8_t usecMaxCycles = 55) { (void)usecMaxCycles; }
+    float readTemperature(bool fahrenheit = false, bool force = false);
+    float readHumidity(bool force = false);
+};
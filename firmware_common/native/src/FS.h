@@ -0,0 +1,68 @@
+/*
+ * FS.h (host build) - in-memory file system with the Arduino fs::FS API
+ *
+ * Flat map of path -> contents; a directory exists once created or once a
+ * file below it exists. Enough for OfflineJournal: open/read/write/append,
+ * seek, size, remove and directory listing in name order.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+    typedef std::map<std::string, std::string> FileMap;
+
+    class File
+    {
+    public:
+        File() {}
+        File(FileMap *files, const std::string &path, bool directory)
+            : files_(files), path_(path), directory_(directory) {}
+
+        explicit operator bool() const { return files_ != nullptr; }
+
+        size_t write(const uint8_t *buffer, size_t size);
+        size_t read(uint8_t *buffer, size_t size);
+        bool seek(uint32_t position);
+        size_t position() const { return position_; }
+        size_t size() const;
+        const char *name() const;
+        const char *path() const { return path_.c_str(); }
+        bool isDirectory() const { return directory_; }
+        void flush() {}
+        void close() { files_ = nullptr; }
+        File openNextFile();
+
+    private:
+        FileMap *files_ = nullptr;
+        std::string path_;
+        bool directory_ = false;
+        size_t position_ = 0;
+        std::string lastChild_;
+    };
+
+    class FS
+    {
+    public:
+        File open(const char *path, const char *mode = FILE_READ, bool create = false);
+        bool exists(const char *path);
+        bool mkdir(const char *path);
+        bool remove(const char *path);
+        bool rmdir(const char *path);
+
+    protected:
+        FileMap files_;
+        std::map<std::string, bool> directories_;
+    };
+}
+
+using fs::File;
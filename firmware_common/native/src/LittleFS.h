@@ -0,0 +1,18 @@
+/*
+ * LittleFS.h (host build) - the in-memory FS from FS.h, always mounts
+ */
+
+#pragma once
+
+#include <FS.h>
+
+class LittleFSFS : public fs::FS
+{
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char *partitionLabel = "spiffs");
+    bool format();
+    size_t totalBytes() { return 1536 * 1024; }
+    size_t usedBytes();
+};
+extern LittleFSFS LittleFS;
@@ -0,0 +1,1237 @@
+#include "NativeHal.h"
+
+#include <Arduino.h>
+#include <DHT.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <driver/ledc.h>
+#include <esp_ota_ops.h>
+#include <lwip/sockets.h>
+#include <mbedtls/sha256.h>
+
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// =============================================================================
+// SIMULATED HARDWARE STATE
+// =============================================================================
+
+namespace
+{
+    uint64_t clockUs = 0;
+
+    bool serialEcho = false;
+    uint32_t serialBytes = 0;
+
+    const int PIN_COUNT = 49;
+    const int LEDC_CHANNELS = 16;
+    uint8_t pinLevels[PIN_COUNT];
+    uint32_t ledcDuties[LEDC_CHANNELS];
+    ledc_cb_t fadeCallbacks[LEDC_CHANNELS];
+    void *fadeArgs[LEDC_CHANNELS];
+
+    std::map<std::string, std::vector<uint8_t>> nvs; // "namespace/key" -> blob
+    uint32_t nvsWriteCount = 0;
+
+    float dhtTemperature = 25.0f;
+    float dhtHumidity = 60.0f;
+    int dhtPin = -1;
+
+    std::mt19937 rng(12345); // fixed seed: runs are repeatable
+
+    // Broker: loopback listener + in-memory session
+    struct InjectedMessage
+    {
+        char topic[96];
+        uint8_t payload[512];
+        size_t length;
+    };
+    const size_t INJECT_QUEUE_SIZE = 8;
+
+    int listenFd = -1;
+    int acceptedFd = -1;
+    uint32_t sessionId = 0; // current broker-side session, 0 = none
+    uint32_t nextSessionId = 1;
+    uint32_t publishCount = 0;
+    uint32_t publishBytes = 0;
+    uint32_t subscribeCount = 0;
+    InjectedMessage injected[INJECT_QUEUE_SIZE];
+    size_t injectedHead = 0;
+    size_t injectedCount = 0;
+    uint8_t clientBytes[8192]; // written by the client, not parsed yet
+    size_t clientByteCount = 0;
+    bool connectSeen = false;  // the connection started with CONNECT
+    uint32_t protocolErrorCount = 0;
+    const char *watchedTopic = nullptr; // watchTopic(), kept by the caller
+    uint32_t watchedCount = 0;
+
+    void countWatched(const char *topic, size_t topicLength)
+    {
+        if (watchedTopic && strlen(watchedTopic) == topicLength && memcmp(watchedTopic, topic, topicLength) == 0)
+        {
+            watchedCount++;
+        }
+    }
+
+    TaskHandle_t const nativeTask = (TaskHandle_t)&clockUs;
+
+    void closeFd(int &fd)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    // Accept whatever NetLink connected, so the backlog never fills up
+    void acceptPending()
+    {
+        if (listenFd < 0)
+        {
+            return;
+        }
+        for (int fd = accept(listenFd, nullptr, nullptr); fd >= 0; fd = accept(listenFd, nullptr, nullptr))
+        {
+            closeFd(acceptedFd);
+            acceptedFd = fd;
+            clientByteCount = 0;
+            connectSeen = false;
+        }
+    }
+
+    // PUBLISH packets the client wrote to the socket (MqttOutbox) are counted
+    // like PubSubClient::publish(), QoS1 ones answered with a PUBACK at once.
+    // A connection that does not start with CONNECT is closed, as a broker does
+    void serveSession()
+    {
+        acceptPending();
+        if (acceptedFd < 0)
+        {
+            return;
+        }
+        ssize_t n;
+        while ((n = recv(acceptedFd, clientBytes + clientByteCount, sizeof(clientBytes) - clientByteCount,
+                         MSG_DONTWAIT)) > 0)
+        {
+            clientByteCount += n;
+            size_t at = 0;
+            for (;;)
+            {
+                // Fixed header: type/flags, remaining length (1-4 bytes)
+                size_t remaining = 0;
+                size_t header = 1;
+                bool complete = false;
+                while (at + header < clientByteCount && header <= 4)
+                {
+                    uint8_t c = clientBytes[at + header];
+                    remaining |= (size_t)(c & 0x7F) << (7 * (header - 1));
+                    header++;
+                    if (!(c & 0x80))
+                    {
+                        complete = true;
+                        break;
+                    }
+                }
+                if (!complete || at + header + remaining > clientByteCount)
+                {
+                    break;
+                }
+
+                const uint8_t *packet = clientBytes + at;
+                if (!connectSeen && (packet[0] >> 4) != 1)
+                {
+                    protocolErrorCount++;
+                    closeFd(acceptedFd);
+                    clientByteCount = 0;
+                    sessionId = 0;
+                    return;
+                }
+                connectSeen = true;
+                uint8_t qos = (packet[0] >> 1) & 3;
+                if ((packet[0] >> 4) == 3 && remaining >= 2)
+                {
+                    size_t topicLength = (size_t)packet[header] << 8 | packet[header + 1];
+                    size_t idLength = qos > 0 ? 2 : 0;
+                    publishCount++;
+                    publishBytes += remaining - 2 - topicLength - idLength;
+                    countWatched((const char *)packet + header + 2, topicLength);
+                    if (qos == 1)
+                    {
+                        const uint8_t *id = packet + header + 2 + topicLength;
+                        uint8_t puback[4] = {0x40, 2, id[0], id[1]};
+                        send(acceptedFd, puback, sizeof(puback), MSG_DONTWAIT);
+                    }
+                }
+                at += header + remaining;
+            }
+            memmove(clientBytes, clientBytes + at, clientByteCount - at);
+            clientByteCount -= at;
+            if (clientByteCount == sizeof(clientBytes)) // no packet fits: not MQTT
+            {
+                clientByteCount = 0;
+            }
+        }
+    }
+}
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+LittleFSFS LittleFS;
+
+// =============================================================================
+// HARNESS CONTROLS
+// =============================================================================
+
+namespace NativeHal
+{
+    void advanceMs(uint32_t ms) { clockUs += (uint64_t)ms * 1000; }
+    void advanceUs(uint32_t us) { clockUs += us; }
+
+    void setSerialEcho(bool echo) { serialEcho = echo; }
+    uint32_t serialBytes() { return ::serialBytes; }
+
+    int pinLevel(uint8_t pin) { return pin < PIN_COUNT ? pinLevels[pin] : LOW; }
+    uint32_t ledcDuty(uint8_t channel) { return channel < LEDC_CHANNELS ? ledcDuties[channel] : 0; }
+
+    uint32_t nvsWrites() { return nvsWriteCount; }
+
+    void attachDht(uint8_t pin) { dhtPin = pin; }
+
+    void setDhtReading(float temperature, float humidity)
+    {
+        dhtTemperature = temperature;
+        dhtHumidity = humidity;
+    }
+
+    void setAccessPoint(bool up) { WiFi.setAccessPoint(up); }
+
+    bool startBroker(uint16_t port)
+    {
+        if (listenFd >= 0)
+        {
+            return true;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (fd < 0)
+        {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+        {
+            close(fd);
+            return false;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        listenFd = fd;
+        signal(SIGPIPE, SIG_IGN); // a write to a dropped session fails with EPIPE instead
+        return true;
+    }
+
+    void stopBroker()
+    {
+        closeFd(listenFd);
+        dropSession();
+    }
+
+    void dropSession()
+    {
+        closeFd(acceptedFd);
+        clientByteCount = 0;
+        sessionId = 0;
+        injectedCount = 0;
+    }
+
+    bool sessionUp() { return sessionId != 0; }
+
+    bool inject(const char *topic, const uint8_t *payload, size_t length)
+    {
+        if (injectedCount == INJECT_QUEUE_SIZE || strlen(topic) >= sizeof(injected[0].topic) ||
+            length > sizeof(injected[0].payload))
+        {
+            return false;
+        }
+        InjectedMessage &message = injected[(injectedHead + injectedCount) % INJECT_QUEUE_SIZE];
+        strcpy(message.topic, topic);
+        memcpy(message.payload, payload, length);
+        message.length = length;
+        injectedCount++;
+        return true;
+    }
+
+    uint32_t published() { return publishCount; }
+    uint32_t publishedBytes() { return publishBytes; }
+    uint32_t subscriptions() { return subscribeCount; }
+    uint32_t protocolErrors() { return protocolErrorCount; }
+
+    void watchTopic(const char *topic)
+    {
+        watchedTopic = topic;
+        watchedCount = 0;
+    }
+
+    uint32_t watchedPublishes() { return watchedCount; }
+}
+
+// =============================================================================
+// ARDUINO CORE
+// =============================================================================
+
+unsigned long millis() { return (unsigned long)(clockUs / 1000); }
+unsigned long micros() { return (unsigned long)clockUs; }
+void delay(uint32_t ms) { clockUs += (uint64_t)ms * 1000; }
+void delayMicroseconds(uint32_t us) { clockUs += us; }
+void yield() {}
+
+long random(long howBig)
+{
+    return howBig > 0 ? (long)(rng() % (unsigned long)howBig) : 0;
+}
+
+long random(long howSmall, long howBig)
+{
+    return howBig > howSmall ? howSmall + random(howBig - howSmall) : howSmall;
+}
+
+void randomSeed(unsigned long seed) { rng.seed(seed); }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < PIN_COUNT)
+    {
+        pinLevels[pin] = value ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin) { return NativeHal::pinLevel(pin); }
+
+uint32_t ledcSetup(uint8_t, uint32_t freq, uint8_t) { return freq; }
+void ledcAttachPin(uint8_t, uint8_t) {}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+    if (channel < LEDC_CHANNELS)
+    {
+        ledcDuties[channel] = duty;
+    }
+}
+
+uint32_t ledcRead(uint8_t channel) { return NativeHal::ledcDuty(channel); }
+
+// Same channel numbering as the 2.x core: speed mode * 8 + hardware channel
+esp_err_t ledc_fade_func_install(int) { return ESP_OK; }
+
+esp_err_t ledc_cb_register(ledc_mode_t mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *arg)
+{
+    int index = mode * 8 + channel;
+    fadeCallbacks[index] = cbs->fade_cb;
+    fadeArgs[index] = arg;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, uint32_t,
+                                       ledc_fade_mode_t)
+{
+    int index = mode * 8 + channel;
+    ledcDuties[index] = duty;
+    if (fadeCallbacks[index])
+    {
+        ledc_cb_param_t param = {LEDC_FADE_END_EVT, (uint32_t)mode, (uint32_t)channel, duty};
+        fadeCallbacks[index](&param, fadeArgs[index]);
+    }
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel) { return ledcDuties[mode * 8 + channel]; }
+
+// DHT11 frame: humidity int/tenths, temperature int/tenths (bit 7 = below
+// zero), checksum; every bit ends on a falling edge
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    if ((int)pin != dhtPin || mode != FALLING || isnan(dhtTemperature) || isnan(dhtHumidity))
+    {
+        return;
+    }
+    float temperature = fabsf(dhtTemperature);
+    int humidity10 = (int)lroundf(dhtHumidity * 10);
+    int temperature10 = (int)lroundf(temperature * 10);
+    uint8_t data[5] = {
+        (uint8_t)(humidity10 / 10), (uint8_t)(humidity10 % 10),
+        (uint8_t)(temperature10 / 10), (uint8_t)((temperature10 % 10) | (dhtTemperature < 0 ? 0x80 : 0)),
+        0};
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+
+    clockUs += 30; // response: 80 us low, 80 us high
+    handler(arg);
+    clockUs += 160;
+    handler(arg);
+    for (int bit = 0; bit < 40; bit++)
+    {
+        clockUs += 50 + ((data[bit / 8] & (0x80 >> (bit % 8))) ? 70 : 27);
+        handler(arg);
+    }
+}
+
+void detachInterrupt(uint8_t) {}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    serialBytes += size;
+    if (serialEcho)
+    {
+        fwrite(buffer, 1, size, stderr);
+    }
+    return size;
+}
+
+// Plausible ESP32-C3 figures; the harness measures real allocations itself
+uint32_t EspClass::getHeapSize() { return 320 * 1024; }
+uint32_t EspClass::getFreeHeap() { return 200 * 1024; }
+uint32_t EspClass::getMinFreeHeap() { return 190 * 1024; }
+uint32_t EspClass::getMaxAllocHeap() { return 110 * 1024; }
+
+void EspClass::restart()
+{
+    fprintf(stderr, "ESP.restart() called\n");
+    exit(1);
+}
+
+bool IPAddress::fromString(const char *text)
+{
+    struct in_addr parsed;
+    if (inet_pton(AF_INET, text, &parsed) != 1)
+    {
+        return false;
+    }
+    address_ = parsed.s_addr;
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(text);
+}
+
+// =============================================================================
+// FREERTOS (tasks are driven by the harness)
+// =============================================================================
+
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *created)
+{
+    if (created)
+    {
+        *created = nativeTask;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t)
+{
+    return xTaskCreate(task, name, stackDepth, parameters, priority, created);
+}
+
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t period)
+{
+    *previousWake += period;
+}
+
+TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return nativeTask; }
+const char *pcTaskGetName(TaskHandle_t) { return "native"; }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) {}
+
+// =============================================================================
+// WIFI
+// =============================================================================
+
+bool WiFiClass::mode(wifi_mode_t) { return true; }
+bool WiFiClass::setAutoReconnect(bool) { return true; }
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb callback, arduino_event_id_t)
+{
+    callback_ = callback;
+    return 1;
+}
+
+// The simulated access point
+static const uint8_t NATIVE_AP_BSSID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const int32_t NATIVE_AP_CHANNEL = 6;
+
+wl_status_t WiFiClass::begin(const char *, const char *, int32_t channel, const uint8_t *bssid, bool)
+{
+    bool reachable = accessPointUp_ && (channel == 0 || channel == NATIVE_AP_CHANNEL) &&
+                     (bssid == nullptr || memcmp(bssid, NATIVE_AP_BSSID, sizeof(NATIVE_AP_BSSID)) == 0);
+    if (!reachable)
+    {
+        emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    else if (!associated_)
+    {
+        associated_ = true;
+        emit(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+        emit(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
+    return status();
+}
+
+bool WiFiClass::config(IPAddress localIp, IPAddress, IPAddress, IPAddress, IPAddress)
+{
+    staticIp_ = (uint32_t)localIp != 0;
+    localIp_ = localIp;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool, bool)
+{
+    if (associated_)
+    {
+        associated_ = false;
+        emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    return true;
+}
+
+wl_status_t WiFiClass::status() { return associated_ ? WL_CONNECTED : WL_DISCONNECTED; }
+IPAddress WiFiClass::localIP()
+{
+    if (!associated_)
+    {
+        return IPAddress();
+    }
+    return staticIp_ ? localIp_ : IPAddress(192, 168, 1, 50);
+}
+IPAddress WiFiClass::gatewayIP() { return associated_ ? IPAddress(192, 168, 1, 1) : IPAddress(); }
+IPAddress WiFiClass::subnetMask() { return associated_ ? IPAddress(255, 255, 255, 0) : IPAddress(); }
+IPAddress WiFiClass::dnsIP(uint8_t) { return associated_ ? IPAddress(192, 168, 1, 1) : IPAddress(); }
+uint8_t *WiFiClass::BSSID() { return associated_ ? (uint8_t *)NATIVE_AP_BSSID : nullptr; }
+int32_t WiFiClass::channel() { return associated_ ? NATIVE_AP_CHANNEL : 0; }
+int8_t WiFiClass::RSSI() { return associated_ ? rssi_ : 0; }
+
+int WiFiClass::hostByName(const char *host, IPAddress &result)
+{
+    if (strcmp(host, "localhost") == 0)
+    {
+        result = IPAddress(127, 0, 0, 1);
+        return 1;
+    }
+    return result.fromString(host) ? 1 : 0;
+}
+
+void WiFiClass::setAccessPoint(bool up)
+{
+    accessPointUp_ = up;
+    if (!up)
+    {
+        disconnect();
+    }
+}
+
+void WiFiClass::emit(arduino_event_id_t event)
+{
+    if (callback_)
+    {
+        arduino_event_info_t info;
+        info.reason = 0;
+        callback_(event, info);
+    }
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return 0;
+    }
+    fd_ = fd;
+    return 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    return WiFi.hostByName(host, ip) == 1 ? connect(ip, port) : 0;
+}
+
+// Blocking like the device's (MqttOutbox and CONNECT write: the PubSubClient
+// stand-in keeps its other packets in the in-memory session)
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+    ssize_t n = fd_ >= 0 ? send(fd_, buffer, size, 0) : -1;
+    return n > 0 ? (size_t)n : 0;
+}
+
+// The broker answers what was written before anything is read back
+int WiFiClient::available()
+{
+    serveSession();
+    int count = 0;
+    return fd_ >= 0 && ioctl(fd_, FIONREAD, &count) == 0 ? count : 0;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+    serveSession();
+    ssize_t n = fd_ >= 0 ? recv(fd_, buffer, size, MSG_DONTWAIT) : -1;
+    return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek()
+{
+    serveSession();
+    uint8_t c;
+    return fd_ >= 0 && recv(fd_, &c, 1, MSG_DONTWAIT | MSG_PEEK) == 1 ? c : -1;
+}
+
+void WiFiClient::stop()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+// =============================================================================
+// PUBSUBCLIENT (in-memory session)
+// =============================================================================
+
+PubSubClient &PubSubClient::setServer(IPAddress, uint16_t) { return *this; }
+PubSubClient &PubSubClient::setServer(const char *, uint16_t) { return *this; }
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)
+{
+    this->callback = callback;
+    return *this;
+}
+
+PubSubClient &PubSubClient::setClient(Client &client)
+{
+    client_ = &client;
+    return *this;
+}
+
+PubSubClient &PubSubClient::setKeepAlive(uint16_t) { return *this; }
+PubSubClient &PubSubClient::setSocketTimeout(uint16_t) { return *this; }
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+    bufferSize_ = size;
+    return size > 0;
+}
+
+bool PubSubClient::connect(const char *id)
+{
+    return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass)
+{
+    return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char *id, const char *willTopic, uint8_t willQos, bool willRetain,
+                           const char *willMessage)
+{
+    return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage, true);
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass,
+                           const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage)
+{
+    return connect(id, user, pass, willTopic, willQos, willRetain, willMessage, true);
+}
+
+// CONNECT goes through the client like the library's (user, password and
+// will left out); the broker side checks it opens the connection
+bool PubSubClient::connect(const char *id, const char *, const char *,
+                           const char *, uint8_t, bool, const char *, bool cleanSession)
+{
+    acceptPending();
+    if (!client_ || !client_->connected() || acceptedFd < 0)
+    {
+        state_ = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    size_t idLength = strlen(id) < 64 ? strlen(id) : 64;
+    uint8_t packet[2 + 12 + 64] = {0x10, (uint8_t)(12 + idLength), 0, 4, 'M', 'Q', 'T', 'T', 4,
+                                   (uint8_t)(cleanSession ? 0x02 : 0), 0, 30,
+                                   (uint8_t)(idLength >> 8), (uint8_t)idLength};
+    memcpy(packet + 14, id, idLength);
+    if (client_->write(packet, 14 + idLength) != 14 + idLength)
+    {
+        state_ = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    serveSession();
+    if (acceptedFd < 0)
+    {
+        state_ = MQTT_CONNECT_FAILED; // closed by the broker
+        return false;
+    }
+    sessionId = nextSessionId++;
+    session_ = sessionId;
+    state_ = MQTT_CONNECTED;
+    return true;
+}
+
+void PubSubClient::disconnect()
+{
+    if (connected())
+    {
+        NativeHal::dropSession();
+    }
+    session_ = 0;
+    state_ = MQTT_DISCONNECTED;
+    if (client_)
+    {
+        client_->stop();
+    }
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload)
+{
+    return publish(topic, (const uint8_t *)payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained)
+{
+    return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length)
+{
+    return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *, unsigned int length, bool)
+{
+    // Same limit as the library: fixed header (5) + topic length (2) + topic + payload
+    if (!connected() || 5 + 2 + strlen(topic) + length > bufferSize_)
+    {
+        return false;
+    }
+    publishCount++;
+    publishBytes += length;
+    countWatched(topic, strlen(topic));
+    return true;
+}
+
+bool PubSubClient::subscribe(const char *topic) { return subscribe(topic, 0); }
+
+bool PubSubClient::subscribe(const char *, uint8_t)
+{
+    if (!connected())
+    {
+        return false;
+    }
+    subscribeCount++;
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char *) { return connected(); }
+
+bool PubSubClient::loop()
+{
+    if (!connected())
+    {
+        if (state_ == MQTT_CONNECTED)
+        {
+            state_ = MQTT_CONNECTION_LOST;
+            session_ = 0;
+        }
+        return false;
+    }
+
+    // What the broker wrote to the socket: PUBACKs of MqttOutbox publishes,
+    // dropped as by the library (after the client wrapper saw them)
+    while (client_->available() > 0)
+    {
+        client_->read();
+    }
+
+    // Deliver at most one message per loop(), like reading one packet
+    if (injectedCount > 0)
+    {
+        InjectedMessage &message = injected[injectedHead];
+        injectedHead = (injectedHead + 1) % INJECT_QUEUE_SIZE;
+        injectedCount--;
+        if (callback)
+        {
+            callback(message.topic, message.payload, (unsigned int)message.length);
+        }
+    }
+    return true;
+}
+
+bool PubSubClient::connected()
+{
+    return session_ != 0 && session_ == sessionId && client_ && client_->connected();
+}
+
+// =============================================================================
+// DHT
+// =============================================================================
+
+float DHT::readTemperature(bool, bool) { return dhtTemperature; }
+float DHT::readHumidity(bool) { return dhtHumidity; }
+
+// =============================================================================
+// NVS (in memory)
+// =============================================================================
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    name_ = name;
+    readOnly_ = readOnly;
+    return true;
+}
+
+bool Preferences::clear()
+{
+    if (!name_ || readOnly_)
+    {
+        return false;
+    }
+    std::string prefix = std::string(name_) + "/";
+    for (auto it = nvs.begin(); it != nvs.end();)
+    {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? nvs.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    if (!name_ || readOnly_)
+    {
+        return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)value;
+    nvs[std::string(name_) + "/" + key].assign(bytes, bytes + length);
+    nvsWriteCount++;
+    return length;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength)
+{
+    size_t length = getBytesLength(key);
+    if (length == 0 || length > maxLength)
+    {
+        return 0;
+    }
+    memcpy(buffer, nvs[std::string(name_) + "/" + key].data(), length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    if (!name_)
+    {
+        return 0;
+    }
+    auto it = nvs.find(std::string(name_) + "/" + key);
+    return it != nvs.end() ? it->second.size() : 0;
+}
+
+// =============================================================================
+// FILE SYSTEM (in memory)
+// =============================================================================
+
+namespace fs
+{
+    size_t File::write(const uint8_t *buffer, size_t size)
+    {
+        if (!files_ || directory_)
+        {
+            return 0;
+        }
+        (*files_)[path_].append((const char *)buffer, size);
+        return size;
+    }
+
+    size_t File::read(uint8_t *buffer, size_t size)
+    {
+        if (!files_ || directory_)
+        {
+            return 0;
+        }
+        const std::string &data = (*files_)[path_];
+        size_t count = position_ < data.size() ? min(size, data.size() - position_) : 0;
+        memcpy(buffer, data.data() + position_, count);
+        position_ += count;
+        return count;
+    }
+
+    bool File::seek(uint32_t position)
+    {
+        if (!files_ || position > size())
+        {
+            return false;
+        }
+        position_ = position;
+        return true;
+    }
+
+    size_t File::size() const
+    {
+        if (!files_)
+        {
+            return 0;
+        }
+        FileMap::const_iterator it = files_->find(path_);
+        return it == files_->end() ? 0 : it->second.size();
+    }
+
+    const char *File::name() const
+    {
+        size_t slash = path_.rfind('/');
+        return path_.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    }
+
+    File File::openNextFile()
+    {
+        if (!files_ || !directory_)
+        {
+            return File();
+        }
+        std::string prefix = path_ + "/";
+        FileMap::iterator it = lastChild_.empty() ? files_->lower_bound(prefix) : files_->upper_bound(lastChild_);
+        for (; it != files_->end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+        {
+            if (it->first.find('/', prefix.size()) == std::string::npos)
+            {
+                lastChild_ = it->first;
+                return File(files_, it->first, false);
+            }
+        }
+        return File();
+    }
+
+    File FS::open(const char *path, const char *mode, bool)
+    {
+        std::string key(path);
+        if (directories_.count(key))
+        {
+            return File(&files_, key, true);
+        }
+        if (mode[0] == 'w')
+        {
+            files_[key].clear();
+        }
+        else if (mode[0] == 'a')
+        {
+            files_[key];
+        }
+        else if (!files_.count(key))
+        {
+            return File();
+        }
+        File file(&files_, key, false);
+        if (mode[0] == 'a')
+        {
+            file.seek(file.size());
+        }
+        return file;
+    }
+
+    bool FS::exists(const char *path)
+    {
+        return files_.count(path) > 0 || directories_.count(path) > 0;
+    }
+
+    bool FS::mkdir(const char *path)
+    {
+        directories_[path] = true;
+        return true;
+    }
+
+    bool FS::remove(const char *path) { return files_.erase(path) > 0; }
+    bool FS::rmdir(const char *path) { return directories_.erase(path) > 0; }
+}
+
+bool LittleFSFS::begin(bool, const char *, uint8_t, const char *) { return true; }
+
+bool LittleFSFS::format()
+{
+    files_.clear();
+    directories_.clear();
+    return true;
+}
+
+size_t LittleFSFS::usedBytes()
+{
+    size_t used = 0;
+    for (fs::FileMap::const_iterator it = files_.begin(); it != files_.end(); ++it)
+    {
+        used += it->second.size();
+    }
+    return used;
+}
+
+// =============================================================================
+// OTA PARTITIONS (in memory)
+// =============================================================================
+
+namespace
+{
+    const esp_partition_t appPartitions[2] = {
+        {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000, "app0", false},
+        {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x150000, 0x140000, "app1", false},
+    };
+    const esp_partition_t *bootPartition = &appPartitions[0];
+
+    const esp_ota_handle_t OTA_HANDLE = 1;
+    const esp_partition_t *otaPartition = nullptr; // open update
+    std::vector<uint8_t> otaImage;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (const esp_partition_t &partition : appPartitions)
+    {
+        if (partition.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype) &&
+            (!label || strcmp(label, partition.label) == 0))
+        {
+            return &partition;
+        }
+    }
+    return nullptr;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) { return &appPartitions[0]; }
+const esp_partition_t *esp_ota_get_boot_partition(void) { return bootPartition; }
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    const esp_partition_t *from = start_from ? start_from : esp_ota_get_running_partition();
+    return from == &appPartitions[0] ? &appPartitions[1] : &appPartitions[0];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if (!partition || partition == esp_ota_get_running_partition() ||
+        (image_size < OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (otaPartition)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    otaPartition = partition;
+    otaImage.clear();
+    *out_handle = OTA_HANDLE;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (handle != OTA_HANDLE || !otaPartition)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (otaImage.size() + size > otaPartition->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *bytes = (const uint8_t *)data;
+    otaImage.insert(otaImage.end(), bytes, bytes + size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle != OTA_HANDLE || !otaPartition)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    otaPartition = nullptr;
+    return !otaImage.empty() && otaImage[0] == 0xE9 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle != OTA_HANDLE || !otaPartition)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    otaPartition = nullptr;
+    otaImage.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bootPartition = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) { return ESP_OK; }
+
+// =============================================================================
+// SHA-256 (FIPS 180-4)
+// =============================================================================
+
+namespace
+{
+    const uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void sha256Block(uint32_t state[8], const unsigned char block[64])
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 |
+                   block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t v[8];
+        memcpy(v, state, sizeof(v));
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = v[7] + (rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+                          SHA256_K[i] + w[i];
+            uint32_t t2 = (rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22)) +
+                          ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+            memmove(v + 1, v, 7 * sizeof(uint32_t));
+            v[4] += t1;
+            v[0] = t1 + t2;
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            state[i] += v[i];
+        }
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t INITIAL[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    if (is224)
+    {
+        return -1; // SHA-224 is not used
+    }
+    mbedtls_sha256_init(ctx);
+    memcpy(ctx->state, INITIAL, sizeof(INITIAL));
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    while (ilen > 0)
+    {
+        size_t used = ctx->total[0] % 64;
+        size_t take = min(ilen, (size_t)64 - used);
+        memcpy(ctx->buffer + used, input, take);
+        uint32_t before = ctx->total[0];
+        ctx->total[0] += (uint32_t)take;
+        if (ctx->total[0] < before)
+        {
+            ctx->total[1]++;
+        }
+        if (used + take == 64)
+        {
+            sha256Block(ctx->state, ctx->buffer);
+        }
+        input += take;
+        ilen -= take;
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    uint64_t bits = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) * 8;
+    unsigned char pad[72] = {0x80};
+    size_t used = ctx->total[0] % 64;
+    size_t padLength = (used < 56 ? 56 : 120) - used;
+    for (int i = 0; i < 8; i++)
+    {
+        pad[padLength + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    mbedtls_sha256_update_ret(ctx, pad, padLength + 8);
+    for (int i = 0; i < 8; i++)
+    {
+        output[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        output[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        output[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        output[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+    return 0;
+}
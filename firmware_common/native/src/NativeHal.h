@@ -0,0 +1,66 @@
+/*
+ * NativeHal - harness controls for the host build (env:native)
+ *
+ * The firmware talks to the hardware only through the Arduino core and a few
+ * libraries (WiFi, PubSubClient, DHT, LittleFS, Preferences, FreeRTOS). On the device those
+ * come from the ESP32 toolchain; the headers next to this file implement the
+ * same subset on the host, and this namespace is how a harness drives them:
+ * simulated time, the access point, a loopback broker, sensor readings.
+ *
+ * The broker side is a TCP listener on 127.0.0.1 (so NetLink's non-blocking
+ * connect runs for real) plus an in-memory MQTT session inside the
+ * PubSubClient stand-in: publishes are counted, injected messages are
+ * delivered to the callback from loop(). CONNECT and the PUBLISH packets
+ * written to the socket directly (MqttOutbox) go over it: the broker side
+ * reads them whenever the client reads, counts the publishes and answers
+ * QoS1 with a PUBACK.
+ *
+ * ESP-IDF pieces the firmware calls directly (esp_vfs_eventfd, esp_pm, LEDC
+ * fades, OTA partitions, mbedtls SHA-256) map to Linux eventfd, no-ops,
+ * fades that finish at once, an in-memory app partition and a plain C++
+ * SHA-256.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace NativeHal
+{
+    // Simulated clock (millis()/micros() start at 0)
+    void advanceMs(uint32_t ms);
+    void advanceUs(uint32_t us);
+
+    // Serial output: counted, echoed to stderr only when enabled
+    void setSerialEcho(bool echo);
+    uint32_t serialBytes();
+
+    // GPIO / LEDC state written by the firmware
+    int pinLevel(uint8_t pin);
+    uint32_t ledcDuty(uint8_t channel);
+
+    // NVS (Preferences) blob writes since start
+    uint32_t nvsWrites();
+
+    // DHT11 on a pin: frames are played into the pin's FALLING interrupt
+    // (DhtSampler) and returned by the DHT library stand-in. NaN = no answer
+    void attachDht(uint8_t pin);
+    void setDhtReading(float temperature, float humidity);
+
+    // Access point: down drops the station, up lets WiFi.begin() associate
+    void setAccessPoint(bool up);
+
+    // Broker
+    bool startBroker(uint16_t port); // listen on 127.0.0.1:port
+    void stopBroker();               // refuse connections, drop the session
+    void dropSession();              // connection lost, listener stays up
+    bool sessionUp();
+    bool inject(const char *topic, const uint8_t *payload, size_t length); // delivered by loop()
+    uint32_t published(); // PubSubClient::publish() and raw PUBLISH packets
+    uint32_t publishedBytes();
+    uint32_t subscriptions();
+    uint32_t protocolErrors(); // connections closed for not starting with CONNECT
+    void watchTopic(const char *topic); // counts publishes to this topic from now on (kept by the caller)
+    uint32_t watchedPublishes();
+}
@@ -0,0 +1,27 @@
+/*
+ * Preferences.h (host build) - NVS key/value store kept in memory
+ *
+ * Only the blob calls the firmware uses. Contents outlive a Preferences
+ * object (a "reboot" of the firmware inside one harness run); writes are
+ * counted by NativeHal::nvsWrites().
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() { name_ = nullptr; }
+    bool clear();
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytes(const char *key, void *buffer, size_t maxLength);
+    size_t getBytesLength(const char *key);
+
+private:
+    const char *name_ = nullptr;
+    bool readOnly_ = false;
+};
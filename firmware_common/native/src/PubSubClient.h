@@ -0,0 +1,70 @@
+/*
+ * PubSubClient.h (host build) - PubSubClient 2.8 API over an in-memory session
+ *
+ * connect() succeeds when the underlying Client is connected and the
+ * NativeHal broker is up; publish() checks the same size limit as the real
+ * library (buffer size) and is counted by NativeHal::published(); loop()
+ * reads (and drops) what the broker wrote to the socket and delivers
+ * injected messages. See NativeHal.h.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+class PubSubClient
+{
+public:
+    PubSubClient() {}
+    explicit PubSubClient(Client &client) : client_(&client) {}
+
+    PubSubClient &setServer(IPAddress ip, uint16_t port);
+    PubSubClient &setServer(const char *host, uint16_t port);
+    PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient &setClient(Client &client);
+    PubSubClient &setKeepAlive(uint16_t keepAlive);
+    PubSubClient &setSocketTimeout(uint16_t timeout);
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() { return bufferSize_; }
+
+    bool connect(const char *id);
+    bool connect(const char *id, const char *user, const char *pass);
+    bool connect(const char *id, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+    bool connect(const char *id, const char *user, const char *pass,
+                 const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+    bool connect(const char *id, const char *user, const char *pass,
+                 const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage,
+                 bool cleanSession);
+    void disconnect();
+
+    bool publish(const char *topic, const char *payload);
+    bool publish(const char *topic, const char *payload, bool retained);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained);
+
+    bool subscribe(const char *topic);
+    bool subscribe(const char *topic, uint8_t qos);
+    bool unsubscribe(const char *topic);
+
+    bool loop();
+    bool connected();
+    int state() { return state_; }
+
+private:
+    Client *client_ = nullptr;
+    MQTT_CALLBACK_SIGNATURE;
+    uint16_t bufferSize_ = MQTT_MAX_PACKET_SIZE;
+    uint32_t session_ = 0; // NativeHal session this client joined, 0 = none
+    int state_ = MQTT_DISCONNECTED;
+};
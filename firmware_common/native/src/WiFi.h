@@ -0,0 +1,120 @@
+/*
+ * WiFi.h (host build) - station-mode WiFi driven by the harness
+ *
+ * WiFi.begin() "associates" immediately when the simulated access point is up
+ * (NativeHal::setAccessPoint(true), the default) and delivers CONNECTED and
+ * GOT_IP through the registered event callback, as the system event task
+ * would. Taking the access point down delivers DISCONNECTED. A begin() aimed
+ * at another BSSID than the simulated AP's fails like a vanished AP.
+ *
+ * WiFiClient wraps a real host socket: NetLink hands it the descriptor of its
+ * non-blocking connect, exactly like on the device.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF,
+    WIFI_STA,
+    WIFI_AP,
+    WIFI_AP_STA
+} wifi_mode_t;
+
+typedef enum
+{
+    ARDUINO_EVENT_WIFI_READY,
+    ARDUINO_EVENT_WIFI_STA_START,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+    ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef union
+{
+    uint8_t reason;
+} arduino_event_info_t;
+
+typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)> WiFiEventFuncCb;
+typedef int wifi_event_id_t;
+
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    bool setAutoReconnect(bool autoReconnect);
+    bool setSleep(bool enabled) { return (void)enabled, true; }
+    void persistent(bool persistent) { (void)persistent; }
+    wifi_event_id_t onEvent(WiFiEventFuncCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t *bssid = nullptr, bool connect = true);
+    bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    wl_status_t status();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    uint8_t *BSSID();
+    int32_t channel();
+    int8_t RSSI();
+    int hostByName(const char *host, IPAddress &result);
+
+    // Harness side (NativeHal)
+    void setAccessPoint(bool up);
+    void setRssi(int8_t rssi) { rssi_ = rssi; }
+
+private:
+    void emit(arduino_event_id_t event);
+
+    WiFiEventFuncCb callback_;
+    bool accessPointUp_ = true;
+    bool associated_ = false;
+    bool staticIp_ = false;
+    IPAddress localIp_;
+    int8_t rssi_ = -55;
+};
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client
+{
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd) : fd_(fd) {}
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t) override { return connect(ip, port); }
+    int connect(const char *host, uint16_t port, int32_t) override { return connect(host, port); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override { return fd_ >= 0; }
+    operator bool() override { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    using Print::write;
+
+private:
+    int fd_ = -1;
+};
@@ -0,0 +1,63 @@
+/*
+ * driver/ledc.h (host build) - the LEDC fade calls BoardTraits uses
+ *
+ * A fade finishes at once: the duty jumps to the target (NativeHal::ledcDuty())
+ * and the fade-end callback runs before ledc_set_fade_time_and_start()
+ * returns, as if the interrupt had fired.
+ */
+
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef enum
+{
+    LEDC_LOW_SPEED_MODE,
+    LEDC_SPEED_MODE_MAX
+} ledc_mode_t;
+
+typedef enum
+{
+    LEDC_CHANNEL_0,
+    LEDC_CHANNEL_1,
+    LEDC_CHANNEL_2,
+    LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4,
+    LEDC_CHANNEL_5,
+    LEDC_CHANNEL_6,
+    LEDC_CHANNEL_7,
+    LEDC_CHANNEL_MAX
+} ledc_channel_t;
+
+typedef enum
+{
+    LEDC_FADE_NO_WAIT,
+    LEDC_FADE_WAIT_DONE
+} ledc_fade_mode_t;
+
+typedef enum
+{
+    LEDC_FADE_END_EVT
+} ledc_cb_event_t;
+
+typedef struct
+{
+    ledc_cb_event_t event;
+    uint32_t speed_mode;
+    uint32_t channel;
+    uint32_t duty;
+} ledc_cb_param_t;
+
+typedef bool (*ledc_cb_t)(const ledc_cb_param_t *param, void *user_arg);
+
+typedef struct
+{
+    ledc_cb_t fade_cb;
+} ledc_cbs_t;
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags);
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg);
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty,
+                                       uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode);
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
@@ -0,0 +1,27 @@
+/*
+ * esp_ota_ops.h (host build) - OTA writes into an in-memory partition
+ *
+ * esp_ota_end() accepts an image that starts with the ESP32 image magic
+ * (0xE9); esp_ota_set_boot_partition() takes effect at the next "boot",
+ * i.e. esp_ota_get_running_partition() does not change within a run.
+ */
+
+#pragma once
+
+#include <esp_partition.h>
+
+typedef uint32_t esp_ota_handle_t;
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+#define ESP_ERR_OTA_VALIDATE_FAILED 0x1503
+
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_boot_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
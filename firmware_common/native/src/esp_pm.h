@@ -0,0 +1,34 @@
+/*
+ * esp_pm.h (host build) - power management accepts any configuration
+ */
+
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32c3_t;
+typedef esp_pm_config_esp32c3_t esp_pm_config_esp32s3_t;
+
+typedef enum
+{
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
+
+inline esp_err_t esp_pm_configure(const void *) { return ESP_OK; }
+inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t, int, const char *, esp_pm_lock_handle_t *handle)
+{
+    *handle = nullptr;
+    return ESP_OK;
+}
+inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t) { return ESP_OK; }
+inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t) { return ESP_OK; }
@@ -0,0 +1,17 @@
+/*
+ * esp_vfs_eventfd.h (host build) - Linux eventfd, the API ESP-IDF mirrors
+ */
+
+#pragma once
+
+#include <esp_err.h>
+#include <sys/eventfd.h>
+
+typedef struct
+{
+    size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() {5}
+
+inline esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *) { return ESP_OK; }
@@ -0,0 +1,27 @@
+/*
+ * FreeRTOS.h (host build) - types and macros only
+ *
+ * The host build does not run tasks: xTaskCreate() records nothing and the
+ * harness calls each task's step function (networkStep(), readSensor(), ...)
+ * itself, one at a time. Notifications are therefore no-ops.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define configASSERT(x)
+#define portYIELD_FROM_ISR(...)
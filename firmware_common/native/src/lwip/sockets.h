@@ -0,0 +1,16 @@
+/*
+ * lwip/sockets.h (host build) - the BSD socket API NetLink uses maps 1:1 onto
+ * POSIX, so NetLink makes real non-blocking TCP connects on the host (to the
+ * harness's loopback listener, or any broker address in the config).
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
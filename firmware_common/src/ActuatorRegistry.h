@@ -0,0 +1,231 @@
+/*
+ * ActuatorRegistry - table-driven output channels
+ *
+ * Every output of a device is one row of a constant ActuatorSpec table:
+ * command/state key, kind, pins, LEDC channel, polarity.
+ *
+ *   constexpr ActuatorSpec ACTUATORS[] = {
+ *       // name   level key   kind              pin dir     pwm     ledc active-low freq  bits
+ *       {"light", nullptr,    ACTUATOR_SWITCH,  8,  NO_PIN, NO_PIN, 0,   false,     0,    8},
+ *       {"fan",   "fanSpeed", ACTUATOR_HBRIDGE, 5,  9,      10,     0,   false,     5000, 8},
+ *   };
+ *   ActuatorRegistry<2> actuators(ACTUATORS);
+ *
+ * Command dispatch, device/state and the NVS snapshot iterate over the
+ * table, so a third relay is one more row. find() maps a command key to
+ * its channel in O(1): the constructor hashes every name and level key
+ * (FNV-1a) into an open-addressing index of at least 4 slots per channel,
+ * a lookup hashes the key token and compares about one name. Keys must be
+ * unique.
+ *
+ * The state of a channel (on/off and its level, the 0-255 duty it runs at
+ * while on) is one atomic word: written by the actuator task, read by the
+ * network task. ActuatorOutput drives the pins of a row.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <BoardTraits.h>
+#include <CommandParser.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum ActuatorKind : uint8_t
+{
+    ACTUATOR_SWITCH, // pin on/off: relay, LED
+    ACTUATOR_PWM,    // duty on pwmPin, 0 while off
+    ACTUATOR_HBRIDGE // pin = IN1, dirPin = IN2, pwmPin = ENA: forward at duty, or coast
+};
+
+struct ActuatorSpec
+{
+    const char *name;     // command and device/state key
+    const char *levelKey; // key of the 0-100 % level command/state, nullptr: on/off only
+    ActuatorKind kind;
+    int8_t pin;           // SWITCH output, HBRIDGE IN1
+    int8_t dirPin;        // HBRIDGE IN2
+    int8_t pwmPin;        // PWM output, HBRIDGE ENA
+    uint8_t ledcChannel;  // of pwmPin (Arduino-ESP32 2.x)
+    bool activeLow;
+    uint32_t pwmFreq;
+    uint8_t pwmBits;
+};
+
+struct ActuatorState
+{
+    bool on;
+    uint8_t level; // duty 0-255 while on, kept while off
+
+    bool operator==(const ActuatorState &other) const { return on == other.on && level == other.level; }
+    bool operator!=(const ActuatorState &other) const { return !(*this == other); }
+};
+
+// A command key resolved by ActuatorRegistry::find()
+struct ActuatorKey
+{
+    uint8_t channel;
+    bool level; // the channel's levelKey, not its name
+};
+
+// Pin writes for one table row (no state kept)
+struct ActuatorOutput
+{
+    // Pins configured, output off
+    static void begin(const ActuatorSpec &spec)
+    {
+        if (spec.kind != ACTUATOR_PWM)
+        {
+            pinMode(spec.pin, OUTPUT);
+        }
+        if (spec.kind == ACTUATOR_HBRIDGE)
+        {
+            pinMode(spec.dirPin, OUTPUT);
+        }
+        if (spec.kind != ACTUATOR_SWITCH)
+        {
+            pinMode(spec.pwmPin, OUTPUT);
+            ledcBegin(spec);
+        }
+        write(spec, ActuatorState{false, 0});
+    }
+
+    static void write(const ActuatorSpec &spec, const ActuatorState &state)
+    {
+        if (spec.kind != ACTUATOR_PWM)
+        {
+            drive(spec, state.on);
+        }
+        if (spec.kind != ACTUATOR_SWITCH)
+        {
+            setDuty(spec, state.on ? state.level : 0);
+        }
+    }
+
+    // SWITCH output / HBRIDGE direction inputs only (forward or coast)
+    static void drive(const ActuatorSpec &spec, bool on)
+    {
+        digitalWrite(spec.pin, on != spec.activeLow ? HIGH : LOW);
+        if (spec.kind == ACTUATOR_HBRIDGE)
+        {
+            digitalWrite(spec.dirPin, spec.activeLow ? HIGH : LOW);
+        }
+    }
+
+    // level 0-255, scaled to the channel's resolution
+    static void setDuty(const ActuatorSpec &spec, uint8_t level)
+    {
+        ledcSet(spec, (uint32_t)level * ((1u << spec.pwmBits) - 1) / 255);
+    }
+
+    // LEDC duty now, 0 for a switch
+    static uint32_t duty(const ActuatorSpec &spec) { return spec.kind == ACTUATOR_SWITCH ? 0 : ledcGet(spec); }
+
+private:
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+    static void ledcBegin(const ActuatorSpec &spec) { ledcAttach(spec.pwmPin, spec.pwmFreq, spec.pwmBits); }
+    static void ledcSet(const ActuatorSpec &spec, uint32_t duty) { ledcWrite(spec.pwmPin, duty); }
+    static uint32_t ledcGet(const ActuatorSpec &spec) { return ledcRead(spec.pwmPin); }
+#else
+    static void ledcBegin(const ActuatorSpec &spec)
+    {
+        ledcSetup(spec.ledcChannel, spec.pwmFreq, spec.pwmBits);
+        ledcAttachPin(spec.pwmPin, spec.ledcChannel);
+    }
+    static void ledcSet(const ActuatorSpec &spec, uint32_t duty) { ledcWrite(spec.ledcChannel, duty); }
+    static uint32_t ledcGet(const ActuatorSpec &spec) { return ledcRead(spec.ledcChannel); }
+#endif
+};
+
+// Smallest power of two >= keys (size of the key index)
+constexpr size_t actuatorIndexSlots(size_t keys, size_t slots = 1)
+{
+    return slots >= keys ? slots : actuatorIndexSlots(keys, slots * 2);
+}
+
+template <size_t N>
+class ActuatorRegistry
+{
+    static_assert(N >= 1 && N <= 127, "ActuatorRegistry holds 1-127 channels");
+
+public:
+    explicit ActuatorRegistry(const ActuatorSpec (&specs)[N]) : specs_(specs)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            insert(specs[i].name, i, false);
+            if (specs[i].levelKey)
+            {
+                insert(specs[i].levelKey, i, true);
+            }
+            set(i, ActuatorState{false, 255});
+        }
+    }
+
+    static constexpr size_t size() { return N; }
+    const ActuatorSpec &spec(size_t channel) const { return specs_[channel]; }
+
+    ActuatorState state(size_t channel) const
+    {
+        uint16_t word = states_[channel].load();
+        return ActuatorState{(word & ON_BIT) != 0, (uint8_t)word};
+    }
+
+    void set(size_t channel, const ActuatorState &state)
+    {
+        states_[channel].store((uint16_t)((state.on ? ON_BIT : 0) | state.level));
+    }
+
+    // Channel (and field) a command key addresses; false for an unknown key
+    bool find(const CommandToken &key, ActuatorKey &out) const
+    {
+        for (size_t slot = hash(key.data, key.length) & (SLOTS - 1); index_[slot] != 0; slot = (slot + 1) & (SLOTS - 1))
+        {
+            uint8_t entry = index_[slot] - 1;
+            const ActuatorSpec &spec = specs_[entry >> 1];
+            if (key.equals((entry & 1) ? spec.levelKey : spec.name))
+            {
+                out.channel = entry >> 1;
+                out.level = (entry & 1) != 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    enum : uint16_t
+    {
+        ON_BIT = 0x100
+    };
+    enum : size_t
+    {
+        SLOTS = actuatorIndexSlots(4 * N) // load factor <= 1/2
+    };
+
+    void insert(const char *key, size_t channel, bool level)
+    {
+        size_t slot = hash(key, strlen(key)) & (SLOTS - 1);
+        while (index_[slot] != 0)
+        {
+            slot = (slot + 1) & (SLOTS - 1);
+        }
+        index_[slot] = (uint8_t)(channel * 2 + (level ? 1 : 0) + 1);
+    }
+
+    static uint32_t hash(const char *data, size_t length)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            h = (h ^ (uint8_t)data[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    const ActuatorSpec *specs_;
+    std::atomic<uint16_t> states_[N];
+    uint8_t index_[SLOTS] = {}; // channel * 2 + level + 1, 0 = empty
+};
@@ -0,0 +1,259 @@
+/*
+ * BoardTraits - compile-time board description and the GPIO layer built on it
+ *
+ * A board is a struct of static constexpr members (see Boards.h): pins,
+ * sensor, fan driver, LEDC API and output polarity. BoardIO<Board> turns it
+ * into the few output operations the firmwares need; every branch on a
+ * trait is resolved by template specialisation, so a board costs exactly
+ * the digitalWrite()/ledcWrite() calls it needs and nothing at runtime.
+ *
+ * Instantiating BoardIO<Board> also checks the description:
+ * - no GPIO is assigned to two functions (NO_PIN entries are skipped),
+ * - the sensor and fan driver have the pins they need,
+ * - the board's LEDC API matches the Arduino core being compiled against
+ *   (core 2.x: ledcSetup/ledcAttachPin, channel-based ledcWrite;
+ *    core 3.x: ledcAttach, pin-based ledcWrite).
+ *
+ * PWM fans can also change speed through LEDC hardware fades (fanFade()):
+ * the fade engine steps the duty without the CPU and calls back from the
+ * LEDC interrupt when it ends. See FadeRamp.h for ramps built from fades.
+ *
+ * Required members:
+ *   NAME, SENSOR, DHT_PIN, LIGHT_PIN, LIGHT_ACTIVE_LOW,
+ *   FAN, FAN_PIN, FAN_DIR_PIN, FAN_PWM_PIN, FAN_ACTIVE_LOW,
+ *   STATUS_LED_PIN, STATUS_LED_ACTIVE_LOW,
+ *   LEDC, PWM_CHANNEL, PWM_FREQ, PWM_BITS
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+
+enum SensorKind : uint8_t
+{
+    SENSOR_DHT11,
+    SENSOR_DHT22,
+    SENSOR_SIMULATED // generated readings, no sensor wired
+};
+
+enum FanDriver : uint8_t
+{
+    FAN_L298N, // FAN_PIN = IN1, FAN_DIR_PIN = IN2, FAN_PWM_PIN = ENA (speed)
+    FAN_RELAY  // FAN_PIN switches a relay, on/off only
+};
+
+enum LedcApi : uint8_t
+{
+    LEDC_CHANNEL_API, // Arduino-ESP32 2.x
+    LEDC_PIN_API      // Arduino-ESP32 3.x
+};
+
+static constexpr int NO_PIN = -1;
+
+// The API of the core this translation unit is compiled against (host
+// builds use the 2.x calls, see firmware_common/native)
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+static constexpr LedcApi CORE_LEDC_API = LEDC_PIN_API;
+#else
+static constexpr LedcApi CORE_LEDC_API = LEDC_CHANNEL_API;
+#endif
+
+// True when no pin in the list is used twice (NO_PIN never clashes)
+constexpr bool pinFree(int)
+{
+    return true;
+}
+
+template <typename... Rest>
+constexpr bool pinFree(int pin, int other, Rest... rest)
+{
+    return (pin == NO_PIN || pin != other) && pinFree(pin, rest...);
+}
+
+constexpr bool pinsDistinct()
+{
+    return true;
+}
+
+template <typename... Rest>
+constexpr bool pinsDistinct(int pin, Rest... rest)
+{
+    return pinFree(pin, rest...) && pinsDistinct(rest...);
+}
+
+// Runs in the LEDC interrupt when a hardware fade has ended
+typedef void (*FadeDone)();
+
+// Fan speed PWM, one specialisation per LEDC API (only the board's is compiled)
+template <typename Board, LedcApi Api = Board::LEDC>
+struct LedcOutput;
+
+template <typename Board>
+struct LedcOutput<Board, LEDC_CHANNEL_API>
+{
+    static void attach()
+    {
+        ledcSetup(Board::PWM_CHANNEL, Board::PWM_FREQ, Board::PWM_BITS);
+        ledcAttachPin(Board::FAN_PWM_PIN, Board::PWM_CHANNEL);
+    }
+    static void write(uint32_t duty) { ledcWrite(Board::PWM_CHANNEL, duty); }
+
+    // Fades go through the IDF driver: the 2.x core puts channel c in speed
+    // mode c / 8, hardware channel c % 8. A write (ledcWrite) while a fade
+    // runs waits for it to end.
+    static bool fadeBegin(FadeDone done)
+    {
+        esp_err_t err = ledc_fade_func_install(0);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // already installed
+        {
+            return false;
+        }
+        ledc_cbs_t callbacks = {};
+        callbacks.fade_cb = fadeEnded;
+        return ledc_cb_register(mode(), channel(), &callbacks, (void *)done) == ESP_OK;
+    }
+    static void fade(uint32_t duty, uint32_t ms)
+    {
+        ledc_set_fade_time_and_start(mode(), channel(), duty, ms, LEDC_FADE_NO_WAIT);
+    }
+    static uint32_t read() { return ledc_get_duty(mode(), channel()); }
+
+private:
+    static ledc_mode_t mode() { return (ledc_mode_t)(Board::PWM_CHANNEL / 8); }
+    static ledc_channel_t channel() { return (ledc_channel_t)(Board::PWM_CHANNEL % 8); }
+
+    static bool IRAM_ATTR fadeEnded(const ledc_cb_param_t *param, void *done)
+    {
+        if (param->event == LEDC_FADE_END_EVT)
+        {
+            ((FadeDone)done)();
+        }
+        return false; // the callback yields itself (portYIELD_FROM_ISR)
+    }
+};
+
+template <typename Board>
+struct LedcOutput<Board, LEDC_PIN_API>
+{
+    static void attach() { ledcAttach(Board::FAN_PWM_PIN, Board::PWM_FREQ, Board::PWM_BITS); }
+    static void write(uint32_t duty) { ledcWrite(Board::FAN_PWM_PIN, duty); }
+
+    static bool fadeBegin(FadeDone done)
+    {
+        callback() = done;
+        return true;
+    }
+    static void fade(uint32_t duty, uint32_t ms)
+    {
+        ledcFadeWithInterrupt(Board::FAN_PWM_PIN, read(), duty, ms, callback());
+    }
+    static uint32_t read() { return ledcRead(Board::FAN_PWM_PIN); }
+
+private:
+    static FadeDone &callback()
+    {
+        static FadeDone done = nullptr;
+        return done;
+    }
+};
+
+// Fan output, one specialisation per driver
+template <typename Board, FanDriver Driver = Board::FAN>
+struct FanOutput;
+
+template <typename Board>
+struct FanOutput<Board, FAN_L298N>
+{
+    static const bool HAS_SPEED = true;
+
+    static void begin()
+    {
+        pinMode(Board::FAN_PIN, OUTPUT);
+        pinMode(Board::FAN_DIR_PIN, OUTPUT);
+        pinMode(Board::FAN_PWM_PIN, OUTPUT);
+        LedcOutput<Board>::attach();
+    }
+
+    // Forward at duty, or both inputs low (coast) and no PWM
+    static void set(bool on, uint32_t duty)
+    {
+        drive(on);
+        LedcOutput<Board>::write(on ? duty : 0);
+    }
+
+    // Direction inputs only (forward or coast), the duty is left alone
+    static void drive(bool on)
+    {
+        digitalWrite(Board::FAN_PIN, on != Board::FAN_ACTIVE_LOW ? HIGH : LOW);
+        digitalWrite(Board::FAN_DIR_PIN, Board::FAN_ACTIVE_LOW ? HIGH : LOW);
+    }
+
+    static void setDuty(uint32_t duty) { LedcOutput<Board>::write(duty); }
+};
+
+template <typename Board>
+struct FanOutput<Board, FAN_RELAY>
+{
+    static const bool HAS_SPEED = false;
+
+    static void begin() { pinMode(Board::FAN_PIN, OUTPUT); }
+    static void set(bool on, uint32_t) { digitalWrite(Board::FAN_PIN, on != Board::FAN_ACTIVE_LOW ? HIGH : LOW); }
+    static void setDuty(uint32_t) {}
+};
+
+template <typename Board>
+class BoardIO
+{
+    static_assert(pinsDistinct(Board::DHT_PIN, Board::LIGHT_PIN, Board::FAN_PIN, Board::FAN_DIR_PIN,
+                               Board::FAN_PWM_PIN, Board::STATUS_LED_PIN),
+                  "Board traits: two functions share a GPIO");
+    static_assert(Board::SENSOR == SENSOR_SIMULATED || Board::DHT_PIN != NO_PIN,
+                  "Board traits: a DHT sensor needs DHT_PIN");
+    static_assert(Board::LIGHT_PIN != NO_PIN && Board::FAN_PIN != NO_PIN,
+                  "Board traits: light and fan outputs need a pin");
+    static_assert(Board::FAN != FAN_L298N || (Board::FAN_DIR_PIN != NO_PIN && Board::FAN_PWM_PIN != NO_PIN),
+                  "Board traits: an L298N fan needs FAN_DIR_PIN (IN2) and FAN_PWM_PIN (ENA)");
+    static_assert(Board::FAN != FAN_L298N || Board::LEDC == CORE_LEDC_API,
+                  "Board traits: LEDC API does not match the Arduino core");
+
+public:
+    static const bool HAS_FAN_SPEED = FanOutput<Board>::HAS_SPEED;
+    static const bool HAS_STATUS_LED = Board::STATUS_LED_PIN != NO_PIN;
+
+    // All outputs configured and off
+    static void begin()
+    {
+        pinMode(Board::LIGHT_PIN, OUTPUT);
+        FanOutput<Board>::begin();
+        if (HAS_STATUS_LED)
+        {
+            pinMode(Board::STATUS_LED_PIN, OUTPUT);
+        }
+        setLight(false);
+        setFan(false, 0);
+        setStatusLed(false);
+    }
+
+    static void setLight(bool on) { digitalWrite(Board::LIGHT_PIN, on != Board::LIGHT_ACTIVE_LOW ? HIGH : LOW); }
+
+    // duty (0 .. 2^PWM_BITS - 1) is ignored by on/off fan drivers
+    static void setFan(bool on, uint32_t duty) { FanOutput<Board>::set(on, duty); }
+    static void setFanDuty(uint32_t duty) { FanOutput<Board>::setDuty(duty); }
+
+    // PWM fans only: speed through hardware fades. fanFadeBegin() once after
+    // begin(); done runs in the LEDC interrupt at the end of each fanFade().
+    // Start a fade only after the previous one has ended.
+    static bool fanFadeBegin(FadeDone done) { return LedcOutput<Board>::fadeBegin(done); }
+    static void fanFade(uint32_t duty, uint32_t ms) { LedcOutput<Board>::fade(duty, ms); }
+    static void setFanDrive(bool on) { FanOutput<Board>::drive(on); }
+    static uint32_t fanDuty() { return LedcOutput<Board>::read(); }
+
+    static void setStatusLed(bool on)
+    {
+        if (HAS_STATUS_LED)
+        {
+            digitalWrite(Board::STATUS_LED_PIN, on != Board::STATUS_LED_ACTIVE_LOW ? HIGH : LOW);
+        }
+    }
+};
@@ -0,0 +1,91 @@
+/*
+ * Boards - the boards this repo ships, described as BoardTraits
+ *
+ * A firmware picks one with -DIOT_BOARD=<name> (one PlatformIO env per
+ * board) and falls back to its own default. A wiring change is a change
+ * here; BoardIO<> rejects a description where two functions share a pin.
+ */
+
+#pragma once
+
+#include "BoardTraits.h"
+
+// ESP32-C3 Super Mini, DHT11, built-in LED as the light, L298N fan.
+// Motor IN1 moved off GPIO8, which the built-in LED already uses.
+struct Esp32C3SuperMini
+{
+    static constexpr const char *NAME = "ESP32-C3 Super Mini";
+
+    static constexpr SensorKind SENSOR = SENSOR_DHT11;
+    static constexpr int DHT_PIN = 2;
+
+    static constexpr int LIGHT_PIN = 8; // built-in LED
+    static constexpr bool LIGHT_ACTIVE_LOW = false;
+
+    static constexpr FanDriver FAN = FAN_L298N;
+    static constexpr int FAN_PIN = 5;      // L298N IN1
+    static constexpr int FAN_DIR_PIN = 9;  // L298N IN2
+    static constexpr int FAN_PWM_PIN = 10; // L298N ENA
+    static constexpr bool FAN_ACTIVE_LOW = false;
+
+    static constexpr int STATUS_LED_PIN = NO_PIN;
+    static constexpr bool STATUS_LED_ACTIVE_LOW = false;
+
+    static constexpr LedcApi LEDC = CORE_LEDC_API;
+    static constexpr uint8_t PWM_CHANNEL = 0;
+    static constexpr uint32_t PWM_FREQ = 5000; // 5 kHz
+    static constexpr uint8_t PWM_BITS = 8;     // duty 0-255
+};
+
+// ESP32-C3 Super Mini wired as the former esp32c3_iot_demo sketch: DHT22,
+// external LED on GPIO21 (sinks current, so active-low), L298N on 5/6/9
+struct Esp32C3SuperMiniDht22
+{
+    static constexpr const char *NAME = "ESP32-C3 Super Mini (DHT22)";
+
+    static constexpr SensorKind SENSOR = SENSOR_DHT22;
+    static constexpr int DHT_PIN = 2;
+
+    static constexpr int LIGHT_PIN = 21;
+    static constexpr bool LIGHT_ACTIVE_LOW = true;
+
+    static constexpr FanDriver FAN = FAN_L298N;
+    static constexpr int FAN_PIN = 5;     // L298N IN1
+    static constexpr int FAN_DIR_PIN = 6; // L298N IN2
+    static constexpr int FAN_PWM_PIN = 9; // L298N ENA
+    static constexpr bool FAN_ACTIVE_LOW = false;
+
+    static constexpr int STATUS_LED_PIN = NO_PIN;
+    static constexpr bool STATUS_LED_ACTIVE_LOW = false;
+
+    static constexpr LedcApi LEDC = CORE_LEDC_API;
+    static constexpr uint8_t PWM_CHANNEL = 0;
+    static constexpr uint32_t PWM_FREQ = 5000;
+    static constexpr uint8_t PWM_BITS = 8;
+};
+
+// ESP32-S3 DevKitC-1 with a two-channel relay module and simulated sensors
+struct Esp32S3DevKitC
+{
+    static constexpr const char *NAME = "ESP32-S3 DevKitC-1";
+
+    static constexpr SensorKind SENSOR = SENSOR_SIMULATED;
+    static constexpr int DHT_PIN = NO_PIN;
+
+    static constexpr int LIGHT_PIN = 5; // relay 1
+    static constexpr bool LIGHT_ACTIVE_LOW = false;
+
+    static constexpr FanDriver FAN = FAN_RELAY;
+    static constexpr int FAN_PIN = 6; // relay 2
+    static constexpr int FAN_DIR_PIN = NO_PIN;
+    static constexpr int FAN_PWM_PIN = NO_PIN;
+    static constexpr bool FAN_ACTIVE_LOW = false;
+
+    static constexpr int STATUS_LED_PIN = 2;
+    static constexpr bool STATUS_LED_ACTIVE_LOW = false;
+
+    static constexpr LedcApi LEDC = CORE_LEDC_API;
+    static constexpr uint8_t PWM_CHANNEL = 0;
+    static constexpr uint32_t PWM_FREQ = 0;
+    static constexpr uint8_t PWM_BITS = 8;
+};
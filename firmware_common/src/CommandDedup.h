@@ -0,0 +1,88 @@
+/*
+ * CommandDedup - drops commands redelivered with a "seq" already applied
+ *
+ * With a persistent session and a QoS1 subscription the broker delivers a
+ * command at least once: a PUBLISH whose PUBACK was lost with the
+ * connection comes again after the reconnect, and a "toggle" must not run
+ * twice. Senders put a "seq" in every command, unique per command:
+ *
+ *   {"light":"toggle","seq":73512004,"id":"web-k3x9","ts":1760600000123}
+ *
+ * (the web and Flutter apps start from a random base and count up, so two
+ * senders practically never share a value). The network task calls seen()
+ * before dispatching a payload and drops it when it returns true.
+ *
+ * The last N seq values are remembered as 32-bit FNV-1a hashes of their raw
+ * token text: numbers of any size and strings work alike, nothing is
+ * parsed. A redelivery is recognised as long as fewer than N other
+ * sequenced commands arrived after the original; a hash collision (1 in
+ * 2^32 per pair) would drop a genuine command. Commands without "seq" are
+ * never dropped. Network task only.
+ */
+
+#pragma once
+
+#include <CommandParser.h>
+#include <stddef.h>
+#include <stdint.h>
+
+template <size_t N>
+class CommandDedup
+{
+    static_assert(N >= 1, "CommandDedup needs at least one entry");
+
+public:
+    // True when payload's "seq" was seen before (drop the command);
+    // otherwise the seq is remembered and false returned
+    bool seen(const uint8_t *payload, size_t length)
+    {
+        CommandReader reader(payload, length);
+        CommandToken key;
+        CommandToken value;
+        while (reader.next(key, value))
+        {
+            if (key.equals("seq"))
+            {
+                return check(hash(value));
+            }
+        }
+        return false;
+    }
+
+    uint32_t duplicates() const { return duplicates_; }
+
+private:
+    bool check(uint32_t key)
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (keys_[i] == key)
+            {
+                duplicates_++;
+                return true;
+            }
+        }
+        keys_[next_] = key;
+        next_ = (next_ + 1) % N;
+        if (count_ < N)
+        {
+            count_++;
+        }
+        return false;
+    }
+
+    static uint32_t hash(const CommandToken &token)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < token.length; i++)
+        {
+            h = (h ^ (uint8_t)token.data[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    uint32_t keys_[N] = {};
+    size_t next_ = 0;  // oldest entry once the ring is full
+    size_t count_ = 0;
+    uint32_t duplicates_ = 0;
+};
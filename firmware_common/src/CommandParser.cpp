@@ -0,0 +1,243 @@
+#include "CommandParser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// =============================================================================
+// TOKENS
+// =============================================================================
+
+bool CommandToken::equals(const char *text) const
+{
+    return strlen(text) == length && memcmp(data, text, length) == 0;
+}
+
+bool CommandToken::toInt(long &out) const
+{
+    if (isString || length == 0 || length > 20)
+    {
+        return false;
+    }
+
+    // Tokens are not NUL-terminated: parse from a small stack copy
+    char digits[24];
+    memcpy(digits, data, length);
+    digits[length] = '\0';
+
+    char *parsed = nullptr;
+    long value = strtol(digits, &parsed, 10);
+    if (parsed == digits || (*parsed != '\0' && *parsed != '.' && *parsed != 'e' && *parsed != 'E'))
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+// =============================================================================
+// READER
+// =============================================================================
+
+CommandReader::CommandReader(const uint8_t *payload, size_t length)
+    : pos_((const char *)payload), end_((const char *)payload + length)
+{
+}
+
+bool CommandReader::next(CommandToken &key, CommandToken &value)
+{
+    if (done_ || error_)
+    {
+        return false;
+    }
+
+    skipSpace();
+    if (!started_)
+    {
+        if (pos_ == end_ || *pos_ != '{')
+        {
+            return fail();
+        }
+        pos_++;
+        started_ = true;
+        skipSpace();
+        if (pos_ < end_ && *pos_ == '}')
+        {
+            done_ = true;
+            return false;
+        }
+    }
+
+    if (!readString(key))
+    {
+        return fail();
+    }
+    skipSpace();
+    if (pos_ == end_ || *pos_ != ':')
+    {
+        return fail();
+    }
+    pos_++;
+    skipSpace();
+    if (!readValue(value))
+    {
+        return fail();
+    }
+
+    // Separator: another pair follows, or the object ends
+    skipSpace();
+    if (pos_ < end_ && *pos_ == ',')
+    {
+        pos_++;
+    }
+    else if (pos_ < end_ && *pos_ == '}')
+    {
+        pos_++;
+        done_ = true;
+    }
+    else
+    {
+        return fail();
+    }
+    return true;
+}
+
+void CommandReader::skipSpace()
+{
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r' || *pos_ == '\n'))
+    {
+        pos_++;
+    }
+}
+
+bool CommandReader::readString(CommandToken &token)
+{
+    if (pos_ == end_ || *pos_ != '"')
+    {
+        return false;
+    }
+    const char *start = ++pos_;
+    while (pos_ < end_ && *pos_ != '"')
+    {
+        pos_ += (*pos_ == '\\') ? 2 : 1;
+    }
+    if (pos_ >= end_)
+    {
+        return false;
+    }
+    token.data = start;
+    token.length = pos_ - start;
+    token.isString = true;
+    pos_++; // closing quote
+    return true;
+}
+
+bool CommandReader::readValue(CommandToken &token)
+{
+    if (pos_ == end_)
+    {
+        return false;
+    }
+    if (*pos_ == '"')
+    {
+        return readString(token);
+    }
+
+    // Nested object/array: skip it, handlers only see its raw text
+    const char *start = pos_;
+    if (*pos_ == '{' || *pos_ == '[')
+    {
+        int depth = 0;
+        do
+        {
+            if (*pos_ == '"')
+            {
+                CommandToken ignored;
+                if (!readString(ignored))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (*pos_ == '{' || *pos_ == '[')
+            {
+                depth++;
+            }
+            else if (*pos_ == '}' || *pos_ == ']')
+            {
+                depth--;
+            }
+            pos_++;
+        } while (depth > 0 && pos_ < end_);
+        if (depth != 0)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Number, true, false, null
+        while (pos_ < end_ && *pos_ != ',' && *pos_ != '}' && *pos_ != ' ' &&
+               *pos_ != '\t' && *pos_ != '\r' && *pos_ != '\n')
+        {
+            pos_++;
+        }
+    }
+
+    token.data = start;
+    token.length = pos_ - start;
+    token.isString = false;
+    return token.length > 0;
+}
+
+bool CommandReader::fail()
+{
+    error_ = true;
+    return false;
+}
+
+// =============================================================================
+// DISPATCH
+// =============================================================================
+
+CommandDispatch dispatchCommand(const uint8_t *payload, size_t length,
+                                const CommandRoute *routes, size_t routeCount,
+                                CommandFallback fallback)
+{
+    CommandDispatch result;
+    CommandReader reader(payload, length);
+    CommandToken key;
+    CommandToken value;
+
+    while (reader.next(key, value))
+    {
+        bool matched = false;
+        for (size_t i = 0; i < routeCount && !matched; i++)
+        {
+            const CommandRoute &route = routes[i];
+            if (key.equals(route.key) && (!route.verb || (value.isString && value.equals(route.verb))))
+            {
+                matched = true;
+                if (route.handler(value))
+                {
+                    result.dispatched++;
+                }
+            }
+        }
+        if (!matched && fallback)
+        {
+            CommandResult handled = fallback(key, value);
+            matched = handled != COMMAND_UNMATCHED;
+            if (handled == COMMAND_DISPATCHED)
+            {
+                result.dispatched++;
+            }
+        }
+        if (!matched)
+        {
+            result.unmatched++;
+        }
+    }
+
+    result.valid = !reader.error();
+    return result;
+}
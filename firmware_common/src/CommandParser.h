@@ -0,0 +1,96 @@
+/*
+ * CommandParser - zero-copy JSON command decoding with table dispatch
+ *
+ * Commands are flat JSON objects such as {"light":"on","fanSpeed":70}.
+ * CommandReader walks the MQTT payload in place and yields each top-level
+ * key/value pair as pointer + length tokens: no copy, no JsonDocument, no
+ * heap. dispatchCommand() matches every pair against a constant route table
+ * and calls the handler:
+ *
+ *   const CommandRoute ROUTES[] = {
+ *       {"light", "on", lightOn},
+ *       {"fanSpeed", nullptr, fanSpeed}, // nullptr verb: any value
+ *   };
+ *   CommandDispatch result = dispatchCommand(payload, length, ROUTES);
+ *
+ * Keys no route matches go to an optional fallback, e.g. a lookup in an
+ * ActuatorRegistry, which says whether it knew the key:
+ *
+ *   CommandDispatch result = dispatchCommand(payload, length, ROUTES, actuatorCommand);
+ *
+ * String values are compared raw (escape sequences are not decoded), which
+ * is fine for command verbs. Nested objects/arrays are skipped.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct CommandToken
+{
+    const char *data = nullptr;
+    size_t length = 0;
+    bool isString = false; // quoted value (data excludes the quotes)
+
+    bool equals(const char *text) const;
+    bool toInt(long &out) const; // numbers only, fraction truncated
+};
+
+typedef bool (*CommandHandler)(const CommandToken &value);
+
+enum CommandResult : uint8_t
+{
+    COMMAND_UNMATCHED, // unknown key or verb
+    COMMAND_REJECTED,  // known key, nothing dispatched (bad value, queue full)
+    COMMAND_DISPATCHED
+};
+
+typedef CommandResult (*CommandFallback)(const CommandToken &key, const CommandToken &value);
+
+struct CommandRoute
+{
+    const char *key;
+    const char *verb; // nullptr matches any value
+    CommandHandler handler;
+};
+
+struct CommandDispatch
+{
+    bool valid = true;     // payload was a well-formed flat object
+    uint8_t dispatched = 0; // handlers that returned true
+    uint8_t unmatched = 0;  // pairs with no route (unknown key or verb)
+};
+
+class CommandReader
+{
+public:
+    CommandReader(const uint8_t *payload, size_t length);
+
+    // Next key/value pair; false at the end of the object or on a syntax error
+    bool next(CommandToken &key, CommandToken &value);
+    bool error() const { return error_; }
+
+private:
+    void skipSpace();
+    bool readString(CommandToken &token);
+    bool readValue(CommandToken &token);
+    bool fail();
+
+    const char *pos_;
+    const char *end_;
+    bool started_ = false;
+    bool done_ = false;
+    bool error_ = false;
+};
+
+CommandDispatch dispatchCommand(const uint8_t *payload, size_t length,
+                                const CommandRoute *routes, size_t routeCount,
+                                CommandFallback fallback = nullptr);
+
+template <size_t N>
+CommandDispatch dispatchCommand(const uint8_t *payload, size_t length, const CommandRoute (&routes)[N],
+                                CommandFallback fallback = nullptr)
+{
+    return dispatchCommand(payload, length, routes, N, fallback);
+}
@@ -0,0 +1,188 @@
+/*
+ * CommandTrace - correlation ids and timestamps for command acknowledgements
+ *
+ * A command may carry an "id" (string or number) and the sender's "ts":
+ *
+ *   {"light":"toggle","id":"web-k3x9","ts":1760600000123}
+ *
+ * The network task calls begin() before dispatching the payload: it copies
+ * both fields into a free slot and stamps the receive time. Every actuator
+ * command queued while the slot is current() carries its index;
+ * dispatched() closes the slot with the number of commands queued. The
+ * actuator task calls applied() after executing each one, and once all of
+ * them ran (or straight away when nothing was queued) the slot shows up in
+ * ready() for the network task to publish its ack and release() it.
+ *
+ * Times are micros() on the device clock, so only differences between them
+ * mean anything; "ts" is echoed untouched for the sender's own clock.
+ * Commands without an "id" are not traced. applied() only uses atomic
+ * load/store (single writer), fine on the ESP32-C3.
+ */
+
+#pragma once
+
+#include <CommandParser.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t N>
+class CommandTrace
+{
+    static_assert(N >= 1 && N <= 32, "ready() returns a 32-bit slot mask");
+
+public:
+    static const uint8_t NONE = 0xFF;
+
+    struct Slot
+    {
+        char id[24];
+        char sentTs[24]; // empty when the command had no "ts"
+        bool idIsString;
+        bool sentTsIsString;
+        uint32_t receivedUs;
+        uint8_t queued; // actuator commands carrying this slot
+        bool armed;     // dispatched() was called
+        bool inUse;
+        std::atomic<uint8_t> applied{0};     // written by the actuator task
+        std::atomic<uint32_t> actuatedUs{0}; // last applied() time
+
+        bool ok() const { return queued > 0; }
+    };
+
+    // Network task: before dispatching a command payload
+    uint8_t begin(const uint8_t *payload, size_t length, uint32_t receivedUs)
+    {
+        current_ = NONE;
+
+        CommandReader reader(payload, length);
+        CommandToken key;
+        CommandToken value;
+        CommandToken id;
+        CommandToken ts;
+        bool hasId = false;
+        while (reader.next(key, value))
+        {
+            if (key.equals("id"))
+            {
+                id = value;
+                hasId = true;
+            }
+            else if (key.equals("ts"))
+            {
+                ts = value;
+            }
+        }
+        if (!hasId || reader.error())
+        {
+            return NONE;
+        }
+
+        uint8_t index = 0;
+        while (index < N && slots_[index].inUse)
+        {
+            index++;
+        }
+        if (index == N)
+        {
+            overflowed_++;
+            return NONE;
+        }
+
+        Slot &slot = slots_[index];
+        if (!copyToken(slot.id, slot.idIsString, id))
+        {
+            return NONE;
+        }
+        if (!copyToken(slot.sentTs, slot.sentTsIsString, ts))
+        {
+            slot.sentTs[0] = '\0';
+        }
+        slot.receivedUs = receivedUs;
+        slot.queued = 0;
+        slot.armed = false;
+        slot.applied.store(0, std::memory_order_relaxed);
+        slot.actuatedUs.store(0, std::memory_order_relaxed);
+        slot.inUse = true;
+        current_ = index;
+        return index;
+    }
+
+    // Slot to stamp on commands queued by the route handlers
+    uint8_t current() const { return current_; }
+
+    // Network task: after dispatching, with the number of commands queued
+    void dispatched(uint8_t queued)
+    {
+        if (current_ == NONE)
+        {
+            return;
+        }
+        slots_[current_].queued = queued;
+        slots_[current_].armed = true;
+        current_ = NONE;
+    }
+
+    // Actuator task: one command of this slot has been executed
+    void applied(uint8_t index, uint32_t nowUs)
+    {
+        if (index >= N)
+        {
+            return;
+        }
+        Slot &slot = slots_[index];
+        slot.actuatedUs.store(nowUs, std::memory_order_relaxed);
+        slot.applied.store(slot.applied.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Network task: bit i set when slot i can be acknowledged
+    uint32_t ready() const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            const Slot &slot = slots_[i];
+            if (slot.inUse && slot.armed && slot.applied.load(std::memory_order_acquire) >= slot.queued)
+            {
+                mask |= 1UL << i;
+            }
+        }
+        return mask;
+    }
+
+    const Slot &slot(uint8_t index) const { return slots_[index]; }
+    void release(uint8_t index) { slots_[index].inUse = false; }
+
+    // Traced commands that found every slot busy (acknowledged nothing)
+    uint32_t overflowed() const { return overflowed_; }
+
+private:
+    // Strings are kept raw (escapes undecoded); numbers must look like one,
+    // since they are echoed back verbatim into JSON
+    static bool copyToken(char (&out)[24], bool &isString, const CommandToken &token)
+    {
+        if (!token.data || token.length == 0 || token.length >= sizeof(out))
+        {
+            return false;
+        }
+        if (!token.isString)
+        {
+            for (size_t i = 0; i < token.length; i++)
+            {
+                if (token.data[i] == '\0' || !strchr("0123456789-+.eE", token.data[i]))
+                {
+                    return false;
+                }
+            }
+        }
+        memcpy(out, token.data, token.length);
+        out[token.length] = '\0';
+        isString = token.isString;
+        return true;
+    }
+
+    Slot slots_[N] = {};
+    uint8_t current_ = NONE;
+    uint32_t overflowed_ = 0;
+};
@@ -0,0 +1,144 @@
+#include "DhtSampler.h"
+
+// =============================================================================
+// POLLING (sensor task)
+// =============================================================================
+
+void DhtSampler::begin(uint8_t pin, Type type, uint32_t intervalMs, uint32_t retryMs)
+{
+    pin_ = pin;
+    type_ = type;
+    intervalMs_ = intervalMs;
+    retryMs_ = retryMs;
+    state_ = State::IDLE;
+    nextReadAt_ = millis();
+
+    // Idle line is high (pull-up)
+    pinMode(pin_, INPUT_PULLUP);
+}
+
+uint32_t DhtSampler::poll(uint32_t nowMs)
+{
+    switch (state_)
+    {
+    case State::IDLE:
+    {
+        int32_t untilRead = (int32_t)(nextReadAt_ - nowMs);
+        if (untilRead > 0)
+        {
+            return (uint32_t)untilRead;
+        }
+        // Start signal: DHT11 wants >= 18 ms low, DHT22 >= 1 ms
+        pinMode(pin_, OUTPUT);
+        digitalWrite(pin_, LOW);
+        state_ = State::START;
+        stateSince_ = nowMs;
+        return type_ == DHT11_SENSOR ? 20 : 2;
+    }
+
+    case State::START:
+    {
+        uint32_t startMs = type_ == DHT11_SENSOR ? 20 : 2;
+        if (nowMs - stateSince_ < startMs)
+        {
+            return startMs - (nowMs - stateSince_);
+        }
+        // Release the line; the sensor answers 20-40 us later
+        edgeCount_.store(0, std::memory_order_relaxed);
+        pinMode(pin_, INPUT_PULLUP);
+        attachInterruptArg(digitalPinToInterrupt(pin_), onEdge, this, FALLING);
+        state_ = State::CAPTURE;
+        stateSince_ = nowMs;
+        return 5;
+    }
+
+    case State::CAPTURE:
+        if (edgeCount_.load(std::memory_order_acquire) < FRAME_EDGES &&
+            nowMs - stateSince_ < CAPTURE_TIMEOUT_MS)
+        {
+            return 1;
+        }
+        finish(nowMs);
+        return nextReadAt_ - nowMs;
+    }
+    return intervalMs_;
+}
+
+void DhtSampler::finish(uint32_t nowMs)
+{
+    detachInterrupt(digitalPinToInterrupt(pin_));
+    state_ = State::IDLE;
+
+    uint8_t data[5];
+    if (!decode(data))
+    {
+        failures_.store(failures_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        nextReadAt_ = nowMs + retryMs_;
+        return;
+    }
+
+    if (type_ == DHT11_SENSOR)
+    {
+        reading_.humidity = data[0] + data[1] * 0.1f;
+        reading_.temperature = data[2] + (data[3] & 0x0F) * 0.1f;
+        if (data[3] & 0x80)
+        {
+            reading_.temperature = -reading_.temperature;
+        }
+    }
+    else
+    {
+        reading_.humidity = ((data[0] << 8) | data[1]) * 0.1f;
+        reading_.temperature = (((data[2] & 0x7F) << 8) | data[3]) * 0.1f;
+        if (data[2] & 0x80)
+        {
+            reading_.temperature = -reading_.temperature;
+        }
+    }
+    reading_.atMs = nowMs;
+    reading_.valid = true;
+    fresh_ = true;
+    reads_.store(reads_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    nextReadAt_ = nowMs + intervalMs_;
+}
+
+// Decodes the last 41 edges (the response edge may come before the ISR is
+// attached): edge i -> i+1 spans bit i
+bool DhtSampler::decode(uint8_t data[5]) const
+{
+    uint8_t count = edgeCount_.load(std::memory_order_acquire);
+    if (count < FRAME_EDGES - 1)
+    {
+        return false;
+    }
+    if (count > FRAME_EDGES)
+    {
+        count = FRAME_EDGES; // trailing glitches
+    }
+    const uint32_t *edges = edgeUs_ + (count - (FRAME_EDGES - 1));
+
+    memset(data, 0, 5);
+    for (uint8_t bit = 0; bit < 40; bit++)
+    {
+        if (edges[bit + 1] - edges[bit] > BIT_THRESHOLD_US)
+        {
+            data[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+    return (uint8_t)(data[0] + data[1] + data[2] + data[3]) == data[4];
+}
+
+// =============================================================================
+// EDGE CAPTURE (GPIO ISR)
+// =============================================================================
+
+void IRAM_ATTR DhtSampler::onEdge(void *arg)
+{
+    DhtSampler *sampler = (DhtSampler *)arg;
+    uint8_t count = sampler->edgeCount_.load(std::memory_order_relaxed);
+    if (count < MAX_EDGES)
+    {
+        sampler->edgeUs_[count] = micros();
+        sampler->edgeCount_.store(count + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * DhtSampler - interrupt-driven DHT11/DHT22 reader with a last-good cache
+ *
+ * The DHT library bit-bangs the whole 40-bit frame with interrupts disabled
+ * (~4-5 ms per read, 20 ms more for the DHT11 start pulse in delay()). On
+ * the single-core ESP32-C3 that stalls every other task, MQTT and the
+ * actuator included. This sampler never blocks:
+ *
+ *   IDLE --interval--> START (pin low) --start pulse--> CAPTURE --> IDLE
+ *
+ * - START drives the line low and returns; the caller sleeps through the
+ *   start pulse.
+ * - CAPTURE releases the line and timestamps every falling edge in a GPIO
+ *   ISR (micros(), a few hundred ns each). Bits are decoded afterwards from
+ *   the edge spacing: 50 us low + 26-28 us high is a 0, + 70 us high a 1.
+ * - A frame with a bad checksum or missing edges is a failure: the cache
+ *   keeps the previous reading (and its age) and the read is retried after
+ *   the sensor's minimum re-read time.
+ *
+ * poll() runs on one task (the sensor task) and returns how long that task
+ * may sleep before the next poll. reading() is meant for the same task; the
+ * counters can be read from any task.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+struct DhtReading
+{
+    float temperature;
+    float humidity;
+    uint32_t atMs; // millis() of the read
+    bool valid;    // false until the first good frame
+};
+
+class DhtSampler
+{
+public:
+    enum Type : uint8_t
+    {
+        DHT11_SENSOR = 11,
+        DHT22_SENSOR = 22
+    };
+
+    // First read starts on the first poll()
+    void begin(uint8_t pin, Type type, uint32_t intervalMs, uint32_t retryMs);
+
+    // Advances the read; returns the ms the caller may sleep before polling again
+    uint32_t poll(uint32_t nowMs);
+
+    const DhtReading &reading() const { return reading_; }
+    uint32_t ageMs(uint32_t nowMs) const { return reading_.valid ? nowMs - reading_.atMs : UINT32_MAX; }
+
+    // True once per new good reading
+    bool takeFresh()
+    {
+        bool fresh = fresh_;
+        fresh_ = false;
+        return fresh;
+    }
+
+    uint32_t reads() const { return reads_.load(std::memory_order_relaxed); }
+    uint32_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+private:
+    enum class State : uint8_t
+    {
+        IDLE,
+        START,
+        CAPTURE
+    };
+
+    // 1 response edge + 1 start-of-data edge + 40 bit edges
+    static const uint8_t FRAME_EDGES = 42;
+    static const uint8_t MAX_EDGES = 48;
+    static const uint32_t CAPTURE_TIMEOUT_MS = 10; // frame is ~4.5 ms
+    static const uint32_t BIT_THRESHOLD_US = 100;  // 0: ~77 us, 1: ~120 us edge to edge
+
+    static void onEdge(void *arg);
+    bool decode(uint8_t data[5]) const;
+    void finish(uint32_t nowMs);
+
+    uint8_t pin_ = 0;
+    Type type_ = DHT11_SENSOR;
+    uint32_t intervalMs_ = 2000;
+    uint32_t retryMs_ = 1000;
+
+    State state_ = State::IDLE;
+    uint32_t stateSince_ = 0;
+    uint32_t nextReadAt_ = 0;
+
+    // Written by the ISR only (no RMW atomics on the C3)
+    uint32_t edgeUs_[MAX_EDGES];
+    std::atomic<uint8_t> edgeCount_{0};
+
+    DhtReading reading_ = {NAN, NAN, 0, false};
+    bool fresh_ = false;
+    std::atomic<uint32_t> reads_{0};
+    std::atomic<uint32_t> failures_{0};
+};
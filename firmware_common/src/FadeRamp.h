@@ -0,0 +1,162 @@
+/*
+ * FadeRamp - plans a PWM duty ramp as hardware fade segments
+ *
+ * The LEDC fade engine steps the duty on its own but only in straight
+ * lines, and a running fade cannot be retargeted (ESP-IDF 4.4 blocks the
+ * caller until it ends). FadeRamp cuts a ramp into segments of at most
+ * `maxSegmentMs`; each one is a single hardware fade, and the CPU only
+ * runs between segments (next()) to start the following one:
+ * - the curve is followed piecewise-linearly through the segment ends,
+ * - a new goal (retarget()) never waits on the hardware: it is picked up
+ *   at the next segment end, at most `maxSegmentMs` later, and the ramp
+ *   continues from the duty reached so far,
+ * - the ramp time scales with the distance: 0 to full duty takes
+ *   `fullScaleMs`, so the slew rate (and the motor's current spike) is
+ *   bounded whatever the step.
+ *
+ * Segments never repeat the previous duty (a zero-length fade has no end
+ * event on some IDF versions); their time is merged into the next one.
+ *
+ * Single-threaded: the owner starts the returned segments and calls next()
+ * when a fade ends.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+enum RampCurve : uint8_t
+{
+    RAMP_LINEAR,
+    RAMP_EASE_IN,    // slow start (quadratic)
+    RAMP_EASE_OUT,   // slow finish (quadratic)
+    RAMP_EASE_IN_OUT // smoothstep
+};
+
+struct RampPolicy
+{
+    uint32_t fullDuty;     // duty at 100 %, e.g. 255 for 8-bit PWM
+    uint32_t fullScaleMs;  // 0 -> fullDuty; 0 = jump straight to the goal
+    uint32_t maxSegmentMs; // retarget latency and curve resolution
+    RampCurve curve;
+};
+
+class FadeRamp
+{
+public:
+    struct Segment
+    {
+        uint32_t duty; // fade target
+        uint32_t ms;   // fade time, 0 = write the duty directly
+    };
+
+    explicit FadeRamp(const RampPolicy &policy) : policy_(policy) {}
+
+    // At rest at duty (after a direct write)
+    void reset(uint32_t duty)
+    {
+        duty_ = duty;
+        goal_ = duty;
+        active_ = false;
+    }
+
+    // New goal. True when the ramp was idle and the caller should start
+    // next() now; while a segment runs the goal is taken at its end.
+    bool retarget(uint32_t goal)
+    {
+        goal_ = goal;
+        if (active_ || goal == duty_)
+        {
+            return false;
+        }
+        plan();
+        active_ = true;
+        return true;
+    }
+
+    // The next segment once the previous one ended (or after retarget()
+    // returned true); false when the goal is reached
+    bool next(Segment &segment)
+    {
+        if (goal_ != planGoal_)
+        {
+            plan(); // retargeted mid-ramp: restart from the duty reached
+        }
+
+        uint32_t ms = 0;
+        while (step_ < steps_)
+        {
+            step_++;
+            ms += segmentMs_;
+            uint32_t duty = at(step_);
+            if (duty != duty_)
+            {
+                duty_ = duty;
+                segment.duty = duty;
+                segment.ms = ms;
+                return true;
+            }
+        }
+        active_ = false;
+        return false;
+    }
+
+    bool active() const { return active_; }
+    uint32_t goal() const { return goal_; }
+
+    // Duty at the end of the running segment (or at rest)
+    uint32_t segmentDuty() const { return duty_; }
+
+private:
+    void plan()
+    {
+        from_ = duty_;
+        planGoal_ = goal_;
+        uint32_t distance = goal_ > from_ ? goal_ - from_ : from_ - goal_;
+        uint32_t totalMs = policy_.fullDuty > 0 ? (uint64_t)policy_.fullScaleMs * distance / policy_.fullDuty : 0;
+        steps_ = policy_.maxSegmentMs > 0 ? (totalMs + policy_.maxSegmentMs - 1) / policy_.maxSegmentMs : 1;
+        if (steps_ == 0)
+        {
+            steps_ = 1;
+        }
+        segmentMs_ = totalMs / steps_;
+        step_ = 0;
+    }
+
+    // Duty at the end of segment `step` of the current plan
+    uint32_t at(uint32_t step) const
+    {
+        if (step >= steps_)
+        {
+            return planGoal_;
+        }
+        float x = (float)step / steps_;
+        float y;
+        switch (policy_.curve)
+        {
+        case RAMP_EASE_IN:
+            y = x * x;
+            break;
+        case RAMP_EASE_OUT:
+            y = 1 - (1 - x) * (1 - x);
+            break;
+        case RAMP_EASE_IN_OUT:
+            y = x * x * (3 - 2 * x);
+            break;
+        default:
+            y = x;
+            break;
+        }
+        return (uint32_t)((float)from_ + ((float)planGoal_ - (float)from_) * y + 0.5f);
+    }
+
+    RampPolicy policy_;
+    uint32_t duty_ = 0;     // end of the running segment / at rest
+    uint32_t goal_ = 0;     // latest requested duty
+    uint32_t planGoal_ = 0; // goal the current plan heads for
+    uint32_t from_ = 0;     // duty the current plan started at
+    uint32_t steps_ = 0;
+    uint32_t step_ = 0;
+    uint32_t segmentMs_ = 0;
+    bool active_ = false;
+};
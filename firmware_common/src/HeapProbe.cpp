@@ -0,0 +1,121 @@
+#ifdef IOT_HEAP_CHECK
+
+#include "HeapProbe.h"
+
+#include <assert.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// =============================================================================
+// ALLOCATOR WRAPPERS (linked in with -Wl,--wrap=...)
+// =============================================================================
+
+static TaskHandle_t probedTask = nullptr;
+static uint32_t taskAllocs = 0;  // malloc/calloc/realloc calls
+static int32_t taskBalance = 0;  // live blocks (allocs - frees)
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+    void __real_free(void *ptr);
+
+    static inline bool onProbedTask()
+    {
+        return probedTask && xTaskGetCurrentTaskHandle() == probedTask;
+    }
+
+    void *__wrap_malloc(size_t size)
+    {
+        void *ptr = __real_malloc(size);
+        if (ptr && onProbedTask())
+        {
+            taskAllocs++;
+            taskBalance++;
+        }
+        return ptr;
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        void *ptr = __real_calloc(count, size);
+        if (ptr && onProbedTask())
+        {
+            taskAllocs++;
+            taskBalance++;
+        }
+        return ptr;
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        void *moved = __real_realloc(ptr, size);
+        if (onProbedTask())
+        {
+            taskAllocs++;
+            if (!ptr && moved)
+            {
+                taskBalance++;
+            }
+            else if (ptr && size == 0)
+            {
+                taskBalance--;
+            }
+        }
+        return moved;
+    }
+
+    void __wrap_free(void *ptr)
+    {
+        if (ptr && onProbedTask())
+        {
+            taskBalance--;
+        }
+        __real_free(ptr);
+    }
+}
+
+// =============================================================================
+// PROBE
+// =============================================================================
+
+void HeapProbe::attach()
+{
+    probedTask = xTaskGetCurrentTaskHandle();
+    Serial.printf("🧪 Heap probe armed on task %s\n", pcTaskGetName(probedTask));
+}
+
+void HeapProbe::begin()
+{
+    allocsAtBegin_ = taskAllocs;
+    balanceAtBegin_ = taskBalance;
+    freeHeapAtBegin_ = ESP.getFreeHeap();
+}
+
+void HeapProbe::end(bool steady)
+{
+    if (!steady)
+    {
+        steadyStreak_ = 0;
+        return;
+    }
+    if (steadyStreak_ < WARMUP_ITERATIONS)
+    {
+        steadyStreak_++;
+        return;
+    }
+
+    uint32_t allocs = taskAllocs - allocsAtBegin_;
+    int32_t balance = taskBalance - balanceAtBegin_;
+    if (allocs != 0 || balance != 0)
+    {
+        Serial.printf("❌ Heap probe: %lu allocs, balance %ld (free heap %lu -> %lu)\n",
+                      (unsigned long)allocs, (long)balance,
+                      (unsigned long)freeHeapAtBegin_, (unsigned long)ESP.getFreeHeap());
+        Serial.flush();
+    }
+    assert(allocs == 0 && balance == 0);
+}
+
+#endif // IOT_HEAP_CHECK
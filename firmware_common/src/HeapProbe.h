@@ -0,0 +1,47 @@
+/*
+ * HeapProbe - debug check that loop() runs without heap allocations
+ *
+ * Enabled by building with -DIOT_HEAP_CHECK and wrapping the allocator:
+ *
+ *   build_flags = -DIOT_HEAP_CHECK
+ *       -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+ *
+ * The wrappers count allocations and frees made from the task that called
+ * attach() (the task running the publish path). Other tasks - WiFi driver,
+ * lwIP, the sensor/actuator tasks - are ignored.
+ *
+ * end() asserts that a steady-state iteration (MQTT online at both ends, no
+ * reconnect in between) made zero allocations and left the task's net heap
+ * balance unchanged. A few iterations after every (re)connect are skipped:
+ * WiFiClient and PubSubClient allocate their buffers lazily on first use.
+ *
+ * Without IOT_HEAP_CHECK every method is an empty inline.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+class HeapProbe
+{
+public:
+#ifdef IOT_HEAP_CHECK
+    void attach();
+    void begin();
+    void end(bool steady);
+#else
+    void attach() {}
+    void begin() {}
+    void end(bool) {}
+#endif
+
+private:
+#ifdef IOT_HEAP_CHECK
+    static const uint8_t WARMUP_ITERATIONS = 3;
+
+    uint32_t allocsAtBegin_ = 0;
+    int32_t balanceAtBegin_ = 0;
+    uint32_t freeHeapAtBegin_ = 0;
+    uint8_t steadyStreak_ = 0;
+#endif
+};
@@ -0,0 +1,138 @@
+/*
+ * JsonArena - fixed static arena allocator for ArduinoJson 7
+ *
+ *   static JsonArena<4096> jsonArena;
+ *   JsonDocument doc(&jsonArena);
+ *
+ * Documents built on the hot path are short-lived and nested at most a couple
+ * of levels (e.g. a state publish from inside a command handler), so a bump
+ * allocator is enough:
+ * - allocate() carves blocks off the top of a static buffer,
+ * - freeing the most recent block pops it, and once every block has been
+ *   freed (all documents destroyed) the arena rewinds to empty,
+ * - reallocate() grows/shrinks the top block in place, which is what
+ *   ArduinoJson's string builder and shrinkToFit() do.
+ *
+ * When the arena is exhausted allocate() returns nullptr and ArduinoJson
+ * reports doc.overflowed(), exactly like an out-of-memory heap. The heap is
+ * never touched.
+ *
+ * Not thread-safe: use one arena per task.
+ */
+
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t N>
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override
+    {
+        size_t need = HEADER + align(size);
+        if (need > N - top_)
+        {
+            failures_++;
+            return nullptr;
+        }
+
+        uint8_t *block = buffer_ + top_;
+        setSize(block, size);
+        last_ = top_;
+        top_ += need;
+        outstanding_++;
+        if (top_ > highWater_)
+        {
+            highWater_ = top_;
+        }
+        return block + HEADER;
+    }
+
+    void deallocate(void *ptr) override
+    {
+        if (!ptr)
+        {
+            return;
+        }
+
+        if (--outstanding_ == 0)
+        {
+            top_ = 0;
+            last_ = NONE;
+        }
+        else if (blockOffset(ptr) == last_)
+        {
+            // Most recent block: give its space back immediately
+            top_ = last_;
+            last_ = NONE;
+        }
+    }
+
+    void *reallocate(void *ptr, size_t newSize) override
+    {
+        if (!ptr)
+        {
+            return allocate(newSize);
+        }
+
+        size_t offset = blockOffset(ptr);
+        if (offset == last_)
+        {
+            size_t need = HEADER + align(newSize);
+            if (need > N - offset)
+            {
+                failures_++;
+                return nullptr;
+            }
+            setSize(buffer_ + offset, newSize);
+            top_ = offset + need;
+            if (top_ > highWater_)
+            {
+                highWater_ = top_;
+            }
+            return ptr;
+        }
+
+        size_t oldSize = getSize(buffer_ + offset);
+        void *moved = allocate(newSize);
+        if (moved)
+        {
+            memcpy(moved, ptr, oldSize < newSize ? oldSize : newSize);
+            deallocate(ptr);
+        }
+        return moved;
+    }
+
+    size_t capacity() const { return N; }
+    size_t used() const { return top_; }
+    size_t highWater() const { return highWater_; }
+    uint32_t failures() const { return failures_; }
+
+private:
+    static constexpr size_t ALIGNMENT = 8;
+    static constexpr size_t HEADER = ALIGNMENT; // block size, padded to keep payload aligned
+    static constexpr size_t NONE = SIZE_MAX;
+
+    static size_t align(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    size_t blockOffset(void *ptr) const { return (uint8_t *)ptr - HEADER - buffer_; }
+
+    static void setSize(uint8_t *block, size_t size) { memcpy(block, &size, sizeof(size)); }
+    static size_t getSize(const uint8_t *block)
+    {
+        size_t size;
+        memcpy(&size, block, sizeof(size));
+        return size;
+    }
+
+    alignas(ALIGNMENT) uint8_t buffer_[N];
+    size_t top_ = 0;
+    size_t last_ = NONE;
+    size_t outstanding_ = 0;
+    size_t highWater_ = 0;
+    uint32_t failures_ = 0;
+};
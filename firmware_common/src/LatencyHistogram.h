@@ -0,0 +1,149 @@
+/*
+ * LatencyHistogram - fixed-size log-linear (HDR-style) histogram in µs
+ *
+ * Values below 8 us get one bucket each; above that every power of two is
+ * split into 8 linear sub-buckets, so a bucket is at most 12.5% wide. The
+ * range ends at 2^26 us (~67 s); larger values land in the last bucket.
+ * record() is a count-leading-zeros and an increment, cheap enough for every
+ * loop iteration; the 192 counters take 768 bytes.
+ *
+ * formatCounts() writes the dense bucket range as "[first,c,c,...]" so a
+ * host can rebuild the bucket bounds with the same formula (SUB_BITS = 3).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class LatencyHistogram
+{
+public:
+    static const uint8_t SUB_BITS = 3;
+    static const uint8_t MAX_BITS = 26;
+    static const size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * SUB_BUCKETS;
+
+    void record(uint32_t valueUs)
+    {
+        counts_[indexOf(valueUs)]++;
+        count_++;
+        if (valueUs > maxUs_)
+        {
+            maxUs_ = valueUs;
+        }
+    }
+
+    void reset()
+    {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        maxUs_ = 0;
+    }
+
+    uint32_t count() const { return count_; }
+    uint32_t maxUs() const { return maxUs_; }
+
+    // Upper bound of the bucket holding the p-th percentile (0-100], capped at max
+    uint32_t percentile(float p) const
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+        uint32_t rank = (uint32_t)(p / 100.0f * count_ + 0.999f);
+        if (rank == 0)
+        {
+            rank = 1;
+        }
+        uint32_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+            {
+                uint32_t upper = upperBound(i);
+                return upper < maxUs_ ? upper : maxUs_;
+            }
+        }
+        return maxUs_;
+    }
+
+    // "[first,c,c,...]" from the first to the last non-empty bucket; 0 if it
+    // does not fit (out is then left empty)
+    size_t formatCounts(char *out, size_t size) const
+    {
+        size_t first = 0;
+        size_t last = BUCKETS;
+        while (first < BUCKETS && counts_[first] == 0)
+        {
+            first++;
+        }
+        while (last > first && counts_[last - 1] == 0)
+        {
+            last--;
+        }
+
+        int written = snprintf(out, size, "[%u", (unsigned)(first < BUCKETS ? first : 0));
+        size_t length = written > 0 ? (size_t)written : size;
+        for (size_t i = first; i < last && length < size; i++)
+        {
+            written = snprintf(out + length, size - length, ",%lu", (unsigned long)counts_[i]);
+            length += written > 0 ? (size_t)written : size;
+        }
+        if (length + 1 >= size)
+        {
+            if (size > 0)
+            {
+                out[0] = '\0';
+            }
+            return 0;
+        }
+        out[length++] = ']';
+        out[length] = '\0';
+        return length;
+    }
+
+    static size_t indexOf(uint32_t valueUs)
+    {
+        if (valueUs < SUB_BUCKETS)
+        {
+            return valueUs;
+        }
+        uint32_t exponent = 31 - __builtin_clz(valueUs);
+        if (exponent >= MAX_BITS)
+        {
+            return BUCKETS - 1;
+        }
+        uint32_t sub = (valueUs >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return SUB_BUCKETS + (exponent - SUB_BITS) * SUB_BUCKETS + sub;
+    }
+
+    static uint32_t lowerBound(size_t index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        uint32_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        uint32_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+        return (uint32_t)(SUB_BUCKETS + sub) << shift;
+    }
+
+    static uint32_t upperBound(size_t index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        uint32_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        return lowerBound(index) + (1UL << shift) - 1;
+    }
+
+private:
+    uint32_t counts_[BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t maxUs_ = 0;
+};
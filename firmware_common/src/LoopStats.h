@@ -0,0 +1,79 @@
+/*
+ * LoopStats - loop() iteration latency counters
+ *
+ * Wrap the body of loop() with begin()/end() and the worst-case iteration
+ * time is tracked both since boot and for the current reporting window.
+ * Every iteration also lands in histogram(), which the sys/metrics publisher
+ * reads and resets together with busyUs() (time spent inside iterations,
+ * i.e. the task's CPU share once divided by the window). Costs two micros()
+ * reads and a bucket increment per iteration; report() formats on the stack
+ * so it stays allocation-free.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <LatencyHistogram.h>
+
+class LoopStats
+{
+public:
+    void begin()
+    {
+        startUs_ = micros();
+    }
+
+    void end()
+    {
+        uint32_t elapsed = micros() - startUs_;
+        iterations_++;
+        totalUs_ += elapsed;
+        busyUs_ += elapsed;
+        histogram_.record(elapsed);
+        if (elapsed > windowMaxUs_)
+        {
+            windowMaxUs_ = elapsed;
+        }
+        if (elapsed > maxUs_)
+        {
+            maxUs_ = elapsed;
+        }
+    }
+
+    uint32_t maxUs() const { return maxUs_; }
+    uint32_t windowMaxUs() const { return windowMaxUs_; }
+    uint32_t iterations() const { return iterations_; }
+    uint32_t avgUs() const { return iterations_ ? (uint32_t)(totalUs_ / iterations_) : 0; }
+
+    // Iteration times and busy time since the caller last reset them
+    const LatencyHistogram &histogram() const { return histogram_; }
+    uint64_t busyUs() const { return busyUs_; }
+    void resetHistogram()
+    {
+        histogram_.reset();
+        busyUs_ = 0;
+    }
+
+    // Prints the window summary and starts a new window.
+    void report(const char *label)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "⏱️  %s: max %lu us (window %lu us), avg %lu us over %lu iterations",
+                 label,
+                 (unsigned long)maxUs_,
+                 (unsigned long)windowMaxUs_,
+                 (unsigned long)avgUs(),
+                 (unsigned long)iterations_);
+        Serial.println(line);
+        windowMaxUs_ = 0;
+    }
+
+private:
+    uint32_t startUs_ = 0;
+    uint32_t maxUs_ = 0;
+    uint32_t windowMaxUs_ = 0;
+    uint32_t iterations_ = 0;
+    uint64_t totalUs_ = 0;
+    uint64_t busyUs_ = 0;
+    LatencyHistogram histogram_;
+};
@@ -0,0 +1,73 @@
+#include "LoopWaker.h"
+
+#include <esp_vfs_eventfd.h>
+#include <lwip/sockets.h>
+
+bool LoopWaker::begin()
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err = esp_vfs_eventfd_register(&config);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // already registered is fine
+    {
+        Serial.printf("⚠️  eventfd unavailable (%d), polling every %lu ms\n", (int)err,
+                      (unsigned long)FALLBACK_POLL_MS);
+        return false;
+    }
+    eventFd_ = eventfd(0, 0);
+    return eventFd_ >= 0;
+}
+
+void LoopWaker::wake()
+{
+    if (eventFd_ >= 0)
+    {
+        uint64_t one = 1;
+        write(eventFd_, &one, sizeof(one));
+    }
+}
+
+LoopWaker::Reason LoopWaker::wait(int socketFd, uint32_t timeoutMs, bool writable)
+{
+    if (eventFd_ < 0)
+    {
+        vTaskDelay(pdMS_TO_TICKS(timeoutMs < FALLBACK_POLL_MS ? timeoutMs : FALLBACK_POLL_MS));
+        counts_[TIMEOUT]++;
+        return TIMEOUT;
+    }
+
+    fd_set readable;
+    fd_set sendable;
+    FD_ZERO(&readable);
+    FD_ZERO(&sendable);
+    FD_SET(eventFd_, &readable);
+    int maxFd = eventFd_;
+    if (socketFd >= 0)
+    {
+        FD_SET(socketFd, &readable);
+        if (writable)
+        {
+            FD_SET(socketFd, &sendable);
+        }
+        maxFd = max(maxFd, socketFd);
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    int ready = select(maxFd + 1, &readable, &sendable, nullptr, &timeout);
+
+    Reason reason = TIMEOUT;
+    if (ready > 0 && FD_ISSET(eventFd_, &readable))
+    {
+        // Reading resets the counter: any number of wake() calls is one wake-up
+        uint64_t count;
+        read(eventFd_, &count, sizeof(count));
+        reason = WOKEN;
+    }
+    else if (ready > 0)
+    {
+        reason = SOCKET;
+    }
+    counts_[reason]++;
+    return reason;
+}
@@ -0,0 +1,56 @@
+/*
+ * LoopWaker - tickless wait for the network task
+ *
+ * Instead of waking every few ms to poll, the network task sleeps in one
+ * select() until whichever comes first:
+ *
+ * - its next timer deadline (heartbeat, metrics, NetLink retry, ...),
+ * - the MQTT socket becoming readable (a command, a PINGRESP, a PUBACK), or
+ *   writable when the caller's send buffer was full (see MqttOutbox),
+ * - wake() from another task or the WiFi event task (a sample was queued,
+ *   the actuator changed state, WiFi came up or went down).
+ *
+ * wake() writes an eventfd (esp_vfs_eventfd), which is what lets select()
+ * wait on the socket and on task events at once. Between wake-ups no task
+ * is runnable, so FreeRTOS idles and the power manager can drop into light
+ * sleep (see initPower() in the firmwares).
+ *
+ * If the eventfd cannot be created, wait() falls back to sleeping at most
+ * FALLBACK_POLL_MS, i.e. the old fixed-interval polling.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+class LoopWaker
+{
+public:
+    enum Reason : uint8_t
+    {
+        TIMEOUT, // deadline reached
+        WOKEN,   // wake() was called
+        SOCKET   // socket readable
+    };
+
+    bool begin();
+
+    // Any task (not an ISR). Wakes the pending or the next wait().
+    void wake();
+
+    // Sleeps until wake(), socketFd readable (-1: none) or timeoutMs;
+    // writable too when the caller has data the socket did not take
+    Reason wait(int socketFd, uint32_t timeoutMs, bool writable = false);
+
+    // Wake-ups by reason since resetCounts()
+    uint32_t timeouts() const { return counts_[TIMEOUT]; }
+    uint32_t wakes() const { return counts_[WOKEN]; }
+    uint32_t socketWakes() const { return counts_[SOCKET]; }
+    void resetCounts() { counts_[TIMEOUT] = counts_[WOKEN] = counts_[SOCKET] = 0; }
+
+private:
+    static const uint32_t FALLBACK_POLL_MS = 10;
+
+    int eventFd_ = -1;
+    uint32_t counts_[3] = {};
+};
@@ -0,0 +1,528 @@
+/*
+ * MqttOutbox - pipelined, non-blocking publishes next to PubSubClient
+ *
+ * PubSubClient 2.8 publishes at QoS0 only, through its one packet buffer,
+ * and a socket write waits (up to its timeout) for a peer that stops
+ * reading. The outbox takes over the publish path; PubSubClient keeps
+ * CONNECT, SUBSCRIBE, keepalive and incoming messages:
+ *
+ *   publish()  encode the PUBLISH packet into a bounded byte ring (false when
+ *              the ring is full: the caller journals or retries, nothing waits)
+ *   transmit() write queued packets without blocking (TlsClient::sendSome(),
+ *              a TLS record or a MSG_DONTWAIT send()) while the socket takes
+ *              them; a partly written packet continues on the next call
+ *   QoS1       at most `window` packets await their PUBACK (packet ids from
+ *              0x8000 up, PubSubClient numbers its SUBSCRIBEs from 1); a
+ *              packet leaves the ring once acknowledged, QoS0 once written
+ *
+ * The outbox is also the Client PubSubClient runs on: every call is passed
+ * to the TlsClient (plain TCP unless TLS is on), PubSubClient's own packets
+ * wait until a partly written PUBLISH is complete, and the bytes it reads
+ * go through a small MQTT framing parser that picks out PUBACKs
+ * (PubSubClient drops them).
+ *
+ *   WiFiClient espClient;
+ *   TlsClient mqttTls(espClient);
+ *   MqttOutbox<4096, 16> mqttOutbox(mqttTls, 8);
+ *   PubSubClient mqttClient(mqttOutbox);
+ *
+ * sessionStarted() goes first in the MQTT connected callback: packets still
+ * awaiting a PUBACK are sent again with the DUP flag (a persistent session
+ * expects that), the rest of the queue follows. Messages queued while the
+ * link was down are therefore not lost, but publish() itself refuses new
+ * ones until the session is back.
+ *
+ * backpressure() turns on at 3/4 of the ring (bytes or packets) and off at
+ * 1/4; producers on other tasks read it to slow down. The acknowledgement
+ * round trip of every QoS1 packet goes into ackRttUs().
+ *
+ * Network task only, except backpressure(). Static storage, no heap.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "LatencyHistogram.h"
+#include "TlsClient.h"
+
+template <size_t BYTES, size_t SLOTS>
+class MqttOutbox : public Client
+{
+    static_assert(BYTES >= 64 && BYTES <= 65535, "MqttOutbox ring holds 64 B - 64 KB");
+    static_assert(SLOTS >= 2 && SLOTS <= 256 && (SLOTS & (SLOTS - 1)) == 0, "MqttOutbox slots: power of two");
+
+public:
+    // window: QoS1 packets awaiting a PUBACK at once (1 = stop-and-wait)
+    MqttOutbox(TlsClient &link, uint8_t window)
+        : link_(link), window_(window == 0 ? 1 : window < SLOTS ? window : SLOTS)
+    {
+    }
+
+    // Queues one PUBLISH and sends what the socket takes. False while the
+    // session is down or when the ring is full (counted in rejected())
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained, uint8_t qos)
+    {
+        if (!sessionUp_)
+        {
+            return false;
+        }
+        qos = qos > 0 ? 1 : 0;
+        size_t topicLength = strlen(topic);
+        size_t remaining = 2 + topicLength + (qos ? 2 : 0) + length;
+        size_t total = 1 + lengthBytes(remaining) + remaining;
+        if (total > BYTES - (byteHead_ - byteTail_) || head_ - tail_ == SLOTS)
+        {
+            rejected_++;
+            updateBackpressure();
+            return false;
+        }
+
+        Entry &entry = entries_[head_ & (SLOTS - 1)];
+        entry.start = byteHead_;
+        entry.length = (uint16_t)total;
+        entry.packetId = qos ? nextPacketId() : 0;
+        entry.qos = qos;
+        entry.done = false;
+        entry.sentUs = 0;
+
+        uint8_t header[7];
+        size_t n = 0;
+        header[n++] = (uint8_t)(0x30 | (qos << 1) | (retained ? 1 : 0));
+        for (size_t value = remaining;;)
+        {
+            header[n++] = (uint8_t)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+            value >>= 7;
+            if (value == 0)
+            {
+                break;
+            }
+        }
+        header[n++] = (uint8_t)(topicLength >> 8);
+        header[n++] = (uint8_t)topicLength;
+        put(header, n);
+        put((const uint8_t *)topic, topicLength);
+        if (qos)
+        {
+            uint8_t id[2] = {(uint8_t)(entry.packetId >> 8), (uint8_t)entry.packetId};
+            put(id, sizeof(id));
+        }
+        put(payload, length);
+        head_++;
+
+        size_t depth = head_ - tail_;
+        if (depth > depthMax_)
+        {
+            depthMax_ = depth;
+        }
+        transmit();
+        return true;
+    }
+
+    // Sends queued packets until the window is full, the socket would block
+    // or nothing is left. Call after the MQTT client read (acks free the
+    // window) and whenever the socket became writable
+    void transmit()
+    {
+        stalled_ = false;
+        if (sessionUp_ && !link_.connected())
+        {
+            endSession();
+        }
+        while (sessionUp_ && next_ != head_)
+        {
+            Entry &entry = entries_[next_ & (SLOTS - 1)];
+            if (entry.done) // acknowledged before a reconnect: not sent again
+            {
+                next_++;
+                continue;
+            }
+            if (entry.qos && partial_ == 0 && inFlight_ >= window_)
+            {
+                break; // next PUBACK (socket readable) frees a slot
+            }
+            if (!writeEntry(entry))
+            {
+                break;
+            }
+            if (entry.qos)
+            {
+                entry.sentUs = micros();
+                inFlight_++;
+            }
+            else
+            {
+                entry.done = true;
+            }
+            sent_++;
+            next_++;
+        }
+        // A TLS record taken whole but not on the socket yet (the last one
+        // written, or one left while the window was full)
+        if (sessionUp_ && !stalled_ && !link_.sendPending())
+        {
+            stalled_ = true;
+        }
+        release();
+        updateBackpressure();
+    }
+
+    // First thing in the MQTT connected callback: resend what was in flight
+    void sessionStarted()
+    {
+        sessionUp_ = true;
+        partial_ = 0;
+        inFlight_ = 0;
+        for (size_t i = tail_; i != next_; i++)
+        {
+            Entry &entry = entries_[i & (SLOTS - 1)];
+            if (!entry.done)
+            {
+                bytes_[entry.start % BYTES] |= 0x08; // DUP
+                resent_++;
+            }
+        }
+        next_ = tail_;
+        transmit();
+    }
+
+    // Producers on any task: the ring is filling up, hold back
+    bool backpressure() const { return backpressure_.load(std::memory_order_relaxed); }
+
+    // The socket could not take everything: wait for it to be writable
+    bool stalled() const { return stalled_; }
+    // The socket filled up inside a PUBLISH (the rest goes out first)
+    bool partlyWritten() const { return partial_ > 0; }
+
+    size_t queued() const { return head_ - next_; }  // not written yet
+    size_t pending() const { return head_ - tail_; } // queued + in flight
+    size_t pendingBytes() const { return byteHead_ - byteTail_; }
+    size_t inFlight() const { return inFlight_; }
+    uint8_t window() const { return window_; }
+    static constexpr size_t capacity() { return SLOTS; }
+    static constexpr size_t capacityBytes() { return BYTES; }
+
+    // Counters, depthMax() and ackRttUs() until resetStats()
+    size_t depthMax() const { return depthMax_; }
+    uint32_t sent() const { return sent_; }
+    uint32_t acked() const { return acked_; }
+    uint32_t resent() const { return resent_; }     // DUP after a reconnect
+    uint32_t rejected() const { return rejected_; } // ring full
+    uint32_t backpressureEvents() const { return backpressureEvents_; }
+    const LatencyHistogram &ackRttUs() const { return ackRtt_; }
+    void resetStats()
+    {
+        depthMax_ = head_ - tail_;
+        sent_ = acked_ = resent_ = rejected_ = backpressureEvents_ = 0;
+        ackRtt_.reset();
+    }
+
+    // Client: PubSubClient's transport, passed to the TlsClient. A new
+    // connection never continues a PUBLISH cut off on the old one: that
+    // entry goes out whole after sessionStarted()
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        endSession();
+        return link_.connect(ip, port);
+    }
+    int connect(const char *host, uint16_t port) override
+    {
+        endSession();
+        return link_.connect(host, port);
+    }
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) override
+    {
+        endSession();
+        return link_.connect(ip, port, timeout);
+    }
+    int connect(const char *host, uint16_t port, int32_t timeout) override
+    {
+        endSession();
+        return link_.connect(host, port, timeout);
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        // Never inside a PUBLISH: finish it, blocking like PubSubClient
+        // would. Outside a session (CONNECT on a new connection) the rest
+        // of an old PUBLISH is dropped instead
+        if (partial_ > 0 && !sessionUp_)
+        {
+            partial_ = 0;
+        }
+        if (partial_ > 0)
+        {
+            Entry &entry = entries_[next_ & (SLOTS - 1)];
+            if (!finishEntry(entry))
+            {
+                return 0;
+            }
+        }
+        return link_.write(buffer, size);
+    }
+    int available() override { return link_.available(); }
+    int read() override
+    {
+        int c = link_.read();
+        if (c >= 0)
+        {
+            parse((uint8_t)c);
+        }
+        return c;
+    }
+    int read(uint8_t *buffer, size_t size) override
+    {
+        int n = link_.read(buffer, size);
+        for (int i = 0; i < n; i++)
+        {
+            parse(buffer[i]);
+        }
+        return n;
+    }
+    int peek() override { return link_.peek(); }
+    void flush() override { link_.flush(); }
+    void stop() override
+    {
+        endSession();
+        link_.stop();
+    }
+    uint8_t connected() override { return link_.connected(); }
+    operator bool() override { return link_.connected(); }
+    using Print::write;
+
+private:
+    enum : uint8_t
+    {
+        PUBACK = 4 // MQTT control packet type
+    };
+    enum ParseStage : uint8_t
+    {
+        PACKET_TYPE,
+        PACKET_LENGTH,
+        PACKET_BODY
+    };
+
+    struct Entry
+    {
+        size_t start;      // byte counter of the first byte
+        uint16_t length;   // whole packet
+        uint16_t packetId; // QoS1, else 0
+        uint8_t qos;
+        bool done;         // QoS0 written / QoS1 acknowledged
+        uint32_t sentUs;   // micros() when fully written
+    };
+
+    static size_t lengthBytes(size_t remaining)
+    {
+        return remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4;
+    }
+
+    uint16_t nextPacketId()
+    {
+        packetId_ = packetId_ == 0xFFFF ? 0x8000 : packetId_ + 1;
+        return packetId_;
+    }
+
+    void put(const uint8_t *data, size_t length)
+    {
+        size_t at = byteHead_ % BYTES;
+        size_t first = length < BYTES - at ? length : BYTES - at;
+        memcpy(bytes_ + at, data, first);
+        memcpy(bytes_, data + first, length - first);
+        byteHead_ += length;
+    }
+
+    // The connection is gone: nothing more goes out on it (PubSubClient's
+    // CONNECT starts the next one, sessionStarted() resends the entries)
+    void endSession()
+    {
+        sessionUp_ = false;
+        stalled_ = false;
+        partial_ = 0;
+    }
+
+    // Continues the entry at partial_; true once all of it is written
+    bool writeEntry(Entry &entry)
+    {
+        while (partial_ < entry.length)
+        {
+            size_t at = (entry.start + partial_) % BYTES;
+            size_t chunk = entry.length - partial_;
+            if (chunk > BYTES - at)
+            {
+                chunk = BYTES - at;
+            }
+            int n = link_.sendSome(bytes_ + at, chunk);
+            if (n <= 0)
+            {
+                // Send buffer full: retry (the same bytes) when writable. An
+                // error is a dead connection, which NetLink notices and reconnects
+                stalled_ = n == 0;
+                return false;
+            }
+            partial_ += n;
+        }
+        partial_ = 0;
+        return true;
+    }
+
+    // Rest of a partly written entry, through the (blocking) Client write
+    bool finishEntry(Entry &entry)
+    {
+        while (partial_ < entry.length)
+        {
+            size_t at = (entry.start + partial_) % BYTES;
+            size_t chunk = entry.length - partial_;
+            if (chunk > BYTES - at)
+            {
+                chunk = BYTES - at;
+            }
+            size_t n = link_.write(bytes_ + at, chunk);
+            if (n == 0)
+            {
+                return false;
+            }
+            partial_ += n;
+        }
+        partial_ = 0;
+        if (entry.qos)
+        {
+            entry.sentUs = micros();
+            inFlight_++;
+        }
+        else
+        {
+            entry.done = true;
+        }
+        sent_++;
+        next_++;
+        return true;
+    }
+
+    // Frees acknowledged / written packets from the front of the ring
+    void release()
+    {
+        while (tail_ != next_ && entries_[tail_ & (SLOTS - 1)].done)
+        {
+            byteTail_ += entries_[tail_ & (SLOTS - 1)].length;
+            tail_++;
+        }
+    }
+
+    void acknowledged(uint16_t packetId)
+    {
+        for (size_t i = tail_; i != next_; i++)
+        {
+            Entry &entry = entries_[i & (SLOTS - 1)];
+            if (entry.qos && !entry.done && entry.packetId == packetId)
+            {
+                entry.done = true;
+                inFlight_--;
+                acked_++;
+                ackRtt_.record(micros() - entry.sentUs);
+                release();
+                return;
+            }
+        }
+        // A PUBACK for a packet sent again after a reconnect, already released
+    }
+
+    // Incoming bytes, one MQTT packet after the other: PUBACK ids only
+    void parse(uint8_t c)
+    {
+        int fd = link_.fd();
+        if (fd != rxFd_) // NetLink handed over a new connection
+        {
+            rxFd_ = fd;
+            rxStage_ = PACKET_TYPE;
+        }
+        switch (rxStage_)
+        {
+        case PACKET_TYPE:
+            rxType_ = c >> 4;
+            rxRemaining_ = 0;
+            rxShift_ = 0;
+            rxStage_ = PACKET_LENGTH;
+            break;
+
+        case PACKET_LENGTH:
+            rxRemaining_ |= (uint32_t)(c & 0x7F) << rxShift_;
+            rxShift_ += 7;
+            if (!(c & 0x80))
+            {
+                rxIndex_ = 0;
+                rxPacketId_ = 0;
+                rxStage_ = rxRemaining_ > 0 ? PACKET_BODY : PACKET_TYPE;
+            }
+            break;
+
+        case PACKET_BODY:
+            if (rxIndex_ < 2)
+            {
+                rxPacketId_ = (uint16_t)(rxPacketId_ << 8 | c);
+            }
+            if (++rxIndex_ == rxRemaining_)
+            {
+                if (rxType_ == PUBACK)
+                {
+                    acknowledged(rxPacketId_);
+                }
+                rxStage_ = PACKET_TYPE;
+            }
+            break;
+        }
+    }
+
+    void updateBackpressure()
+    {
+        size_t bytes = byteHead_ - byteTail_;
+        size_t slots = head_ - tail_;
+        bool on = backpressure_.load(std::memory_order_relaxed);
+        if (!on && (bytes >= BYTES * 3 / 4 || slots >= SLOTS * 3 / 4))
+        {
+            backpressure_.store(true, std::memory_order_relaxed);
+            backpressureEvents_++;
+        }
+        else if (on && bytes <= BYTES / 4 && slots <= SLOTS / 4)
+        {
+            backpressure_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    TlsClient &link_;
+    uint8_t window_;
+
+    uint8_t bytes_[BYTES];
+    size_t byteHead_ = 0; // free-running byte counters
+    size_t byteTail_ = 0;
+    Entry entries_[SLOTS];
+    size_t head_ = 0; // next free entry
+    size_t next_ = 0; // next entry to write
+    size_t tail_ = 0; // oldest entry still held
+    size_t partial_ = 0; // bytes of entries_[next_] already written
+    size_t inFlight_ = 0;
+    uint16_t packetId_ = 0xFFFF;
+    bool sessionUp_ = false;
+    bool stalled_ = false;
+    std::atomic<bool> backpressure_{false};
+
+    ParseStage rxStage_ = PACKET_TYPE;
+    int rxFd_ = -1;
+    uint8_t rxType_ = 0;
+    uint8_t rxShift_ = 0;
+    uint32_t rxRemaining_ = 0;
+    uint32_t rxIndex_ = 0;
+    uint16_t rxPacketId_ = 0;
+
+    size_t depthMax_ = 0;
+    uint32_t sent_ = 0;
+    uint32_t acked_ = 0;
+    uint32_t resent_ = 0;
+    uint32_t rejected_ = 0;
+    uint32_t backpressureEvents_ = 0;
+    LatencyHistogram ackRtt_;
+};
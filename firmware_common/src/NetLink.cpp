@@ -0,0 +1,548 @@
+#include "NetLink.h"
+
+#include <lwip/sockets.h>
+
+#include "TlsClient.h"
+
+// NVS namespace of the AP cache; written only when the AP or lease changes
+static const char *const AP_CACHE_NAMESPACE = "netlink";
+
+NetLink::NetLink(WiFiClient &tcp, PubSubClient &mqtt)
+    : tcp_(tcp), mqtt_(mqtt), apStore_(AP_CACHE_NAMESPACE, PersistPolicy{0, 0})
+{
+}
+
+// =============================================================================
+// PUBLIC API
+// =============================================================================
+
+void NetLink::begin(const NetLinkConfig &config, ConnectedCallback onConnected)
+{
+    config_ = config;
+    onConnected_ = onConnected;
+    wifiBackoffMs_ = config_.backoffMinMs;
+    mqttBackoffMs_ = config_.backoffMinMs;
+
+    if (config_.fastConnect)
+    {
+        apKnown_ = apStore_.begin(ap_) && ap_.channel != 0;
+    }
+
+    // We own the retry policy; the core's built-in auto-reconnect would race
+    // with the state machine from the event task. The WiFi driver's own
+    // config copy in flash would only cost a write per boot.
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info)
+                 { onWiFiEvent(event, info); });
+
+    Serial.printf("🔌 Connecting to WiFi: %s\n", config_.wifiSsid);
+    startWiFi(millis());
+}
+
+void NetLink::poll(uint32_t nowMs)
+{
+    handleEvents(nowMs);
+
+    switch (state_)
+    {
+    case State::WIFI_BACKOFF:
+        if ((int32_t)(nowMs - retryAt_) >= 0)
+        {
+            startWiFi(nowMs);
+        }
+        break;
+
+    case State::WIFI_CONNECTING:
+        if (nowMs - stateSince_ >= wifiTimeoutMs())
+        {
+            if (fastAttempt_)
+            {
+                dropCache("cached AP timed out", nowMs);
+                break;
+            }
+            Serial.println("⚠️  WiFi connect timed out");
+            WiFi.disconnect();
+            scheduleRetry(State::WIFI_BACKOFF, wifiBackoffMs_, nowMs);
+        }
+        break;
+
+    case State::MQTT_BACKOFF:
+        if ((int32_t)(nowMs - retryAt_) >= 0)
+        {
+            startTcpConnect(nowMs);
+        }
+        break;
+
+    case State::MQTT_CONNECTING:
+        if (handshaking_)
+        {
+            pollTlsHandshake(nowMs);
+        }
+        else
+        {
+            pollTcpConnect(nowMs);
+        }
+        break;
+
+    case State::ONLINE:
+        mqtt_.loop();
+        if (!mqtt_.connected())
+        {
+            Serial.printf("⚠️  MQTT connection lost, rc=%d\n", mqtt_.state());
+            tcp_.stop();
+            scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+        }
+        break;
+    }
+}
+
+uint32_t NetLink::nextPollMs(uint32_t nowMs) const
+{
+    if (pendingEvents_.load() != 0)
+    {
+        return 0;
+    }
+
+    int32_t remaining = 0;
+    switch (state_)
+    {
+    case State::WIFI_BACKOFF:
+    case State::MQTT_BACKOFF:
+        remaining = (int32_t)(retryAt_ - nowMs);
+        break;
+    case State::WIFI_CONNECTING:
+        remaining = (int32_t)(stateSince_ + wifiTimeoutMs() - nowMs);
+        break;
+    case State::MQTT_CONNECTING:
+        return CONNECT_POLL_MS;
+    case State::ONLINE:
+        return config_.idlePollMs;
+    }
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+const char *NetLink::stateName(State state)
+{
+    switch (state)
+    {
+    case State::WIFI_BACKOFF:
+        return "wifi_backoff";
+    case State::WIFI_CONNECTING:
+        return "wifi_connecting";
+    case State::MQTT_BACKOFF:
+        return "mqtt_backoff";
+    case State::MQTT_CONNECTING:
+        return "mqtt_connecting";
+    case State::ONLINE:
+        return "online";
+    }
+    return "unknown";
+}
+
+// =============================================================================
+// WIFI EVENTS
+// =============================================================================
+
+// Runs on the system event task: only record what happened.
+void NetLink::onWiFiEvent(arduino_event_id_t event, arduino_event_info_t)
+{
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+        associatedAt_.store(millis());
+        return; // GOT_IP follows, nothing to do before it
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        gotIpAt_.store(millis());
+        pendingEvents_.fetch_or(EV_GOT_IP);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        pendingEvents_.fetch_or(EV_DISCONNECTED);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        pendingEvents_.fetch_or(EV_LOST_IP);
+        break;
+    default:
+        return;
+    }
+
+    if (wake_)
+    {
+        wake_();
+    }
+}
+
+void NetLink::handleEvents(uint32_t nowMs)
+{
+    uint32_t events = pendingEvents_.exchange(0);
+    if (events == 0)
+    {
+        return;
+    }
+
+    // Both edges in one poll: the driver status tells us which came last.
+    bool down = events & (EV_DISCONNECTED | EV_LOST_IP);
+    bool up = events & EV_GOT_IP;
+    if (down && up)
+    {
+        down = WiFi.status() != WL_CONNECTED;
+        up = !down;
+    }
+
+    if (down)
+    {
+        if (state_ == State::WIFI_CONNECTING && fastAttempt_)
+        {
+            dropCache("cached AP did not answer", nowMs);
+        }
+        else if (state_ == State::WIFI_CONNECTING)
+        {
+            Serial.println("⚠️  WiFi association failed");
+            scheduleRetry(State::WIFI_BACKOFF, wifiBackoffMs_, nowMs);
+        }
+        else if (wifiUp())
+        {
+            Serial.println("⚠️  WiFi disconnected, reconnecting...");
+            closeSocket();
+            dropTcp();
+            scheduleRetry(State::WIFI_BACKOFF, wifiBackoffMs_, nowMs);
+        }
+    }
+    else if (up && !wifiUp())
+    {
+        Serial.printf("✅ WiFi connected! IP: %s, RSSI: %d dBm%s\n",
+                      WiFi.localIP().toString().c_str(), WiFi.RSSI(),
+                      staticIp_ ? " (cached lease)" : fastAttempt_ ? " (cached AP)" : "");
+        if (wifiEverUp_)
+        {
+            wifiReconnects_++;
+        }
+        else
+        {
+            bootTimes_.ipMs = gotIpAt_.load();
+            bootTimes_.wifiMs = associatedAt_.load();
+            if (bootTimes_.wifiMs == 0) // CONNECTED not reported
+            {
+                bootTimes_.wifiMs = bootTimes_.ipMs;
+            }
+            bootTimes_.cachedAp = fastAttempt_;
+            bootTimes_.cachedIp = staticIp_;
+        }
+        wifiEverUp_ = true;
+        wifiBackoffMs_ = config_.backoffMinMs;
+
+        // Go straight for the broker, no need to wait a backoff period.
+        retryAt_ = nowMs;
+        enter(State::MQTT_BACKOFF, nowMs);
+    }
+}
+
+void NetLink::startWiFi(uint32_t nowMs)
+{
+    // Drop stale edges (e.g. the DISCONNECTED our own timeout triggered).
+    pendingEvents_.store(0);
+
+    fastAttempt_ = apKnown_ && !cacheFailed_;
+    bool staticIp = fastAttempt_ && useCachedIp();
+    if (staticIp)
+    {
+        WiFi.config(IPAddress(ap_.ip), IPAddress(ap_.gateway), IPAddress(ap_.subnet), IPAddress(ap_.dns));
+    }
+    else if (staticIp_)
+    {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // back to DHCP
+    }
+    staticIp_ = staticIp;
+
+    if (fastAttempt_)
+    {
+        WiFi.begin(config_.wifiSsid, config_.wifiPassword, ap_.channel, ap_.bssid);
+    }
+    else
+    {
+        WiFi.begin(config_.wifiSsid, config_.wifiPassword);
+    }
+    enter(State::WIFI_CONNECTING, nowMs);
+}
+
+uint32_t NetLink::wifiTimeoutMs() const
+{
+    return fastAttempt_ ? config_.fastConnectTimeoutMs : config_.wifiConnectTimeoutMs;
+}
+
+bool NetLink::useCachedIp() const
+{
+    return config_.reuseIpLease && ap_.ip != 0 && ap_.subnet != 0;
+}
+
+// The cached AP or lease failed: scan + DHCP right away, no backoff
+void NetLink::dropCache(const char *why, uint32_t nowMs)
+{
+    Serial.printf("⚠️  WiFi fast connect failed (%s), scanning\n", why);
+    cacheFailed_ = true;
+    cacheFallbacks_++;
+    closeSocket();
+    dropTcp();
+    WiFi.disconnect();
+    retryAt_ = nowMs;
+    enter(State::WIFI_BACKOFF, nowMs);
+}
+
+// Called once the broker answered: this AP and lease are worth reusing.
+// PersistedState only writes when they differ from what NVS holds.
+void NetLink::rememberAp(uint32_t nowMs)
+{
+    cacheFailed_ = false;
+    if (!config_.fastConnect)
+    {
+        return;
+    }
+
+    ApCache current = {};
+    const uint8_t *bssid = WiFi.BSSID();
+    if (bssid == nullptr)
+    {
+        return;
+    }
+    memcpy(current.bssid, bssid, sizeof(current.bssid));
+    current.channel = (uint8_t)WiFi.channel();
+    current.ip = (uint32_t)WiFi.localIP();
+    current.gateway = (uint32_t)WiFi.gatewayIP();
+    current.subnet = (uint32_t)WiFi.subnetMask();
+    current.dns = (uint32_t)WiFi.dnsIP();
+
+    ap_ = current;
+    apKnown_ = current.channel != 0;
+    apStore_.update(current, nowMs);
+    apStore_.flush(nowMs);
+}
+
+// =============================================================================
+// MQTT CONNECT
+// =============================================================================
+
+bool NetLink::resolveBroker()
+{
+    if (brokerResolved_)
+    {
+        return true;
+    }
+
+    if (!brokerIp_.fromString(config_.mqttHost) &&
+        WiFi.hostByName(config_.mqttHost, brokerIp_) != 1)
+    {
+        Serial.printf("❌ Cannot resolve MQTT host: %s\n", config_.mqttHost);
+        return false;
+    }
+
+    mqtt_.setServer(brokerIp_, config_.mqttPort);
+    brokerResolved_ = true;
+    return true;
+}
+
+void NetLink::startTcpConnect(uint32_t nowMs)
+{
+    if (!resolveBroker())
+    {
+        scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+        return;
+    }
+
+    Serial.printf("🔄 Connecting to MQTT broker: %s:%d\n", config_.mqttHost, config_.mqttPort);
+
+    closeSocket();
+    dropTcp();
+    handshaking_ = false;
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+    {
+        Serial.printf("❌ socket() failed, errno=%d\n", errno);
+        scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config_.mqttPort);
+    addr.sin_addr.s_addr = (uint32_t)brokerIp_;
+
+    connectFd_ = fd;
+    enter(State::MQTT_CONNECTING, nowMs);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        Serial.printf("❌ TCP connect failed, errno=%d\n", errno);
+        tcpFailed(nowMs);
+    }
+}
+
+void NetLink::pollTcpConnect(uint32_t nowMs)
+{
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(connectFd_, &writable);
+    struct timeval noWait = {0, 0};
+
+    int ready = select(connectFd_ + 1, nullptr, &writable, nullptr, &noWait);
+    if (ready == 0)
+    {
+        if (nowMs - stateSince_ >= config_.tcpConnectTimeoutMs)
+        {
+            Serial.println("❌ TCP connect to broker timed out");
+            tcpFailed(nowMs);
+        }
+        return;
+    }
+
+    int sockErr = 0;
+    socklen_t errLen = sizeof(sockErr);
+    if (ready < 0 || getsockopt(connectFd_, SOL_SOCKET, SO_ERROR, &sockErr, &errLen) < 0 || sockErr != 0)
+    {
+        Serial.printf("❌ TCP connect failed, errno=%d\n", ready < 0 ? errno : sockErr);
+        tcpFailed(nowMs);
+        return;
+    }
+
+    // Hand the connected socket to WiFiClient in the same (blocking) mode
+    // WiFiClient::connect() leaves it in. PubSubClient skips its own TCP
+    // connect when the client is already connected.
+    int fd = connectFd_;
+    connectFd_ = -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    tcp_ = WiFiClient(fd);
+
+    // TLS first, in steps over the next polls (still MQTT_CONNECTING)
+    if (tls_ && tls_->enabled())
+    {
+        tls_->startHandshake(nowMs);
+        handshaking_ = true;
+        pollTlsHandshake(nowMs);
+        return;
+    }
+    mqttConnect(nowMs);
+}
+
+void NetLink::pollTlsHandshake(uint32_t nowMs)
+{
+    TlsClient::Handshake result = tls_->pollHandshake(nowMs);
+    if (result == TlsClient::HANDSHAKE_PENDING)
+    {
+        return;
+    }
+    handshaking_ = false;
+    if (result == TlsClient::HANDSHAKE_FAILED)
+    {
+        tls_->stop();
+        scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+        return;
+    }
+    mqttConnect(nowMs);
+}
+
+// CONNECT / CONNACK over the connected (and secured) socket. The only
+// blocking call in NetLink: PubSubClient waits for CONNACK, at most its
+// socket timeout (setSocketTimeout(), whole seconds)
+void NetLink::mqttConnect(uint32_t nowMs)
+{
+    if (!finishMqttConnect())
+    {
+        Serial.printf("❌ MQTT connection failed, rc=%d\n", mqtt_.state());
+        tcp_.stop();
+        scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+        return;
+    }
+
+    Serial.println("✅ MQTT connected!");
+    if (everOnline_)
+    {
+        mqttReconnects_++;
+    }
+    if (bootTimes_.mqttMs == 0)
+    {
+        bootTimes_.mqttMs = nowMs;
+    }
+    everOnline_ = true;
+    mqttBackoffMs_ = config_.backoffMinMs;
+    enter(State::ONLINE, nowMs);
+
+    if (onConnected_)
+    {
+        onConnected_();
+    }
+
+    // After the first publishes, so the NVS write never delays them
+    rememberAp(nowMs);
+}
+
+// A cached lease that cannot reach the broker may belong to someone else
+// by now: get a fresh one instead of retrying with it
+void NetLink::tcpFailed(uint32_t nowMs)
+{
+    closeSocket();
+    if (staticIp_ && !cacheFailed_ && !everOnline_)
+    {
+        dropCache("cached lease cannot reach the broker", nowMs);
+        return;
+    }
+    scheduleRetry(State::MQTT_BACKOFF, mqttBackoffMs_, nowMs);
+}
+
+bool NetLink::finishMqttConnect()
+{
+    bool hasAuth = config_.mqttUsername && config_.mqttUsername[0] != '\0';
+
+    return mqtt_.connect(config_.clientId,
+                         hasAuth ? config_.mqttUsername : nullptr,
+                         hasAuth ? config_.mqttPassword : nullptr,
+                         config_.willTopic,
+                         config_.willQos,
+                         config_.willRetain,
+                         config_.willMessage,
+                         config_.cleanSession);
+}
+
+void NetLink::closeSocket()
+{
+    if (connectFd_ >= 0)
+    {
+        close(connectFd_);
+        connectFd_ = -1;
+    }
+}
+
+// Closes the broker socket behind PubSubClient's back, then lets it notice:
+// a client still in MQTT_CONNECTED would take the next socket for the old
+// session and skip CONNECT
+void NetLink::dropTcp()
+{
+    tcp_.stop();
+    mqtt_.connected();
+}
+
+// =============================================================================
+// STATE HELPERS
+// =============================================================================
+
+void NetLink::enter(State next, uint32_t nowMs)
+{
+    state_ = next;
+    stateSince_ = nowMs;
+}
+
+void NetLink::scheduleRetry(State next, uint32_t &backoffMs, uint32_t nowMs)
+{
+    // Up to +25% jitter so a room full of boards doesn't retry in lockstep
+    // after an AP or broker restart.
+    uint32_t delayMs = backoffMs + random(0, backoffMs / 4 + 1);
+    retryAt_ = nowMs + delayMs;
+    backoffMs = min(backoffMs * 2, config_.backoffMaxMs);
+
+    Serial.printf("⏳ Retry in %lu ms\n", (unsigned long)delayMs);
+    enter(next, nowMs);
+}
@@ -0,0 +1,219 @@
+/*
+ * NetLink - non-blocking WiFi + MQTT connection manager
+ *
+ * Replaces the blocking "WiFi.begin() + delay(500) polling" reconnect loops
+ * with an event-driven state machine:
+ *
+ *   WIFI_BACKOFF -> WIFI_CONNECTING -> MQTT_BACKOFF -> MQTT_CONNECTING -> ONLINE
+ *        ^               |                 ^                |              |
+ *        +--- timeout ---+                 +---- failure ---+--- dropped --+
+ *
+ * - WiFi transitions are driven by the Arduino WiFi event callbacks, which run
+ *   on the system event task. The callback only sets bits in an atomic mask;
+ *   all state changes happen in poll() on the caller's task.
+ * - The MQTT TCP connect is started non-blocking and polled with a zero
+ *   timeout select(), so an unreachable broker never stalls the loop. The
+ *   CONNECT/CONNACK exchange is then handed to PubSubClient, which blocks
+ *   until CONNACK: one LAN round trip normally, PubSubClient's socket
+ *   timeout (setSocketTimeout()) at most when the broker accepted TCP but
+ *   does not answer.
+ * - TLS (setTls()): once the TCP connect succeeded, the TlsClient handshake
+ *   is polled in steps while still MQTT_CONNECTING, then CONNECT goes out
+ *   encrypted. A resumed session makes that one round trip.
+ * - Every failure doubles the retry delay (with jitter) up to a ceiling, and a
+ *   successful connection resets it.
+ *
+ * - Fast reconnect: the BSSID and channel of the last AP that got us to the
+ *   broker (optionally with its IP lease) are kept in NVS. The next
+ *   association, after a reboot too, goes straight to that AP without a
+ *   channel scan and, with reuseIpLease, without the DHCP exchange. A cached
+ *   AP that does not answer, or a cached lease that cannot reach the broker,
+ *   falls back to a full scan + DHCP at once (no backoff).
+ *
+ * poll() is meant to be called every loop() iteration and returns in
+ * microseconds in every state, except for that CONNACK wait (once per
+ * connection) and PubSubClient reading the rest of a packet that arrived
+ * in part (same timeout). Keep the socket timeout short. A caller that
+ * sleeps between polls (see LoopWaker) asks nextPollMs() how long it may
+ * sleep and registers a wake callback so WiFi events cut the sleep short.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <atomic>
+
+#include "PersistedState.h"
+
+class TlsClient;
+
+struct NetLinkConfig
+{
+    const char *wifiSsid;
+    const char *wifiPassword;
+
+    const char *mqttHost; // IPv4 literal preferred (hostnames are resolved once, blocking)
+    uint16_t mqttPort;
+    const char *mqttUsername; // nullptr or "" for anonymous
+    const char *mqttPassword;
+    const char *clientId; // must be stable across reboots when cleanSession is false
+    bool cleanSession;    // false: the broker keeps our subscriptions and queues QoS1 messages while offline
+
+    // Last Will Testament, published by the broker if we drop off
+    const char *willTopic;
+    const char *willMessage;
+    uint8_t willQos;
+    bool willRetain;
+
+    uint32_t backoffMinMs;        // first retry delay
+    uint32_t backoffMaxMs;        // retry delay ceiling
+    uint32_t wifiConnectTimeoutMs; // association + DHCP budget
+    uint32_t tcpConnectTimeoutMs;  // TCP handshake budget to the broker
+    uint32_t idlePollMs;           // ONLINE: max gap between polls (keepalive pings)
+
+    bool fastConnect;              // associate to the cached BSSID/channel, no scan
+    bool reuseIpLease;             // and configure the cached IP lease, no DHCP
+    uint32_t fastConnectTimeoutMs; // cached AP: give up and scan after this
+};
+
+class NetLink
+{
+public:
+    enum class State : uint8_t
+    {
+        WIFI_BACKOFF,
+        WIFI_CONNECTING,
+        MQTT_BACKOFF,
+        MQTT_CONNECTING,
+        ONLINE
+    };
+
+    // Invoked on the poll() task right after the MQTT session is established.
+    // Subscriptions and the initial state publishes belong here.
+    typedef void (*ConnectedCallback)();
+
+    // Invoked on the WiFi event task after an event was recorded, so a
+    // caller sleeping until nextPollMs() can poll() right away.
+    typedef void (*WakeCallback)();
+
+    // millis() when each stage was first reached after boot, 0 = not yet
+    struct BootTimes
+    {
+        uint32_t wifiMs; // associated
+        uint32_t ipMs;   // got an IP
+        uint32_t mqttMs; // CONNACK
+        bool cachedAp;   // first association used the cached BSSID/channel
+        bool cachedIp;   // ... and the cached IP lease
+    };
+
+    NetLink(WiFiClient &tcp, PubSubClient &mqtt);
+
+    // Registers the WiFi event handler and kicks off the first association.
+    // Returns immediately.
+    void begin(const NetLinkConfig &config, ConnectedCallback onConnected);
+
+    // Advances the state machine and services the MQTT client. Only blocks
+    // in PubSubClient, bounded by its socket timeout (see above).
+    void poll(uint32_t nowMs);
+
+    // ms until poll() has timed work to do (retry, timeout, TCP connect
+    // progress, keepalive); incoming MQTT data is signalled by the socket
+    uint32_t nextPollMs(uint32_t nowMs) const;
+    void setWakeCallback(WakeCallback wake) { wake_ = wake; }
+
+    // TLS between the socket and the MQTT client; used once tls->begin()
+    // succeeded, plain MQTT otherwise
+    void setTls(TlsClient *tls) { tls_ = tls; }
+
+    State state() const { return state_; }
+    bool wifiUp() const { return state_ >= State::MQTT_BACKOFF; }
+    bool online() const { return state_ == State::ONLINE; }
+
+    uint32_t wifiReconnects() const { return wifiReconnects_; }
+    uint32_t mqttReconnects() const { return mqttReconnects_; }
+    uint32_t cacheFallbacks() const { return cacheFallbacks_; }
+    const BootTimes &bootTimes() const { return bootTimes_; }
+
+    static const char *stateName(State state);
+
+private:
+    static const uint32_t CONNECT_POLL_MS = 5; // TCP / TLS handshake progress
+
+    // Last AP that got us to the broker (IPv4 values in network byte order)
+    struct ApCache
+    {
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t reserved;
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+    };
+
+    enum EventBits : uint32_t
+    {
+        EV_GOT_IP = 1u << 0,
+        EV_DISCONNECTED = 1u << 1,
+        EV_LOST_IP = 1u << 2,
+    };
+
+    void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info);
+    void handleEvents(uint32_t nowMs);
+
+    void startWiFi(uint32_t nowMs);
+    uint32_t wifiTimeoutMs() const;
+    bool useCachedIp() const;
+    void dropCache(const char *why, uint32_t nowMs);
+    void rememberAp(uint32_t nowMs);
+    void tcpFailed(uint32_t nowMs);
+    void startTcpConnect(uint32_t nowMs);
+    void pollTcpConnect(uint32_t nowMs);
+    void pollTlsHandshake(uint32_t nowMs);
+    void mqttConnect(uint32_t nowMs);
+    bool finishMqttConnect();
+    void closeSocket();
+    void dropTcp();
+
+    void enter(State next, uint32_t nowMs);
+    void scheduleRetry(State next, uint32_t &backoffMs, uint32_t nowMs);
+    bool resolveBroker();
+
+    WiFiClient &tcp_;
+    PubSubClient &mqtt_;
+    NetLinkConfig config_;
+    ConnectedCallback onConnected_ = nullptr;
+    WakeCallback wake_ = nullptr;
+    TlsClient *tls_ = nullptr;
+
+    std::atomic<uint32_t> pendingEvents_{0};
+    std::atomic<uint32_t> associatedAt_{0};
+    std::atomic<uint32_t> gotIpAt_{0};
+
+    State state_ = State::WIFI_BACKOFF;
+    uint32_t stateSince_ = 0;
+    uint32_t retryAt_ = 0;
+    uint32_t wifiBackoffMs_ = 0;
+    uint32_t mqttBackoffMs_ = 0;
+
+    IPAddress brokerIp_;
+    bool brokerResolved_ = false;
+    int connectFd_ = -1;
+    bool handshaking_ = false; // MQTT_CONNECTING: TCP is up, TLS handshake running
+
+    PersistedState<ApCache> apStore_;
+    ApCache ap_ = {};
+    bool apKnown_ = false;     // ap_ holds a usable AP
+    bool cacheFailed_ = false; // ap_ just failed, scan until the next success
+    bool fastAttempt_ = false; // current association uses ap_
+    bool staticIp_ = false;    // ap_'s lease is configured instead of DHCP
+
+    bool everOnline_ = false;
+    bool wifiEverUp_ = false;
+    uint32_t wifiReconnects_ = 0;
+    uint32_t mqttReconnects_ = 0;
+    uint32_t cacheFallbacks_ = 0;
+    BootTimes bootTimes_ = {};
+};
@@ -0,0 +1,310 @@
+/*
+ * OfflineJournal - store-and-forward buffer for samples taken while offline
+ *
+ * Records (fixed-size POD structs) are appended to a RAM ring. When the ring
+ * fills up, its oldest half is spilled to an append-only segment file on the
+ * filesystem (LittleFS):
+ *
+ *   /journal/<seq>.bin   raw Record array, seq increasing, oldest first
+ *
+ * Order is always preserved: flash holds the older records, RAM the newer.
+ * peek()/consume() drain oldest-first, so a reconnect can replay the backlog
+ * at whatever pace the caller chooses and drop records only once they have
+ * been published.
+ *
+ * Flash wear is bounded:
+ * - nothing is written while online,
+ * - writes are whole blocks (RamCapacity / 2 records), never single samples,
+ * - at most maxSegments segment files of segmentRecords each exist; when a new
+ *   segment would exceed that, the OLDEST segment is deleted (drop-oldest) and
+ *   its records are counted in dropped().
+ * Without a filesystem the RAM ring alone applies the same drop-oldest policy.
+ *
+ * The read position inside the oldest segment is kept in RAM only, so a reboot
+ * mid-replay may re-send up to one segment. Segments left over from a previous
+ * boot are still replayed; peek() flags them because their millis() timestamps
+ * belong to the earlier boot.
+ *
+ * File access allocates (LittleFS file handles), so flash spill/replay are
+ * transient, not steady-state, operations.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SampleRing.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+template <typename Record, size_t RamCapacity>
+class OfflineJournal
+{
+    static_assert(RamCapacity >= 2, "RAM ring must hold at least two records");
+
+public:
+    // fs: mounted filesystem, or nullptr for a RAM-only journal
+    void begin(fs::FS *fs, const char *dir, uint16_t segmentRecords, uint8_t maxSegments)
+    {
+        fs_ = fs;
+        snprintf(dir_, sizeof(dir_), "%s", dir);
+        segmentRecords_ = segmentRecords;
+        maxSegments_ = maxSegments;
+
+        if (!fs_)
+        {
+            return;
+        }
+        if (!fs_->exists(dir_))
+        {
+            fs_->mkdir(dir_);
+        }
+
+        // Pick up segments left over from before the reboot
+        bool found = false;
+        uint32_t minSeq = 0;
+        uint32_t maxSeq = 0;
+        File root = fs_->open(dir_);
+        for (File entry = root.openNextFile(); entry; entry = root.openNextFile())
+        {
+            uint32_t seq = parseSeq(entry.name());
+            flashPending_ += entry.size() / sizeof(Record);
+            if (!found || seq < minSeq)
+            {
+                minSeq = seq;
+            }
+            if (!found || seq > maxSeq)
+            {
+                maxSeq = seq;
+            }
+            found = true;
+        }
+
+        if (found)
+        {
+            firstSeg_ = minSeq;
+            firstSegCount_ = countRecords(minSeq);
+            lastSeg_ = maxSeq + 1; // this boot writes to fresh segments
+        }
+        else
+        {
+            firstSeg_ = lastSeg_ = 0;
+        }
+        bootFirstSeg_ = lastSeg_;
+        lastSegCount_ = 0;
+    }
+
+    void append(const Record &record)
+    {
+        if (ram_.full() && fs_)
+        {
+            spill();
+        }
+        ram_.push(record); // drops the oldest if spilling was impossible
+        buffered_++;
+    }
+
+    // Copies up to max of the oldest records without removing them. All
+    // returned records come from the same boot; previousBoot tells which.
+    size_t peek(Record *out, size_t max, bool *previousBoot = nullptr)
+    {
+        if (previousBoot)
+        {
+            *previousBoot = false;
+        }
+
+        if (flashPending_ > 0)
+        {
+            size_t available = firstCount() - readOffset_;
+            size_t want = min(max, available);
+
+            char path[48];
+            segmentPath(firstSeg_, path, sizeof(path));
+            File file = fs_->open(path, FILE_READ);
+            size_t got = 0;
+            if (file && file.seek(readOffset_ * sizeof(Record)))
+            {
+                got = file.read((uint8_t *)out, want * sizeof(Record)) / sizeof(Record);
+            }
+            file.close();
+
+            if (got == 0)
+            {
+                // Missing or truncated segment: count it as lost and move on
+                dropped_ += available;
+                flashPending_ -= available;
+                readOffset_ += available;
+                retireFirstSegment();
+                return peek(out, max, previousBoot);
+            }
+
+            if (previousBoot)
+            {
+                *previousBoot = firstSeg_ < bootFirstSeg_;
+            }
+            return got;
+        }
+
+        size_t count = min(max, ram_.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = ram_[i];
+        }
+        return count;
+    }
+
+    // Removes the n oldest records (after they were published).
+    void consume(size_t n)
+    {
+        replayed_ += n;
+        while (n > 0)
+        {
+            if (flashPending_ == 0)
+            {
+                ram_.discard(n);
+                return;
+            }
+
+            size_t step = min(n, firstCount() - readOffset_);
+            readOffset_ += step;
+            flashPending_ -= step;
+            n -= step;
+            if (readOffset_ >= firstCount())
+            {
+                retireFirstSegment();
+            }
+        }
+    }
+
+    size_t pending() const { return flashPending_ + ram_.size(); }
+    size_t flashPending() const { return flashPending_; }
+    bool empty() const { return pending() == 0; }
+
+    uint32_t buffered() const { return buffered_; }
+    uint32_t replayed() const { return replayed_; }
+    uint32_t dropped() const { return dropped_ + ram_.dropped(); }
+
+private:
+    static constexpr size_t SPILL_BLOCK = RamCapacity / 2;
+
+    size_t firstCount() const { return firstSeg_ == lastSeg_ ? lastSegCount_ : firstSegCount_; }
+
+    void spill()
+    {
+        if (lastSegCount_ >= segmentRecords_)
+        {
+            if (firstSeg_ == lastSeg_)
+            {
+                firstSegCount_ = lastSegCount_;
+            }
+            lastSeg_++;
+            lastSegCount_ = 0;
+        }
+        if (flashPending_ > 0 && lastSegCount_ == 0 && lastSeg_ - firstSeg_ >= maxSegments_)
+        {
+            evictOldestSegment();
+        }
+
+        Record block[SPILL_BLOCK];
+        size_t count = min(SPILL_BLOCK, ram_.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            block[i] = ram_[i];
+        }
+
+        char path[48];
+        segmentPath(lastSeg_, path, sizeof(path));
+        File file = fs_->open(path, FILE_APPEND);
+        size_t written = file ? file.write((const uint8_t *)block, count * sizeof(Record)) / sizeof(Record) : 0;
+        file.close();
+
+        ram_.discard(count);
+        dropped_ += count - written;
+        if (written == 0)
+        {
+            return;
+        }
+
+        if (flashPending_ == 0)
+        {
+            firstSeg_ = lastSeg_;
+            readOffset_ = 0;
+        }
+        lastSegCount_ += written;
+        flashPending_ += written;
+    }
+
+    void evictOldestSegment()
+    {
+        size_t lost = firstCount() - readOffset_;
+        dropped_ += lost;
+        flashPending_ -= lost;
+        readOffset_ += lost;
+        retireFirstSegment();
+    }
+
+    // Deletes the fully read (or evicted) oldest segment.
+    void retireFirstSegment()
+    {
+        char path[48];
+        segmentPath(firstSeg_, path, sizeof(path));
+        fs_->remove(path);
+
+        readOffset_ = 0;
+        if (flashPending_ == 0)
+        {
+            // Nothing left on flash: restart on a fresh segment
+            if (firstSeg_ == lastSeg_)
+            {
+                lastSeg_++;
+            }
+            firstSeg_ = lastSeg_;
+            lastSegCount_ = 0;
+            firstSegCount_ = 0;
+            return;
+        }
+
+        firstSeg_++;
+        firstSegCount_ = firstSeg_ == lastSeg_ ? lastSegCount_ : countRecords(firstSeg_);
+    }
+
+    size_t countRecords(uint32_t seq)
+    {
+        char path[48];
+        segmentPath(seq, path, sizeof(path));
+        File file = fs_->open(path, FILE_READ);
+        size_t count = file ? file.size() / sizeof(Record) : 0;
+        file.close();
+        return count;
+    }
+
+    void segmentPath(uint32_t seq, char *out, size_t len) const
+    {
+        snprintf(out, len, "%s/%08lu.bin", dir_, (unsigned long)seq);
+    }
+
+    static uint32_t parseSeq(const char *name)
+    {
+        const char *base = strrchr(name, '/');
+        return strtoul(base ? base + 1 : name, nullptr, 10);
+    }
+
+    fs::FS *fs_ = nullptr;
+    char dir_[24] = "";
+    uint16_t segmentRecords_ = 0;
+    uint8_t maxSegments_ = 0;
+
+    SampleRing<Record, RamCapacity> ram_;
+
+    uint32_t firstSeg_ = 0;     // oldest segment on flash
+    uint32_t lastSeg_ = 0;      // segment being appended to
+    uint32_t bootFirstSeg_ = 0; // first segment written by this boot
+    size_t firstSegCount_ = 0;
+    size_t lastSegCount_ = 0;
+    size_t readOffset_ = 0; // records already consumed from firstSeg_
+    size_t flashPending_ = 0;
+
+    uint32_t buffered_ = 0;
+    uint32_t replayed_ = 0;
+    uint32_t dropped_ = 0;
+};
@@ -0,0 +1,368 @@
+#include "OtaUpdater.h"
+
+#include <CommandParser.h>
+#include <Preferences.h>
+#include <string.h>
+
+// mbedtls 2.x (IDF 4.4, Arduino-ESP32 2.x) has the *_ret calls, 3.x renamed them
+#if defined(MBEDTLS_VERSION_MAJOR) && MBEDTLS_VERSION_MAJOR >= 3
+#define SHA256_STARTS mbedtls_sha256_starts
+#define SHA256_UPDATE mbedtls_sha256_update
+#define SHA256_FINISH mbedtls_sha256_finish
+#else
+#define SHA256_STARTS mbedtls_sha256_starts_ret
+#define SHA256_UPDATE mbedtls_sha256_update_ret
+#define SHA256_FINISH mbedtls_sha256_finish_ret
+#endif
+
+// NVS namespace and key of the boot record
+static const char *const OTA_NAMESPACE = "ota";
+static const char *const BOOT_RECORD_KEY = "boot";
+
+const char *otaStateName(OtaState state)
+{
+    switch (state)
+    {
+    case OTA_RECEIVING:
+        return "receiving";
+    case OTA_DONE:
+        return "done";
+    case OTA_FAILED:
+        return "failed";
+    default:
+        return "idle";
+    }
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// 64 hex digits -> 32 bytes
+static bool parseSha256(const CommandToken &token, uint8_t (&out)[32])
+{
+    if (!token.isString || token.length != 64)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < 32; i++)
+    {
+        int high = hexDigit(token.data[i * 2]);
+        int low = hexDigit(token.data[i * 2 + 1]);
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        out[i] = (uint8_t)(high << 4 | low);
+    }
+    return true;
+}
+
+OtaUpdater::OtaUpdater(size_t chunkSize) : chunkSize_(chunkSize)
+{
+    mbedtls_sha256_init(&sha_);
+}
+
+// =============================================================================
+// BOOT RECORD / ROLLBACK
+// =============================================================================
+
+bool OtaUpdater::beginBoot(uint8_t maxBootAttempts)
+{
+    Preferences prefs;
+    if (!prefs.begin(OTA_NAMESPACE, false))
+    {
+        return false;
+    }
+    BootRecord record;
+    bool found = prefs.getBytesLength(BOOT_RECORD_KEY) == sizeof(record) &&
+                 prefs.getBytes(BOOT_RECORD_KEY, &record, sizeof(record)) == sizeof(record) && record.pending;
+    prefs.end();
+    if (!found)
+    {
+        return false;
+    }
+
+    record.previous[sizeof(record.previous) - 1] = '\0';
+    memcpy(previous_, record.previous, sizeof(previous_));
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (running && strcmp(running->label, record.previous) == 0)
+    {
+        // The bootloader did not start the new image: nothing to confirm
+        Serial.printf("⚠️ OTA: new image did not boot, still on %s\n", running->label);
+        clearBootRecord();
+        return false;
+    }
+
+    record.attempts++;
+    if (record.attempts > maxBootAttempts)
+    {
+        Serial.printf("⚠️ OTA: new image not confirmed after %u boots\n", (unsigned)maxBootAttempts);
+        rollback();
+        return false;
+    }
+    saveBootRecord(record);
+    unconfirmed_ = true;
+    Serial.printf("🆕 OTA: new image, boot %u/%u, waiting for confirmation\n", (unsigned)record.attempts,
+                  (unsigned)maxBootAttempts);
+    return true;
+}
+
+void OtaUpdater::confirm()
+{
+    if (!unconfirmed_)
+    {
+        return;
+    }
+    clearBootRecord();
+    esp_ota_mark_app_valid_cancel_rollback(); // no-op unless the bootloader does rollback
+    unconfirmed_ = false;
+    Serial.println("✅ OTA: new image confirmed");
+}
+
+void OtaUpdater::rollback()
+{
+    const esp_partition_t *previous =
+        esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, previous_);
+    clearBootRecord();
+    unconfirmed_ = false;
+    if (!previous || esp_ota_set_boot_partition(previous) != ESP_OK)
+    {
+        Serial.printf("❌ OTA: cannot roll back to '%s'\n", previous_);
+        return;
+    }
+    Serial.printf("↩️ OTA: rolling back to %s, restarting\n", previous->label);
+    Serial.flush();
+    ESP.restart();
+}
+
+bool OtaUpdater::saveBootRecord(const BootRecord &record)
+{
+    Preferences prefs;
+    bool saved = prefs.begin(OTA_NAMESPACE, false) &&
+                 prefs.putBytes(BOOT_RECORD_KEY, &record, sizeof(record)) == sizeof(record);
+    prefs.end();
+    return saved;
+}
+
+void OtaUpdater::clearBootRecord()
+{
+    Preferences prefs;
+    if (prefs.begin(OTA_NAMESPACE, false))
+    {
+        prefs.clear();
+    }
+    prefs.end();
+}
+
+// =============================================================================
+// TRANSFER
+// =============================================================================
+
+void OtaUpdater::control(const uint8_t *payload, size_t length, uint32_t nowMs)
+{
+    CommandReader reader(payload, length);
+    CommandToken key;
+    CommandToken value;
+    CommandToken cmd;
+    long size = 0;
+    uint8_t sha256[32];
+    bool hasSha = false;
+    while (reader.next(key, value))
+    {
+        if (key.equals("cmd"))
+        {
+            cmd = value;
+        }
+        else if (key.equals("size"))
+        {
+            value.toInt(size);
+        }
+        else if (key.equals("sha256"))
+        {
+            hasSha = parseSha256(value, sha256);
+        }
+    }
+
+    if (cmd.equals("abort"))
+    {
+        if (state_ == OTA_RECEIVING)
+        {
+            fail("aborted", nowMs);
+        }
+        return;
+    }
+    if (!cmd.equals("begin") || reader.error() || size <= 0 || !hasSha)
+    {
+        if (state_ != OTA_RECEIVING) // a bad message never ends a running update
+        {
+            fail("bad request", nowMs);
+        }
+        return;
+    }
+
+    bool same = (uint32_t)size == size_ && memcmp(sha256, expected_, sizeof(sha256)) == 0;
+    if (same && (state_ == OTA_RECEIVING || state_ == OTA_DONE))
+    {
+        statusPending_ = true; // resume: tell the sender where we are
+        Serial.printf("🔁 OTA: resume at %u/%u\n", (unsigned)offset_, (unsigned)size_);
+        return;
+    }
+    start((uint32_t)size, sha256, nowMs);
+}
+
+void OtaUpdater::start(uint32_t size, const uint8_t (&sha256)[32], uint32_t nowMs)
+{
+    close();
+    error_ = nullptr;
+    size_ = size;
+    offset_ = 0;
+    dropped_ = 0;
+    startMs_ = nowMs;
+    memcpy(expected_, sha256, sizeof(expected_));
+
+    partition_ = esp_ota_get_next_update_partition(nullptr);
+    if (!partition_)
+    {
+        fail("no ota partition", nowMs);
+        return;
+    }
+    if (size > partition_->size)
+    {
+        fail("image too large", nowMs);
+        return;
+    }
+    // Sequential writes: sectors are erased as the image reaches them, not
+    // all up front (which would block for seconds)
+    if (esp_ota_begin(partition_, OTA_WITH_SEQUENTIAL_WRITES, &handle_) != ESP_OK)
+    {
+        fail("ota begin", nowMs);
+        return;
+    }
+    open_ = true;
+    SHA256_STARTS(&sha_, 0);
+    state_ = OTA_RECEIVING;
+    statusPending_ = true;
+    Serial.printf("⬇️ OTA: %u bytes into %s\n", (unsigned)size_, partition_->label);
+}
+
+void OtaUpdater::chunk(const uint8_t *payload, size_t length, uint32_t nowMs)
+{
+    if (state_ != OTA_RECEIVING)
+    {
+        statusPending_ = true; // a sender still streaming learns the state
+        return;
+    }
+    if (length <= OTA_CHUNK_HEADER)
+    {
+        return;
+    }
+    uint32_t offset = (uint32_t)payload[0] | (uint32_t)payload[1] << 8 | (uint32_t)payload[2] << 16 |
+                      (uint32_t)payload[3] << 24;
+    const uint8_t *data = payload + OTA_CHUNK_HEADER;
+    size_t dataLength = length - OTA_CHUNK_HEADER;
+    if (offset != offset_)
+    {
+        dropped_++;
+        statusPending_ = true; // resync: the status carries the offset we need
+        return;
+    }
+    if (dataLength > size_ - offset_)
+    {
+        fail("image larger than announced", nowMs);
+        return;
+    }
+
+    if (esp_ota_write(handle_, data, dataLength) != ESP_OK)
+    {
+        fail("flash write", nowMs);
+        return;
+    }
+    SHA256_UPDATE(&sha_, data, dataLength);
+    offset_ += dataLength;
+    statusPending_ = true;
+    if (offset_ == size_)
+    {
+        finish(nowMs);
+    }
+}
+
+void OtaUpdater::finish(uint32_t nowMs)
+{
+    uint8_t digest[32];
+    SHA256_FINISH(&sha_, digest);
+    if (memcmp(digest, expected_, sizeof(digest)) != 0)
+    {
+        fail("sha256 mismatch", nowMs);
+        return;
+    }
+    open_ = false;
+    if (esp_ota_end(handle_) != ESP_OK) // also checks the image header and segments
+    {
+        fail("image invalid", nowMs);
+        return;
+    }
+
+    BootRecord record = {};
+    record.pending = 1;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (running)
+    {
+        strncpy(record.previous, running->label, sizeof(record.previous) - 1);
+    }
+    if (!saveBootRecord(record) || esp_ota_set_boot_partition(partition_) != ESP_OK)
+    {
+        clearBootRecord();
+        fail("set boot partition", nowMs);
+        return;
+    }
+
+    state_ = OTA_DONE;
+    endMs_ = nowMs;
+    statusPending_ = true;
+    Serial.printf("✅ OTA: %u bytes verified in %u ms (%.1f KB/s), boot partition %s\n", (unsigned)size_,
+                  (unsigned)elapsedMs(nowMs), kbPerSecond(nowMs), partition_->label);
+}
+
+void OtaUpdater::fail(const char *error, uint32_t nowMs)
+{
+    close();
+    state_ = OTA_FAILED;
+    error_ = error;
+    endMs_ = nowMs;
+    statusPending_ = true;
+    Serial.printf("❌ OTA: %s at %u/%u\n", error, (unsigned)offset_, (unsigned)size_);
+}
+
+void OtaUpdater::close()
+{
+    if (open_)
+    {
+        esp_ota_abort(handle_);
+        open_ = false;
+    }
+}
+
+uint32_t OtaUpdater::elapsedMs(uint32_t nowMs) const
+{
+    return (state_ == OTA_RECEIVING ? nowMs : endMs_) - startMs_;
+}
+
+float OtaUpdater::kbPerSecond(uint32_t nowMs) const
+{
+    uint32_t ms = elapsedMs(nowMs);
+    return ms > 0 ? (float)offset_ / 1024.0f * 1000.0f / (float)ms : 0.0f;
+}
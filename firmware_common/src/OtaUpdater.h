@@ -0,0 +1,127 @@
+/*
+ * OtaUpdater - firmware update streamed over MQTT straight into flash
+ *
+ * The image arrives in chunks and each chunk is written into the inactive
+ * OTA partition (esp_ota_write, a flash sector is erased when the image
+ * first reaches it) and fed to a running SHA-256 while it is still in the
+ * MQTT receive buffer: nothing is copied and the image is never held in
+ * RAM. Protocol (sender: tests/ota_push.py):
+ *
+ *   sender -> sys/ota         {"cmd":"begin","size":912384,"sha256":"<64 hex digits>"}
+ *   device -> sys/ota/status  {"state":"receiving","offset":0,"size":912384,"chunk":4096}
+ *   sender -> sys/ota/data    <offset: uint32 little-endian><up to "chunk" bytes>
+ *   device -> sys/ota/status  {"state":"receiving","offset":8192,...}
+ *   device -> sys/ota/status  {"state":"done",...,"ms":21873}        then reboots
+ *
+ * A chunk is taken only at the offset the device expects; any other chunk
+ * (one was lost: the data topic is QoS0) is dropped and the next status
+ * repeats the expected offset, from where the sender resends. Resume: when
+ * the connection drops the partial image stays open; the sender repeats
+ * "begin" with the same size and hash and the status answers with the
+ * offset reached. A different image, {"cmd":"abort"} or a reboot start over.
+ *
+ * Once the whole image is in, the hash is compared, esp_ota_end() checks
+ * the image and it becomes the boot partition. Before the reboot a boot
+ * record goes to NVS (namespace "ota"): the new image calls beginBoot()
+ * early in setup(), which counts the attempt, and confirm() once it is
+ * online. An image that boots more than maxBootAttempts times without
+ * confirming, or that the firmware gives up on (rollback(), e.g. after a
+ * timeout), switches back to the previous partition and restarts. This
+ * works whether or not the bootloader was built with app rollback.
+ *
+ * Network task only (control() and chunk() from the MQTT callback).
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes in front of every data chunk: its offset in the image (little-endian)
+static constexpr size_t OTA_CHUNK_HEADER = 4;
+
+enum OtaState : uint8_t
+{
+    OTA_IDLE,
+    OTA_RECEIVING,
+    OTA_DONE,  // image verified and set to boot: restart
+    OTA_FAILED // see error()
+};
+
+const char *otaStateName(OtaState state);
+
+class OtaUpdater
+{
+public:
+    // chunkSize: data bytes per chunk the sender is asked for (the MQTT
+    // buffer must hold a chunk, its header and the topic)
+    explicit OtaUpdater(size_t chunkSize);
+
+    // At boot, before the network: counts a boot of an image not confirmed
+    // yet and rolls back (restarts) once it has had maxBootAttempts.
+    // True when the running image still needs confirm()
+    bool beginBoot(uint8_t maxBootAttempts);
+    bool unconfirmed() const { return unconfirmed_; }
+    void confirm();
+    // Previous image back as boot partition, then restart; returns only
+    // when there is nothing to go back to
+    void rollback();
+
+    // sys/ota control message
+    void control(const uint8_t *payload, size_t length, uint32_t nowMs);
+    // sys/ota/data chunk
+    void chunk(const uint8_t *payload, size_t length, uint32_t nowMs);
+
+    // A status is due (state change, progress, resync): publish it, then statusSent()
+    bool statusPending() const { return statusPending_; }
+    void statusSent() { statusPending_ = false; }
+
+    OtaState state() const { return state_; }
+    const char *error() const { return error_; } // nullptr unless OTA_FAILED
+    uint32_t offset() const { return offset_; }
+    uint32_t size() const { return size_; }
+    size_t chunkSize() const { return chunkSize_; }
+    uint32_t chunksDropped() const { return dropped_; } // out of order, resent by the sender
+
+    // Since "begin"; the whole update once it is done
+    uint32_t elapsedMs(uint32_t nowMs) const;
+    float kbPerSecond(uint32_t nowMs) const;
+
+private:
+    struct BootRecord
+    {
+        uint8_t pending;  // image written, not confirmed yet
+        uint8_t attempts; // boots of the new image so far
+        char previous[17]; // label of the partition to go back to
+    };
+
+    void start(uint32_t size, const uint8_t (&sha256)[32], uint32_t nowMs);
+    void finish(uint32_t nowMs);
+    void fail(const char *error, uint32_t nowMs);
+    void close(); // abandon an open partition write
+
+    bool saveBootRecord(const BootRecord &record);
+    void clearBootRecord();
+
+    size_t chunkSize_;
+    OtaState state_ = OTA_IDLE;
+    const char *error_ = nullptr;
+
+    const esp_partition_t *partition_ = nullptr;
+    esp_ota_handle_t handle_ = 0;
+    bool open_ = false;
+    mbedtls_sha256_context sha_;
+    uint8_t expected_[32] = {};
+    uint32_t size_ = 0;
+    uint32_t offset_ = 0;
+    uint32_t startMs_ = 0;
+    uint32_t endMs_ = 0;
+    uint32_t dropped_ = 0;
+    bool statusPending_ = false;
+
+    bool unconfirmed_ = false;
+    char previous_[17] = {};
+};
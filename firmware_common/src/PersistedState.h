@@ -0,0 +1,170 @@
+/*
+ * PersistedState - a small state record in NVS with coalesced writes
+ *
+ * The record (T plus a header) lives under one key of an NVS namespace
+ * (Preferences). update() only remembers the latest state; flash is written
+ * by flush() once the state has been quiet for `quietMs`, or at the latest
+ * `maxDelayMs` after the first unsaved change, so a burst of commands costs
+ * one write. A state equal to the stored one is never written again (a
+ * toggle and its undo cost nothing).
+ *
+ * Wear: NVS appends each write to the current page and erases a page only
+ * once it is full of stale entries. A record of a few bytes takes about
+ * three 32-byte entries, so under constant traffic (one write per
+ * maxDelayMs) the default 20 KB NVS partition erases each page a few dozen
+ * times a day, far below its ~100k cycle endurance. writes() counts writes
+ * since boot, lifetimeWrites() is carried in the record itself.
+ *
+ * T must be trivially copyable without padding (compared with memcmp).
+ * Single-threaded: begin()/update()/flush() from one task.
+ */
+
+#pragma once
+
+#include <Preferences.h>
+#include <stdint.h>
+#include <string.h>
+
+struct PersistPolicy
+{
+    uint32_t quietMs;    // write after this long without a change
+    uint32_t maxDelayMs; // but no later than this after the first change
+};
+
+template <typename T>
+class PersistedState
+{
+public:
+    static const uint32_t NOT_DUE = UINT32_MAX;
+
+    PersistedState(const char *nvsNamespace, const PersistPolicy &policy)
+        : namespace_(nvsNamespace), policy_(policy)
+    {
+    }
+
+    // Opens the namespace and reads the stored record into restored; false
+    // (restored untouched) when there is none or it does not match T
+    bool begin(T &restored)
+    {
+        ready_ = prefs_.begin(namespace_, false);
+        if (!ready_)
+        {
+            return false;
+        }
+        Record record;
+        if (prefs_.getBytesLength(KEY) != sizeof(record) ||
+            prefs_.getBytes(KEY, &record, sizeof(record)) != sizeof(record) ||
+            record.version != VERSION || record.size != sizeof(T))
+        {
+            return false;
+        }
+        stored_ = record;
+        latest_ = record.state;
+        hasStored_ = true;
+        restored = record.state;
+        return true;
+    }
+
+    // Latest state; no flash I/O
+    void update(const T &state, uint32_t nowMs)
+    {
+        if (pending_ && memcmp(&state, &latest_, sizeof(T)) == 0)
+        {
+            return; // nothing new (e.g. a republished state)
+        }
+        latest_ = state;
+        bool differs = !hasStored_ || memcmp(&state, &stored_.state, sizeof(T)) != 0;
+        if (!differs)
+        {
+            pending_ = false; // back to what flash holds
+            return;
+        }
+        if (pending_)
+        {
+            coalesced_++;
+        }
+        else
+        {
+            pending_ = true;
+            firstChangeMs_ = nowMs;
+        }
+        lastChangeMs_ = nowMs;
+    }
+
+    // ms until flush() would write, NOT_DUE when nothing is pending
+    uint32_t untilDue(uint32_t nowMs) const
+    {
+        if (!pending_)
+        {
+            return NOT_DUE;
+        }
+        uint32_t quiet = remaining(lastChangeMs_, policy_.quietMs, nowMs);
+        uint32_t latest = remaining(firstChangeMs_, policy_.maxDelayMs, nowMs);
+        return quiet < latest ? quiet : latest;
+    }
+
+    // Writes the latest state when due (or force, e.g. before a restart);
+    // true if flash was written
+    bool flush(uint32_t nowMs, bool force = false)
+    {
+        if (!pending_ || !ready_ || (!force && untilDue(nowMs) > 0))
+        {
+            return false;
+        }
+        Record record = {};
+        record.version = VERSION;
+        record.size = sizeof(T);
+        record.lifetimeWrites = stored_.lifetimeWrites + 1;
+        record.state = latest_;
+        if (prefs_.putBytes(KEY, &record, sizeof(record)) != sizeof(record))
+        {
+            failures_++;
+            lastChangeMs_ = nowMs; // retry after another quiet period
+            firstChangeMs_ = nowMs;
+            return false;
+        }
+        stored_ = record;
+        hasStored_ = true;
+        pending_ = false;
+        writes_++;
+        return true;
+    }
+
+    bool pending() const { return pending_; }
+    uint32_t writes() const { return writes_; }
+    uint32_t lifetimeWrites() const { return stored_.lifetimeWrites; }
+    uint32_t coalesced() const { return coalesced_; } // updates folded into a later write
+    uint32_t failures() const { return failures_; }
+
+private:
+    static constexpr const char *KEY = "state";
+    static const uint16_t VERSION = 1;
+
+    struct Record
+    {
+        uint16_t version;
+        uint16_t size;
+        uint32_t lifetimeWrites;
+        T state;
+    };
+
+    static uint32_t remaining(uint32_t sinceMs, uint32_t periodMs, uint32_t nowMs)
+    {
+        uint32_t elapsed = nowMs - sinceMs;
+        return elapsed >= periodMs ? 0 : periodMs - elapsed;
+    }
+
+    Preferences prefs_;
+    const char *namespace_;
+    PersistPolicy policy_;
+    Record stored_ = {};
+    T latest_ = {};
+    bool ready_ = false;
+    bool hasStored_ = false;
+    bool pending_ = false;
+    uint32_t firstChangeMs_ = 0;
+    uint32_t lastChangeMs_ = 0;
+    uint32_t writes_ = 0;
+    uint32_t coalesced_ = 0;
+    uint32_t failures_ = 0;
+};
@@ -0,0 +1,68 @@
+/*
+ * ReportFilter - per-field report-on-change (deadband) decision
+ *
+ * A reading is due for publishing when it moved at least `deadband` away
+ * from the last reported value and `minIntervalMs` has passed since that
+ * report, or unconditionally once `maxIntervalMs` has passed (so consumers
+ * still see the device is alive). The first reading is always due.
+ *
+ * A message carrying several fields is sent when any of them is due; call
+ * reported() on every field that went out. suppressed() counts readings for
+ * which this field alone would not have triggered a publish.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+struct ReportPolicy
+{
+    float deadband;
+    uint32_t minIntervalMs;
+    uint32_t maxIntervalMs;
+};
+
+class ReportFilter
+{
+public:
+    explicit ReportFilter(const ReportPolicy &policy) : policy_(policy) {}
+
+    bool check(float value, uint32_t nowMs)
+    {
+        bool due;
+        uint32_t elapsed = nowMs - lastMs_;
+        if (!hasReported_ || elapsed >= policy_.maxIntervalMs)
+        {
+            due = true;
+        }
+        else
+        {
+            // Small tolerance so a 0.2 step is not lost to float rounding
+            due = elapsed >= policy_.minIntervalMs &&
+                  fabsf(value - lastValue_) + 1e-4f >= policy_.deadband;
+        }
+
+        if (!due)
+        {
+            suppressed_++;
+        }
+        return due;
+    }
+
+    void reported(float value, uint32_t nowMs)
+    {
+        lastValue_ = value;
+        lastMs_ = nowMs;
+        hasReported_ = true;
+    }
+
+    uint32_t suppressed() const { return suppressed_; }
+
+private:
+    ReportPolicy policy_;
+    float lastValue_ = 0;
+    uint32_t lastMs_ = 0;
+    bool hasReported_ = false;
+    uint32_t suppressed_ = 0;
+};
@@ -0,0 +1,59 @@
+/*
+ * SampleRing - fixed-capacity FIFO ring buffer
+ *
+ * Statically sized, no heap. When full, push() overwrites the oldest entry
+ * and counts it in dropped(), so the newest data always survives a long
+ * outage. Index 0 is the oldest entry.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SampleRing
+{
+    static_assert(N > 0, "SampleRing needs a non-zero capacity");
+
+public:
+    void push(const T &item)
+    {
+        if (count_ == N)
+        {
+            head_ = (head_ + 1) % N;
+            count_--;
+            dropped_++;
+        }
+        items_[(head_ + count_) % N] = item;
+        count_++;
+    }
+
+    // Removes up to n entries from the front (oldest first).
+    void discard(size_t n)
+    {
+        if (n > count_)
+        {
+            n = count_;
+        }
+        head_ = (head_ + n) % N;
+        count_ -= n;
+    }
+
+    const T &operator[](size_t i) const { return items_[(head_ + i) % N]; }
+    const T &front() const { return items_[head_]; }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == N; }
+    void clear() { head_ = count_ = 0; }
+
+    static constexpr size_t capacity() { return N; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    T items_[N];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint32_t dropped_ = 0;
+};
@@ -0,0 +1,67 @@
+/*
+ * SpscQueue - lock-free single-producer / single-consumer queue
+ *
+ * One task may push(), one other task may pop(); no mutex, no heap, never
+ * blocks. Head and tail are free-running counters published with
+ * release/acquire ordering, so only plain atomic loads and stores are needed
+ * (fine on the ESP32-C3, which has no hardware read-modify-write atomics).
+ *
+ * The queue does not wake the consumer: pair push() with xTaskNotifyGive()
+ * on the consumer task. A full queue rejects the new item and counts it in
+ * dropped().
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    // Producer side
+    bool push(const T &item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N)
+        {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        items_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &out)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out = items_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return N; }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    T items_[N];
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+    std::atomic<uint32_t> dropped_{0};
+};
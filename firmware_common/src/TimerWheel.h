@@ -0,0 +1,364 @@
+/*
+ * TimerWheel - hierarchical timer wheel for the network task's timed work
+ *
+ * Jobs are registered once (add()/every()) and armed with start(); periodic
+ * jobs rearm themselves. Time is millis(), one tick per ms. Six levels of
+ * 64 slots cover the whole 32-bit range (a level-k slot spans 64^k ms), so
+ * millis() wrap-around needs no special casing for delays below 2^31 ms.
+ *
+ * - start()/stop() are O(1): a job goes into the slot picked by the highest
+ *   bit in which its deadline differs from the wheel clock, and slots are
+ *   intrusive lists of job indices.
+ * - run() jumps straight to the next occupied slot via per-level occupancy
+ *   bitmaps (no per-ms stepping). Jobs in an upper-level slot cascade down
+ *   when the clock reaches its start; level-0 slots hold a single deadline.
+ * - Periodic jobs are drift-free: the next deadline is the previous one plus
+ *   the period, not the time the job ran. Whole periods lost to a stall are
+ *   skipped (counted in missed()) instead of firing back to back.
+ * - untilNext() is the exact time to the earliest deadline, so the caller
+ *   can sleep until then.
+ * - start() counts from the time of the latest run() (inside a callback:
+ *   that run()'s nowMs, not the deadline being served). The wheel does not
+ *   read the clock itself, so a caller that slept calls run() before arming
+ *   anything, or the job comes due up to one sleep early.
+ *
+ * Jitter: every run records how late it started (run() time minus deadline),
+ * per job and in total, until resetStats().
+ *
+ * Single-threaded: use from one task only. Callbacks may start or stop any
+ * job, including their own. Static storage, no heap.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <size_t N>
+class TimerWheel
+{
+    static_assert(N > 0 && N < 255, "TimerWheel handles are 8-bit");
+
+public:
+    typedef void (*Callback)();
+    typedef uint8_t Handle;
+    static const Handle NONE = 0xFF;
+    static const uint32_t NO_DEADLINE = UINT32_MAX;
+
+    struct JobStats
+    {
+        uint32_t runs;
+        uint32_t lateMaxMs;   // worst start delay past the deadline
+        uint32_t lateTotalMs; // / runs = mean start delay
+        uint32_t missed;      // periods skipped after a stall
+    };
+
+    TimerWheel()
+    {
+        for (uint8_t level = 0; level < LEVELS; level++)
+        {
+            for (uint8_t index = 0; index < SLOTS; index++)
+            {
+                heads_[level][index] = NONE;
+            }
+        }
+    }
+
+    // Sets the wheel clock; call before the first start()
+    void begin(uint32_t nowMs)
+    {
+        clock_ = nowMs;
+        now_ = nowMs;
+    }
+
+    // Registers an idle job; periodMs 0 makes it one-shot. NONE when full.
+    Handle add(Callback callback, uint32_t periodMs = 0)
+    {
+        if (count_ == N)
+        {
+            return NONE;
+        }
+        Job &job = jobs_[count_];
+        job.callback = callback;
+        job.periodMs = periodMs;
+        job.level = IDLE;
+        job.stats = JobStats();
+        return count_++;
+    }
+
+    // Registers a periodic job and starts it (first run after one period)
+    Handle every(uint32_t periodMs, Callback callback)
+    {
+        Handle handle = add(callback, periodMs);
+        if (handle != NONE)
+        {
+            start(handle, periodMs);
+        }
+        return handle;
+    }
+
+    // (Re)arms a job to run delayMs after the last run() time (at least 1 ms)
+    void start(Handle handle, uint32_t delayMs)
+    {
+        Job &job = jobs_[handle];
+        unlink(handle);
+        job.deadline = now_ + (delayMs > 0 ? delayMs : 1);
+        link(handle);
+    }
+
+    void stop(Handle handle) { unlink(handle); }
+    bool pending(Handle handle) const { return jobs_[handle].level != IDLE; }
+
+    // Runs every job due at or before nowMs, in deadline order
+    void run(uint32_t nowMs)
+    {
+        if ((int32_t)(nowMs - clock_) <= 0)
+        {
+            return;
+        }
+        now_ = nowMs;
+        for (;;)
+        {
+            uint32_t tick = 0;
+            if (!nextEvent(tick) || tick - clock_ > nowMs - clock_)
+            {
+                clock_ = nowMs;
+                return;
+            }
+            clock_ = tick;
+
+            // Upper-level slots starting at this tick move down first
+            for (uint8_t level = LEVELS - 1; level > 0; level--)
+            {
+                if ((tick & ((1u << (level * LEVEL_BITS)) - 1)) == 0)
+                {
+                    cascade(level, (tick >> (level * LEVEL_BITS)) & SLOT_MASK);
+                }
+            }
+
+            // Everything left in the level-0 slot is due at exactly this tick
+            Handle &head = heads_[0][tick & SLOT_MASK];
+            while (head != NONE)
+            {
+                Handle handle = head;
+                unlink(handle);
+                fire(handle, nowMs);
+            }
+        }
+    }
+
+    // ms from nowMs to the earliest deadline (0 if overdue), NO_DEADLINE if idle
+    uint32_t untilNext(uint32_t nowMs) const
+    {
+        for (uint8_t level = 0; level < LEVELS; level++)
+        {
+            int index = nextSlot(level);
+            if (index < 0)
+            {
+                continue;
+            }
+
+            // The lowest occupied level holds the earliest deadline
+            uint32_t earliest = 0;
+            bool first = true;
+            for (Handle handle = heads_[level][index]; handle != NONE; handle = jobs_[handle].next)
+            {
+                uint32_t deadline = jobs_[handle].deadline;
+                if (first || deadline - clock_ < earliest - clock_)
+                {
+                    earliest = deadline;
+                    first = false;
+                }
+            }
+            int32_t remaining = (int32_t)(earliest - nowMs);
+            return remaining > 0 ? (uint32_t)remaining : 0;
+        }
+        return NO_DEADLINE;
+    }
+
+    const JobStats &stats(Handle handle) const { return jobs_[handle].stats; }
+
+    // Totals over all jobs since resetStats()
+    uint32_t runs() const { return total(&JobStats::runs); }
+    uint32_t missed() const { return total(&JobStats::missed); }
+    uint32_t lateMaxMs() const
+    {
+        uint32_t worst = 0;
+        for (uint8_t i = 0; i < count_; i++)
+        {
+            if (jobs_[i].stats.lateMaxMs > worst)
+            {
+                worst = jobs_[i].stats.lateMaxMs;
+            }
+        }
+        return worst;
+    }
+
+    void resetStats()
+    {
+        for (uint8_t i = 0; i < count_; i++)
+        {
+            jobs_[i].stats = JobStats();
+        }
+    }
+
+private:
+    static const uint8_t LEVEL_BITS = 6;
+    static const uint8_t SLOTS = 1 << LEVEL_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const uint8_t LEVELS = (32 + LEVEL_BITS - 1) / LEVEL_BITS;
+    static const uint8_t IDLE = 0xFF;
+
+    struct Job
+    {
+        Callback callback;
+        uint32_t periodMs;
+        uint32_t deadline;
+        Handle prev;
+        Handle next;
+        uint8_t level; // IDLE when not armed
+        uint8_t index;
+        JobStats stats;
+    };
+
+    // Slot choice: the highest bit where deadline and clock differ. The slot
+    // is then reached (and cascaded) no later than the deadline.
+    void link(Handle handle)
+    {
+        Job &job = jobs_[handle];
+        uint32_t differ = job.deadline ^ clock_;
+        job.level = differ ? (31 - __builtin_clz(differ)) / LEVEL_BITS : 0;
+        job.index = (job.deadline >> (job.level * LEVEL_BITS)) & SLOT_MASK;
+
+        Handle &head = heads_[job.level][job.index];
+        job.prev = NONE;
+        job.next = head;
+        if (head != NONE)
+        {
+            jobs_[head].prev = handle;
+        }
+        head = handle;
+        occupied_[job.level] |= 1ULL << job.index;
+    }
+
+    void unlink(Handle handle)
+    {
+        Job &job = jobs_[handle];
+        if (job.level == IDLE)
+        {
+            return;
+        }
+        Handle &head = heads_[job.level][job.index];
+        if (job.prev != NONE)
+        {
+            jobs_[job.prev].next = job.next;
+        }
+        else
+        {
+            head = job.next;
+        }
+        if (job.next != NONE)
+        {
+            jobs_[job.next].prev = job.prev;
+        }
+        if (head == NONE)
+        {
+            occupied_[job.level] &= ~(1ULL << job.index);
+        }
+        job.level = IDLE;
+    }
+
+    void cascade(uint8_t level, uint32_t index)
+    {
+        Handle handle = heads_[level][index];
+        heads_[level][index] = NONE;
+        occupied_[level] &= ~(1ULL << index);
+        while (handle != NONE)
+        {
+            Handle next = jobs_[handle].next;
+            link(handle);
+            handle = next;
+        }
+    }
+
+    void fire(Handle handle, uint32_t nowMs)
+    {
+        Job &job = jobs_[handle];
+        uint32_t lateMs = nowMs - job.deadline;
+        job.stats.runs++;
+        job.stats.lateTotalMs += lateMs;
+        if (lateMs > job.stats.lateMaxMs)
+        {
+            job.stats.lateMaxMs = lateMs;
+        }
+
+        // Rearm before the callback so it can stop or restart itself
+        if (job.periodMs > 0)
+        {
+            uint32_t skipped = lateMs / job.periodMs;
+            job.stats.missed += skipped;
+            job.deadline += (skipped + 1) * job.periodMs;
+            link(handle);
+        }
+        job.callback();
+    }
+
+    // Next occupied slot at this level after the clock's own, or -1. Only
+    // the top level wraps around (deadlines past a millis() roll-over).
+    int nextSlot(uint8_t level) const
+    {
+        uint64_t bits = occupied_[level];
+        if (bits == 0)
+        {
+            return -1;
+        }
+        uint32_t current = (clock_ >> (level * LEVEL_BITS)) & SLOT_MASK;
+        uint64_t above = current < SLOT_MASK ? bits >> (current + 1) : 0;
+        if (above != 0)
+        {
+            return current + 1 + __builtin_ctzll(above);
+        }
+        return __builtin_ctzll(bits);
+    }
+
+    // Earliest tick after the clock at which a slot expires or cascades
+    bool nextEvent(uint32_t &tick) const
+    {
+        bool found = false;
+        for (uint8_t level = 0; level < LEVELS; level++)
+        {
+            int index = nextSlot(level);
+            if (index < 0)
+            {
+                continue;
+            }
+            uint8_t shift = level * LEVEL_BITS;
+            uint8_t parentShift = shift + LEVEL_BITS;
+            uint32_t base = parentShift < 32 ? (clock_ >> parentShift) << parentShift : 0;
+            uint32_t candidate = base | ((uint32_t)index << shift);
+            if (!found || candidate - clock_ < tick - clock_)
+            {
+                tick = candidate;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    uint32_t total(uint32_t JobStats::*field) const
+    {
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < count_; i++)
+        {
+            sum += jobs_[i].stats.*field;
+        }
+        return sum;
+    }
+
+    Job jobs_[N];
+    uint8_t count_ = 0;
+    Handle heads_[LEVELS][SLOTS];
+    uint64_t occupied_[LEVELS] = {};
+    uint32_t clock_ = 0; // wheel position: the tick being served inside run()
+    uint32_t now_ = 0;   // nowMs of the latest run(), what start() counts from
+};
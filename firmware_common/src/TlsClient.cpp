@@ -0,0 +1,695 @@
+#include "TlsClient.h"
+
+#include <errno.h>
+#include <lwip/sockets.h>
+#include <string.h>
+
+#ifdef IOT_MQTT_TLS
+#include <esp_attr.h>
+#include <mbedtls/error.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl_internal.h>
+#include <mbedtls/version.h>
+
+#if MBEDTLS_VERSION_MAJOR >= 3
+#error "TlsClient uses the mbedtls 2.x API (Arduino-ESP32 2.x, IDF 4.4)"
+#endif
+
+// TLS 1.2, ECDHE-ECDSA on P-256 only: the broker certificate must be P-256
+static const int CIPHERSUITES[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    0};
+static const mbedtls_ecp_group_id CURVES[] = {MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE};
+static const int SIG_HASHES[] = {MBEDTLS_MD_SHA256, MBEDTLS_MD_NONE};
+
+// Serialized session (mbedtls_ssl_session_save), with the peer certificate
+// when mbedtls keeps it (IDF default) and the broker's ticket
+static const size_t SESSION_CACHE_BYTES = 1536;
+static const uint32_t SESSION_MAGIC = 0x544c5331; // "TLS1"
+
+struct SessionCache
+{
+    uint32_t magic;
+    uint32_t nameHash; // server name the session belongs to
+    uint32_t length;
+    uint32_t check;    // FNV-1a of the fields above and the data
+    uint8_t data[SESSION_CACHE_BYTES];
+};
+
+// Not cleared by a restart or deep sleep; garbage after a power cycle
+RTC_NOINIT_ATTR static SessionCache sessionCache;
+
+static uint32_t fnv1a(const uint8_t *data, size_t length, uint32_t hash = 2166136261u)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t nameHash(const char *serverName)
+{
+    return fnv1a((const uint8_t *)serverName, strlen(serverName));
+}
+
+static uint32_t cacheCheck()
+{
+    uint32_t hash = fnv1a((const uint8_t *)&sessionCache, offsetof(SessionCache, check));
+    return fnv1a(sessionCache.data, sessionCache.length, hash);
+}
+
+static bool cacheValid(const char *serverName)
+{
+    return sessionCache.magic == SESSION_MAGIC && sessionCache.length <= SESSION_CACHE_BYTES &&
+           sessionCache.nameHash == nameHash(serverName) && sessionCache.check == cacheCheck();
+}
+#endif
+
+TlsClient::TlsClient(WiFiClient &tcp) : tcp_(tcp)
+{
+#ifdef IOT_MQTT_TLS
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    mbedtls_x509_crt_init(&caCert_);
+    mbedtls_x509_crt_init(&clientCert_);
+    mbedtls_pk_init(&clientKey_);
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ssl_init(&ssl_);
+#endif
+}
+
+// =============================================================================
+// CLIENT (TLS application data, or plain TCP)
+// =============================================================================
+
+int TlsClient::connect(IPAddress ip, uint16_t port)
+{
+    if (!tcp_.connect(ip, port))
+    {
+        return 0;
+    }
+    return enabled_ ? connectTls() : 1;
+}
+
+int TlsClient::connect(const char *host, uint16_t port)
+{
+    if (!tcp_.connect(host, port))
+    {
+        return 0;
+    }
+    return enabled_ ? connectTls() : 1;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    if (!tcp_.connect(ip, port, timeout))
+    {
+        return 0;
+    }
+    return enabled_ ? connectTls() : 1;
+}
+
+int TlsClient::connect(const char *host, uint16_t port, int32_t timeout)
+{
+    if (!tcp_.connect(host, port, timeout))
+    {
+        return 0;
+    }
+    return enabled_ ? connectTls() : 1;
+}
+
+// Blocking handshake for a caller that connects on its own (NetLink polls)
+int TlsClient::connectTls()
+{
+    startHandshake(millis());
+    for (;;)
+    {
+        Handshake result = pollHandshake(millis());
+        if (result == HANDSHAKE_DONE)
+        {
+            return 1;
+        }
+        if (result == HANDSHAKE_FAILED)
+        {
+            tcp_.stop();
+            return 0;
+        }
+        delay(1);
+    }
+}
+
+int TlsClient::sendSome(const uint8_t *buffer, size_t size)
+{
+    if (enabled_)
+    {
+        return tlsSend(buffer, size);
+    }
+    int n = send(tcp_.fd(), buffer, size, MSG_DONTWAIT);
+    if (n >= 0)
+    {
+        return n;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+}
+
+bool TlsClient::sendPending()
+{
+    return !enabled_ || tlsFlush() != 0;
+}
+
+size_t TlsClient::write(const uint8_t *buffer, size_t size)
+{
+    if (!enabled_)
+    {
+        return tcp_.write(buffer, size);
+    }
+    size_t written = 0;
+    while (written < size)
+    {
+        int n = tlsSend(buffer + written, size - written);
+        if (n < 0 || (n == 0 && !waitWritable(WRITE_TIMEOUT_MS)))
+        {
+            break;
+        }
+        written += n;
+    }
+    return written;
+}
+
+bool TlsClient::waitWritable(uint32_t timeoutMs)
+{
+    int fd = tcp_.fd();
+    if (fd < 0)
+    {
+        return false;
+    }
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(fd, &writable);
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(fd + 1, nullptr, &writable, nullptr, &timeout) > 0;
+}
+
+int TlsClient::available()
+{
+    if (!enabled_)
+    {
+        return tcp_.available();
+    }
+    return (peeked_ >= 0 ? 1 : 0) + tlsAvailable();
+}
+
+int TlsClient::read()
+{
+    if (!enabled_)
+    {
+        return tcp_.read();
+    }
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsClient::read(uint8_t *buffer, size_t size)
+{
+    if (!enabled_)
+    {
+        return tcp_.read(buffer, size);
+    }
+    if (size == 0)
+    {
+        return 0;
+    }
+    size_t n = 0;
+    if (peeked_ >= 0)
+    {
+        buffer[n++] = (uint8_t)peeked_;
+        peeked_ = -1;
+    }
+    if (n < size)
+    {
+        int got = tlsRead(buffer + n, size - n);
+        if (got > 0)
+        {
+            n += got;
+        }
+    }
+    return n > 0 ? (int)n : -1;
+}
+
+int TlsClient::peek()
+{
+    if (!enabled_)
+    {
+        return tcp_.peek();
+    }
+    if (peeked_ < 0)
+    {
+        uint8_t c;
+        if (tlsRead(&c, 1) == 1)
+        {
+            peeked_ = c;
+        }
+    }
+    return peeked_;
+}
+
+void TlsClient::flush()
+{
+    if (!enabled_)
+    {
+        tcp_.flush();
+    }
+}
+
+void TlsClient::stop()
+{
+    if (enabled_ && stage_ == ESTABLISHED)
+    {
+        tlsClose();
+    }
+    stage_ = IDLE;
+    peeked_ = -1;
+    recordPending_ = false;
+    tcp_.stop();
+}
+
+uint8_t TlsClient::connected()
+{
+    if (!enabled_)
+    {
+        return tcp_.connected();
+    }
+    return stage_ == ESTABLISHED && tcp_.connected();
+}
+
+#ifdef IOT_MQTT_TLS
+
+// =============================================================================
+// SETUP / HANDSHAKE
+// =============================================================================
+
+bool TlsClient::begin(const TlsConfig &config)
+{
+    config_ = config;
+    if (!config.serverName || !config.caCert)
+    {
+        Serial.println("❌ TLS: server name and CA certificate required");
+        return false;
+    }
+
+    int ret = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_, (const unsigned char *)"iot-mqtt", 8);
+    if (ret != 0)
+    {
+        Serial.printf("❌ TLS: RNG seed failed, -0x%04x\n", -ret);
+        return false;
+    }
+    ret = mbedtls_x509_crt_parse(&caCert_, (const unsigned char *)config.caCert, strlen(config.caCert) + 1);
+    if (ret != 0)
+    {
+        Serial.printf("❌ TLS: bad CA certificate, -0x%04x\n", -ret);
+        return false;
+    }
+
+    mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                MBEDTLS_SSL_PRESET_DEFAULT);
+    mbedtls_ssl_conf_min_version(&conf_, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+    mbedtls_ssl_conf_max_version(&conf_, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+    mbedtls_ssl_conf_ciphersuites(&conf_, CIPHERSUITES);
+    mbedtls_ssl_conf_curves(&conf_, CURVES);
+    mbedtls_ssl_conf_sig_hashes(&conf_, SIG_HASHES);
+    mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf_, &caCert_, nullptr);
+    mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf_, config.resumeSessions ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED
+                                                                   : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif
+
+    if (config.clientCert && config.clientKey)
+    {
+        ret = mbedtls_x509_crt_parse(&clientCert_, (const unsigned char *)config.clientCert,
+                                     strlen(config.clientCert) + 1);
+        if (ret == 0)
+        {
+            ret = mbedtls_pk_parse_key(&clientKey_, (const unsigned char *)config.clientKey,
+                                       strlen(config.clientKey) + 1, nullptr, 0);
+        }
+        if (ret == 0)
+        {
+            ret = mbedtls_ssl_conf_own_cert(&conf_, &clientCert_, &clientKey_);
+        }
+        if (ret != 0)
+        {
+            Serial.printf("❌ TLS: bad client certificate or key, -0x%04x\n", -ret);
+            return false;
+        }
+    }
+
+    // Allocates the record buffers, once
+    ret = mbedtls_ssl_setup(&ssl_, &conf_);
+    if (ret != 0)
+    {
+        Serial.printf("❌ TLS: setup failed, -0x%04x\n", -ret);
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl_, this, bioSend, bioRecv, nullptr);
+
+    enabled_ = true;
+    Serial.printf("🔒 TLS to %s (ECDHE-ECDSA P-256)%s\n", config.serverName,
+                  sessionCached() ? ", cached session" : "");
+    return true;
+}
+
+void TlsClient::startHandshake(uint32_t nowMs)
+{
+    if (!enabled_)
+    {
+        return;
+    }
+    peeked_ = -1;
+    recordPending_ = false;
+    mbedtls_ssl_session_reset(&ssl_);
+    mbedtls_ssl_set_hostname(&ssl_, config_.serverName);
+    offered_ = false;
+    sawCertificate_ = false;
+    if (config_.resumeSessions)
+    {
+        restoreSession();
+    }
+    handshakeStartMs_ = nowMs;
+    stage_ = HANDSHAKING;
+}
+
+TlsClient::Handshake TlsClient::pollHandshake(uint32_t nowMs)
+{
+    if (!enabled_)
+    {
+        return HANDSHAKE_DONE;
+    }
+    if (stage_ != HANDSHAKING)
+    {
+        return stage_ == ESTABLISHED ? HANDSHAKE_DONE : HANDSHAKE_FAILED;
+    }
+    if (nowMs - handshakeStartMs_ >= config_.handshakeTimeoutMs)
+    {
+        broken("handshake timed out", 0);
+        handshakeFailures_++;
+        sessionCache.magic = 0;
+        return HANDSHAKE_FAILED;
+    }
+
+    // One step per message; the broker's certificate only comes in a full
+    // handshake (a resumed one goes from ServerHello to ChangeCipherSpec).
+    // The slice is checked between steps only: an ECC step runs to the end
+    uint32_t sliceStart = millis();
+    while (ssl_.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+    {
+        uint32_t stepStart = millis();
+        if (stepStart - sliceStart >= HANDSHAKE_SLICE_MS)
+        {
+            return HANDSHAKE_PENDING; // rest on the next poll
+        }
+        int ret = mbedtls_ssl_handshake_step(&ssl_);
+        uint32_t stepMs = millis() - stepStart;
+        if (stepMs > maxStepMs_)
+        {
+            maxStepMs_ = stepMs;
+        }
+        if (ssl_.state == MBEDTLS_SSL_SERVER_CERTIFICATE)
+        {
+            sawCertificate_ = true;
+        }
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            return HANDSHAKE_PENDING;
+        }
+        if (ret != 0)
+        {
+            uint32_t flags = mbedtls_ssl_get_verify_result(&ssl_);
+            if (flags != 0 && flags != (uint32_t)-1)
+            {
+                char reason[96];
+                mbedtls_x509_crt_verify_info(reason, sizeof(reason), "", flags);
+                Serial.printf("❌ TLS: broker certificate rejected: %s", reason);
+            }
+            broken("handshake failed", ret);
+            handshakeFailures_++;
+            sessionCache.magic = 0; // start over with a full handshake
+            return HANDSHAKE_FAILED;
+        }
+    }
+
+    stage_ = ESTABLISHED;
+    uint32_t ms = millis() - handshakeStartMs_;
+    lastResumed_ = offered_ && !sawCertificate_;
+    if (lastResumed_)
+    {
+        resumedMs_ = ms;
+        resumedHandshakes_++;
+    }
+    else
+    {
+        fullMs_ = ms;
+        fullHandshakes_++;
+    }
+    // A full handshake brings a new ticket / id, a resumed one may renew it
+    if (config_.resumeSessions)
+    {
+        saveSession();
+    }
+    Serial.printf("🔒 TLS %s handshake in %u ms (%s)\n", lastResumed_ ? "resumed" : "full", (unsigned)ms,
+                  mbedtls_ssl_get_ciphersuite(&ssl_));
+    return HANDSHAKE_DONE;
+}
+
+void TlsClient::broken(const char *what, int ret)
+{
+    if (ret != 0)
+    {
+        char text[64];
+        mbedtls_strerror(ret, text, sizeof(text));
+        Serial.printf("❌ TLS %s: -0x%04x %s\n", what, -ret, text);
+    }
+    else
+    {
+        Serial.printf("❌ TLS %s\n", what);
+    }
+    stage_ = BROKEN;
+}
+
+// =============================================================================
+// SESSION CACHE (RTC memory)
+// =============================================================================
+
+bool TlsClient::sessionCached() const
+{
+    return enabled_ && cacheValid(config_.serverName);
+}
+
+void TlsClient::restoreSession()
+{
+    if (!cacheValid(config_.serverName))
+    {
+        return;
+    }
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, sessionCache.data, sessionCache.length) == 0 &&
+        mbedtls_ssl_set_session(&ssl_, &session) == 0)
+    {
+        offered_ = true;
+    }
+    else
+    {
+        sessionCache.magic = 0; // saved by a differently configured build
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+void TlsClient::saveSession()
+{
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    size_t length = 0;
+    sessionCache.magic = 0;
+    if (mbedtls_ssl_get_session(&ssl_, &session) == 0 &&
+        mbedtls_ssl_session_save(&session, sessionCache.data, sizeof(sessionCache.data), &length) == 0)
+    {
+        sessionCache.nameHash = nameHash(config_.serverName);
+        sessionCache.length = length;
+        sessionCache.magic = SESSION_MAGIC;
+        sessionCache.check = cacheCheck();
+    }
+    else
+    {
+        Serial.println("⚠️ TLS: session not cached, the next handshake is a full one");
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+// =============================================================================
+// RECORD I/O
+// =============================================================================
+
+// The socket stays in blocking mode for PubSubClient; mbedTLS never waits
+int TlsClient::bioSend(void *ctx, const unsigned char *buffer, size_t length)
+{
+    TlsClient *self = (TlsClient *)ctx;
+    int fd = self->tcp_.fd();
+    if (fd < 0)
+    {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    int n = send(fd, buffer, length, MSG_DONTWAIT);
+    if (n >= 0)
+    {
+        return n;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsClient::bioRecv(void *ctx, unsigned char *buffer, size_t length)
+{
+    TlsClient *self = (TlsClient *)ctx;
+    int fd = self->tcp_.fd();
+    if (fd < 0)
+    {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    int n = recv(fd, buffer, length, MSG_DONTWAIT);
+    if (n >= 0)
+    {
+        return n; // 0: closed by the broker
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+// A write the socket could not take has been encrypted already: mbedTLS
+// keeps the record and its next mbedtls_ssl_write() only flushes it (and
+// reports whatever it was given as written). So the bytes count as taken
+// and the record is flushed before anything new is encrypted.
+int TlsClient::tlsSend(const uint8_t *buffer, size_t size)
+{
+    if (stage_ != ESTABLISHED)
+    {
+        return -1;
+    }
+    int ret = tlsFlush();
+    if (ret <= 0)
+    {
+        return ret;
+    }
+    ret = mbedtls_ssl_write(&ssl_, buffer, size);
+    if (ret >= 0)
+    {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        // One record, at most the maximum payload, is waiting for the socket
+        recordPending_ = true;
+        int taken = mbedtls_ssl_get_max_out_record_payload(&ssl_);
+        return taken > 0 && (size_t)taken < size ? taken : (int)size;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+        return 0;
+    }
+    broken("write", ret);
+    return -1;
+}
+
+// 1: nothing pending (any more), 0: the socket is still full, -1: dead
+int TlsClient::tlsFlush()
+{
+    if (stage_ != ESTABLISHED)
+    {
+        return -1;
+    }
+    if (!recordPending_)
+    {
+        return 1;
+    }
+    int ret = mbedtls_ssl_flush_output(&ssl_);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        return 0;
+    }
+    if (ret != 0)
+    {
+        broken("write", ret);
+        return -1;
+    }
+    recordPending_ = false;
+    return 1;
+}
+
+// Decrypted bytes ready; reads one record off the socket when none are
+int TlsClient::tlsAvailable()
+{
+    if (stage_ != ESTABLISHED)
+    {
+        return 0;
+    }
+    size_t n = mbedtls_ssl_get_bytes_avail(&ssl_);
+    if (n == 0)
+    {
+        int ret = mbedtls_ssl_read(&ssl_, nullptr, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            broken(ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ? "closed by the broker" : "read", ret);
+            return 0;
+        }
+        n = mbedtls_ssl_get_bytes_avail(&ssl_);
+    }
+    return (int)n;
+}
+
+int TlsClient::tlsRead(uint8_t *buffer, size_t size)
+{
+    if (stage_ != ESTABLISHED)
+    {
+        return -1;
+    }
+    int ret = mbedtls_ssl_read(&ssl_, buffer, size);
+    if (ret > 0)
+    {
+        return ret;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        broken(ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ? "closed by the broker" : "read", ret);
+    }
+    return -1;
+}
+
+// close_notify, best effort (the socket is closed right after)
+void TlsClient::tlsClose()
+{
+    mbedtls_ssl_close_notify(&ssl_);
+}
+
+#else // IOT_MQTT_TLS
+
+// Built without TLS: begin() refuses and every call stays on the WiFiClient
+
+bool TlsClient::begin(const TlsConfig &)
+{
+    Serial.println("⚠️ TLS: built without IOT_MQTT_TLS, MQTT stays plain");
+    return false;
+}
+
+void TlsClient::startHandshake(uint32_t) {}
+TlsClient::Handshake TlsClient::pollHandshake(uint32_t) { return HANDSHAKE_DONE; }
+bool TlsClient::sessionCached() const { return false; }
+int TlsClient::tlsSend(const uint8_t *, size_t) { return -1; }
+int TlsClient::tlsFlush() { return 1; }
+int TlsClient::tlsAvailable() { return 0; }
+int TlsClient::tlsRead(uint8_t *, size_t) { return -1; }
+void TlsClient::tlsClose() {}
+
+#endif // IOT_MQTT_TLS
@@ -0,0 +1,190 @@
+/*
+ * TlsClient - MQTT over TLS with session resumption, on NetLink's socket
+ *
+ * Sits between the MQTT client and the WiFiClient that holds NetLink's TCP
+ * socket (PubSubClient -> MqttOutbox -> TlsClient -> WiFiClient). Without
+ * begin(), or in a build without IOT_MQTT_TLS, every call goes straight to
+ * the WiFiClient: plain MQTT on 1883 exactly as before.
+ *
+ * With TLS the handshake runs from NetLink::poll() on the non-blocking
+ * socket, one mbedTLS step per message: waiting for the broker never
+ * blocks, and no further step starts once a call has used
+ * HANDSHAKE_SLICE_MS. A step itself is not cut short, though: the ECDSA
+ * verify (ServerKeyExchange) and the ECDHE (ClientKeyExchange) of a full
+ * handshake are one software P-256 operation each, hundreds of ms on a C3
+ * (the Arduino mbedTLS build has no restartable ECC). maxStepMs() reports
+ * the longest step; a resumed handshake has neither:
+ *
+ *   full       ClientHello -> Certificate, ServerKeyExchange (ECDSA verify)
+ *              -> ClientKeyExchange (ECDHE P-256) -> Finished   2 RTT + ECC
+ *   resumed    ClientHello with the cached ticket / session id
+ *              -> ServerHello, Finished                          1 RTT, no ECC
+ *
+ * Only TLS 1.2 with ECDHE-ECDSA suites on P-256 is offered: the cheapest
+ * curve and signature to compute without an ECC accelerator (the broker
+ * key must be ECDSA P-256, see mosquitto/gen_certs.sh).
+ *
+ * After every handshake the session (ticket or id, master secret) is
+ * serialized into RTC memory that survives reconnects, software restarts
+ * and deep sleep but not a power cycle (RTC_NOINIT, checked with a hash).
+ * The next handshake offers it; a broker that no longer knows it simply
+ * answers with a full handshake. A failed handshake drops the cache.
+ *
+ * sendSome() is the non-blocking write MqttOutbox uses. Bytes mbedTLS has
+ * encrypted count as taken even when the socket did not take the record:
+ * it stays inside mbedTLS and goes out (sendPending(), or first thing in
+ * the next write) before anything else is encrypted, so no caller's bytes
+ * are lost or sent twice.
+ *
+ * Network task only. Needs mbedtls 2.x (Arduino-ESP32 2.x / IDF 4.4); the
+ * SSL buffers are allocated once by begin(), handshakes allocate (peer
+ * certificate, ECC), reading and writing application data does not.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef IOT_MQTT_TLS
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#endif
+
+struct TlsConfig
+{
+    const char *serverName; // SNI and the name checked in the broker certificate
+    const char *caCert;     // PEM of the CA that signed the broker certificate
+    const char *clientCert; // PEM, nullptr unless the broker asks for one
+    const char *clientKey;  // PEM (ECDSA P-256)
+    uint32_t handshakeTimeoutMs;
+    bool resumeSessions;    // false: every handshake is a full one (for comparison)
+};
+
+class TlsClient : public Client
+{
+public:
+#ifdef IOT_MQTT_TLS
+    static const bool SUPPORTED = true;
+#else
+    static const bool SUPPORTED = false;
+#endif
+
+    enum Handshake : uint8_t
+    {
+        HANDSHAKE_PENDING,
+        HANDSHAKE_DONE,
+        HANDSHAKE_FAILED
+    };
+
+    explicit TlsClient(WiFiClient &tcp);
+
+    // Parses the certificates and sets up the SSL context; false (plain
+    // TCP stays in use) on an error or without IOT_MQTT_TLS
+    bool begin(const TlsConfig &config);
+    bool enabled() const { return enabled_; }
+
+    // NetLink, once the TCP connect to the broker succeeded
+    void startHandshake(uint32_t nowMs);
+    Handshake pollHandshake(uint32_t nowMs);
+
+    // Non-blocking write: bytes taken, 0 when the socket is full (nothing
+    // taken), -1 when the connection is dead
+    int sendSome(const uint8_t *buffer, size_t size);
+    // Pushes out a record sendSome() left in mbedTLS; false while the socket
+    // is still full (wait until it is writable), true when nothing is left
+    bool sendPending();
+
+    int fd() const { return tcp_.fd(); }
+
+    // Last handshake, and the last full / resumed one (ms, 0 = none yet)
+    bool lastResumed() const { return lastResumed_; }
+    uint32_t lastHandshakeMs() const { return lastResumed_ ? resumedMs_ : fullMs_; }
+    uint32_t fullMs() const { return fullMs_; }
+    uint32_t resumedMs() const { return resumedMs_; }
+    uint32_t fullHandshakes() const { return fullHandshakes_; }
+    uint32_t resumedHandshakes() const { return resumedHandshakes_; }
+    uint32_t handshakeFailures() const { return handshakeFailures_; }
+    uint32_t maxStepMs() const { return maxStepMs_; } // longest handshake step since boot
+    bool sessionCached() const;
+
+    // Client: TLS application data, or the WiFiClient as is
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+    int connect(const char *host, uint16_t port, int32_t timeout) override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected() != 0; }
+    using Print::write;
+
+private:
+    static const uint32_t HANDSHAKE_SLICE_MS = 20; // no new step after this long in pollHandshake()
+    static const uint32_t WRITE_TIMEOUT_MS = 2000; // blocking write(): socket full this long
+
+    enum Stage : uint8_t
+    {
+        IDLE,        // no TLS connection (or plain TCP)
+        HANDSHAKING,
+        ESTABLISHED,
+        BROKEN       // fatal TLS error: connected() false, NetLink reconnects
+    };
+
+    int connectTls();
+    bool waitWritable(uint32_t timeoutMs);
+
+    // TLS side of the Client calls (only reached once begin() succeeded)
+    int tlsSend(const uint8_t *buffer, size_t size);
+    int tlsFlush();
+    int tlsAvailable();
+    int tlsRead(uint8_t *buffer, size_t size);
+    void tlsClose();
+
+#ifdef IOT_MQTT_TLS
+    static int bioSend(void *ctx, const unsigned char *buffer, size_t length);
+    static int bioRecv(void *ctx, unsigned char *buffer, size_t length);
+
+    void restoreSession();
+    void saveSession();
+    void broken(const char *what, int ret);
+
+    mbedtls_entropy_context entropy_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_x509_crt caCert_;
+    mbedtls_x509_crt clientCert_;
+    mbedtls_pk_context clientKey_;
+    mbedtls_ssl_config conf_;
+    mbedtls_ssl_context ssl_;
+#endif
+
+    WiFiClient &tcp_;
+    TlsConfig config_ = {};
+    bool enabled_ = false;
+    Stage stage_ = IDLE;
+    int peeked_ = -1;
+    bool recordPending_ = false; // encrypted, not all of it on the socket yet
+
+    uint32_t handshakeStartMs_ = 0;
+    bool offered_ = false;        // a cached session went into the ClientHello
+    bool sawCertificate_ = false; // the broker sent its certificate: full handshake
+
+    bool lastResumed_ = false;
+    uint32_t fullMs_ = 0;
+    uint32_t resumedMs_ = 0;
+    uint32_t fullHandshakes_ = 0;
+    uint32_t resumedHandshakes_ = 0;
+    uint32_t handshakeFailures_ = 0;
+    uint32_t maxStepMs_ = 0;
+};
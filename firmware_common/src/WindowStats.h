@@ -0,0 +1,56 @@
+/*
+ * WindowStats - streaming min/max/mean/stddev of one value over a window
+ *
+ * Welford's update: O(1) time and 20 bytes of state per value, numerically
+ * stable (no sum of squares that cancels out), so a window can take any
+ * number of samples. reset() starts the next window.
+ *
+ * stddev() is the sample standard deviation (n - 1); 0 below two samples.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+class WindowStats
+{
+public:
+    void add(float value)
+    {
+        count_++;
+        float delta = value - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (value - mean_);
+        if (count_ == 1 || value < min_)
+        {
+            min_ = value;
+        }
+        if (count_ == 1 || value > max_)
+        {
+            max_ = value;
+        }
+    }
+
+    void reset()
+    {
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+        min_ = 0;
+        max_ = 0;
+    }
+
+    uint32_t count() const { return count_; }
+    float min() const { return min_; }
+    float max() const { return max_; }
+    float mean() const { return mean_; }
+    float stddev() const { return count_ > 1 ? sqrtf(m2_ / (count_ - 1)) : 0.0f; }
+
+private:
+    uint32_t count_ = 0;
+    float mean_ = 0;
+    float m2_ = 0; // sum of squared differences from the mean
+    float min_ = 0;
+    float max_ = 0;
+};
@@ -0,0 +1,498 @@
+/*
+ * Native loop benchmark (env:native)
+ *
+ * Builds the unmodified firmware (src/main.cpp) against the host HAL in
+ * firmware_common/native and drives the task step functions directly, one
+ * stage at a time:
+ *
+ *   dht sample       dhtSampler.poll()        one full read (start, ISR frame, decode)
+ *   sensor publish   publishSensorSample()    JSON encode + MQTT outbox (queue, send())
+ *   command parse    mqttCallback()           zero-copy parse + queue
+ *   command apply    actuatorStep()           actuator task body (GPIO + whole fan ramp,
+ *                                             host fades end at once)
+ *   state + ack      networkStep()            coalesced device/state + device/ack
+ *                                             (DEVICE_STATE_COALESCE_MS after the change)
+ *   idle step        networkStep()            nothing pending
+ *   mqtt reconnect   networkStep() until online after a dropped session
+ *   wifi reconnect   networkStep() until online after the AP went away
+ *
+ * A connection is also dropped while the outbox is inside a PUBLISH: the
+ * next connection has to start with CONNECT (the broker stand-in closes a
+ * connection that does not, like Mosquitto). And after an idle sleep, a
+ * burst of 20 toggles has to cost a single device/state publish.
+ *
+ * Then one simulated idle minute (online, no samples or commands) is run
+ * twice: with the old fixed 10 ms network poll and with the tickless
+ * schedule (sleep for networkSleepMs()), reporting wake-ups and network
+ * task CPU time per minute.
+ *
+ * Every stage is timed with the thread CPU clock (ns) into a LatencyHistogram
+ * and the allocator is interposed to count malloc/calloc/realloc calls made
+ * inside it. The steady-state stages must not allocate: the exit code is 1 if
+ * one did (or the reconnect above failed), so the run can gate a CI job.
+ *
+ * Usage (from firmware_esp32c3/):
+ *   pio run -e native && .pio/build/native/program [-n iterations] [-v]
+ *
+ * -v echoes the firmware's Serial output to stderr.
+ */
+
+#include "../src/main.cpp"
+
+#include <NativeHal.h>
+
+#include <sys/socket.h>
+#include <time.h>
+
+// =============================================================================
+// ALLOCATION COUNTER
+// =============================================================================
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+static bool countAllocs = false;
+static uint64_t allocCalls = 0;
+static uint64_t allocBytes = 0;
+
+static void countAlloc(size_t size)
+{
+    if (countAllocs)
+    {
+        allocCalls++;
+        allocBytes += size;
+    }
+}
+
+extern "C"
+{
+    void *malloc(size_t size)
+    {
+        countAlloc(size);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        countAlloc(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        countAlloc(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void *ptr)
+    {
+        __libc_free(ptr);
+    }
+}
+
+// =============================================================================
+// STAGES
+// =============================================================================
+
+struct Stage
+{
+    const char *name;
+    bool steady; // must not allocate
+    LatencyHistogram ns;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t serialBytes;
+};
+
+Stage stages[] = {
+    {"dht sample", true, {}, 0, 0, 0},
+    {"sensor publish", true, {}, 0, 0, 0},
+    {"command parse", true, {}, 0, 0, 0},
+    {"command apply", true, {}, 0, 0, 0},
+    {"state + ack", true, {}, 0, 0, 0},
+    {"idle step", true, {}, 0, 0, 0},
+    {"mqtt reconnect", false, {}, 0, 0, 0},
+    {"wifi reconnect", false, {}, 0, 0, 0},
+};
+enum StageId
+{
+    DHT_SAMPLE,
+    SENSOR_PUBLISH,
+    COMMAND_PARSE,
+    COMMAND_APPLY,
+    STATE_ACK,
+    IDLE_STEP,
+    MQTT_RECONNECT,
+    WIFI_RECONNECT,
+    STAGE_COUNT
+};
+static_assert(sizeof(stages) / sizeof(stages[0]) == STAGE_COUNT, "One Stage per StageId");
+
+static uint64_t threadNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+template <typename F>
+void measure(StageId id, F body)
+{
+    Stage &stage = stages[id];
+    uint64_t allocsBefore = allocCalls;
+    uint64_t bytesBefore = allocBytes;
+    uint32_t serialBefore = NativeHal::serialBytes();
+
+    countAllocs = true;
+    uint64_t start = threadNs();
+    body();
+    uint64_t elapsed = threadNs() - start;
+    countAllocs = false;
+
+    stage.ns.record(elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+    stage.allocs += allocCalls - allocsBefore;
+    stage.bytes += allocBytes - bytesBefore;
+    stage.serialBytes += NativeHal::serialBytes() - serialBefore;
+}
+
+// Simulated time between scripted network task iterations
+const uint32_t STEP_MS = 10;
+
+// One network task iteration after STEP_MS of simulated time
+static void step()
+{
+    NativeHal::advanceMs(STEP_MS);
+    networkStep();
+}
+
+// The iteration that publishes a coalesced device/state (and its acks)
+static void stateStep()
+{
+    NativeHal::advanceMs(DEVICE_STATE_COALESCE_MS);
+    networkStep();
+}
+
+static bool runUntilOnline(uint32_t maxSteps)
+{
+    for (uint32_t i = 0; i < maxSteps && !netLink.online(); i++)
+    {
+        step();
+    }
+    return netLink.online();
+}
+
+// =============================================================================
+// SCENARIO
+// =============================================================================
+
+// Sensor task: poll the sampler until it has a new reading (the simulated
+// DHT plays its frame into the ISR), then take the cached reading
+static void sampleDht()
+{
+    for (uint32_t polls = 0; polls < 16 && !dhtSampler.takeFresh(); polls++)
+    {
+        NativeHal::advanceMs(dhtSampler.poll(millis()));
+    }
+}
+
+static void sensorRound(uint32_t round, bool timed)
+{
+    // Alternate past the deadband so report-on-change publishes every sample
+    NativeHal::advanceMs(SENSOR_PUBLISH_INTERVAL);
+    NativeHal::setDhtReading(round % 2 ? 25.0f : 24.0f, round % 2 ? 61.0f : 59.0f);
+    if (timed)
+    {
+        measure(DHT_SAMPLE, sampleDht);
+    }
+    else
+    {
+        sampleDht();
+    }
+    readSensor();
+
+    SensorSample sample;
+    if (!sampleQueue.pop(sample))
+    {
+        return;
+    }
+    if (timed)
+    {
+        measure(SENSOR_PUBLISH, [&]() { publishSensorSample(sample); });
+    }
+    else
+    {
+        publishSensorSample(sample);
+    }
+}
+
+static void commandRound(uint32_t round, bool timed)
+{
+    static const char *const COMMANDS[] = {
+        "{\"light\":\"toggle\",\"id\":\"bench-%lu\",\"ts\":%lu}",
+        "{\"fan\":\"toggle\",\"id\":\"bench-%lu\",\"ts\":%lu}",
+        "{\"fanSpeed\":%lu,\"id\":\"bench-%lu\"}",
+    };
+    char payload[96];
+    size_t which = round % 3;
+    int length = which == 2
+                     ? snprintf(payload, sizeof(payload), COMMANDS[which], (unsigned long)(round % 101), (unsigned long)round)
+                     : snprintf(payload, sizeof(payload), COMMANDS[which], (unsigned long)round, (unsigned long)millis());
+    char topic[sizeof(topicDeviceCmd)];
+    memcpy(topic, topicDeviceCmd, sizeof(topic));
+
+    if (!timed)
+    {
+        mqttCallback(topic, (byte *)payload, length);
+        actuatorStep();
+        step();
+        stateStep();
+        return;
+    }
+    measure(COMMAND_PARSE, [&]() { mqttCallback(topic, (byte *)payload, length); });
+    measure(COMMAND_APPLY, [&]() { actuatorStep(); });
+    step(); // arms the coalesced device/state publish
+    measure(STATE_ACK, [&]() { stateStep(); });
+}
+
+static void idleRound(bool timed)
+{
+    if (timed)
+    {
+        measure(IDLE_STEP, [&]() { step(); });
+    }
+    else
+    {
+        step();
+    }
+}
+
+static bool reconnectRound(StageId id)
+{
+    if (id == MQTT_RECONNECT)
+    {
+        NativeHal::dropSession();
+    }
+    else
+    {
+        NativeHal::setAccessPoint(false);
+        NativeHal::setAccessPoint(true);
+    }
+
+    bool online = false;
+    measure(id, [&]() {
+        step(); // notices the loss
+        online = runUntilOnline(100000);
+    });
+    return online;
+}
+
+// The broker stand-in reads only when the firmware does, so with a small
+// send buffer the outbox stalls inside a packet; then the connection drops
+static bool midPacketDropRound()
+{
+    int sendBuffer = 4096;
+    setsockopt(espClient.fd(), SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    static const uint8_t payload[999] = {};
+    for (uint32_t i = 0; i < 100000 && !mqttOutbox.partlyWritten(); i++)
+    {
+        if (mqttOutbox.stalled())
+        {
+            mqttOutbox.available(); // full between two packets: let the broker read
+        }
+        mqttOutbox.publish(topicSensorState, payload, sizeof(payload), false, 0);
+    }
+    if (!mqttOutbox.partlyWritten())
+    {
+        return false;
+    }
+
+    uint32_t protocolErrors = NativeHal::protocolErrors();
+    NativeHal::dropSession();
+    step(); // notices the loss
+    return runUntilOnline(100000) && NativeHal::protocolErrors() == protocolErrors;
+}
+
+// Toggles sent back to back after the network task slept: one retained
+// device/state for the whole burst (the coalescing window starts at the
+// first change, also when the timer wheel was idle for seconds)
+const uint32_t BURST_COMMANDS = 20;
+
+static bool burstAfterIdleRound()
+{
+    // Idle long enough, then sleep half of it so no timed job (heartbeat)
+    // comes due during the burst
+    uint32_t sleepMs = networkSleepMs(millis());
+    for (uint32_t i = 0; i < 10000 && sleepMs < 4 * DEVICE_STATE_COALESCE_MS; i++)
+    {
+        step();
+        sleepMs = networkSleepMs(millis());
+    }
+    NativeHal::advanceMs(sleepMs / 2);
+
+    NativeHal::watchTopic(MSGPACK_PAYLOADS ? topicDeviceStateMp : topicDeviceState);
+    char topic[sizeof(topicDeviceCmd)];
+    for (uint32_t i = 0; i < BURST_COMMANDS; i++)
+    {
+        char payload[64];
+        int length = snprintf(payload, sizeof(payload), "{\"light\":\"toggle\",\"id\":\"burst-%lu\"}",
+                              (unsigned long)i);
+        memcpy(topic, topicDeviceCmd, sizeof(topic));
+        mqttCallback(topic, (byte *)payload, length);
+        actuatorStep();
+        NativeHal::advanceMs(1);
+        networkStep();
+    }
+    stateStep();
+    uint32_t statePublishes = NativeHal::watchedPublishes();
+    NativeHal::watchTopic(nullptr);
+    return statePublishes == 1;
+}
+
+struct IdleMinute
+{
+    uint32_t wakeups;
+    uint64_t cpuNs;
+};
+
+// One minute online with nothing to publish: the network task sleeps either a
+// fixed pollMs or, with pollMs 0, for as long as networkSleepMs() allows
+static IdleMinute idleMinute(uint32_t pollMs)
+{
+    IdleMinute result = {0, 0};
+    unsigned long start = millis();
+    while (millis() - start < 60000 && result.wakeups < 60000)
+    {
+        uint32_t sleepMs = pollMs > 0 ? pollMs : networkSleepMs(millis());
+        NativeHal::advanceMs(min(sleepMs, (uint32_t)(60000 - (millis() - start))));
+
+        uint64_t begin = threadNs();
+        networkStep();
+        result.cpuNs += threadNs() - begin;
+        result.wakeups++;
+    }
+    return result;
+}
+
+static void printIdleReport(const IdleMinute &polled, const IdleMinute &tickless)
+{
+    printf("\n%-16s%12s%14s\n", "idle minute", "wakeups", "CPU us");
+    printf("%-16s%12lu%14.1f\n", "10 ms poll", (unsigned long)polled.wakeups, polled.cpuNs / 1000.0);
+    printf("%-16s%12lu%14.1f\n", "tickless", (unsigned long)tickless.wakeups, tickless.cpuNs / 1000.0);
+}
+
+static void printReport(uint32_t iterations)
+{
+    printf("\n%-16s%8s%12s%12s%12s%10s%10s%10s\n",
+           "stage", "calls", "p50 ns", "p99 ns", "max ns", "allocs", "B alloc", "B serial");
+    for (size_t i = 0; i < STAGE_COUNT; i++)
+    {
+        const Stage &stage = stages[i];
+        uint32_t calls = stage.ns.count();
+        if (calls == 0)
+        {
+            continue;
+        }
+        printf("%-16s%8lu%12lu%12lu%12lu%10.2f%10.1f%10.1f\n",
+               stage.name, (unsigned long)calls,
+               (unsigned long)stage.ns.percentile(50), (unsigned long)stage.ns.percentile(99),
+               (unsigned long)stage.ns.maxUs(),
+               (double)stage.allocs / calls, (double)stage.bytes / calls, (double)stage.serialBytes / calls);
+    }
+    printf("(allocs, B alloc, B serial: per call; %lu iterations, simulated time %lu s)\n",
+           (unsigned long)iterations, (unsigned long)(millis() / 1000));
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = 2000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            NativeHal::setSerialEcho(true);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            iterations = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+    }
+    const uint32_t reconnects = iterations / 20 > 0 ? iterations / 20 : 1;
+
+    NativeHal::attachDht(Board::DHT_PIN);
+    if (!NativeHal::startBroker(MQTT_PORT))
+    {
+        fprintf(stderr, "❌ Cannot listen on 127.0.0.1:%d\n", MQTT_PORT);
+        return 2;
+    }
+
+    setup();
+    if (!runUntilOnline(100000))
+    {
+        fprintf(stderr, "❌ Firmware never came online\n");
+        return 2;
+    }
+
+    // Warm-up: first publishes, lazy buffers, first journal/metrics passes
+    for (uint32_t i = 0; i < 32; i++)
+    {
+        sensorRound(i, false);
+        commandRound(i, false);
+        idleRound(false);
+    }
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        sensorRound(i, true);
+        commandRound(i, true);
+        idleRound(true);
+    }
+
+    for (uint32_t i = 0; i < reconnects; i++)
+    {
+        if (!reconnectRound(MQTT_RECONNECT) || !reconnectRound(WIFI_RECONNECT))
+        {
+            fprintf(stderr, "❌ Firmware did not reconnect\n");
+            return 2;
+        }
+    }
+
+    if (!midPacketDropRound())
+    {
+        fprintf(stderr, "❌ Reconnect after a drop inside a PUBLISH did not start with CONNECT\n");
+        return 1;
+    }
+
+    if (!burstAfterIdleRound())
+    {
+        fprintf(stderr, "❌ %lu commands after an idle sleep took more than one device/state publish\n",
+                (unsigned long)BURST_COMMANDS);
+        return 1;
+    }
+
+    printReport(iterations);
+
+    IdleMinute polled = idleMinute(STEP_MS);
+    IdleMinute tickless = idleMinute(0);
+    printIdleReport(polled, tickless);
+
+    int failed = 0;
+    for (size_t i = 0; i < STAGE_COUNT; i++)
+    {
+        if (stages[i].steady && stages[i].allocs > 0)
+        {
+            printf("❌ %s allocated %llu times\n", stages[i].name, (unsigned long long)stages[i].allocs);
+            failed = 1;
+        }
+    }
+    if (!failed)
+    {
+        printf("✅ Steady-state stages made no heap allocations (%lu MQTT publishes)\n",
+               (unsigned long)NativeHal::published());
+    }
+    return failed;
+}
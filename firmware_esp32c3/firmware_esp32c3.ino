@@ -0,0 +1,12 @@
+/*
+ * ESP32-C3 IoT Demo Firmware - Arduino IDE entry point
+ *
+ * The firmware lives in src/main.cpp (Arduino IDE compiles a sketch's src/
+ * folder too), the same source PlatformIO builds. The wiring comes from
+ * firmware_common/src/Boards.h: Esp32C3SuperMini unless IOT_BOARD says
+ * otherwise, e.g. change the default in src/main.cpp to
+ * Esp32C3SuperMiniDht22 for a board wired like the former
+ * esp32c3_iot_demo sketch (DHT22, LED on GPIO21, L298N on GPIO5/6/9).
+ *
+ * Needs the IoTCore library (firmware_common), see ARDUINO_SETUP.md.
+ */
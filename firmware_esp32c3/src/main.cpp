@@ -1,34 +1,90 @@
 /*
  * ESP32-C3 IoT Demo Firmware - REAL HARDWARE VERSION
  *
- * Hardware:
+ * Hardware (default board, see Boards.h for the others):
  * - ESP32-C3 Super Mini
  * - DHT11 Temperature & Humidity Sensor (GPIO2)
  * - Built-in LED for Light control (GPIO8)
  * - L298N Motor Driver for Fan control:
- *   - IN1: GPIO8
+ *   - IN1: GPIO5
  *   - IN2: GPIO9
  *   - ENA (PWM): GPIO10
  *
  * Features:
- * - WiFi connection with auto-reconnect
+ * - FreeRTOS tasks: sensor sampler, network/MQTT, actuator/command
+ *   (lock-free SPSC queues between them, atomic device state)
+ * - Non-blocking WiFi/MQTT reconnect (event-driven, exponential backoff)
+ * - Tickless network task (sleeps until the next deadline, socket data or a
+ *   task event), WiFi modem sleep, DFS and automatic light sleep
  * - MQTT client with LWT (Last Will Testament)
- * - Real DHT11 sensor readings
- * - Device control via MQTT commands (Light & Fan)
- * - PWM fan speed control
+ * - Real DHT11 sensor readings (interrupt-driven sampler, last-good cache)
+ * - Device control via MQTT commands, one row per output in the ACTUATORS
+ *   table (Light & Fan by default)
+ * - PWM fan speed control, ramped by the LEDC hardware fade engine
+ * - Light/fan state persisted in NVS (coalesced writes), restored at boot
  * - Retained device state messages for UI synchronization
+ * - Allocation-free publish/command path (static JSON arena, fixed buffers)
+ * - Optional batched telemetry (N samples per MQTT message)
+ * - Store-and-forward journal: readings taken while offline are kept in RAM /
+ *   LittleFS and replayed with their original timestamps after reconnect
+ * - Optional compact MessagePack payloads for sensor/device state (.../mp topics)
+ * - Report-on-change sensor publishing (per-field deadband, min/max interval)
+ * - Optional windowed summaries (min/max/mean/stddev per minute) instead of raw readings
+ * - Zero-copy command parsing with a (key, verb) -> handler route table
+ * - Command acknowledgements on device/ack (optional "id"/"ts" in the command)
+ * - Persistent MQTT session, QoS1 commands: commands sent while the board is
+ *   reconnecting are queued by the broker; "seq" suppresses redeliveries
+ * - Non-blocking publish path: a bounded outbox with a pipelined QoS1
+ *   in-flight window; a filling outbox holds the sensor task back
+ * - Runtime metrics on sys/metrics: loop time histogram, heap, task stacks,
+ *   reconnects, publish and DHT failures
+ * - Firmware update over MQTT: the image is streamed in chunks straight into
+ *   the inactive OTA partition (SHA-256 checked on the fly, resumable), and
+ *   rolled back if the new image does not get online
+ * - Optional MQTT over TLS (env esp32-c3-devkitm-1-tls): ECDHE-ECDSA P-256,
+ *   non-blocking handshake, sessions resumed across reconnects and restarts
  *
  * MQTT Topics:
- * - Publish sensor data: demo/room1/sensor/state
- * - Publish device state: demo/room1/device/state (retained)
+ * - Publish sensor data: demo/room1/sensor/state (MessagePack: .../sensor/state/mp)
+ * - Publish sensor batches: demo/room1/sensor/batch (batch mode, journal replay)
+ * - Publish sensor summaries: demo/room1/sensor/summary (summary mode)
+ * - Publish device state: demo/room1/device/state (retained, MessagePack: .../device/state/mp)
  * - Publish online status: demo/room1/sys/online (retained, LWT)
- * - Subscribe commands: demo/room1/device/cmd
+ * - Publish runtime metrics: demo/room1/sys/metrics (every 60 s)
+ * - Publish command acks: demo/room1/device/ack (commands carrying an "id")
+ * - Subscribe commands: demo/room1/device/cmd (QoS1)
+ * - Subscribe OTA: demo/room1/sys/ota (QoS1), demo/room1/sys/ota/data (image chunks)
+ * - Publish OTA progress: demo/room1/sys/ota/status
  */
 
 #include <WiFi.h>
+#include <LittleFS.h>
+#include <Boards.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
-#include <DHT.h>
+#include <DhtSampler.h>
+#include <NetLink.h>
+#include <LoopStats.h>
+#include <JsonArena.h>
+#include <HeapProbe.h>
+#include <SampleRing.h>
+#include <OfflineJournal.h>
+#include <ReportFilter.h>
+#include <WindowStats.h>
+#include <SpscQueue.h>
+#include <CommandParser.h>
+#include <CommandTrace.h>
+#include <CommandDedup.h>
+#include <LoopWaker.h>
+#include <TimerWheel.h>
+#include <FadeRamp.h>
+#include <PersistedState.h>
+#include <ActuatorRegistry.h>
+#include <OtaUpdater.h>
+#include <MqttOutbox.h>
+#include <TlsClient.h>
+#include <esp_pm.h>
+#include <atomic>
 
 // =============================================================================
 // CONFIGURATION
@@ -39,80 +95,453 @@ const char *WIFI_SSID = "LE HUNG";
 const char *WIFI_PASSWORD = "123456789";
 
 // MQTT Broker Configuration
+#ifdef IOT_NATIVE
+const char *MQTT_HOST = "127.0.0.1"; // env:native: the harness's loopback broker
+const int MQTT_PORT = 18830;
+#else
 const char *MQTT_HOST = "192.168.1.12"; // Your computer's IP running Mosquitto
-const int MQTT_PORT = 1883;
+const int MQTT_PORT = TlsClient::SUPPORTED ? 8883 : 1883; // TLS listener in TLS builds
+#endif
 const char *MQTT_USERNAME = ""; // Empty for no auth
 const char *MQTT_PASSWORD = ""; // Empty for no auth
 
+// Persistent session: the client id is DEVICE_ID plus the low half of the
+// chip MAC (stable across reboots, unique per board), so the broker keeps
+// the device/cmd subscription and queues QoS1 commands while we are away
+// and hands them over right after CONNACK.
+const bool MQTT_CLEAN_SESSION = false;
+const uint8_t COMMAND_QOS = 1;
+
+// Outgoing messages (see MqttOutbox.h)
+// Every publish is encoded into a bounded outbox and written without
+// blocking; QoS1 publishes are pipelined, up to MQTT_INFLIGHT_WINDOW await
+// their PUBACK at once. A full outbox fails the publish (sensor samples go
+// to the journal); from 3/4 full the sensor task skips readings until it
+// has drained to 1/4. Unacknowledged messages are resent after a reconnect.
+const uint8_t MQTT_PUBLISH_QOS = 1;     // every message the device publishes
+const uint8_t MQTT_INFLIGHT_WINDOW = 8; // QoS1 messages awaiting their PUBACK
+const size_t MQTT_OUTBOX_BYTES = 4096;
+const size_t MQTT_OUTBOX_SLOTS = 16;    // messages, power of two
+
+// MQTT over TLS (TLS builds only, -DIOT_MQTT_TLS; see TlsClient.h)
+// mosquitto/gen_certs.sh creates the CA and the broker certificate for
+// MQTT_TLS_SERVER_NAME and prints the CA in the form to paste below. The
+// broker is reached by MQTT_HOST; its certificate is checked against the
+// name (mbedTLS does not match IP addresses).
+// The session is cached in RTC memory: a reconnect or restart does a
+// resumed handshake (1 RTT, no ECC) instead of a full one.
+const char *MQTT_TLS_SERVER_NAME = "mosquitto.local";
+const char *MQTT_TLS_CA_CERT = R"PEM(-----BEGIN CERTIFICATE-----
+paste the output of mosquitto/gen_certs.sh here
+-----END CERTIFICATE-----
+)PEM";
+const char *MQTT_TLS_CLIENT_CERT = nullptr; // device certificate (require_certificate true)
+const char *MQTT_TLS_CLIENT_KEY = nullptr;
+const uint32_t MQTT_TLS_HANDSHAKE_TIMEOUT_MS = 8000;
+const bool MQTT_TLS_RESUME = true; // false: full handshake every time (to compare)
+
 // Device Configuration
 const char *DEVICE_ID = "esp32c3_real";
 const char *FIRMWARE_VERSION = "real-hw-1.0.0";
-const char *TOPIC_NS = "demo/room1"; // Match simulator and apps
-
-// GPIO Pin Configuration for ESP32-C3 Super Mini
-#define DHT_PIN 2      // DHT11 Data pin
-#define DHT_TYPE DHT11 // DHT11 sensor type
-
-#define LED_PIN 8 // Built-in LED (Light control)
-
-// L298N Motor Driver pins
-#define MOTOR_IN1 8  // L298N IN1
-#define MOTOR_IN2 9  // L298N IN2
-#define MOTOR_ENA 10 // L298N ENA (PWM)
-
-// PWM Configuration for Fan
-#define PWM_FREQ 5000 // 5 KHz
-#define PWM_CHANNEL 0
-#define PWM_RESOLUTION 8 // 8-bit (0-255)
+#define TOPIC_NS "demo/room1" // Match simulator and apps (literal: topics are built at compile time)
+
+// Board: pins, sensor, fan driver, LEDC API, polarity (see Boards.h).
+// PlatformIO envs pass -DIOT_BOARD; Arduino IDE builds use the default.
+#ifndef IOT_BOARD
+#define IOT_BOARD Esp32C3SuperMini
+#endif
+typedef IOT_BOARD Board;
+typedef BoardIO<Board> BoardPins;
+static_assert(Board::SENSOR == SENSOR_DHT11 || Board::SENSOR == SENSOR_DHT22,
+              "This firmware reads a DHT sensor (DhtSampler)");
+static_assert(BoardPins::HAS_FAN_SPEED, "fanSpeed commands need a PWM fan driver");
+const DhtSampler::Type DHT_TYPE = Board::SENSOR == SENSOR_DHT22 ? DhtSampler::DHT22_SENSOR : DhtSampler::DHT11_SENSOR;
+
+// Actuator Channels (see ActuatorRegistry.h)
+// One row per output. Commands ({"<name>":"on|off|toggle"}, {"<levelKey>":0-100}),
+// device/state and the NVS snapshot follow the table, so another relay is
+// one more row. FAN_CHANNEL ramps through LEDC fades, the others switch at once.
+constexpr ActuatorSpec ACTUATORS[] = {
+    // name, level key, kind, pin, dir pin, PWM pin, LEDC channel, active low, PWM Hz, PWM bits
+    {"light", nullptr, ACTUATOR_SWITCH, Board::LIGHT_PIN, NO_PIN, NO_PIN, 0, Board::LIGHT_ACTIVE_LOW, 0, 8},
+    {"fan", "fanSpeed", ACTUATOR_HBRIDGE, Board::FAN_PIN, Board::FAN_DIR_PIN, Board::FAN_PWM_PIN, Board::PWM_CHANNEL,
+     Board::FAN_ACTIVE_LOW, Board::PWM_FREQ, Board::PWM_BITS},
+};
+const size_t ACTUATOR_COUNT = sizeof(ACTUATORS) / sizeof(ACTUATORS[0]);
+const uint8_t FAN_CHANNEL = 1; // driven by fanRamp (BoardIO fades)
+static_assert(ACTUATORS[FAN_CHANNEL].kind == ACTUATOR_HBRIDGE && ACTUATORS[FAN_CHANNEL].pwmPin == Board::FAN_PWM_PIN,
+              "FAN_CHANNEL must be the board's L298N fan");
+
+// Fan Speed Ramp (see FadeRamp.h)
+// Speed changes and fan on/off fade the ENA duty in the LEDC hardware
+// instead of jumping, which jolts the motor and spikes the L298N current.
+// 0 -> 100 % takes the full-scale time (smaller steps proportionally less);
+// a command arriving mid-ramp retargets it within one segment. The actuator
+// task only runs between segments. Full-scale time 0 = no ramp.
+const RampPolicy FAN_RAMP_POLICY = {255, 1500, 100, RAMP_EASE_IN_OUT}; // full duty, full-scale ms, segment ms, curve
 
 // Timing Configuration
-const unsigned long SENSOR_PUBLISH_INTERVAL = 3000; // 3 seconds
+const unsigned long SENSOR_PUBLISH_INTERVAL = 3000; // 3 seconds (sampling interval in batch mode)
+
+// DHT Sampler Configuration (see DhtSampler.h)
+// The sampler reads the DHT in the background and keeps the last good
+// reading; every SENSOR_PUBLISH_INTERVAL the sensor task takes that cached
+// reading, unless it is older than DHT_MAX_AGE_MS.
+const uint32_t DHT_SAMPLE_INTERVAL_MS = 2000; // DHT11: at most ~1 read/s
+const uint32_t DHT_RETRY_MS = 1000;           // after a failed frame
+const uint32_t DHT_MAX_AGE_MS = 10000;        // older cached readings are not published
 const unsigned long HEARTBEAT_INTERVAL = 15000;     // 15 seconds
-const unsigned long WIFI_RECONNECT_INTERVAL = 5000; // 5 seconds
-const unsigned long MQTT_RECONNECT_INTERVAL = 5000; // 5 seconds
+const unsigned long LOOP_STATS_INTERVAL = 60000;    // 60 seconds
+const unsigned long METRICS_INTERVAL = 60000;       // sys/metrics, also the loop histogram window
+const unsigned long DEVICE_STATE_COALESCE_MS = 100; // one device/state publish per burst of changes
+
+// Task Configuration
+// The actuator task outranks the network task, so a command reaches the GPIO
+// as soon as it is parsed, even while the network task is stuck in a socket
+// call. The sensor task runs lowest: it only polls the DHT sampler.
+const UBaseType_t ACTUATOR_TASK_PRIORITY = 3;
+const UBaseType_t NETWORK_TASK_PRIORITY = 2;
+const UBaseType_t SENSOR_TASK_PRIORITY = 1;
+const uint32_t ACTUATOR_TASK_STACK = 3072;
+const uint32_t NETWORK_TASK_STACK = 8192; // JSON documents, MQTT, Serial
+const uint32_t SENSOR_TASK_STACK = 3072;
+const uint32_t NETWORK_IDLE_POLL_MS = 5000; // online and idle: longest sleep (keepalive is 60 s)
+const size_t SAMPLE_QUEUE_SIZE = 8;  // sensor -> network
+const size_t COMMAND_QUEUE_SIZE = 8; // network -> actuator
+const size_t COMMAND_TRACE_SLOTS = 4; // traced commands awaiting their device/ack
+const size_t COMMAND_DEDUP_WINDOW = 16; // recent command "seq" values (QoS1 redelivery)
+const size_t NETWORK_TIMER_SLOTS = 10; // timed jobs of the network task (TimerWheel)
+
+// Power Configuration
+// Between wake-ups the network task blocks in LoopWaker::wait() and every
+// task is idle: the CPU clocks down to PM_MIN_CPU_MHZ and, if the core was
+// built with tickless idle, enters automatic light sleep. The radio uses
+// modem sleep (it wakes for DTIM beacons, the AP buffers frames meanwhile,
+// so the MQTT session and keepalive are unaffected). 80 MHz minimum keeps
+// APB, and with it the fan PWM frequency, fixed; the fan holds off light
+// sleep while it runs because LEDC stops there.
+const bool POWER_SAVE = true;
+const int PM_MAX_CPU_MHZ = 160;
+const int PM_MIN_CPU_MHZ = 80;
+
+// Reconnect policy (see NetLink.h)
+const uint32_t NET_BACKOFF_MIN_MS = 500;        // first retry after 0.5 s
+const uint32_t NET_BACKOFF_MAX_MS = 30000;      // cap retries at 30 s
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000; // association + DHCP
+const uint32_t MQTT_TCP_TIMEOUT_MS = 3000;      // TCP handshake to broker
+const uint16_t MQTT_SOCKET_TIMEOUT_S = 1;       // CONNACK / packet read: the only blocking wait in NetLink
+
+// Fast reconnect (see NetLink.h): the BSSID/channel of the last AP that
+// reached the broker is cached in NVS, so a reboot associates without a
+// channel scan. Reusing its IP lease also skips DHCP; only enable it when
+// the router keeps this board's address (DHCP reservation), a reused lease
+// that cannot reach the broker falls back to DHCP.
+const bool WIFI_FAST_CONNECT = true;
+const bool WIFI_REUSE_IP_LEASE = false;
+const uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 3000; // then scan
+
+// Batch Telemetry Configuration
+// When enabled, readings are buffered and sent as one sensor/batch message
+// every SENSOR_BATCH_SIZE samples or SENSOR_BATCH_FLUSH_INTERVAL, whichever
+// comes first. sensor/state is not published in this mode.
+const bool SENSOR_BATCH_MODE = false;
+const size_t SENSOR_BATCH_SIZE = 10;                     // samples per message
+const unsigned long SENSOR_BATCH_FLUSH_INTERVAL = 30000; // 30 seconds
+const size_t SENSOR_BATCH_CAPACITY = 2 * SENSOR_BATCH_SIZE; // survives one failed flush
+
+// Report-on-change Configuration (sensor/state, see ReportFilter.h)
+// A reading is published when temperature or humidity moved past its
+// deadband (at most once per min interval), and always after the max
+// interval so consumers can detect liveness. Batch mode keeps every sample.
+const bool SENSOR_REPORT_ON_CHANGE = true;
+const ReportPolicy TEMPERATURE_REPORT_POLICY = {0.2f, 3000, 60000}; // °C, min ms, max ms
+const ReportPolicy HUMIDITY_REPORT_POLICY = {1.0f, 3000, 60000};    // %RH, min ms, max ms
+
+// Window Summary Configuration (see WindowStats.h)
+// When enabled, the DHT is read at its max rate and every reading is folded
+// into streaming accumulators; one sensor/summary message (min, max, mean,
+// stddev and count per field) per SENSOR_SUMMARY_WINDOW replaces the raw
+// sensor/state readings. Summaries are not journaled while offline.
+const bool SENSOR_SUMMARY_MODE = false;
+const unsigned long SENSOR_SUMMARY_WINDOW = 60000; // 1 minute
+const uint32_t DHT_SUMMARY_INTERVAL_MS = 1000;     // DHT11 max rate
+
+// Offline Journal Configuration (see OfflineJournal.h)
+// Readings that cannot be published are journaled: 64 in RAM, older ones in
+// LittleFS segments of 256 samples, at most 16 segments (4096 samples = ~3.4 h
+// at 3 s, 32 KB of flash). Past that the oldest segment is dropped.
+// After reconnect the backlog is replayed on sensor/batch, one message of
+// JOURNAL_REPLAY_BATCH samples every JOURNAL_REPLAY_INTERVAL.
+const char *JOURNAL_DIR = "/journal";
+const size_t JOURNAL_RAM_CAPACITY = 64;        // flash write = 32 samples (256 bytes)
+const uint16_t JOURNAL_SEGMENT_RECORDS = 256;  // samples per segment file
+const uint8_t JOURNAL_MAX_SEGMENTS = 16;       // flash budget
+const size_t JOURNAL_REPLAY_BATCH = SENSOR_BATCH_SIZE;
+const unsigned long JOURNAL_REPLAY_INTERVAL = 1000; // 1 message/s
+
+// Device State Persistence (see PersistedState.h)
+// Light, fan and fan speed survive a reboot: setup() restores them before
+// WiFi starts, so the first retained device/state is already right. NVS is
+// written once the state has been stable for the quiet time, at the latest
+// the max delay after the first unsaved change (one write per command burst).
+const bool PERSIST_DEVICE_STATE = true;
+const char *STATE_NVS_NAMESPACE = "iot";
+const PersistPolicy DEVICE_STATE_PERSIST_POLICY = {2000, 30000}; // quiet ms, max delay ms
+
+// OTA Update over MQTT (see OtaUpdater.h, sender: tests/ota_push.py)
+// sys/ota starts an update, sys/ota/data carries the image in chunks that
+// are written straight into the inactive app partition, sys/ota/status
+// reports progress. The new image must publish sys/online within
+// OTA_CONFIRM_TIMEOUT_MS of boot, and in at most OTA_MAX_BOOT_ATTEMPTS
+// boots, or the previous image is booted again.
+const bool OTA_ENABLED = true;
+const size_t OTA_CHUNK_SIZE = 4096;                  // one flash sector per chunk
+const uint8_t OTA_MAX_BOOT_ATTEMPTS = 3;
+const unsigned long OTA_CONFIRM_TIMEOUT_MS = 300000; // 5 minutes to reach the broker
+const unsigned long OTA_RESTART_DELAY_MS = 1000;     // "done" status out before the restart
+
+// Payload Encoding
+// JSON objects on sensor/state and device/state (web, Flutter apps) always;
+// true adds positional MessagePack arrays on sensor/state/mp and
+// device/state/mp (13-15 bytes instead of ~69, decoded by
+// database/mqtt_logger.py)
+const bool MSGPACK_PAYLOADS = false;
+const int ENCODING_BENCHMARK_ROUNDS = 200; // boot-time JSON vs MessagePack comparison
+const int COMMAND_BENCHMARK_ROUNDS = 200;  // boot-time parser comparison
+
+// Memory Configuration
+const size_t JSON_ARENA_SIZE = 4096; // Static pool for all JsonDocuments
+
+// Worst case per batched sample: "4294967295," + "-400," + "1000,"
+// Fixed part: ts, n, rssi, replay/prevBoot flags
+const size_t SENSOR_BATCH_PAYLOAD_SIZE = 96 + SENSOR_BATCH_SIZE * 22;
+// sys/online with every counter at its maximum is ~815 bytes (with "tls")
+const size_t STATUS_PAYLOAD_SIZE = 832;
+// sys/metrics: counters + loop histogram bucket counts (dense range, see LatencyHistogram)
+const size_t METRICS_HISTOGRAM_TEXT_SIZE = 640;
+const size_t METRICS_PAYLOAD_SIZE = 768 + METRICS_HISTOGRAM_TEXT_SIZE;
+const size_t SYSTEM_PAYLOAD_SIZE = STATUS_PAYLOAD_SIZE > METRICS_PAYLOAD_SIZE ? STATUS_PAYLOAD_SIZE : METRICS_PAYLOAD_SIZE;
+const size_t MQTT_PAYLOAD_BUFFER_SIZE = SENSOR_BATCH_PAYLOAD_SIZE > SYSTEM_PAYLOAD_SIZE ? SENSOR_BATCH_PAYLOAD_SIZE : SYSTEM_PAYLOAD_SIZE;
+// PubSubClient's buffer only receives (publishes go through the outbox):
+// commands, OTA control and an OTA chunk
+const size_t COMMAND_PAYLOAD_SIZE = 512;
+const size_t OTA_DATA_PAYLOAD_SIZE = OTA_ENABLED ? OTA_CHUNK_HEADER + OTA_CHUNK_SIZE : 0;
+const size_t MQTT_BUFFER_SIZE =
+    (COMMAND_PAYLOAD_SIZE > OTA_DATA_PAYLOAD_SIZE ? COMMAND_PAYLOAD_SIZE : OTA_DATA_PAYLOAD_SIZE) +
+    64; // + fixed header and topic
+
+static_assert(SENSOR_BATCH_SIZE > 0 && SENSOR_BATCH_SIZE <= 32, "Batch must fit the JSON arena");
+static_assert(MQTT_OUTBOX_BYTES >= 2 * (MQTT_PAYLOAD_BUFFER_SIZE + 64), "The outbox must hold two of the largest messages");
+static_assert(!(SENSOR_BATCH_MODE && SENSOR_SUMMARY_MODE), "Pick batch mode or summary mode");
 
 // =============================================================================
 // GLOBAL VARIABLES
 // =============================================================================
 
 WiFiClient espClient;
-PubSubClient mqttClient(espClient);
-DHT dht(DHT_PIN, DHT_TYPE);
+TlsClient mqttTls(espClient); // TLS on espClient's socket, or plain TCP
+MqttOutbox<MQTT_OUTBOX_BYTES, MQTT_OUTBOX_SLOTS> mqttOutbox(mqttTls, MQTT_INFLIGHT_WINDOW); // publishes
+PubSubClient mqttClient(mqttOutbox); // connect, subscribe, incoming messages (through the outbox's socket)
+NetLink netLink(espClient, mqttClient);
+DhtSampler dhtSampler;
+LoopStats loopStats;
+HeapProbe heapProbe;
+LoopWaker loopWaker; // wakes the network task (samples, state changes, WiFi events)
+
+// Every timed job of the network task; networkSleepMs() sleeps until the next one
+TimerWheel<NETWORK_TIMER_SLOTS> networkTimers;
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle batchFlushTimer;    // armed by the first buffered sample
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle summaryCloseTimer;  // armed by a window's first reading
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle journalReplayTimer; // runs while online with a backlog
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle persistTimer;       // armed by an unsaved device state
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle statePublishTimer;  // armed by the first change of a burst
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle otaRestartTimer;    // armed by a verified OTA image
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle otaConfirmTimer;    // runs from boot until a new image is online
+
+// JSON documents allocate from this arena, payloads serialize into this buffer
+JsonArena<JSON_ARENA_SIZE> jsonArena;
+char payloadBuffer[MQTT_PAYLOAD_BUFFER_SIZE];
+char metricsHistogramText[METRICS_HISTOGRAM_TEXT_SIZE];
+
+// Batched sensor samples (temperature/humidity in tenths)
+struct SensorSample
+{
+    uint32_t timestamp;
+    int16_t temperature10;
+    uint16_t humidity10;
+};
+SampleRing<SensorSample, SENSOR_BATCH_CAPACITY> sensorBatch;
+
+// Actuator command, parsed by the network task and applied by the actuator task
+struct ActuatorCommand
+{
+    enum Action : uint8_t
+    {
+        OFF,
+        ON,
+        TOGGLE,
+        SET
+    };
+
+    uint8_t channel;     // row of ACTUATORS
+    Action action;
+    uint8_t value;       // SET: level, PWM duty 0-255
+    uint8_t traceSlot;   // CommandTrace slot to acknowledge, or NONE
+    uint32_t receivedUs; // micros() when parsed, for the latency counter
+};
+
+// Target state of the outputs, folded from a batch of queued commands
+struct ActuatorIntent
+{
+    ActuatorState channels[ACTUATOR_COUNT];
+};
+
+// Lock-free queues between the tasks (one producer, one consumer each)
+SpscQueue<SensorSample, SAMPLE_QUEUE_SIZE> sampleQueue;       // sensor -> network
+SpscQueue<ActuatorCommand, COMMAND_QUEUE_SIZE> commandQueue; // network -> actuator
+
+// Correlation ids of commands awaiting their device/ack
+CommandTrace<COMMAND_TRACE_SLOTS> commandTrace;
+
+// Command sequence numbers already applied (network task)
+CommandDedup<COMMAND_DEDUP_WINDOW> commandDedup;
+
+TaskHandle_t sensorTaskHandle = nullptr;
+TaskHandle_t networkTaskHandle = nullptr;
+TaskHandle_t actuatorTaskHandle = nullptr;
+
+// Samples waiting for the broker to come back
+OfflineJournal<SensorSample, JOURNAL_RAM_CAPACITY> sensorJournal;
+
+// Report-on-change state and suppressed-reading counters
+ReportFilter temperatureReport(TEMPERATURE_REPORT_POLICY);
+ReportFilter humidityReport(HUMIDITY_REPORT_POLICY);
+uint32_t sensorSuppressed = 0;
+std::atomic<uint32_t> sensorThrottled{0}; // readings the sensor task skipped (outbox backpressure)
+
+// Summary mode: current window (network task)
+WindowStats temperatureWindow;
+WindowStats humidityWindow;
+uint32_t summaryWindowStart = 0; // timestamp of the window's first reading
+uint32_t summariesDropped = 0;   // windows closed while offline
 
-// Device state
-bool lightState = false;
-bool fanState = false;
-int fanSpeed = 255; // PWM value 0-255
+uint32_t bootFirstPublishMs = 0; // first sys/online after boot (network task)
 
-// Timing variables
-unsigned long lastSensorPublish = 0;
-unsigned long lastHeartbeat = 0;
-unsigned long lastWifiCheck = 0;
+// Device state: written by the actuator task only, read by the network task
+// (fan level: PWM value 0-255, the ramp's goal while the fan is on)
+ActuatorRegistry<ACTUATOR_COUNT> actuators(ACTUATORS);
+std::atomic<bool> deviceStateDirty{false};    // actuator -> network: publish state
+std::atomic<uint32_t> commandLatencyMaxUs{0}; // parse -> GPIO, worst case
+std::atomic<uint32_t> commandsCoalesced{0};   // commands folded into another's output write
 
-// MQTT Topics
-String topicSensorState;
-String topicDeviceState;
-String topicDeviceCmd;
-String topicSysOnline;
+// Health counters for sys/metrics
+uint32_t publishFailures = 0; // network task (DHT failures: dhtSampler.failures())
+unsigned long metricsWindowStart = 0; // millis() of the last published metrics
+
+// Device state as stored in NVS (no padding: compared byte-wise)
+struct DeviceSnapshot
+{
+    uint8_t channels; // ACTUATOR_COUNT when saved
+    uint8_t on[ACTUATOR_COUNT];
+    uint8_t level[ACTUATOR_COUNT]; // PWM duty 0-255
+};
+PersistedState<DeviceSnapshot> deviceStateStore(STATE_NVS_NAMESPACE, DEVICE_STATE_PERSIST_POLICY); // network task
+
+// Firmware update in progress, boot confirmation (network task)
+OtaUpdater otaUpdater(OTA_CHUNK_SIZE);
+
+// Fan ramp: actuator task only; the LEDC interrupt flags each finished fade
+FadeRamp fanRamp(FAN_RAMP_POLICY);
+std::atomic<bool> fanFadeEnded{false};
+bool fanFadeReady = false; // hardware fades available, else direct writes
+
+// Keeps the chip out of light sleep while the fan PWM runs (actuator task)
+esp_pm_lock_handle_t fanPmLock = nullptr;
+bool fanPmLockHeld = false;
+
+// MQTT client id, derived from the eFuse MAC: stable across reboots (persistent session)
+char mqttClientId[32];
+
+// MQTT Topics (concatenated at compile time)
+const char topicSensorState[] = TOPIC_NS "/sensor/state";
+const char topicSensorStateMp[] = TOPIC_NS "/sensor/state/mp";
+const char topicSensorBatch[] = TOPIC_NS "/sensor/batch";
+const char topicSensorSummary[] = TOPIC_NS "/sensor/summary";
+const char topicDeviceState[] = TOPIC_NS "/device/state";
+const char topicDeviceStateMp[] = TOPIC_NS "/device/state/mp";
+const char topicDeviceCmd[] = TOPIC_NS "/device/cmd";
+const char topicDeviceAck[] = TOPIC_NS "/device/ack";
+const char topicSysOnline[] = TOPIC_NS "/sys/online";
+const char topicSysMetrics[] = TOPIC_NS "/sys/metrics";
+const char topicSysOta[] = TOPIC_NS "/sys/ota";
+const char topicSysOtaData[] = TOPIC_NS "/sys/ota/data";
+const char topicSysOtaStatus[] = TOPIC_NS "/sys/ota/status";
 
 // =============================================================================
 // FUNCTION DECLARATIONS
 // =============================================================================
 
+void initOta();
+void initPower();
 void initGPIO();
+void restoreDeviceState();
+void initStorage();
 void initTopics();
-void initWiFi();
 void initMQTT();
-void reconnectWiFi();
-void reconnectMQTT();
+void initNetwork();
+void initTimers();
+void startTasks();
+void sensorTask(void *);
+void networkTask(void *);
+void actuatorTask(void *);
+bool actuatorStep();
+bool applyQueuedCommands();
+bool applyIntent(const ActuatorIntent &intent);
+void writeChannel(size_t channel, const ActuatorState &from, const ActuatorState &to);
+bool advanceFanRamp();
+void networkStep();
+uint32_t networkSleepMs(unsigned long nowMs);
+void publishHeartbeat();
+void reportLoopStats();
+void replayJournalJob();
+void noteDeviceState(uint32_t nowMs);
+void persistDeviceStateJob();
+void publishDeviceStateJob();
+void otaRestartJob();
+void otaConfirmJob();
+void wakeNetworkTask();
+void onMqttConnected();
 void mqttCallback(char *topic, byte *payload, unsigned int length);
-void handleCommand(JsonDocument &doc);
-void publishSensorData();
+bool otaMessage(const char *topic, const uint8_t *payload, size_t length);
+CommandResult actuatorCommand(const CommandToken &key, const CommandToken &value);
+bool traceField(const CommandToken &value);
+bool queueCommand(const ActuatorCommand &command);
+void foldCommand(ActuatorIntent &intent, const ActuatorCommand &command);
+void readSensor();
+void publishSensorSample(const SensorSample &sample);
+void buildSensorJson(JsonDocument &doc, const SensorSample &sample, int rssi);
+void buildSensorMsgPack(JsonDocument &doc, const SensorSample &sample, int rssi);
+void flushSensorBatch();
+void publishSensorSummary();
+void addSummaryFields(JsonObject out, const WindowStats &stats);
+void journalSensorBatch();
+void replaySensorJournal();
+bool publishSensorBatch(const SensorSample *samples, size_t count, bool replay, bool previousBoot);
 void publishDeviceState();
+uint32_t channelDuty(size_t channel);
+void publishCommandAcks(uint32_t readySlots);
 void publishOnlineStatus(bool online);
-void setLight(bool state);
-void setFan(bool state);
-void setFanSpeed(int speed);
+void publishOtaStatus();
+void publishMetrics();
+bool publishJson(const char *topic, const JsonDocument &doc, bool retained);
+bool publishMsgPack(const char *topic, const JsonDocument &doc, bool retained);
+bool publishBuffer(const char *topic, size_t length, bool retained);
+void benchmarkPayloadEncoding();
+void benchmarkCommandParsing();
+void driveFan(const ActuatorState &from, const ActuatorState &to);
+void rampFanTo(uint32_t duty);
+void onFanFadeEnd();
+void holdAwake(bool hold);
 
 // =============================================================================
 // SETUP FUNCTION
@@ -120,8 +549,9 @@ void setFanSpeed(int speed);
 
 void setup()
 {
+    // No settle delay: a USB serial monitor attached later misses the banner,
+    // but WiFi starts ~1 s sooner
     Serial.begin(115200);
-    delay(1000);
 
     Serial.println("\n╔════════════════════════════════════════════╗");
     Serial.println("║   ESP32-C3 IoT Real Hardware Demo         ║");
@@ -129,27 +559,56 @@ void setup()
     Serial.printf("🆔 Device ID: %s\n", DEVICE_ID);
     Serial.printf("📦 Firmware: %s\n", FIRMWARE_VERSION);
     Serial.printf("📡 Topic Namespace: %s\n", TOPIC_NS);
-    Serial.printf("🌡️  DHT11 Sensor: GPIO%d\n", DHT_PIN);
-    Serial.printf("💡 LED: GPIO%d\n", LED_PIN);
-    Serial.printf("🌀 Motor: IN1=GPIO%d, IN2=GPIO%d, ENA=GPIO%d\n", MOTOR_IN1, MOTOR_IN2, MOTOR_ENA);
+    Serial.printf("🧩 Board: %s\n", Board::NAME);
+    Serial.printf("🌡️  DHT%d Sensor: GPIO%d\n", (int)DHT_TYPE, Board::DHT_PIN);
+    Serial.printf("💡 LED: GPIO%d\n", Board::LIGHT_PIN);
+    Serial.printf("🌀 Motor: IN1=GPIO%d, IN2=GPIO%d, ENA=GPIO%d\n", Board::FAN_PIN, Board::FAN_DIR_PIN,
+                  Board::FAN_PWM_PIN);
     Serial.println("────────────────────────────────────────────");
 
+    // A freshly updated image counts this boot (rolls back after too many)
+    initOta();
+
+    // CPU frequency scaling, light sleep, WiFi modem sleep
+    initPower();
+
     // Initialize GPIO pins
     initGPIO();
 
-    // Initialize DHT sensor
-    dht.begin();
-    Serial.println("✅ DHT11 sensor initialized");
+    // Light/fan as before the reboot, before the network publishes anything
+    restoreDeviceState();
 
     // Initialize MQTT topics
     initTopics();
 
-    // Initialize WiFi
-    initWiFi();
-
-    // Initialize MQTT
+    // Initialize MQTT client
     initMQTT();
 
+    // Start WiFi/MQTT connection (returns immediately). As early as possible:
+    // association and DHCP run in the background while the rest of setup()
+    // and the boot benchmarks execute.
+    initNetwork();
+
+    // Initialize DHT sampler (first read starts with the sensor task)
+    dhtSampler.begin(Board::DHT_PIN, DHT_TYPE, SENSOR_SUMMARY_MODE ? DHT_SUMMARY_INTERVAL_MS : DHT_SAMPLE_INTERVAL_MS,
+                     DHT_RETRY_MS);
+    Serial.println("✅ DHT sampler initialized");
+
+    // Mount LittleFS for the offline journal
+    initStorage();
+
+    // Print JSON vs MessagePack size/encode time for a sensor reading
+    benchmarkPayloadEncoding();
+
+    // Print zero-copy parser vs JsonDocument time per command
+    benchmarkCommandParsing();
+
+    // Register the network task's periodic and one-shot jobs
+    initTimers();
+
+    // Hand everything over to the sensor, network and actuator tasks
+    startTasks();
+
     Serial.println("✅ Setup complete!");
     Serial.println("────────────────────────────────────────────\n");
 }
@@ -160,410 +619,1598 @@ void setup()
 
 void loop()
 {
-    unsigned long currentMillis = millis();
+    // All work runs in the tasks started by setup()
+    vTaskDelete(nullptr);
+}
+
+// =============================================================================
+// TASKS
+// =============================================================================
+
+void startTasks()
+{
+    xTaskCreate(actuatorTask, "actuator", ACTUATOR_TASK_STACK, nullptr, ACTUATOR_TASK_PRIORITY, &actuatorTaskHandle);
+    xTaskNotifyGive(actuatorTaskHandle); // a fan ramp restored in setup() may be waiting
+    xTaskCreate(networkTask, "network", NETWORK_TASK_STACK, nullptr, NETWORK_TASK_PRIORITY, &networkTaskHandle);
+    xTaskCreate(sensorTask, "sensor", SENSOR_TASK_STACK, nullptr, SENSOR_TASK_PRIORITY, &sensorTaskHandle);
+    Serial.println("✅ Tasks started: actuator, network, sensor");
+}
+
+// Drives the DHT sampler and queues its cached reading every
+// SENSOR_PUBLISH_INTERVAL (summary mode: every new reading); sleeps in
+// between (start pulse, frame, interval)
+void sensorTask(void *)
+{
+    unsigned long lastSample = millis();
+    for (;;)
+    {
+        unsigned long now = millis();
+        uint32_t sleepMs = dhtSampler.poll(now);
+
+        if (SENSOR_SUMMARY_MODE)
+        {
+            if (dhtSampler.takeFresh())
+            {
+                readSensor();
+            }
+        }
+        else if (now - lastSample >= SENSOR_PUBLISH_INTERVAL)
+        {
+            lastSample += SENSOR_PUBLISH_INTERVAL;
+            readSensor();
+        }
+        uint32_t untilSample = SENSOR_PUBLISH_INTERVAL - (now - lastSample);
+        vTaskDelay(pdMS_TO_TICKS(min(sleepMs, untilSample)) + 1); // at least one tick
+    }
+}
+
+// Owns WiFi, MQTT, JSON and the publish path (NetLink, journal, batching)
+void networkTask(void *)
+{
+    heapProbe.attach();
+    for (;;)
+    {
+        networkStep();
+
+        // Tickless: sleep until the next deadline, MQTT data (or room for
+        // the outbox's stalled write) or a wakeNetworkTask()
+        loopWaker.wait(netLink.online() ? espClient.fd() : -1, networkSleepMs(millis()), mqttOutbox.stalled());
+    }
+}
+
+// Called by the sensor/actuator tasks and NetLink's WiFi event handler
+void wakeNetworkTask()
+{
+    loopWaker.wake();
+}
+
+// Applies queued commands to the GPIOs and starts the fan ramp's next
+// fade. No Serial or network I/O here, so command-to-GPIO latency does not
+// depend on the network task.
+void actuatorTask(void *)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (actuatorStep())
+        {
+            wakeNetworkTask();
+        }
+    }
+}
+
+// One wake-up of the actuator task; true if the network task has a state
+// and/or ack to publish
+bool actuatorStep()
+{
+    bool changed = applyQueuedCommands();
+    while (fanFadeEnded.exchange(false))
+    {
+        if (advanceFanRamp())
+        {
+            deviceStateDirty.store(true); // reached the target duty
+            changed = true;
+        }
+    }
+    return changed;
+}
 
-    // Check WiFi connection
-    if (currentMillis - lastWifiCheck >= WIFI_RECONNECT_INTERVAL)
+// Drains the command queue: the queued commands are folded, in order, into
+// one target state and the outputs are written once, so a burst of toggles
+// costs one GPIO write / ramp retarget, and nothing is dropped. True if
+// anything was applied (the network task then has a state and/or ack to
+// publish)
+bool applyQueuedCommands()
+{
+    bool applied = false;
+    for (;;)
     {
-        lastWifiCheck = currentMillis;
-        if (WiFi.status() != WL_CONNECTED)
+        ActuatorCommand batch[COMMAND_QUEUE_SIZE];
+        size_t count = 0;
+        while (count < COMMAND_QUEUE_SIZE && commandQueue.pop(batch[count]))
+        {
+            count++;
+        }
+        if (count == 0)
+        {
+            return applied;
+        }
+
+        ActuatorIntent intent;
+        for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+        {
+            intent.channels[i] = actuators.state(i);
+        }
+        for (size_t i = 0; i < count; i++)
         {
-            Serial.println("⚠️  WiFi disconnected, reconnecting...");
-            reconnectWiFi();
+            foldCommand(intent, batch[i]);
         }
+        bool changed = applyIntent(intent);
+        uint32_t appliedUs = micros();
+        commandsCoalesced.store(commandsCoalesced.load(std::memory_order_relaxed) + count - 1,
+                                std::memory_order_relaxed);
+
+        // State flag first: an ack never overtakes its device/state
+        if (changed)
+        {
+            deviceStateDirty.store(true);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t latencyUs = appliedUs - batch[i].receivedUs;
+            if (latencyUs > commandLatencyMaxUs.load(std::memory_order_relaxed))
+            {
+                commandLatencyMaxUs.store(latencyUs, std::memory_order_relaxed);
+            }
+            commandTrace.applied(batch[i].traceSlot, appliedUs);
+        }
+        applied = true;
+    }
+}
+
+// One iteration of the network task (the former loop())
+void networkStep()
+{
+    loopStats.begin();
+    heapProbe.begin();
+    bool wasOnline = netLink.online();
+    uint32_t mqttReconnects = netLink.mqttReconnects();
+    bool journalOnFlash = sensorJournal.flashPending() > 0;
+    uint32_t nvsWrites = deviceStateStore.writes();
+    OtaState otaState = otaUpdater.state();
+    unsigned long currentMillis = millis();
+
+    // Heartbeat, metrics, batch flush, summary window, journal replay, loop
+    // report. First, so the wheel clock has caught up with the idle sleep
+    // before this iteration arms a timer (start() counts from the last run())
+    networkTimers.run(currentMillis);
+
+    // Advance WiFi/MQTT connection state machine and service MQTT (non-blocking)
+    netLink.poll(currentMillis);
+
+    // PUBACKs read by poll() freed window slots, or the socket takes more now
+    mqttOutbox.transmit();
+
+    // Publish samples queued by the sensor task
+    SensorSample sample;
+    while (sampleQueue.pop(sample))
+    {
+        publishSensorSample(sample);
     }
 
-    // Check MQTT connection
-    if (!mqttClient.connected())
+    // Acks for commands the actuator task has finished, taken before the
+    // state flag so the state they caused is published ahead of them
+    uint32_t acksReady = commandTrace.ready();
+
+    // Device state changed: one retained publish DEVICE_STATE_COALESCE_MS
+    // after the first change (publishDeviceStateJob), however many commands
+    // arrive meanwhile. Acks wait for the publish that carries their state.
+    if (deviceStateDirty.load() && !networkTimers.pending(statePublishTimer))
+    {
+        networkTimers.start(statePublishTimer, DEVICE_STATE_COALESCE_MS);
+    }
+    if (!networkTimers.pending(statePublishTimer))
+    {
+        publishCommandAcks(acksReady);
+    }
+
+    // OTA progress: one status per iteration however many chunks came in (the
+    // sender paces itself on it); a verified image restarts shortly after
+    if (otaUpdater.statusPending() && netLink.online())
+    {
+        publishOtaStatus();
+    }
+    if (otaUpdater.state() == OTA_DONE && !networkTimers.pending(otaRestartTimer))
     {
-        reconnectMQTT();
+        networkTimers.start(otaRestartTimer, OTA_RESTART_DELAY_MS);
     }
-    mqttClient.loop();
 
-    // Publish sensor data periodically
-    if (currentMillis - lastSensorPublish >= SENSOR_PUBLISH_INTERVAL)
+    // A full batch goes out right away (the flush timer covers a partial one)
+    if (SENSOR_BATCH_MODE && sensorBatch.size() >= SENSOR_BATCH_SIZE)
     {
-        lastSensorPublish = currentMillis;
-        publishSensorData();
+        flushSensorBatch();
     }
 
-    // Publish heartbeat (device state + online status)
-    if (currentMillis - lastHeartbeat >= HEARTBEAT_INTERVAL)
+    // Drain the offline journal at a limited pace once back online
+    if (netLink.online() && !sensorJournal.empty() && !networkTimers.pending(journalReplayTimer))
     {
-        lastHeartbeat = currentMillis;
-        publishDeviceState();
-        publishOnlineStatus(true);
+        networkTimers.start(journalReplayTimer, JOURNAL_REPLAY_INTERVAL);
     }
+
+    loopStats.end();
+
+    // Debug builds: steady-state iterations must not touch the heap
+    // (replaying from LittleFS opens files, NVS writes may grow its index and
+    // starting or ending an OTA update allocates, so none counts as steady)
+    heapProbe.end(wasOnline && netLink.online() && mqttReconnects == netLink.mqttReconnects() &&
+                  !journalOnFlash && sensorJournal.flashPending() == 0 && nvsWrites == deviceStateStore.writes() &&
+                  otaState == otaUpdater.state());
+}
+
+// ms until networkStep() has timed work; events (samples, state changes,
+// WiFi, MQTT data) wake the task earlier
+uint32_t networkSleepMs(unsigned long nowMs)
+{
+    // WiFiClient / mbedTLS may already hold bytes read off the socket (select() would not see them)
+    if (netLink.online() && mqttTls.available() > 0)
+    {
+        return 0;
+    }
+
+    return min(netLink.nextPollMs(nowMs), networkTimers.untilNext(nowMs));
 }
 
 // =============================================================================
-// GPIO INITIALIZATION
+// TIMED JOBS (network task, see initTimers())
 // =============================================================================
 
-void initGPIO()
+void initTimers()
 {
-    // LED pin
-    pinMode(LED_PIN, OUTPUT);
-    digitalWrite(LED_PIN, LOW);
+    networkTimers.begin(millis());
+    networkTimers.every(HEARTBEAT_INTERVAL, publishHeartbeat);
+    networkTimers.every(METRICS_INTERVAL, publishMetrics); // also the loop histogram window
+    networkTimers.every(LOOP_STATS_INTERVAL, reportLoopStats);
+    batchFlushTimer = networkTimers.add(flushSensorBatch);
+    summaryCloseTimer = networkTimers.add(publishSensorSummary);
+    journalReplayTimer = networkTimers.add(replayJournalJob, JOURNAL_REPLAY_INTERVAL);
+    persistTimer = networkTimers.add(persistDeviceStateJob);
+    statePublishTimer = networkTimers.add(publishDeviceStateJob);
+    otaRestartTimer = networkTimers.add(otaRestartJob);
+    otaConfirmTimer = networkTimers.add(otaConfirmJob);
+    if (otaUpdater.unconfirmed())
+    {
+        networkTimers.start(otaConfirmTimer, OTA_CONFIRM_TIMEOUT_MS);
+    }
+}
 
-    // Motor driver pins
-    pinMode(MOTOR_IN1, OUTPUT);
-    pinMode(MOTOR_IN2, OUTPUT);
-    pinMode(MOTOR_ENA, OUTPUT);
+// Device state + online status
+void publishHeartbeat()
+{
+    publishDeviceState();
+    publishOnlineStatus(true);
+}
 
-    // Setup PWM for motor speed control
-    ledcSetup(PWM_CHANNEL, PWM_FREQ, PWM_RESOLUTION);
-    ledcAttachPin(MOTOR_ENA, PWM_CHANNEL);
+// The coalesced device/state publish, followed by the acks of the commands
+// whose state it carries
+void publishDeviceStateJob()
+{
+    uint32_t acksReady = commandTrace.ready();
+    deviceStateDirty.store(false); // a change after this sets it again
+    publishDeviceState();
+    noteDeviceState(millis());
+    publishCommandAcks(acksReady);
+}
 
-    // Initial state - everything OFF
-    setLight(false);
-    setFan(false);
+// A verified image is set to boot: save the device state now (the quiet
+// period would not pass before the restart), then restart into it
+void otaRestartJob()
+{
+    deviceStateStore.flush(millis(), true);
+    Serial.println("🔄 OTA: restarting into the new image");
+    Serial.flush();
+    ESP.restart();
+}
 
-    Serial.println("✅ GPIO pins initialized");
+// The new image did not reach the broker in time: back to the previous one
+void otaConfirmJob()
+{
+    Serial.println("⚠️  OTA: new image not online in time");
+    deviceStateStore.flush(millis(), true);
+    otaUpdater.rollback();
+}
+
+// Worst-case iteration latency on Serial
+void reportLoopStats()
+{
+    loopStats.report("Network loop");
+}
+
+// Stops itself once the backlog is sent or the link dropped (networkStep()
+// restarts it when both hold again)
+void replayJournalJob()
+{
+    if (!netLink.online() || sensorJournal.empty())
+    {
+        networkTimers.stop(journalReplayTimer);
+        return;
+    }
+    if (mqttOutbox.backpressure())
+    {
+        return; // the outbox drains first, retried next interval
+    }
+    replaySensorJournal();
+}
+
+// Hands the published state to the NVS store and (re)arms its write
+void noteDeviceState(uint32_t nowMs)
+{
+    if (!PERSIST_DEVICE_STATE)
+    {
+        return;
+    }
+    DeviceSnapshot snapshot = {};
+    snapshot.channels = ACTUATOR_COUNT;
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        ActuatorState state = actuators.state(i);
+        snapshot.on[i] = state.on;
+        snapshot.level[i] = state.level;
+    }
+    deviceStateStore.update(snapshot, nowMs);
+
+    uint32_t dueMs = deviceStateStore.untilDue(nowMs);
+    if (dueMs == PersistedState<DeviceSnapshot>::NOT_DUE)
+    {
+        networkTimers.stop(persistTimer);
+    }
+    else
+    {
+        networkTimers.start(persistTimer, dueMs);
+    }
+}
+
+// Coalesced NVS write; a failed one is retried after another quiet period,
+// one not due yet (a change moved the quiet period) when it is
+void persistDeviceStateJob()
+{
+    uint32_t nowMs = millis();
+    uint32_t failures = deviceStateStore.failures();
+    if (!deviceStateStore.flush(nowMs) && deviceStateStore.pending())
+    {
+        if (deviceStateStore.failures() != failures)
+        {
+            Serial.println("⚠️  Device state not saved to NVS, retrying");
+        }
+        networkTimers.start(persistTimer, deviceStateStore.untilDue(nowMs));
+    }
 }
 
 // =============================================================================
-// MQTT TOPICS INITIALIZATION
+// OTA UPDATE
 // =============================================================================
 
-void initTopics()
+// First boot of a new image: counted in NVS, rolled back past
+// OTA_MAX_BOOT_ATTEMPTS (the confirm timer is armed in initTimers())
+void initOta()
 {
-    topicSensorState = String(TOPIC_NS) + "/sensor/state";
-    topicDeviceState = String(TOPIC_NS) + "/device/state";
-    topicDeviceCmd = String(TOPIC_NS) + "/device/cmd";
-    topicSysOnline = String(TOPIC_NS) + "/sys/online";
-
-    Serial.println("✅ MQTT topics configured:");
-    Serial.printf("   📊 Sensor: %s\n", topicSensorState.c_str());
-    Serial.printf("   📡 State: %s\n", topicDeviceState.c_str());
-    Serial.printf("   📥 Command: %s\n", topicDeviceCmd.c_str());
-    Serial.printf("   🟢 Online: %s\n", topicSysOnline.c_str());
+    if (OTA_ENABLED)
+    {
+        otaUpdater.beginBoot(OTA_MAX_BOOT_ATTEMPTS);
+    }
 }
 
 // =============================================================================
-// WIFI FUNCTIONS
+// POWER MANAGEMENT
 // =============================================================================
 
-void initWiFi()
+void initPower()
 {
-    Serial.printf("🔌 Connecting to WiFi: %s\n", WIFI_SSID);
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    if (!POWER_SAVE)
+    {
+        WiFi.setSleep(false);
+        Serial.println("⚡ Power save off");
+        return;
+    }
+
+    // Modem sleep: the radio sleeps between DTIM beacons
+    WiFi.setSleep(true);
 
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20)
+    esp_pm_config_esp32c3_t pm = {};
+    pm.max_freq_mhz = PM_MAX_CPU_MHZ;
+    pm.min_freq_mhz = PM_MIN_CPU_MHZ;
+    pm.light_sleep_enable = true;
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err == ESP_ERR_NOT_SUPPORTED)
     {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+        // Core built without CONFIG_FREERTOS_USE_TICKLESS_IDLE: frequency scaling only
+        pm.light_sleep_enable = false;
+        err = esp_pm_configure(&pm);
     }
+    if (err == ESP_OK)
+    {
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "fan_pwm", &fanPmLock);
+    }
+    Serial.printf("⚡ Power save: modem sleep, CPU %d-%d MHz, light sleep %s\n",
+                  PM_MIN_CPU_MHZ, PM_MAX_CPU_MHZ,
+                  err != ESP_OK ? "unavailable (PM off)" : pm.light_sleep_enable ? "on" : "unsupported by core");
+}
 
-    if (WiFi.status() == WL_CONNECTED)
+// Actuator task only
+void holdAwake(bool hold)
+{
+    if (!fanPmLock || hold == fanPmLockHeld)
     {
-        Serial.println("\n✅ WiFi connected!");
-        Serial.printf("📍 IP Address: %s\n", WiFi.localIP().toString().c_str());
-        Serial.printf("📶 RSSI: %d dBm\n", WiFi.RSSI());
+        return;
+    }
+    if (hold)
+    {
+        esp_pm_lock_acquire(fanPmLock);
     }
     else
     {
-        Serial.println("\n❌ WiFi connection failed!");
+        esp_pm_lock_release(fanPmLock);
     }
+    fanPmLockHeld = hold;
 }
 
-void reconnectWiFi()
+// =============================================================================
+// GPIO INITIALIZATION
+// =============================================================================
+
+void initGPIO()
 {
-    WiFi.disconnect();
-    delay(100);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    // Every actuator channel (LED, motor driver and fan PWM), all off
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        ActuatorOutput::begin(ACTUATORS[i]);
+    }
+    fanRamp.reset(0);
+    fanFadeReady = BoardPins::fanFadeBegin(onFanFadeEnd);
+    if (!fanFadeReady)
+    {
+        Serial.println("⚠️  LEDC fade unavailable, fan speed changes in one step");
+    }
 
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10)
+    Serial.printf("✅ GPIO pins initialized (%u actuator channels)\n", (unsigned)ACTUATOR_COUNT);
+}
+
+// Applies the state saved in NVS (fan ramps up as after a command); the
+// tasks are not running yet
+void restoreDeviceState()
+{
+    DeviceSnapshot saved;
+    if (!PERSIST_DEVICE_STATE || !deviceStateStore.begin(saved) || saved.channels != ACTUATOR_COUNT)
     {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+        Serial.println("💾 No saved device state, starting with everything OFF");
+        return;
     }
+    ActuatorIntent intent;
+    Serial.print("💾 Restored:");
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        intent.channels[i] = ActuatorState{saved.on[i] != 0, saved.level[i]};
+        Serial.printf(" %s=%s", ACTUATORS[i].name, saved.on[i] ? "ON" : "OFF");
+        if (ACTUATORS[i].levelKey)
+        {
+            Serial.printf(" (%u)", (unsigned)saved.level[i]);
+        }
+    }
+    applyIntent(intent);
+    Serial.printf(", %lu NVS writes so far\n", (unsigned long)deviceStateStore.lifetimeWrites());
+}
+
+// =============================================================================
+// STORAGE INITIALIZATION
+// =============================================================================
 
-    if (WiFi.status() == WL_CONNECTED)
+void initStorage()
+{
+    if (LittleFS.begin(true)) // format on first use
+    {
+        sensorJournal.begin(&LittleFS, JOURNAL_DIR, JOURNAL_SEGMENT_RECORDS, JOURNAL_MAX_SEGMENTS);
+        Serial.printf("✅ Offline journal on LittleFS (%u samples pending)\n", (unsigned)sensorJournal.pending());
+    }
+    else
     {
-        Serial.println("\n✅ WiFi reconnected!");
+        sensorJournal.begin(nullptr, JOURNAL_DIR, JOURNAL_SEGMENT_RECORDS, JOURNAL_MAX_SEGMENTS);
+        Serial.println("⚠️  LittleFS mount failed, offline journal is RAM only");
     }
 }
 
 // =============================================================================
-// MQTT FUNCTIONS
+// MQTT TOPICS INITIALIZATION
+// =============================================================================
+
+void initTopics()
+{
+    Serial.println("✅ MQTT topics configured:");
+    Serial.printf("   📊 Sensor: %s\n", SENSOR_BATCH_MODE     ? topicSensorBatch
+                                          : SENSOR_SUMMARY_MODE ? topicSensorSummary
+                                                                : topicSensorState);
+    Serial.printf("   📡 State: %s\n", topicDeviceState);
+    if (MSGPACK_PAYLOADS)
+    {
+        Serial.printf("   🗜️  MessagePack: %s%s%s\n", SENSOR_BATCH_MODE || SENSOR_SUMMARY_MODE ? "" : topicSensorStateMp,
+                      SENSOR_BATCH_MODE || SENSOR_SUMMARY_MODE ? "" : ", ", topicDeviceStateMp);
+    }
+    Serial.printf("   📥 Command: %s\n", topicDeviceCmd);
+    Serial.printf("   🟢 Online: %s\n", topicSysOnline);
+    if (OTA_ENABLED)
+    {
+        Serial.printf("   ⬇️ OTA: %s (status: %s)\n", topicSysOta, topicSysOtaStatus);
+    }
+}
+
+// =============================================================================
+// NETWORK FUNCTIONS
 // =============================================================================
 
 void initMQTT()
 {
-    mqttClient.setServer(MQTT_HOST, MQTT_PORT);
     mqttClient.setCallback(mqttCallback);
     mqttClient.setKeepAlive(60);
-    mqttClient.setSocketTimeout(10);
+    mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
 
-    // Set Last Will Testament (LWT) - published when device disconnects
-    String lwt = "{\"online\":false,\"timestamp\":" + String(millis()) + "}";
-    mqttClient.setWill(topicSysOnline.c_str(), lwt.c_str(), 1, true);
+    // Incoming messages only, large enough for an OTA chunk (default is 256 bytes)
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
 
-    Serial.printf("✅ MQTT configured: %s:%d\n", MQTT_HOST, MQTT_PORT);
+    snprintf(mqttClientId, sizeof(mqttClientId), "%s_%06lx", DEVICE_ID,
+             (unsigned long)((ESP.getEfuseMac() >> 24) & 0xFFFFFF));
+
+    Serial.printf("✅ MQTT configured: %s:%d, client %s\n", MQTT_HOST, MQTT_PORT, mqttClientId);
 }
 
-void reconnectMQTT()
+void initNetwork()
 {
-    static unsigned long lastAttempt = 0;
-    unsigned long currentMillis = millis();
+    NetLinkConfig config;
+    config.wifiSsid = WIFI_SSID;
+    config.wifiPassword = WIFI_PASSWORD;
+    config.mqttHost = MQTT_HOST;
+    config.mqttPort = MQTT_PORT;
+    config.mqttUsername = MQTT_USERNAME;
+    config.mqttPassword = MQTT_PASSWORD;
+    config.clientId = mqttClientId;
+    config.cleanSession = MQTT_CLEAN_SESSION;
+
+    // Last Will Testament (LWT) - published by the broker when device disconnects
+    config.willTopic = topicSysOnline;
+    config.willMessage = "{\"online\":false}";
+    config.willQos = 1;
+    config.willRetain = true;
+
+    config.backoffMinMs = NET_BACKOFF_MIN_MS;
+    config.backoffMaxMs = NET_BACKOFF_MAX_MS;
+    config.wifiConnectTimeoutMs = WIFI_CONNECT_TIMEOUT_MS;
+    config.tcpConnectTimeoutMs = MQTT_TCP_TIMEOUT_MS;
+    config.idlePollMs = NETWORK_IDLE_POLL_MS;
+
+    config.fastConnect = WIFI_FAST_CONNECT;
+    config.reuseIpLease = WIFI_REUSE_IP_LEASE;
+    config.fastConnectTimeoutMs = WIFI_FAST_CONNECT_TIMEOUT_MS;
+
+    // WiFi events must cut the network task's sleep short
+    if (!loopWaker.begin())
+    {
+        Serial.println("⚠️  Network task falls back to fixed-interval polling");
+    }
+    if (TlsClient::SUPPORTED)
+    {
+        TlsConfig tls;
+        tls.serverName = MQTT_TLS_SERVER_NAME;
+        tls.caCert = MQTT_TLS_CA_CERT;
+        tls.clientCert = MQTT_TLS_CLIENT_CERT;
+        tls.clientKey = MQTT_TLS_CLIENT_KEY;
+        tls.handshakeTimeoutMs = MQTT_TLS_HANDSHAKE_TIMEOUT_MS;
+        tls.resumeSessions = MQTT_TLS_RESUME;
+        if (!mqttTls.begin(tls))
+        {
+            Serial.println("❌ TLS setup failed, MQTT stays plain (will not reach a TLS-only broker)");
+        }
+    }
+    netLink.setTls(&mqttTls);
+    netLink.setWakeCallback(wakeNetworkTask);
+    netLink.begin(config, onMqttConnected);
+}
 
-    if (currentMillis - lastAttempt < MQTT_RECONNECT_INTERVAL)
+// Called by NetLink each time the MQTT session is (re)established
+void onMqttConnected()
+{
+    // Messages the broker never acknowledged go out again (DUP), then the
+    // rest of the outbox
+    mqttOutbox.sessionStarted();
+
+    // Subscribe to command topic
+    mqttClient.subscribe(topicDeviceCmd, COMMAND_QOS);
+    Serial.printf("📥 Subscribed to: %s\n", topicDeviceCmd);
+
+    // OTA control is QoS1 like commands; chunks are QoS0, the status resyncs
+    // the sender after a lost one
+    if (OTA_ENABLED)
     {
-        return;
+        mqttClient.subscribe(topicSysOta, 1);
+        mqttClient.subscribe(topicSysOtaData, 0);
+    }
+
+    // Clear retained offline status and publish online
+    mqttOutbox.publish(topicSysOnline, (const uint8_t *)"", 0, true, MQTT_PUBLISH_QOS); // Clear retained
+    publishOnlineStatus(true);
+
+    // A new image that got this far is good
+    if (otaUpdater.unconfirmed())
+    {
+        otaUpdater.confirm();
+        networkTimers.stop(otaConfirmTimer);
     }
-    lastAttempt = currentMillis;
 
-    if (WiFi.status() != WL_CONNECTED)
+    // Publish initial device state
+    publishDeviceState();
+}
+
+// "id"/"ts"/"seq" are read by CommandTrace/CommandDedup before dispatch, nothing to queue
+bool traceField(const CommandToken &)
+{
+    return false;
+}
+
+// Command routes: {"<key>":"<verb>"} -> handler, nullptr verb takes any value.
+// Actuator keys are not listed: the ACTUATORS table answers them
+// (actuatorCommand) once no route matched.
+const CommandRoute COMMAND_ROUTES[] = {
+    {"id", nullptr, traceField},
+    {"ts", nullptr, traceField},
+    {"seq", nullptr, traceField},
+};
+
+void mqttCallback(char *topic, byte *payload, unsigned int length)
+{
+    uint32_t receivedUs = micros();
+
+    // OTA control or image chunk, taken straight from the MQTT buffer (not logged)
+    if (OTA_ENABLED && otaMessage(topic, payload, length))
     {
         return;
     }
 
-    Serial.printf("🔄 Connecting to MQTT broker: %s:%d\n", MQTT_HOST, MQTT_PORT);
+    // Log received command straight from the MQTT buffer
+    Serial.printf("📥 Command received [%s]: ", topic);
+    Serial.write(payload, length);
+    Serial.println();
 
-    String clientId = String(DEVICE_ID) + "_" + String(random(0xffff), HEX);
+    // A QoS1 redelivery of a command we already applied (its PUBACK was lost
+    // with the connection): acknowledge it at the MQTT level only
+    if (commandDedup.seen(payload, length))
+    {
+        Serial.println("🔁 Duplicate command seq, ignored");
+        return;
+    }
 
-    bool connected = false;
-    if (strlen(MQTT_USERNAME) > 0)
+    // Decode in place and queue actuator commands (runs on the network task);
+    // a command with an "id" gets a device/ack once it has been applied
+    commandTrace.begin(payload, length, receivedUs);
+    CommandDispatch result = dispatchCommand(payload, length, COMMAND_ROUTES, actuatorCommand);
+    commandTrace.dispatched(result.dispatched);
+    if (!result.valid)
     {
-        connected = mqttClient.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD);
+        Serial.println("❌ Command parse error");
     }
-    else
+    if (result.unmatched > 0)
     {
-        connected = mqttClient.connect(clientId.c_str());
+        Serial.printf("⚠️  %u unknown command field(s)\n", (unsigned)result.unmatched);
     }
 
-    if (connected)
+    // Wake the actuator task; it publishes the new state back through us
+    if (result.dispatched > 0)
     {
-        Serial.println("✅ MQTT connected!");
+        xTaskNotifyGive(actuatorTaskHandle);
+    }
+}
 
-        // Subscribe to command topic
-        mqttClient.subscribe(topicDeviceCmd.c_str());
-        Serial.printf("📥 Subscribed to: %s\n", topicDeviceCmd.c_str());
+// sys/ota/data chunks go to flash, sys/ota starts/resumes/aborts an update;
+// false for any other topic. The status goes out from networkStep().
+bool otaMessage(const char *topic, const uint8_t *payload, size_t length)
+{
+    if (strcmp(topic, topicSysOtaData) == 0)
+    {
+        otaUpdater.chunk(payload, length, millis());
+        return true;
+    }
+    if (strcmp(topic, topicSysOta) == 0)
+    {
+        otaUpdater.control(payload, length, millis());
+        return true;
+    }
+    return false;
+}
 
-        // Clear retained offline status and publish online
-        mqttClient.publish(topicSysOnline.c_str(), "", true); // Clear retained
-        publishOnlineStatus(true);
+// {"<name>":"on"|"off"|"toggle"} or {"<levelKey>":0-100} of an ACTUATORS row,
+// found in O(1) whatever the table size
+CommandResult actuatorCommand(const CommandToken &key, const CommandToken &value)
+{
+    ActuatorKey target;
+    if (!actuators.find(key, target))
+    {
+        return COMMAND_UNMATCHED;
+    }
 
-        // Publish initial device state
-        publishDeviceState();
+    ActuatorCommand command;
+    command.channel = target.channel;
+    command.value = 0;
+    if (target.level)
+    {
+        long level;
+        if (!value.toInt(level))
+        {
+            return COMMAND_REJECTED;
+        }
+        level = constrain(level, 0, 100);
+        command.action = ActuatorCommand::SET;
+        command.value = map(level, 0, 100, 0, 255); // Convert to PWM value
+    }
+    else if (value.isString && value.equals("on"))
+    {
+        command.action = ActuatorCommand::ON;
+    }
+    else if (value.isString && value.equals("off"))
+    {
+        command.action = ActuatorCommand::OFF;
+    }
+    else if (value.isString && value.equals("toggle"))
+    {
+        command.action = ActuatorCommand::TOGGLE;
     }
     else
     {
-        Serial.printf("❌ MQTT connection failed, rc=%d\n", mqttClient.state());
+        return COMMAND_UNMATCHED;
     }
+    return queueCommand(command) ? COMMAND_DISPATCHED : COMMAND_REJECTED;
 }
 
-void mqttCallback(char *topic, byte *payload, unsigned int length)
+bool queueCommand(const ActuatorCommand &command)
 {
-    // Parse JSON payload
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, payload, length);
+    ActuatorCommand stamped = command;
+    stamped.traceSlot = commandTrace.current();
+    stamped.receivedUs = micros();
+    if (!commandQueue.push(stamped))
+    {
+        Serial.println("⚠️  Command queue full, command dropped");
+        return false;
+    }
+    return true;
+}
 
-    if (error)
+// Runs on the actuator task: a toggle flips the intended state, not the
+// output, so the fold of a burst is exact
+void foldCommand(ActuatorIntent &intent, const ActuatorCommand &command)
+{
+    ActuatorState &state = intent.channels[command.channel];
+    switch (command.action)
     {
-        Serial.printf("❌ JSON parse error: %s\n", error.c_str());
-        return;
+    case ActuatorCommand::OFF:
+    case ActuatorCommand::ON:
+        state.on = command.action == ActuatorCommand::ON;
+        break;
+
+    case ActuatorCommand::TOGGLE:
+        state.on = !state.on;
+        break;
+
+    case ActuatorCommand::SET:
+        state.level = command.value;
+        break;
     }
+}
 
-    // Log received command
-    String payloadStr;
-    serializeJson(doc, payloadStr);
-    Serial.printf("📥 Command received [%s]: %s\n", topic, payloadStr.c_str());
+// Writes the channels that differ from the intent; true if the device state
+// changed (a burst that ends where it started changes nothing)
+bool applyIntent(const ActuatorIntent &intent)
+{
+    bool changed = false;
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        ActuatorState from = actuators.state(i);
+        if (intent.channels[i] != from)
+        {
+            writeChannel(i, from, intent.channels[i]);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// =============================================================================
+// DEVICE CONTROL FUNCTIONS
+// =============================================================================
+
+// Actuator task only; the state is stored before the pins are written
+void writeChannel(size_t channel, const ActuatorState &from, const ActuatorState &to)
+{
+    actuators.set(channel, to);
+    if (channel == FAN_CHANNEL)
+    {
+        driveFan(from, to);
+    }
+    else
+    {
+        ActuatorOutput::write(ACTUATORS[channel], to);
+    }
+}
 
-    // Handle command
-    handleCommand(doc);
+// Forward and ramp up to the level, or coast at once while the duty ramps
+// down to 0; a new level while on retargets the ramp
+void driveFan(const ActuatorState &from, const ActuatorState &to)
+{
+    if (to.on)
+    {
+        holdAwake(true); // LEDC PWM and fades stop in light sleep
+    }
+    if (to.on != from.on)
+    {
+        ActuatorOutput::drive(ACTUATORS[FAN_CHANNEL], to.on);
+    }
+    rampFanTo(to.on ? to.level : 0);
 }
 
-void handleCommand(JsonDocument &doc)
+// Starts or retargets the fan ramp; never waits for a running fade
+void rampFanTo(uint32_t duty)
 {
-    bool stateChanged = false;
+    if (fanRamp.retarget(duty))
+    {
+        advanceFanRamp();
+    }
+    else if (!fanRamp.active())
+    {
+        holdAwake(actuators.state(FAN_CHANNEL).on); // already at that duty
+    }
+}
 
-    // Light control
-    if (doc.containsKey("light"))
+// Starts the ramp's next hardware fade; true once the ramp is at its goal
+bool advanceFanRamp()
+{
+    FadeRamp::Segment segment;
+    while (fanRamp.next(segment))
     {
-        String cmd = doc["light"].as<String>();
-        if (cmd == "toggle")
+        if (fanFadeReady && segment.ms > 0)
         {
-            lightState = !lightState;
-            setLight(lightState);
-            Serial.printf("💡 Light: %s\n", lightState ? "ON" : "OFF");
-            stateChanged = true;
-        }
-        else if (cmd == "on")
-        {
-            lightState = true;
-            setLight(true);
-            Serial.println("💡 Light: ON");
-            stateChanged = true;
-        }
-        else if (cmd == "off")
-        {
-            lightState = false;
-            setLight(false);
-            Serial.println("💡 Light: OFF");
-            stateChanged = true;
+            BoardPins::fanFade(segment.duty, segment.ms);
+            return false;
         }
+        BoardPins::setFanDuty(segment.duty);
     }
+    holdAwake(actuators.state(FAN_CHANNEL).on); // a stopped fan may sleep again
+    return true;
+}
 
-    // Fan control
-    if (doc.containsKey("fan"))
+// LEDC interrupt: a fan fade ended, the actuator task starts the next one
+// (before startTasks() the flag alone is picked up by its first wake-up)
+void IRAM_ATTR onFanFadeEnd()
+{
+    fanFadeEnded.store(true);
+    if (actuatorTaskHandle)
     {
-        String cmd = doc["fan"].as<String>();
-        if (cmd == "toggle")
-        {
-            fanState = !fanState;
-            setFan(fanState);
-            Serial.printf("🌀 Fan: %s\n", fanState ? "ON" : "OFF");
-            stateChanged = true;
-        }
-        else if (cmd == "on")
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(actuatorTaskHandle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+// =============================================================================
+// MQTT PUBLISH FUNCTIONS
+// =============================================================================
+
+// Runs on the sensor task: take the sampler's cached reading and hand it to
+// the network task (no sensor I/O here)
+void readSensor()
+{
+    const DhtReading &reading = dhtSampler.reading();
+    uint32_t ageMs = dhtSampler.ageMs(millis());
+
+    // Background retries failed; skip rather than publish an old value
+    if (ageMs > DHT_MAX_AGE_MS)
+    {
+        Serial.printf("⚠️  No DHT reading for %lu ms (%lu failed reads)\n",
+                      reading.valid ? (unsigned long)ageMs : (unsigned long)millis(),
+                      (unsigned long)dhtSampler.failures());
+        return;
+    }
+
+    // The MQTT outbox is filling up (slow or stalled broker): skip the
+    // reading rather than queue more than the network task can send
+    if (!SENSOR_BATCH_MODE && !SENSOR_SUMMARY_MODE && mqttOutbox.backpressure())
+    {
+        sensorThrottled.store(sensorThrottled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    SensorSample sample;
+    sample.timestamp = reading.atMs;
+    sample.temperature10 = (int16_t)lroundf(reading.temperature * 10);
+    sample.humidity10 = (uint16_t)lroundf(reading.humidity * 10);
+
+    if (sampleQueue.push(sample))
+    {
+        wakeNetworkTask();
+    }
+}
+
+// Runs on the network task: batch, filter, publish or journal one sample
+void publishSensorSample(const SensorSample &sample)
+{
+    // Batch mode: buffer the sample, flushSensorBatch() sends it later
+    if (SENSOR_BATCH_MODE)
+    {
+        if (sensorBatch.empty())
         {
-            fanState = true;
-            setFan(true);
-            Serial.println("🌀 Fan: ON");
-            stateChanged = true;
+            networkTimers.start(batchFlushTimer, SENSOR_BATCH_FLUSH_INTERVAL);
         }
-        else if (cmd == "off")
+        sensorBatch.push(sample);
+        return;
+    }
+
+    // Summary mode: fold the reading into the window, publishSensorSummary() sends it
+    if (SENSOR_SUMMARY_MODE)
+    {
+        if (temperatureWindow.count() == 0)
         {
-            fanState = false;
-            setFan(false);
-            Serial.println("🌀 Fan: OFF");
-            stateChanged = true;
+            summaryWindowStart = sample.timestamp;
+            networkTimers.start(summaryCloseTimer, SENSOR_SUMMARY_WINDOW);
         }
+        temperatureWindow.add(sample.temperature10 / 10.0f);
+        humidityWindow.add(sample.humidity10 / 10.0f);
+        return;
     }
 
-    // Fan speed control (0-100%)
-    if (doc.containsKey("fanSpeed"))
+    // Report-on-change: skip readings where no field moved past its deadband
+    if (SENSOR_REPORT_ON_CHANGE)
     {
-        int speed = doc["fanSpeed"].as<int>();
-        speed = constrain(speed, 0, 100);
-        fanSpeed = map(speed, 0, 100, 0, 255); // Convert to PWM value
-        if (fanState)
+        float reportedTemperature = sample.temperature10 / 10.0f;
+        float reportedHumidity = sample.humidity10 / 10.0f;
+        bool temperatureDue = temperatureReport.check(reportedTemperature, sample.timestamp);
+        bool humidityDue = humidityReport.check(reportedHumidity, sample.timestamp);
+        if (!temperatureDue && !humidityDue)
         {
-            setFanSpeed(fanSpeed);
-            Serial.printf("🌀 Fan speed: %d%%\n", speed);
+            sensorSuppressed++;
+            return;
         }
-        stateChanged = true;
+        temperatureReport.reported(reportedTemperature, sample.timestamp);
+        humidityReport.reported(reportedHumidity, sample.timestamp);
+    }
+
+    // Offline: keep the reading for replay instead of dropping it
+    if (!netLink.online())
+    {
+        sensorJournal.append(sample);
+        return;
+    }
+
+    // Get WiFi RSSI
+    int rssi = WiFi.RSSI();
+
+    // MessagePack copy first, so a subscriber to both topics sees it before
+    // the JSON one; JSON clients (web, Flutter) keep getting sensor/state
+    if (MSGPACK_PAYLOADS)
+    {
+        JsonDocument packed(&jsonArena);
+        buildSensorMsgPack(packed, sample, rssi);
+        publishMsgPack(topicSensorStateMp, packed, false);
     }
 
-    // Publish updated state if something changed
-    if (stateChanged)
+    // Create payload and publish to MQTT
+    JsonDocument doc(&jsonArena);
+    buildSensorJson(doc, sample, rssi);
+    bool sent = publishJson(topicSensorState, doc, false);
+
+    if (sent)
+    {
+        Serial.printf("🌡️  Sensor: %.1f°C, %.1f%%, %ddBm\n",
+                      sample.temperature10 / 10.0, sample.humidity10 / 10.0, rssi);
+    }
+    else
     {
-        publishDeviceState();
+        sensorJournal.append(sample);
     }
 }
 
-// =============================================================================
-// DEVICE CONTROL FUNCTIONS
-// =============================================================================
+// sensor/state: {"temperature":25.1,"humidity":60.2,"rssi":-57,"timestamp":123456}
+void buildSensorJson(JsonDocument &doc, const SensorSample &sample, int rssi)
+{
+    doc["temperature"] = sample.temperature10 / 10.0; // 1 decimal
+    doc["humidity"] = sample.humidity10 / 10.0;
+    doc["rssi"] = rssi;
+    doc["timestamp"] = sample.timestamp;
+}
 
-void setLight(bool state)
+// sensor/state/mp: [timestamp, temperature x10, humidity x10, rssi]
+// Integers only, so MessagePack picks the smallest encoding (13-15 bytes)
+void buildSensorMsgPack(JsonDocument &doc, const SensorSample &sample, int rssi)
 {
-    digitalWrite(LED_PIN, state ? HIGH : LOW);
-    lightState = state;
+    JsonArray fields = doc.to<JsonArray>();
+    fields.add(sample.timestamp);
+    fields.add(sample.temperature10);
+    fields.add(sample.humidity10);
+    fields.add(rssi);
 }
 
-void setFan(bool state)
+// Send up to SENSOR_BATCH_SIZE buffered samples as one sensor/batch message
+void flushSensorBatch()
 {
-    fanState = state;
-    if (state)
+    networkTimers.stop(batchFlushTimer);
+    if (!netLink.online())
+    {
+        journalSensorBatch(); // nothing to send to, hand samples to the journal
+        return;
+    }
+
+    SensorSample samples[SENSOR_BATCH_SIZE];
+    size_t count = min(sensorBatch.size(), SENSOR_BATCH_SIZE);
+    for (size_t i = 0; i < count; i++)
     {
-        // Forward direction
-        digitalWrite(MOTOR_IN1, HIGH);
-        digitalWrite(MOTOR_IN2, LOW);
-        setFanSpeed(fanSpeed);
+        samples[i] = sensorBatch[i];
+    }
+
+    if (publishSensorBatch(samples, count, false, false))
+    {
+        sensorBatch.discard(count);
+        Serial.printf("📦 Sensor batch: %u samples\n", (unsigned)count);
+        if (!sensorBatch.empty())
+        {
+            networkTimers.start(batchFlushTimer, SENSOR_BATCH_FLUSH_INTERVAL);
+        }
     }
     else
     {
-        // Stop motor
-        digitalWrite(MOTOR_IN1, LOW);
-        digitalWrite(MOTOR_IN2, LOW);
-        ledcWrite(PWM_CHANNEL, 0);
+        journalSensorBatch();
     }
 }
 
-void setFanSpeed(int speed)
+// sensor/summary, one per window (summaryCloseTimer, also when readings
+// stopped arriving):
+// {"ts":<first reading millis>,"durMs":60000,"n":60,"rssi":-57,
+//  "t":{"min":24.1,"max":24.6,"mean":24.32,"sd":0.12},"h":{...}}
+void publishSensorSummary()
 {
-    speed = constrain(speed, 0, 255);
-    ledcWrite(PWM_CHANNEL, speed);
+    unsigned long nowMs = millis();
+    JsonDocument doc(&jsonArena);
+    doc["ts"] = summaryWindowStart;
+    doc["durMs"] = nowMs - summaryWindowStart;
+    doc["n"] = temperatureWindow.count();
+    doc["rssi"] = WiFi.RSSI();
+    addSummaryFields(doc["t"].to<JsonObject>(), temperatureWindow);
+    addSummaryFields(doc["h"].to<JsonObject>(), humidityWindow);
+
+    if (netLink.online() && publishJson(topicSensorSummary, doc, false))
+    {
+        Serial.printf("📈 Sensor summary: %lu readings, %.1f-%.1f°C (mean %.2f, sd %.2f)\n",
+                      (unsigned long)temperatureWindow.count(), temperatureWindow.min(), temperatureWindow.max(),
+                      temperatureWindow.mean(), temperatureWindow.stddev());
+    }
+    else
+    {
+        summariesDropped++;
+        Serial.println("⚠️  Sensor summary dropped (offline or publish failed)");
+    }
+
+    temperatureWindow.reset();
+    humidityWindow.reset();
 }
 
-// =============================================================================
-// MQTT PUBLISH FUNCTIONS
-// =============================================================================
+// Readings are in tenths: two decimals are plenty for mean and sd
+void addSummaryFields(JsonObject out, const WindowStats &stats)
+{
+    out["min"] = stats.min();
+    out["max"] = stats.max();
+    out["mean"] = roundf(stats.mean() * 100) / 100;
+    out["sd"] = roundf(stats.stddev() * 100) / 100;
+}
 
-void publishSensorData()
+// Move every buffered batch sample into the offline journal
+void journalSensorBatch()
 {
-    // Read DHT11 sensor
-    float temperature = dht.readTemperature();
-    float humidity = dht.readHumidity();
+    while (!sensorBatch.empty())
+    {
+        sensorJournal.append(sensorBatch.front());
+        sensorBatch.discard(1);
+    }
+}
 
-    // Check if readings are valid
-    if (isnan(temperature) || isnan(humidity))
+// Publish the oldest journaled samples; they leave the journal only once sent
+void replaySensorJournal()
+{
+    SensorSample samples[JOURNAL_REPLAY_BATCH];
+    bool previousBoot = false;
+    size_t count = sensorJournal.peek(samples, JOURNAL_REPLAY_BATCH, &previousBoot);
+    if (count == 0)
     {
-        Serial.println("⚠️  Failed to read from DHT sensor!");
         return;
     }
 
-    // Get WiFi RSSI
-    int rssi = WiFi.RSSI();
-
-    // Create JSON payload
-    JsonDocument doc;
-    doc["temperature"] = round(temperature * 10) / 10.0; // 1 decimal
-    doc["humidity"] = round(humidity * 10) / 10.0;
-    doc["rssi"] = rssi;
-    doc["timestamp"] = millis();
+    if (publishSensorBatch(samples, count, true, previousBoot))
+    {
+        sensorJournal.consume(count);
+        Serial.printf("📼 Journal replay: %u samples (%u pending)\n",
+                      (unsigned)count, (unsigned)sensorJournal.pending());
+    }
+}
 
-    String payload;
-    serializeJson(doc, payload);
+// {"ts":<first sample millis>,"n":3,"rssi":-57,"dt":[0,3000,6001],"t":[251,252,252],"h":[602,601,603]}
+// dt = ms offset from ts, t/h = temperature (°C) and humidity (%) x10.
+// Journal replays add "replay":true, and "prevBoot":true when the timestamps
+// come from before the last reboot.
+bool publishSensorBatch(const SensorSample *samples, size_t count, bool replay, bool previousBoot)
+{
+    uint32_t firstTimestamp = samples[0].timestamp;
 
-    // Publish to MQTT
-    if (mqttClient.publish(topicSensorState.c_str(), payload.c_str()))
+    JsonDocument doc(&jsonArena);
+    doc["ts"] = firstTimestamp;
+    doc["n"] = count;
+    doc["rssi"] = WiFi.RSSI();
+    if (replay)
     {
-        Serial.printf("🌡️  Sensor: %.1f°C, %.1f%%, %ddBm\n", temperature, humidity, rssi);
+        doc["replay"] = true;
     }
+    if (previousBoot)
+    {
+        doc["prevBoot"] = true;
+    }
+    JsonArray offsets = doc["dt"].to<JsonArray>();
+    JsonArray temperatures = doc["t"].to<JsonArray>();
+    JsonArray humidities = doc["h"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++)
+    {
+        offsets.add(samples[i].timestamp - firstTimestamp);
+        temperatures.add(samples[i].temperature10);
+        humidities.add(samples[i].humidity10);
+    }
+
+    return publishJson(topicSensorBatch, doc, false);
+}
+
+// LEDC duty of a channel now (the fan mid-ramp: in between), 0 for a switch
+uint32_t channelDuty(size_t channel)
+{
+    return channel == FAN_CHANNEL ? BoardPins::fanDuty() : ActuatorOutput::duty(ACTUATORS[channel]);
 }
 
+// One field per ACTUATORS row (plus a level object for rows with a level
+// key), so the message grows linearly with the table
 void publishDeviceState()
 {
-    JsonDocument doc;
-    doc["light"] = lightState ? "on" : "off";
-    doc["fan"] = fanState ? "on" : "off";
+    ActuatorState states[ACTUATOR_COUNT];
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        states[i] = actuators.state(i);
+    }
+
+    // MessagePack copy first (see publishSensorSample()), then the JSON one
+    if (MSGPACK_PAYLOADS)
+    {
+        // device/state/mp: [timestamp, on per row..., rssi, target duty + duty per level row...]
+        // (default table: [timestamp, light on, fan on, rssi, target duty, duty])
+        JsonDocument packed(&jsonArena);
+        JsonArray fields = packed.to<JsonArray>();
+        fields.add(millis());
+        for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+        {
+            fields.add(states[i].on);
+        }
+        fields.add(WiFi.RSSI());
+        for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+        {
+            if (ACTUATORS[i].levelKey)
+            {
+                fields.add(states[i].on ? states[i].level : 0);
+                fields.add(channelDuty(i));
+            }
+        }
+        publishMsgPack(topicDeviceStateMp, packed, true);
+    }
+
+    JsonDocument doc(&jsonArena);
+    for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+    {
+        doc[ACTUATORS[i].name] = states[i].on ? "on" : "off";
+        if (ACTUATORS[i].levelKey)
+        {
+            JsonObject level = doc[ACTUATORS[i].levelKey].to<JsonObject>();
+            level["target"] = states[i].on ? states[i].level : 0; // where the ramp is heading
+            level["duty"] = channelDuty(i);
+        }
+    }
     doc["rssi"] = WiFi.RSSI();
     doc["timestamp"] = millis();
+    bool sent = publishJson(topicDeviceState, doc, true);
 
-    String payload;
-    serializeJson(doc, payload);
+    // Published with retained flag
+    if (sent)
+    {
+        Serial.print("📊 State:");
+        for (size_t i = 0; i < ACTUATOR_COUNT; i++)
+        {
+            Serial.printf(" %s=%s", ACTUATORS[i].name, states[i].on ? "ON" : "OFF");
+            if (ACTUATORS[i].levelKey)
+            {
+                Serial.printf(" (duty %u -> %u)", (unsigned)channelDuty(i),
+                              (unsigned)(states[i].on ? states[i].level : 0));
+            }
+        }
+        Serial.println();
+    }
+}
 
-    // Publish with retained flag
-    if (mqttClient.publish(topicDeviceState.c_str(), payload.c_str(), true))
+// device/ack: one message per traced command, device clock in micros()
+// (rxUs: callback entry, actUs: last GPIO write, pubUs: just before publish)
+void publishCommandAcks(uint32_t readySlots)
+{
+    for (uint8_t i = 0; readySlots != 0; i++, readySlots >>= 1)
     {
-        Serial.printf("📊 State: Light=%s, Fan=%s\n",
-                      lightState ? "ON" : "OFF",
-                      fanState ? "ON" : "OFF");
+        if (!(readySlots & 1))
+        {
+            continue;
+        }
+
+        const auto &slot = commandTrace.slot(i);
+        JsonDocument doc(&jsonArena);
+        if (slot.idIsString)
+        {
+            doc["id"] = slot.id;
+        }
+        else
+        {
+            doc["id"] = serialized(slot.id);
+        }
+        if (slot.sentTs[0] != '\0')
+        {
+            if (slot.sentTsIsString)
+            {
+                doc["ts"] = slot.sentTs;
+            }
+            else
+            {
+                doc["ts"] = serialized(slot.sentTs);
+            }
+        }
+        doc["ok"] = slot.ok();
+        doc["rxUs"] = slot.receivedUs;
+        if (slot.ok())
+        {
+            doc["actUs"] = slot.actuatedUs.load();
+        }
+        doc["pubUs"] = micros();
+        publishJson(topicDeviceAck, doc, false);
+
+        commandTrace.release(i);
     }
 }
 
 void publishOnlineStatus(bool online)
 {
-    JsonDocument doc;
+    JsonDocument doc(&jsonArena);
     doc["online"] = online;
     doc["deviceId"] = DEVICE_ID;
     doc["firmware"] = FIRMWARE_VERSION;
     doc["rssi"] = WiFi.RSSI();
+    doc["loopMaxUs"] = loopStats.maxUs();
+    doc["cmdLatencyMaxUs"] = commandLatencyMaxUs.load();
+    doc["sampleQueueDropped"] = sampleQueue.dropped();
+    doc["sensorThrottled"] = sensorThrottled.load();
+    doc["ackOverflow"] = commandTrace.overflowed();
+    doc["cmdDuplicates"] = commandDedup.duplicates();
+    doc["cmdCoalesced"] = commandsCoalesced.load();
+    doc["wifiReconnects"] = netLink.wifiReconnects();
+    doc["mqttReconnects"] = netLink.mqttReconnects();
+    doc["journalBuffered"] = sensorJournal.buffered();
+    doc["journalReplayed"] = sensorJournal.replayed();
+    doc["journalDropped"] = sensorJournal.dropped();
+    doc["journalPending"] = sensorJournal.pending();
+    doc["suppressedSamples"] = sensorSuppressed;
+    doc["suppressedTemperature"] = temperatureReport.suppressed();
+    doc["suppressedHumidity"] = humidityReport.suppressed();
+    doc["summariesDropped"] = summariesDropped;
     doc["timestamp"] = millis();
 
-    String payload;
-    serializeJson(doc, payload);
+    // Boot timeline, ms since the app started (the bootloader's ~0.3 s is not
+    // counted). sys/online goes out right after CONNACK, so publishMs marks
+    // the first publish after boot.
+    if (online && bootFirstPublishMs == 0)
+    {
+        bootFirstPublishMs = millis();
+    }
+    const NetLink::BootTimes &bootTimes = netLink.bootTimes();
+    JsonObject boot = doc["boot"].to<JsonObject>();
+    boot["wifiMs"] = bootTimes.wifiMs;
+    boot["ipMs"] = bootTimes.ipMs;
+    boot["mqttMs"] = bootTimes.mqttMs;
+    boot["publishMs"] = bootFirstPublishMs;
+    boot["cachedAp"] = bootTimes.cachedAp;
+    boot["cachedIp"] = bootTimes.cachedIp;
+    boot["fallbacks"] = netLink.cacheFallbacks();
+
+    // TLS handshakes of this boot: the last one, and the last full / resumed one
+    if (mqttTls.enabled())
+    {
+        JsonObject tls = doc["tls"].to<JsonObject>();
+        tls["resumed"] = mqttTls.lastResumed();
+        tls["handshakeMs"] = mqttTls.lastHandshakeMs();
+        tls["fullMs"] = mqttTls.fullMs();
+        tls["resumedMs"] = mqttTls.resumedMs();
+        tls["full"] = mqttTls.fullHandshakes();
+        tls["resumptions"] = mqttTls.resumedHandshakes();
+        tls["failures"] = mqttTls.handshakeFailures();
+        tls["stepMaxMs"] = mqttTls.maxStepMs(); // longest single handshake step (ECC), blocks the task
+        tls["cached"] = mqttTls.sessionCached();
+    }
 
     // Publish with retained flag
-    mqttClient.publish(topicSysOnline.c_str(), payload.c_str(), true);
+    publishJson(topicSysOnline, doc, true);
     Serial.printf("🟢 Online status: %s\n", online ? "true" : "false");
 }
+
+// sys/ota/status: where the update stands (the sender resends from
+// "offset"), its error, and time / throughput since "begin"
+void publishOtaStatus()
+{
+    uint32_t nowMs = millis();
+    JsonDocument doc(&jsonArena);
+    doc["state"] = otaStateName(otaUpdater.state());
+    doc["offset"] = otaUpdater.offset();
+    doc["size"] = otaUpdater.size();
+    doc["chunk"] = otaUpdater.chunkSize();
+    doc["dropped"] = otaUpdater.chunksDropped();
+    if (otaUpdater.error())
+    {
+        doc["error"] = otaUpdater.error();
+    }
+    doc["ms"] = otaUpdater.elapsedMs(nowMs);
+    doc["kBps"] = roundf(otaUpdater.kbPerSecond(nowMs) * 10.0f) / 10.0f;
+    if (publishJson(topicSysOtaStatus, doc, false))
+    {
+        otaUpdater.statusSent();
+    }
+}
+
+// sys/metrics: cheap to collect (counters, heap getters, one stack scan per
+// task), published every METRICS_INTERVAL. Kept off while offline so the
+// loop histogram spans the whole gap once the broker is back.
+void publishMetrics()
+{
+    if (!netLink.online())
+    {
+        return;
+    }
+
+    JsonDocument doc(&jsonArena);
+    doc["uptimeS"] = millis() / 1000;
+    doc["heapFree"] = ESP.getFreeHeap();
+    doc["heapMin"] = ESP.getMinFreeHeap();
+    doc["heapLargest"] = ESP.getMaxAllocHeap();
+
+    // Unused stack in bytes (high-water mark)
+    JsonObject stackFree = doc["stackFree"].to<JsonObject>();
+    stackFree["network"] = uxTaskGetStackHighWaterMark(networkTaskHandle);
+    stackFree["sensor"] = uxTaskGetStackHighWaterMark(sensorTaskHandle);
+    stackFree["actuator"] = uxTaskGetStackHighWaterMark(actuatorTaskHandle);
+
+    doc["wifiReconnects"] = netLink.wifiReconnects();
+    doc["mqttReconnects"] = netLink.mqttReconnects();
+    doc["publishFailures"] = publishFailures;
+    doc["dhtFailures"] = dhtSampler.failures();
+
+    // Network task CPU share and why it woke up (tickless loop)
+    unsigned long windowMs = millis() - metricsWindowStart;
+    doc["busyPermille"] = windowMs > 0 ? (uint32_t)(loopStats.busyUs() / windowMs) : 0;
+    JsonObject wakeups = doc["wakeups"].to<JsonObject>();
+    wakeups["timer"] = loopWaker.timeouts();
+    wakeups["event"] = loopWaker.wakes();
+    wakeups["socket"] = loopWaker.socketWakes();
+
+    // Timed jobs: runs, worst start delay past the deadline, periods skipped
+    JsonObject timers = doc["timers"].to<JsonObject>();
+    timers["runs"] = networkTimers.runs();
+    timers["lateMaxMs"] = networkTimers.lateMaxMs();
+    timers["missed"] = networkTimers.missed();
+
+    // Device state in NVS: writes since boot / ever, updates folded into a write
+    JsonObject nvs = doc["nvs"].to<JsonObject>();
+    nvs["writes"] = deviceStateStore.writes();
+    nvs["lifetime"] = deviceStateStore.lifetimeWrites();
+    nvs["coalesced"] = deviceStateStore.coalesced();
+    nvs["failures"] = deviceStateStore.failures();
+
+    // MQTT outbox: depth now and worst, QoS1 window, counters and PUBACK
+    // round trip since the last metrics message
+    JsonObject outbox = doc["outbox"].to<JsonObject>();
+    outbox["queued"] = mqttOutbox.pending();
+    outbox["bytes"] = mqttOutbox.pendingBytes();
+    outbox["depthMax"] = mqttOutbox.depthMax();
+    outbox["inflight"] = mqttOutbox.inFlight();
+    outbox["window"] = mqttOutbox.window();
+    outbox["sent"] = mqttOutbox.sent();
+    outbox["acked"] = mqttOutbox.acked();
+    outbox["resent"] = mqttOutbox.resent();
+    outbox["rejected"] = mqttOutbox.rejected();
+    outbox["backpressure"] = mqttOutbox.backpressureEvents();
+    const LatencyHistogram &ackTimes = mqttOutbox.ackRttUs();
+    JsonObject ackUs = outbox["ackUs"].to<JsonObject>();
+    ackUs["n"] = ackTimes.count();
+    ackUs["p50"] = ackTimes.percentile(50);
+    ackUs["p99"] = ackTimes.percentile(99);
+    ackUs["max"] = ackTimes.maxUs();
+
+    // Network loop iteration time since the last metrics message
+    const LatencyHistogram &loopTimes = loopStats.histogram();
+    JsonObject loopUs = doc["loopUs"].to<JsonObject>();
+    loopUs["n"] = loopTimes.count();
+    loopUs["p50"] = loopTimes.percentile(50);
+    loopUs["p90"] = loopTimes.percentile(90);
+    loopUs["p99"] = loopTimes.percentile(99);
+    loopUs["p999"] = loopTimes.percentile(99.9f);
+    loopUs["max"] = loopTimes.maxUs();
+    if (loopTimes.formatCounts(metricsHistogramText, sizeof(metricsHistogramText)) > 0)
+    {
+        loopUs["hist"] = serialized(metricsHistogramText);
+    }
+
+    if (publishJson(topicSysMetrics, doc, false))
+    {
+        loopStats.resetHistogram();
+        loopWaker.resetCounts();
+        networkTimers.resetStats();
+        mqttOutbox.resetStats();
+        metricsWindowStart = millis();
+    }
+}
+
+// Serialize straight into the static payload buffer and publish (no heap)
+bool publishJson(const char *topic, const JsonDocument &doc, bool retained)
+{
+    size_t length = serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+    if (doc.overflowed() || length == 0 || length >= sizeof(payloadBuffer) - 1)
+    {
+        Serial.printf("❌ Payload too large for %s\n", topic);
+        publishFailures++;
+        return false;
+    }
+
+    return publishBuffer(topic, length, retained);
+}
+
+// Same as publishJson(), MessagePack-encoded
+bool publishMsgPack(const char *topic, const JsonDocument &doc, bool retained)
+{
+    size_t length = serializeMsgPack(doc, payloadBuffer, sizeof(payloadBuffer));
+    if (doc.overflowed() || length == 0 || length >= sizeof(payloadBuffer) - 1)
+    {
+        Serial.printf("❌ Payload too large for %s\n", topic);
+        publishFailures++;
+        return false;
+    }
+
+    return publishBuffer(topic, length, retained);
+}
+
+// Queues payloadBuffer in the outbox (written without blocking); every
+// failed publish (offline or outbox full) is counted
+bool publishBuffer(const char *topic, size_t length, bool retained)
+{
+    if (!mqttOutbox.publish(topic, (const uint8_t *)payloadBuffer, length, retained, MQTT_PUBLISH_QOS))
+    {
+        publishFailures++;
+        return false;
+    }
+    return true;
+}
+
+// =============================================================================
+// BOOT BENCHMARKS
+// =============================================================================
+
+// Build + serialize a typical sensor reading both ways and print the payload
+// size and the average encode time per message
+void benchmarkPayloadEncoding()
+{
+    SensorSample sample;
+    sample.timestamp = 123456789;
+    sample.temperature10 = 251;
+    sample.humidity10 = 602;
+    const int rssi = -57;
+
+    size_t jsonSize = 0;
+    uint32_t start = micros();
+    for (int i = 0; i < ENCODING_BENCHMARK_ROUNDS; i++)
+    {
+        JsonDocument doc(&jsonArena);
+        buildSensorJson(doc, sample, rssi);
+        jsonSize = serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+    }
+    uint32_t jsonUs = micros() - start;
+
+    size_t msgPackSize = 0;
+    start = micros();
+    for (int i = 0; i < ENCODING_BENCHMARK_ROUNDS; i++)
+    {
+        JsonDocument doc(&jsonArena);
+        buildSensorMsgPack(doc, sample, rssi);
+        msgPackSize = serializeMsgPack(doc, payloadBuffer, sizeof(payloadBuffer));
+    }
+    uint32_t msgPackUs = micros() - start;
+
+    char line[128];
+    snprintf(line, sizeof(line), "📏 sensor/state encoding: JSON %u B %lu us, MessagePack %u B %lu us (avg of %d)",
+             (unsigned)jsonSize, (unsigned long)(jsonUs / ENCODING_BENCHMARK_ROUNDS),
+             (unsigned)msgPackSize, (unsigned long)(msgPackUs / ENCODING_BENCHMARK_ROUNDS),
+             ENCODING_BENCHMARK_ROUNDS);
+    Serial.println(line);
+}
+
+// Parse + dispatch typical commands with the route table (no-op handlers)
+// and with the previous path (JsonDocument + key lookups/strcmp), and print
+// the average time per command
+bool benchmarkHandler(const CommandToken &)
+{
+    return true;
+}
+
+void benchmarkCommandParsing()
+{
+    static const CommandRoute benchmarkRoutes[] = {
+        {"light", "on", benchmarkHandler},
+        {"light", "off", benchmarkHandler},
+        {"light", "toggle", benchmarkHandler},
+        {"fan", "on", benchmarkHandler},
+        {"fan", "off", benchmarkHandler},
+        {"fan", "toggle", benchmarkHandler},
+        {"fanSpeed", nullptr, benchmarkHandler},
+    };
+    static const char *const commands[] = {
+        "{\"light\":\"toggle\"}",
+        "{\"fan\":\"on\",\"fanSpeed\":70}",
+    };
+    const size_t commandCount = sizeof(commands) / sizeof(commands[0]);
+
+    uint32_t matches = 0;
+    uint32_t start = micros();
+    for (int i = 0; i < COMMAND_BENCHMARK_ROUNDS; i++)
+    {
+        for (size_t c = 0; c < commandCount; c++)
+        {
+            matches += dispatchCommand((const uint8_t *)commands[c], strlen(commands[c]), benchmarkRoutes).dispatched;
+        }
+    }
+    uint32_t tableUs = micros() - start;
+
+    uint32_t legacyMatches = 0;
+    start = micros();
+    for (int i = 0; i < COMMAND_BENCHMARK_ROUNDS; i++)
+    {
+        for (size_t c = 0; c < commandCount; c++)
+        {
+            JsonDocument doc(&jsonArena);
+            if (deserializeJson(doc, commands[c], strlen(commands[c])))
+            {
+                continue;
+            }
+            const char *lightCmd = doc["light"];
+            if (lightCmd && (strcmp(lightCmd, "toggle") == 0 || strcmp(lightCmd, "on") == 0 || strcmp(lightCmd, "off") == 0))
+            {
+                legacyMatches++;
+            }
+            const char *fanCmd = doc["fan"];
+            if (fanCmd && (strcmp(fanCmd, "toggle") == 0 || strcmp(fanCmd, "on") == 0 || strcmp(fanCmd, "off") == 0))
+            {
+                legacyMatches++;
+            }
+            if (doc.containsKey("fanSpeed"))
+            {
+                legacyMatches += doc["fanSpeed"].as<int>() >= 0;
+            }
+        }
+    }
+    uint32_t legacyUs = micros() - start;
+
+    const uint32_t total = COMMAND_BENCHMARK_ROUNDS * commandCount;
+    char line[128];
+    snprintf(line, sizeof(line), "📏 Command parse+dispatch: route table %lu ns, JsonDocument %lu ns per command (%lu/%lu matches)",
+             (unsigned long)(tableUs * 1000UL / total), (unsigned long)(legacyUs * 1000UL / total),
+             (unsigned long)matches, (unsigned long)legacyMatches);
+    Serial.println(line);
+}
@@ -2,22 +2,64 @@
  * ESP32-S3 IoT Demo Firmware
  * 
  * Features:
- * - WiFi connection with auto-reconnect
+ * - FreeRTOS tasks pinned per core: network/MQTT on core 0 (with WiFi),
+ *   actuator and sensor on core 1; lock-free SPSC queues, atomic device state
+ * - Non-blocking WiFi/MQTT reconnect (event-driven, exponential backoff)
+ * - Tickless network task (sleeps until the next deadline, socket data or a
+ *   task event), WiFi modem sleep, DFS and automatic light sleep
  * - MQTT client with LWT (Last Will Testament)
- * - Device control via MQTT commands (Light & Fan)
+ * - Device control via MQTT commands, one row per relay in the ACTUATORS
+ *   table (Light & Fan by default)
  * - Sensor data publishing (Temperature, Humidity, Light level)
  * - Retained device state messages for UI synchronization
+ * - Allocation-free publish/command path (static JSON arena, fixed buffers)
+ * - Zero-copy command parsing with a (key, verb) -> handler route table
+ * - Command acknowledgements on device/ack (optional "id"/"ts" in the command)
+ * - Persistent MQTT session, QoS1 commands: commands sent while the board is
+ *   reconnecting are queued by the broker; "seq" suppresses redeliveries
+ * - Non-blocking publish path: a bounded outbox with a pipelined QoS1
+ *   in-flight window; a filling outbox holds the sensor task back
+ * - Runtime metrics on sys/metrics: loop time histogram, heap, task stacks,
+ *   reconnects, publish failures
+ * - Firmware update over MQTT: the image is streamed in chunks straight into
+ *   the inactive OTA partition (SHA-256 checked on the fly, resumable), and
+ *   rolled back if the new image does not get online
+ * - Optional MQTT over TLS (env esp32-s3-devkitc-1-tls): ECDHE-ECDSA P-256,
+ *   non-blocking handshake, sessions resumed across reconnects and restarts
  * 
  * MQTT Topics:
  * - Publish sensor data: ${TOPIC_NS}/sensor/state
  * - Publish device state: ${TOPIC_NS}/device/state (retained)
  * - Publish online status: ${TOPIC_NS}/sys/online (retained, LWT)
- * - Subscribe commands: ${TOPIC_NS}/device/cmd
+ * - Publish runtime metrics: ${TOPIC_NS}/sys/metrics (every 60 s)
+ * - Publish command acks: ${TOPIC_NS}/device/ack (commands carrying an "id")
+ * - Subscribe commands: ${TOPIC_NS}/device/cmd (QoS1)
+ * - Subscribe OTA: ${TOPIC_NS}/sys/ota (QoS1), ${TOPIC_NS}/sys/ota/data (image chunks)
+ * - Publish OTA progress: ${TOPIC_NS}/sys/ota/status
  */
 
 #include <WiFi.h>
+#include <Boards.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <NetLink.h>
+#include <LoopStats.h>
+#include <JsonArena.h>
+#include <HeapProbe.h>
+#include <SpscQueue.h>
+#include <CommandParser.h>
+#include <CommandTrace.h>
+#include <CommandDedup.h>
+#include <LoopWaker.h>
+#include <TimerWheel.h>
+#include <PersistedState.h>
+#include <ActuatorRegistry.h>
+#include <OtaUpdater.h>
+#include <MqttOutbox.h>
+#include <TlsClient.h>
+#include <esp_pm.h>
+#include <atomic>
+#include <time.h>
 
 // =============================================================================
 // CONFIGURATION - Modify these values for your setup
@@ -29,77 +71,335 @@ const char* WIFI_PASSWORD = "YourWiFiPassword";  // Change to your WiFi password
 
 // MQTT Broker Configuration
 const char* MQTT_HOST = "192.168.1.10";        // Change to your MQTT broker IP
-const int MQTT_PORT = 1883;
+const int MQTT_PORT = TlsClient::SUPPORTED ? 8883 : 1883;  // TLS listener in TLS builds
 const char* MQTT_USERNAME = "user1";           // Change to your MQTT username
 const char* MQTT_PASSWORD = "pass1";           // Change to your MQTT password
 
+// Persistent session: DEVICE_ID is the client id, so the broker keeps the
+// device/cmd subscription and queues QoS1 commands while we are away
+const bool MQTT_CLEAN_SESSION = false;
+const uint8_t COMMAND_QOS = 1;
+
+// Outgoing messages (see MqttOutbox.h): encoded into a bounded outbox and
+// written without blocking, up to MQTT_INFLIGHT_WINDOW QoS1 publishes await
+// their PUBACK at once. From 3/4 full the sensor task skips readings until
+// it has drained to 1/4; unacknowledged messages are resent on reconnect.
+const uint8_t MQTT_PUBLISH_QOS = 1;
+const uint8_t MQTT_INFLIGHT_WINDOW = 8;
+const size_t MQTT_OUTBOX_BYTES = 4096;
+const size_t MQTT_OUTBOX_SLOTS = 16;  // Messages, power of two
+
+// MQTT over TLS (TLS builds only, -DIOT_MQTT_TLS; see TlsClient.h).
+// mosquitto/gen_certs.sh creates the CA and a broker certificate for
+// MQTT_TLS_SERVER_NAME and prints the CA to paste below. The certificate is
+// checked against this name, not MQTT_HOST (mbedTLS does not match IPs).
+// Sessions are cached in RTC memory, so reconnects and restarts resume.
+const char* MQTT_TLS_SERVER_NAME = "mosquitto.local";
+const char* MQTT_TLS_CA_CERT = R"PEM(-----BEGIN CERTIFICATE-----
+paste the output of mosquitto/gen_certs.sh here
+-----END CERTIFICATE-----
+)PEM";
+const char* MQTT_TLS_CLIENT_CERT = nullptr;  // Device certificate (require_certificate true)
+const char* MQTT_TLS_CLIENT_KEY = nullptr;
+const uint32_t MQTT_TLS_HANDSHAKE_TIMEOUT_MS = 8000;
+const bool MQTT_TLS_RESUME = true;  // false: full handshake every time (to compare)
+
 // Device Configuration
 const char* DEVICE_ID = "esp32_demo_001";      // Unique device identifier
 const char* FIRMWARE_VERSION = "demo1-1.0.0";  // Firmware version
-const char* TOPIC_NS = "lab/room1";            // Topic namespace - match with app/web
+#define TOPIC_NS "lab/room1"                   // Topic namespace - match with app/web (literal, see topics below)
+
+// Board: relay and status LED pins, polarity (see Boards.h).
+// PlatformIO envs pass -DIOT_BOARD; Arduino IDE builds use the default.
+#ifndef IOT_BOARD
+#define IOT_BOARD Esp32S3DevKitC
+#endif
+typedef IOT_BOARD Board;
+typedef BoardIO<Board> BoardPins;
+static_assert(Board::SENSOR == SENSOR_SIMULATED, "This firmware publishes simulated sensor readings");
+static_assert(Board::FAN == FAN_RELAY, "The fan is a relay channel (see ACTUATORS)");
 
-// GPIO Pin Configuration - Adjust according to your ESP32-S3 board
-const int LIGHT_RELAY_PIN = 5;    // GPIO pin for light relay control
-const int FAN_RELAY_PIN = 6;      // GPIO pin for fan relay control
-const int STATUS_LED_PIN = 2;     // Built-in LED for status indication
+// Actuator channels (see ActuatorRegistry.h): one row per output. Commands
+// ({"<name>":"on|off|toggle"}, {"<levelKey>":0-100}), device/state and the NVS
+// snapshot follow the table, so another relay is one more row.
+constexpr ActuatorSpec ACTUATORS[] = {
+  // name, level key, kind, pin, dir pin, PWM pin, LEDC channel, active low, PWM Hz, PWM bits
+  {"light", nullptr, ACTUATOR_SWITCH, Board::LIGHT_PIN, NO_PIN, NO_PIN, 0, Board::LIGHT_ACTIVE_LOW, 0, 8},
+  {"fan", nullptr, ACTUATOR_SWITCH, Board::FAN_PIN, NO_PIN, NO_PIN, 0, Board::FAN_ACTIVE_LOW, 0, 8},
+};
+const size_t ACTUATOR_COUNT = sizeof(ACTUATORS) / sizeof(ACTUATORS[0]);
 
 // Timing Configuration
 const unsigned long SENSOR_PUBLISH_INTERVAL = 3000;   // 3 seconds
 const unsigned long HEARTBEAT_INTERVAL = 15000;       // 15 seconds
-const unsigned long WIFI_RECONNECT_INTERVAL = 5000;   // 5 seconds
-const unsigned long MQTT_RECONNECT_INTERVAL = 5000;   // 5 seconds
-const unsigned long COMMAND_DEBOUNCE_DELAY = 500;     // 500ms debounce
+const unsigned long LOOP_STATS_INTERVAL = 60000;      // 60 seconds
+const unsigned long METRICS_INTERVAL = 60000;         // sys/metrics, also the loop histogram window
+const unsigned long DEVICE_STATE_COALESCE_MS = 100;   // One device/state publish per burst of changes
+
+// Task Configuration
+// Network work shares core 0 with the WiFi/lwIP tasks; core 1 is left to the
+// actuator task (highest priority) and the sensor sampler, so a stalled
+// socket never delays a command once it has been parsed.
+const BaseType_t NETWORK_TASK_CORE = 0;
+const BaseType_t ACTUATOR_TASK_CORE = 1;
+const BaseType_t SENSOR_TASK_CORE = 1;
+const UBaseType_t ACTUATOR_TASK_PRIORITY = 3;
+const UBaseType_t NETWORK_TASK_PRIORITY = 2;
+const UBaseType_t SENSOR_TASK_PRIORITY = 1;
+const uint32_t ACTUATOR_TASK_STACK = 3072;
+const uint32_t NETWORK_TASK_STACK = 8192;         // JSON documents, MQTT, Serial
+const uint32_t SENSOR_TASK_STACK = 3072;
+const uint32_t NETWORK_IDLE_POLL_MS = 5000;       // Online and idle: longest sleep (keepalive is 30 s)
+const size_t SAMPLE_QUEUE_SIZE = 8;               // sensor -> network
+const size_t COMMAND_QUEUE_SIZE = 8;              // network -> actuator
+const size_t COMMAND_TRACE_SLOTS = 4;             // Traced commands awaiting their device/ack
+const size_t COMMAND_DEDUP_WINDOW = 16;           // Recent command "seq" values (QoS1 redelivery)
+const size_t NETWORK_TIMER_SLOTS = 8;             // Timed jobs of the network task (TimerWheel)
+
+// Device State Persistence (see PersistedState.h)
+// Light and fan survive a reboot: setup() restores them before WiFi starts,
+// so the first retained device/state is already right. NVS is written once
+// the state has been stable for the quiet time, at the latest the max delay
+// after the first unsaved change (one write per command burst).
+const bool PERSIST_DEVICE_STATE = true;
+const char* STATE_NVS_NAMESPACE = "iot";
+const PersistPolicy DEVICE_STATE_PERSIST_POLICY = {2000, 30000};  // Quiet ms, max delay ms
+
+// OTA Update over MQTT (see OtaUpdater.h, sender: tests/ota_push.py)
+// sys/ota starts an update, sys/ota/data carries the image in chunks that
+// are written straight into the inactive app partition, sys/ota/status
+// reports progress. The new image must publish sys/online within
+// OTA_CONFIRM_TIMEOUT_MS of boot, in at most OTA_MAX_BOOT_ATTEMPTS boots,
+// or the previous image is booted again.
+const bool OTA_ENABLED = true;
+const size_t OTA_CHUNK_SIZE = 4096;                   // One flash sector per chunk
+const uint8_t OTA_MAX_BOOT_ATTEMPTS = 3;
+const unsigned long OTA_CONFIRM_TIMEOUT_MS = 300000;  // 5 minutes to reach the broker
+const unsigned long OTA_RESTART_DELAY_MS = 1000;      // "done" status out before the restart
+
+// Power Configuration
+// Between wake-ups the network task blocks in LoopWaker::wait() and both
+// cores idle: the CPU clocks down to PM_MIN_CPU_MHZ and, if the core was
+// built with tickless idle, enters automatic light sleep (relay outputs keep
+// their level). The radio uses modem sleep and wakes for DTIM beacons, so
+// the MQTT session and keepalive are unaffected.
+const bool POWER_SAVE = true;
+const int PM_MAX_CPU_MHZ = 240;
+const int PM_MIN_CPU_MHZ = 80;
+
+// Reconnect policy (see NetLink.h)
+const uint32_t NET_BACKOFF_MIN_MS = 500;          // First retry after 0.5 s
+const uint32_t NET_BACKOFF_MAX_MS = 30000;        // Cap retries at 30 s
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000;   // Association + DHCP
+const uint32_t MQTT_TCP_TIMEOUT_MS = 3000;        // TCP handshake to broker
+const uint16_t MQTT_SOCKET_TIMEOUT_S = 1;         // CONNACK / packet read: the only blocking wait in NetLink
+
+// Fast reconnect (see NetLink.h): the BSSID/channel of the last AP that
+// reached the broker is cached in NVS, so a reboot skips the channel scan.
+// Reusing its IP lease also skips DHCP; only enable it with a DHCP
+// reservation for this board (a lease that fails falls back to DHCP).
+const bool WIFI_FAST_CONNECT = true;
+const bool WIFI_REUSE_IP_LEASE = false;
+const uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;  // Then scan
+
+// Memory Configuration
+const size_t JSON_ARENA_SIZE = 4096;              // Static pool for all JsonDocuments
+const size_t METRICS_HISTOGRAM_TEXT_SIZE = 640;   // Loop histogram bucket counts (see LatencyHistogram)
+const size_t MQTT_PAYLOAD_BUFFER_SIZE = 768 + METRICS_HISTOGRAM_TEXT_SIZE;  // Fits sys/metrics
+// PubSubClient's buffer only receives (publishes go through the outbox)
+const size_t COMMAND_PAYLOAD_SIZE = 512;
+const size_t OTA_DATA_PAYLOAD_SIZE = OTA_ENABLED ? OTA_CHUNK_HEADER + OTA_CHUNK_SIZE : 0;
+const size_t MQTT_BUFFER_SIZE =
+    (COMMAND_PAYLOAD_SIZE > OTA_DATA_PAYLOAD_SIZE ? COMMAND_PAYLOAD_SIZE : OTA_DATA_PAYLOAD_SIZE) +
+    64;  // + fixed header and topic
+
+static_assert(MQTT_OUTBOX_BYTES >= 2 * (MQTT_PAYLOAD_BUFFER_SIZE + 64), "The outbox must hold two of the largest messages");
 
 // =============================================================================
 // GLOBAL VARIABLES
 // =============================================================================
 
 WiFiClient espClient;
-PubSubClient mqttClient(espClient);
-
-// Device state
-bool lightState = false;
-bool fanState = false;
-bool deviceOnline = false;
-
-// Timing variables
-unsigned long lastSensorPublish = 0;
-unsigned long lastHeartbeat = 0;
-unsigned long lastWifiCheck = 0;
-unsigned long lastMqttCheck = 0;
-unsigned long lastCommandTime = 0;
-
-// MQTT Topics
-String topicSensorState;
-String topicDeviceState;
-String topicDeviceCmd;
-String topicSysOnline;
+TlsClient mqttTls(espClient);  // TLS on espClient's socket, or plain TCP
+MqttOutbox<MQTT_OUTBOX_BYTES, MQTT_OUTBOX_SLOTS> mqttOutbox(mqttTls, MQTT_INFLIGHT_WINDOW);  // Publishes
+PubSubClient mqttClient(mqttOutbox);  // Connect, subscribe, incoming messages (through the outbox's socket)
+NetLink netLink(espClient, mqttClient);
+LoopStats loopStats;
+HeapProbe heapProbe;
+LoopWaker loopWaker;  // Wakes the network task (samples, state changes, WiFi events)
+
+// Every timed job of the network task; networkSleepMs() sleeps until the next one
+TimerWheel<NETWORK_TIMER_SLOTS> networkTimers;
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle blinkTimer;  // Armed while the status LED blinks
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle persistTimer;  // Armed by an unsaved device state
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle statePublishTimer;  // Armed by the first change of a burst
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle otaRestartTimer;  // Armed by a verified OTA image
+TimerWheel<NETWORK_TIMER_SLOTS>::Handle otaConfirmTimer;  // Runs from boot until a new image is online
+
+// JSON documents allocate from this arena, payloads serialize into this buffer
+JsonArena<JSON_ARENA_SIZE> jsonArena;
+char payloadBuffer[MQTT_PAYLOAD_BUFFER_SIZE];
+char metricsHistogramText[METRICS_HISTOGRAM_TEXT_SIZE];
+
+// Sensor reading, produced by the sensor task
+struct SensorSample {
+  uint32_t ts;
+  int16_t temp10;   // °C x10
+  uint16_t hum10;   // % x10
+  uint16_t lux;
+};
+
+// Actuator command, parsed by the network task and applied by the actuator task
+struct ActuatorCommand {
+  enum Action : uint8_t { OFF, ON, TOGGLE, SET };
+  
+  uint8_t channel;      // Row of ACTUATORS
+  Action action;
+  uint8_t value;        // SET: level, PWM duty 0-255
+  uint8_t trace_slot;   // CommandTrace slot to acknowledge, or NONE
+  uint32_t receivedUs;  // micros() when parsed, for the latency counter
+};
+
+// Target state of the outputs, folded from a batch of queued commands
+struct ActuatorIntent {
+  ActuatorState channels[ACTUATOR_COUNT];
+};
+
+// Lock-free queues between the tasks (one producer, one consumer each)
+SpscQueue<SensorSample, SAMPLE_QUEUE_SIZE> sampleQueue;        // sensor -> network
+SpscQueue<ActuatorCommand, COMMAND_QUEUE_SIZE> commandQueue;  // network -> actuator
+
+// Correlation ids of commands awaiting their device/ack
+CommandTrace<COMMAND_TRACE_SLOTS> commandTrace;
+
+// Command sequence numbers already applied (network task)
+CommandDedup<COMMAND_DEDUP_WINDOW> commandDedup;
+
+TaskHandle_t sensorTaskHandle = nullptr;
+TaskHandle_t networkTaskHandle = nullptr;
+TaskHandle_t actuatorTaskHandle = nullptr;
+
+// Device state: written by the actuator task only, read by the network task
+ActuatorRegistry<ACTUATOR_COUNT> actuators(ACTUATORS);
+std::atomic<bool> deviceStateDirty{false};     // actuator -> network: publish state
+std::atomic<bool> deviceStateUnsaved{false};   // actuator -> network: save state (online or not)
+std::atomic<uint32_t> commandLatencyMaxUs{0};  // parse -> GPIO, worst case
+std::atomic<uint32_t> commandsCoalesced{0};    // Commands folded into another's relay write
+std::atomic<uint32_t> sensorThrottled{0};      // Readings skipped by the sensor task (outbox backpressure)
+uint32_t publishFailures = 0;                  // Failed publish() calls (network task)
+uint32_t bootFirstPublishMs = 0;               // First sys/online after boot (network task)
+unsigned long metricsWindowStart = 0;          // millis() of the last published metrics
+
+// Device state as stored in NVS (no padding: compared byte-wise)
+struct DeviceSnapshot {
+  uint8_t channels;  // ACTUATOR_COUNT when saved
+  uint8_t on[ACTUATOR_COUNT];
+  uint8_t level[ACTUATOR_COUNT];
+};
+PersistedState<DeviceSnapshot> deviceStateStore(STATE_NVS_NAMESPACE, DEVICE_STATE_PERSIST_POLICY);  // Network task
+
+// Firmware update in progress, boot confirmation (network task)
+OtaUpdater otaUpdater(OTA_CHUNK_SIZE);
+
+// MQTT Topics (concatenated at compile time)
+const char topicSensorState[] = TOPIC_NS "/sensor/state";
+const char topicDeviceState[] = TOPIC_NS "/device/state";
+const char topicDeviceCmd[] = TOPIC_NS "/device/cmd";
+const char topicDeviceAck[] = TOPIC_NS "/device/ack";
+const char topicSysOnline[] = TOPIC_NS "/sys/online";
+const char topicSysMetrics[] = TOPIC_NS "/sys/metrics";
+const char topicSysOta[] = TOPIC_NS "/sys/ota";
+const char topicSysOtaData[] = TOPIC_NS "/sys/ota/data";
+const char topicSysOtaStatus[] = TOPIC_NS "/sys/ota/status";
+
+// =============================================================================
+// FUNCTION DECLARATIONS
+// =============================================================================
+
+void initPower();
+void initGPIO();
+void restoreDeviceState();
+void initTopics();
+void initMQTT();
+void initNetwork();
+void initTimers();
+void startTasks();
+void sensorTask(void*);
+void networkTask(void*);
+void actuatorTask(void*);
+void networkStep();
+uint32_t networkSleepMs(unsigned long nowMs);
+void publishHeartbeat();
+void reportLoopStats();
+void noteDeviceState(uint32_t nowMs);
+void persistDeviceStateJob();
+void publishDeviceStateJob();
+void otaRestartJob();
+void otaConfirmJob();
+void wakeNetworkTask();
+void onMqttConnected();
+void onMqttMessage(char* topic, byte* payload, unsigned int length);
+void handleDeviceCommand(const byte* payload, unsigned int length, uint32_t receivedUs);
+bool handleOtaMessage(const char* topic, const byte* payload, unsigned int length);
+CommandResult actuatorCommand(const CommandToken& key, const CommandToken& value);
+bool queueCommand(ActuatorCommand command);
+void foldCommand(ActuatorIntent& intent, const ActuatorCommand& command);
+bool applyIntent(const ActuatorIntent& intent);
+void readSensor();
+void publishSensorData(const SensorSample& sample);
+void publishDeviceState();
+void publishCommandAcks(uint32_t readySlots);
+void publishOnlineStatus(bool online);
+void publishOtaStatus();
+void publishMetrics();
+bool publishJson(const char* topic, const JsonDocument& doc, bool retained);
+void updateStatusLED();
+void toggleStatusLED();
+unsigned long statusBlinkInterval();
 
 // =============================================================================
 // SETUP FUNCTION
 // =============================================================================
 
 void setup() {
+  // No settle delay: a serial monitor attached later misses the banner,
+  // but WiFi starts ~1 s sooner
   Serial.begin(115200);
-  delay(1000);
   
   Serial.println("\n=== ESP32-S3 IoT Demo Starting ===");
   Serial.printf("Device ID: %s\n", DEVICE_ID);
   Serial.printf("Firmware: %s\n", FIRMWARE_VERSION);
   Serial.printf("Topic Namespace: %s\n", TOPIC_NS);
   
+  // A freshly updated image counts this boot (rolls back after too many)
+  if (OTA_ENABLED) {
+    otaUpdater.beginBoot(OTA_MAX_BOOT_ATTEMPTS);
+  }
+  
+  // CPU frequency scaling, light sleep, WiFi modem sleep
+  initPower();
+  
   // Initialize GPIO pins
   initGPIO();
   
+  // Light/fan as before the reboot, before the network publishes anything
+  restoreDeviceState();
+  
   // Initialize MQTT topics
   initTopics();
   
-  // Initialize WiFi
-  initWiFi();
-  
-  // Initialize MQTT
+  // Initialize MQTT client
   initMQTT();
   
+  // Start WiFi/MQTT connection (returns immediately)
+  initNetwork();
+  
+  // Register the network task's timed jobs
+  initTimers();
+  
+  // Hand everything over to the sensor, network and actuator tasks
+  startTasks();
+  
   Serial.println("=== Setup Complete ===\n");
 }
 
@@ -108,296 +408,629 @@ void setup() {
 // =============================================================================
 
 void loop() {
+  // All work runs in the tasks started by setup()
+  vTaskDelete(nullptr);
+}
+
+// =============================================================================
+// TASKS
+// =============================================================================
+
+void startTasks() {
+  xTaskCreatePinnedToCore(actuatorTask, "actuator", ACTUATOR_TASK_STACK, nullptr,
+                          ACTUATOR_TASK_PRIORITY, &actuatorTaskHandle, ACTUATOR_TASK_CORE);
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr,
+                          NETWORK_TASK_PRIORITY, &networkTaskHandle, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(sensorTask, "sensor", SENSOR_TASK_STACK, nullptr,
+                          SENSOR_TASK_PRIORITY, &sensorTaskHandle, SENSOR_TASK_CORE);
+  Serial.printf("Tasks started: network on core %d, actuator/sensor on core %d\n",
+                (int)NETWORK_TASK_CORE, (int)ACTUATOR_TASK_CORE);
+}
+
+// Samples the sensors every SENSOR_PUBLISH_INTERVAL and queues the reading
+void sensorTask(void*) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SENSOR_PUBLISH_INTERVAL));
+    readSensor();
+  }
+}
+
+// Owns WiFi, MQTT, JSON and the status LED
+void networkTask(void*) {
+  heapProbe.attach();
+  for (;;) {
+    networkStep();
+    
+    // Tickless: sleep until the next deadline, MQTT data (or room for the
+    // outbox's stalled write) or a wakeNetworkTask()
+    loopWaker.wait(netLink.online() ? espClient.fd() : -1, networkSleepMs(millis()), mqttOutbox.stalled());
+  }
+}
+
+// Called by the sensor/actuator tasks and NetLink's WiFi event handler
+void wakeNetworkTask() {
+  loopWaker.wake();
+}
+
+// Applies queued commands to the relays. No Serial or network I/O here, so
+// command-to-GPIO latency does not depend on the network task. Every queued
+// command is folded, in order, into one target state and each relay is
+// written once per batch: a burst of toggles never chatters the relays and
+// no command is dropped.
+void actuatorTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    
+    bool applied = false;
+    for (;;) {
+      ActuatorCommand batch[COMMAND_QUEUE_SIZE];
+      size_t count = 0;
+      while (count < COMMAND_QUEUE_SIZE && commandQueue.pop(batch[count])) {
+        count++;
+      }
+      if (count == 0) {
+        break;
+      }
+      
+      ActuatorIntent intent;
+      for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+        intent.channels[i] = actuators.state(i);
+      }
+      for (size_t i = 0; i < count; i++) {
+        foldCommand(intent, batch[i]);
+      }
+      bool changed = applyIntent(intent);
+      uint32_t appliedUs = micros();
+      commandsCoalesced.store(commandsCoalesced.load(std::memory_order_relaxed) + count - 1,
+                              std::memory_order_relaxed);
+      
+      // State flag first: an ack never overtakes its device/state
+      if (changed) {
+        deviceStateUnsaved.store(true);
+        deviceStateDirty.store(true);
+      }
+      for (size_t i = 0; i < count; i++) {
+        uint32_t latencyUs = appliedUs - batch[i].receivedUs;
+        if (latencyUs > commandLatencyMaxUs.load(std::memory_order_relaxed)) {
+          commandLatencyMaxUs.store(latencyUs, std::memory_order_relaxed);
+        }
+        commandTrace.applied(batch[i].trace_slot, appliedUs);
+      }
+      applied = true;
+    }
+    
+    if (applied) {
+      wakeNetworkTask();
+    }
+  }
+}
+
+// One iteration of the network task (the former loop())
+void networkStep() {
+  loopStats.begin();
+  heapProbe.begin();
+  bool wasOnline = netLink.online();
+  uint32_t mqttReconnects = netLink.mqttReconnects();
+  uint32_t nvsWrites = deviceStateStore.writes();
+  OtaState otaState = otaUpdater.state();
   unsigned long currentTime = millis();
   
-  // Check WiFi connection
-  checkWiFi(currentTime);
+  // Heartbeat, metrics, LED blink, loop report. First, so the wheel clock
+  // has caught up with the idle sleep before this iteration arms a timer
+  networkTimers.run(currentTime);
+  
+  // Advance WiFi/MQTT connection state machine and handle MQTT messages
+  netLink.poll(currentTime);
   
-  // Check MQTT connection
-  checkMQTT(currentTime);
+  // PUBACKs read by poll() freed window slots, or the socket takes more now
+  mqttOutbox.transmit();
   
-  // Handle MQTT messages
-  if (mqttClient.connected()) {
-    mqttClient.loop();
+  // Samples queued by the sensor task (dropped while offline)
+  SensorSample sample;
+  while (sampleQueue.pop(sample)) {
+    if (netLink.online()) {
+      publishSensorData(sample);
+    }
+  }
+  
+  if (netLink.online()) {
+    // Acks for commands the actuator task has finished, taken before the
+    // state flag so the state they caused is published ahead of them
+    uint32_t acksReady = commandTrace.ready();
     
-    // Publish sensor data
-    if (currentTime - lastSensorPublish >= SENSOR_PUBLISH_INTERVAL) {
-      publishSensorData();
-      lastSensorPublish = currentTime;
+    // Device state changed: one retained publish DEVICE_STATE_COALESCE_MS
+    // after the first change (publishDeviceStateJob), however many commands
+    // arrive meanwhile. Acks wait for the publish that carries their state.
+    if (deviceStateDirty.load() && !networkTimers.pending(statePublishTimer)) {
+      networkTimers.start(statePublishTimer, DEVICE_STATE_COALESCE_MS);
+    }
+    if (!networkTimers.pending(statePublishTimer)) {
+      publishCommandAcks(acksReady);
     }
     
-    // Publish heartbeat (device state)
-    if (currentTime - lastHeartbeat >= HEARTBEAT_INTERVAL) {
-      publishDeviceState();
-      lastHeartbeat = currentTime;
+    // OTA progress: one status per iteration however many chunks came in
+    // (the sender paces itself on it)
+    if (otaUpdater.statusPending()) {
+      publishOtaStatus();
     }
   }
   
-  // Update status LED
+  // Verified OTA image: restart into it shortly
+  if (otaUpdater.state() == OTA_DONE && !networkTimers.pending(otaRestartTimer)) {
+    networkTimers.start(otaRestartTimer, OTA_RESTART_DELAY_MS);
+  }
+  
+  // Coalesced NVS save of the new state, also while offline
+  if (deviceStateUnsaved.load()) {
+    deviceStateUnsaved.store(false);
+    noteDeviceState(currentTime);
+  }
+  
+  // Solid or blinking status LED for the current link state
   updateStatusLED();
   
-  delay(100); // Small delay to prevent watchdog issues
+  // Measure the work only, not the idle wait in networkTask()
+  loopStats.end();
+  
+  // Debug builds: steady-state iterations must not touch the heap (an NVS
+  // write may grow its index and starting or ending an OTA update
+  // allocates, so neither counts as steady)
+  heapProbe.end(wasOnline && netLink.online() && mqttReconnects == netLink.mqttReconnects() &&
+                nvsWrites == deviceStateStore.writes() && otaState == otaUpdater.state());
+}
+
+// ms until networkStep() has timed work; events (samples, state changes,
+// WiFi, MQTT data) wake the task earlier
+uint32_t networkSleepMs(unsigned long nowMs) {
+  // WiFiClient / mbedTLS may already hold bytes read off the socket (select() would not see them)
+  if (netLink.online() && mqttTls.available() > 0) {
+    return 0;
+  }
+  
+  return min(netLink.nextPollMs(nowMs), networkTimers.untilNext(nowMs));
 }
 
 // =============================================================================
-// INITIALIZATION FUNCTIONS
+// TIMED JOBS (network task)
 // =============================================================================
 
-void initGPIO() {
-  Serial.println("Initializing GPIO pins...");
-  
-  // Configure relay pins as outputs
-  pinMode(LIGHT_RELAY_PIN, OUTPUT);
-  pinMode(FAN_RELAY_PIN, OUTPUT);
-  pinMode(STATUS_LED_PIN, OUTPUT);
-  
-  // Initialize relays to OFF state
-  digitalWrite(LIGHT_RELAY_PIN, LOW);
-  digitalWrite(FAN_RELAY_PIN, LOW);
-  digitalWrite(STATUS_LED_PIN, LOW);
+void initTimers() {
+  networkTimers.begin(millis());
+  networkTimers.every(HEARTBEAT_INTERVAL, publishHeartbeat);
+  networkTimers.every(METRICS_INTERVAL, publishMetrics);  // Also the loop histogram window
+  networkTimers.every(LOOP_STATS_INTERVAL, reportLoopStats);
+  blinkTimer = networkTimers.add(toggleStatusLED);
+  persistTimer = networkTimers.add(persistDeviceStateJob);
+  statePublishTimer = networkTimers.add(publishDeviceStateJob);
+  otaRestartTimer = networkTimers.add(otaRestartJob);
+  otaConfirmTimer = networkTimers.add(otaConfirmJob);
+  if (otaUpdater.unconfirmed()) {
+    networkTimers.start(otaConfirmTimer, OTA_CONFIRM_TIMEOUT_MS);
+  }
+}
+
+// Device state while online
+void publishHeartbeat() {
+  if (netLink.online()) {
+    publishDeviceState();
+  }
+}
+
+void reportLoopStats() {
+  loopStats.report("Network loop");
+}
+
+// A verified image is set to boot: save the device state now (the quiet
+// period would not pass before the restart), then restart into it
+void otaRestartJob() {
+  deviceStateStore.flush(millis(), true);
+  Serial.println("OTA: restarting into the new image");
+  Serial.flush();
+  ESP.restart();
+}
+
+// The new image did not reach the broker in time: back to the previous one
+void otaConfirmJob() {
+  Serial.println("OTA: new image not online in time");
+  deviceStateStore.flush(millis(), true);
+  otaUpdater.rollback();
+}
+
+// The coalesced device/state publish, followed by the acks of the commands
+// whose state it carries. Offline, the next online step rearms it.
+void publishDeviceStateJob() {
+  if (!netLink.online()) {
+    return;
+  }
+  uint32_t acksReady = commandTrace.ready();
+  deviceStateDirty.store(false);  // A change after this sets it again
+  publishDeviceState();
+  publishCommandAcks(acksReady);
+}
+
+// Hands the new state to the NVS store and (re)arms its write
+void noteDeviceState(uint32_t nowMs) {
+  if (!PERSIST_DEVICE_STATE) {
+    return;
+  }
+  DeviceSnapshot snapshot = {};
+  snapshot.channels = ACTUATOR_COUNT;
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    ActuatorState state = actuators.state(i);
+    snapshot.on[i] = state.on;
+    snapshot.level[i] = state.level;
+  }
+  deviceStateStore.update(snapshot, nowMs);
   
-  Serial.printf("Light relay pin: %d\n", LIGHT_RELAY_PIN);
-  Serial.printf("Fan relay pin: %d\n", FAN_RELAY_PIN);
-  Serial.printf("Status LED pin: %d\n", STATUS_LED_PIN);
+  uint32_t dueMs = deviceStateStore.untilDue(nowMs);
+  if (dueMs == PersistedState<DeviceSnapshot>::NOT_DUE) {
+    networkTimers.stop(persistTimer);
+  } else {
+    networkTimers.start(persistTimer, dueMs);
+  }
 }
 
-void initTopics() {
-  Serial.println("Initializing MQTT topics...");
+// Coalesced NVS write; a failed one is retried after another quiet period,
+// one not due yet (a change moved the quiet period) when it is
+void persistDeviceStateJob() {
+  uint32_t nowMs = millis();
+  uint32_t failures = deviceStateStore.failures();
+  if (!deviceStateStore.flush(nowMs) && deviceStateStore.pending()) {
+    if (deviceStateStore.failures() != failures) {
+      Serial.println("Device state not saved to NVS, retrying");
+    }
+    networkTimers.start(persistTimer, deviceStateStore.untilDue(nowMs));
+  }
+}
+
+// =============================================================================
+// INITIALIZATION FUNCTIONS
+// =============================================================================
+
+void initPower() {
+  if (!POWER_SAVE) {
+    WiFi.setSleep(false);
+    Serial.println("Power save off");
+    return;
+  }
   
-  topicSensorState = String(TOPIC_NS) + "/sensor/state";
-  topicDeviceState = String(TOPIC_NS) + "/device/state";
-  topicDeviceCmd = String(TOPIC_NS) + "/device/cmd";
-  topicSysOnline = String(TOPIC_NS) + "/sys/online";
+  // Modem sleep: the radio sleeps between DTIM beacons
+  WiFi.setSleep(true);
   
-  Serial.printf("Sensor topic: %s\n", topicSensorState.c_str());
-  Serial.printf("Device state topic: %s\n", topicDeviceState.c_str());
-  Serial.printf("Command topic: %s\n", topicDeviceCmd.c_str());
-  Serial.printf("Online topic: %s\n", topicSysOnline.c_str());
+  esp_pm_config_esp32s3_t pm = {};
+  pm.max_freq_mhz = PM_MAX_CPU_MHZ;
+  pm.min_freq_mhz = PM_MIN_CPU_MHZ;
+  pm.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err == ESP_ERR_NOT_SUPPORTED) {
+    // Core built without CONFIG_FREERTOS_USE_TICKLESS_IDLE: frequency scaling only
+    pm.light_sleep_enable = false;
+    err = esp_pm_configure(&pm);
+  }
+  Serial.printf("Power save: modem sleep, CPU %d-%d MHz, light sleep %s\n",
+                PM_MIN_CPU_MHZ, PM_MAX_CPU_MHZ,
+                err != ESP_OK ? "unavailable (PM off)" : pm.light_sleep_enable ? "on" : "unsupported by core");
 }
 
-void initWiFi() {
-  Serial.printf("Connecting to WiFi: %s\n", WIFI_SSID);
-  
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+void initGPIO() {
+  Serial.println("Initializing GPIO pins...");
   
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  // Status LED and every actuator channel as outputs, everything OFF
+  BoardPins::begin();
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    ActuatorOutput::begin(ACTUATORS[i]);
   }
   
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.printf("\nWiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("RSSI: %d dBm\n", WiFi.RSSI());
-  } else {
-    Serial.println("\nWiFi connection failed!");
+  Serial.printf("Board: %s\n", Board::NAME);
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    Serial.printf("Actuator %s pin: %d\n", ACTUATORS[i].name, ACTUATORS[i].kind == ACTUATOR_PWM ? ACTUATORS[i].pwmPin : ACTUATORS[i].pin);
+  }
+  Serial.printf("Status LED pin: %d\n", Board::STATUS_LED_PIN);
+}
+
+// Applies the state saved in NVS; the tasks are not running yet
+void restoreDeviceState() {
+  DeviceSnapshot saved;
+  if (!PERSIST_DEVICE_STATE || !deviceStateStore.begin(saved) || saved.channels != ACTUATOR_COUNT) {
+    Serial.println("No saved device state, starting with everything OFF");
+    return;
+  }
+  ActuatorIntent intent;
+  Serial.print("Restored:");
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    intent.channels[i] = ActuatorState{saved.on[i] != 0, saved.level[i]};
+    Serial.printf(" %s=%s", ACTUATORS[i].name, saved.on[i] ? "on" : "off");
+  }
+  applyIntent(intent);
+  Serial.printf(" (%lu NVS writes so far)\n", (unsigned long)deviceStateStore.lifetimeWrites());
+}
+
+void initTopics() {
+  Serial.println("MQTT topics:");
+  Serial.printf("Sensor topic: %s\n", topicSensorState);
+  Serial.printf("Device state topic: %s\n", topicDeviceState);
+  Serial.printf("Command topic: %s\n", topicDeviceCmd);
+  Serial.printf("Online topic: %s\n", topicSysOnline);
+  if (OTA_ENABLED) {
+    Serial.printf("OTA topic: %s (status: %s)\n", topicSysOta, topicSysOtaStatus);
   }
 }
 
 void initMQTT() {
   Serial.printf("Setting up MQTT client for %s:%d\n", MQTT_HOST, MQTT_PORT);
   
-  mqttClient.setServer(MQTT_HOST, MQTT_PORT);
   mqttClient.setCallback(onMqttMessage);
   mqttClient.setKeepAlive(30);
-  mqttClient.setSocketTimeout(5);
-  
-  // Connect to MQTT
-  connectMQTT();
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);  // Incoming only; default 256 bytes is too small for OTA chunks
 }
 
-// =============================================================================
-// WIFI FUNCTIONS
-// =============================================================================
-
-void checkWiFi(unsigned long currentTime) {
-  if (currentTime - lastWifiCheck < WIFI_RECONNECT_INTERVAL) return;
-  lastWifiCheck = currentTime;
+void initNetwork() {
+  NetLinkConfig config;
+  config.wifiSsid = WIFI_SSID;
+  config.wifiPassword = WIFI_PASSWORD;
+  config.mqttHost = MQTT_HOST;
+  config.mqttPort = MQTT_PORT;
+  config.mqttUsername = MQTT_USERNAME;
+  config.mqttPassword = MQTT_PASSWORD;
+  config.clientId = DEVICE_ID;
+  config.cleanSession = MQTT_CLEAN_SESSION;
   
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected. Reconnecting...");
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-      delay(500);
-      Serial.print(".");
-      attempts++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.printf("\nWiFi reconnected! IP: %s\n", WiFi.localIP().toString().c_str());
-    } else {
-      Serial.println("\nWiFi reconnection failed!");
+  // Last Will Testament (LWT)
+  config.willTopic = topicSysOnline;
+  config.willMessage = "{\"online\":false}";
+  config.willQos = 1;
+  config.willRetain = true;
+  
+  config.backoffMinMs = NET_BACKOFF_MIN_MS;
+  config.backoffMaxMs = NET_BACKOFF_MAX_MS;
+  config.wifiConnectTimeoutMs = WIFI_CONNECT_TIMEOUT_MS;
+  config.tcpConnectTimeoutMs = MQTT_TCP_TIMEOUT_MS;
+  config.idlePollMs = NETWORK_IDLE_POLL_MS;
+  
+  config.fastConnect = WIFI_FAST_CONNECT;
+  config.reuseIpLease = WIFI_REUSE_IP_LEASE;
+  config.fastConnectTimeoutMs = WIFI_FAST_CONNECT_TIMEOUT_MS;
+  
+  // WiFi events must cut the network task's sleep short
+  if (!loopWaker.begin()) {
+    Serial.println("Network task falls back to fixed-interval polling");
+  }
+  if (TlsClient::SUPPORTED) {
+    TlsConfig tls;
+    tls.serverName = MQTT_TLS_SERVER_NAME;
+    tls.caCert = MQTT_TLS_CA_CERT;
+    tls.clientCert = MQTT_TLS_CLIENT_CERT;
+    tls.clientKey = MQTT_TLS_CLIENT_KEY;
+    tls.handshakeTimeoutMs = MQTT_TLS_HANDSHAKE_TIMEOUT_MS;
+    tls.resumeSessions = MQTT_TLS_RESUME;
+    if (!mqttTls.begin(tls)) {
+      Serial.println("TLS setup failed, MQTT stays plain (will not reach a TLS-only broker)");
     }
   }
+  netLink.setTls(&mqttTls);
+  netLink.setWakeCallback(wakeNetworkTask);
+  netLink.begin(config, onMqttConnected);
 }
 
 // =============================================================================
 // MQTT FUNCTIONS
 // =============================================================================
 
-void checkMQTT(unsigned long currentTime) {
-  if (currentTime - lastMqttCheck < MQTT_RECONNECT_INTERVAL) return;
-  lastMqttCheck = currentTime;
+// Called by NetLink each time the MQTT session is (re)established
+void onMqttConnected() {
+  // Messages the broker never acknowledged go out again (DUP), then the
+  // rest of the outbox
+  mqttOutbox.sessionStarted();
   
-  if (WiFi.status() == WL_CONNECTED && !mqttClient.connected()) {
-    Serial.println("MQTT disconnected. Reconnecting...");
-    connectMQTT();
-  }
-}
-
-void connectMQTT() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected, skipping MQTT connection");
-    return;
+  // Subscribe to command topic
+  if (mqttClient.subscribe(topicDeviceCmd, COMMAND_QOS)) {
+    Serial.printf("Subscribed to: %s\n", topicDeviceCmd);
+  } else {
+    Serial.println("Failed to subscribe to command topic!");
   }
   
-  Serial.printf("Connecting to MQTT broker: %s:%d\n", MQTT_HOST, MQTT_PORT);
-  
-  // Set Last Will Testament (LWT)
-  String lwt = "{\"online\":false}";
+  // OTA control is QoS1 like commands; chunks are QoS0, the status resyncs
+  // the sender after a lost one
+  if (OTA_ENABLED) {
+    mqttClient.subscribe(topicSysOta, 1);
+    mqttClient.subscribe(topicSysOtaData, 0);
+  }
   
-  bool connected = mqttClient.connect(
-    DEVICE_ID,
-    MQTT_USERNAME,
-    MQTT_PASSWORD,
-    topicSysOnline.c_str(),
-    1,              // QoS
-    true,           // Retain
-    lwt.c_str()     // LWT message
-  );
+  // Publish online status
+  publishOnlineStatus(true);
   
-  if (connected) {
-    Serial.println("MQTT connected successfully!");
-    
-    // Subscribe to command topic
-    if (mqttClient.subscribe(topicDeviceCmd.c_str(), 1)) {
-      Serial.printf("Subscribed to: %s\n", topicDeviceCmd.c_str());
-    } else {
-      Serial.println("Failed to subscribe to command topic!");
-    }
-    
-    // Publish online status
-    publishOnlineStatus(true);
-    
-    // Publish initial device state
-    publishDeviceState();
-    
-    deviceOnline = true;
-  } else {
-    Serial.printf("MQTT connection failed! State: %d\n", mqttClient.state());
-    deviceOnline = false;
+  // A new image that got this far is good
+  if (otaUpdater.unconfirmed()) {
+    otaUpdater.confirm();
+    networkTimers.stop(otaConfirmTimer);
   }
+  
+  // Publish initial device state
+  publishDeviceState();
 }
 
+// "id"/"ts"/"seq" are read by CommandTrace/CommandDedup before dispatch, nothing to queue
+bool traceField(const CommandToken&) {
+  return false;
+}
+
+// Command routes: {"<key>":"<verb>"} -> handler. Actuator keys are answered
+// by the ACTUATORS table (actuatorCommand) once no route matched.
+const CommandRoute COMMAND_ROUTES[] = {
+  {"id", nullptr, traceField},
+  {"ts", nullptr, traceField},
+  {"seq", nullptr, traceField},
+};
+
 void onMqttMessage(char* topic, byte* payload, unsigned int length) {
-  // Convert payload to string
-  String message = "";
-  for (int i = 0; i < length; i++) {
-    message += (char)payload[i];
+  uint32_t receivedUs = micros();
+  
+  // OTA control or image chunk, taken straight from the MQTT buffer (not logged)
+  if (OTA_ENABLED && handleOtaMessage(topic, payload, length)) {
+    return;
   }
   
-  Serial.printf("Received [%s]: %s\n", topic, message.c_str());
+  // Log straight from the MQTT buffer, no String copy
+  Serial.printf("Received [%s]: ", topic);
+  Serial.write(payload, length);
+  Serial.println();
   
   // Check if it's a command message
-  if (String(topic) == topicDeviceCmd) {
-    handleDeviceCommand(message);
+  if (strcmp(topic, topicDeviceCmd) == 0) {
+    handleDeviceCommand(payload, length, receivedUs);
   }
 }
 
-void handleDeviceCommand(String message) {
-  // Debounce commands to prevent rapid switching
-  unsigned long currentTime = millis();
-  if (currentTime - lastCommandTime < COMMAND_DEBOUNCE_DELAY) {
-    Serial.println("Command ignored due to debounce");
+// sys/ota/data chunks go to flash, sys/ota starts/resumes/aborts an update;
+// false for any other topic. The status goes out from networkStep().
+bool handleOtaMessage(const char* topic, const byte* payload, unsigned int length) {
+  if (strcmp(topic, topicSysOtaData) == 0) {
+    otaUpdater.chunk(payload, length, millis());
+    return true;
+  }
+  if (strcmp(topic, topicSysOta) == 0) {
+    otaUpdater.control(payload, length, millis());
+    return true;
+  }
+  return false;
+}
+
+void handleDeviceCommand(const byte* payload, unsigned int length, uint32_t receivedUs) {
+  // A QoS1 redelivery of a command already applied (PUBACK lost with the
+  // connection): acknowledged at the MQTT level only
+  if (commandDedup.seen(payload, length)) {
+    Serial.println("Duplicate command seq, ignored");
     return;
   }
-  lastCommandTime = currentTime;
   
-  // Parse JSON command
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message);
+  // A command with an "id" gets a device/ack (ok=false if nothing was applied)
+  commandTrace.begin(payload, length, receivedUs);
   
-  if (error) {
-    Serial.printf("JSON parse error: %s\n", error.c_str());
-    return;
+  // Decode in place and queue actuator commands
+  CommandDispatch result = dispatchCommand(payload, length, COMMAND_ROUTES, actuatorCommand);
+  commandTrace.dispatched(result.dispatched);
+  if (!result.valid) {
+    Serial.println("Command parse error");
+  }
+  if (result.unmatched > 0) {
+    Serial.printf("Unknown command field(s): %u\n", (unsigned)result.unmatched);
   }
   
-  bool stateChanged = false;
-  
-  // Handle light command
-  if (doc.containsKey("light")) {
-    String lightCmd = doc["light"].as<String>();
-    Serial.printf("Light command: %s\n", lightCmd.c_str());
-    
-    if (lightCmd == "on") {
-      lightState = true;
-      stateChanged = true;
-    } else if (lightCmd == "off") {
-      lightState = false;
-      stateChanged = true;
-    } else if (lightCmd == "toggle") {
-      lightState = !lightState;
-      stateChanged = true;
-    }
-    
-    digitalWrite(LIGHT_RELAY_PIN, lightState ? HIGH : LOW);
-    Serial.printf("Light turned %s\n", lightState ? "ON" : "OFF");
+  // Wake the actuator task; it asks for a state publish once applied
+  if (result.dispatched > 0) {
+    xTaskNotifyGive(actuatorTaskHandle);
+  }
+}
+
+// {"<name>":"on"|"off"|"toggle"} or {"<levelKey>":0-100} of an ACTUATORS row,
+// found in O(1) whatever the table size
+CommandResult actuatorCommand(const CommandToken& key, const CommandToken& value) {
+  ActuatorKey target;
+  if (!actuators.find(key, target)) {
+    return COMMAND_UNMATCHED;
   }
   
-  // Handle fan command
-  if (doc.containsKey("fan")) {
-    String fanCmd = doc["fan"].as<String>();
-    Serial.printf("Fan command: %s\n", fanCmd.c_str());
-    
-    if (fanCmd == "on") {
-      fanState = true;
-      stateChanged = true;
-    } else if (fanCmd == "off") {
-      fanState = false;
-      stateChanged = true;
-    } else if (fanCmd == "toggle") {
-      fanState = !fanState;
-      stateChanged = true;
+  ActuatorCommand command;
+  command.channel = target.channel;
+  command.value = 0;
+  if (target.level) {
+    long level;
+    if (!value.toInt(level)) {
+      return COMMAND_REJECTED;
     }
-    
-    digitalWrite(FAN_RELAY_PIN, fanState ? HIGH : LOW);
-    Serial.printf("Fan turned %s\n", fanState ? "ON" : "OFF");
+    level = constrain(level, 0, 100);
+    command.action = ActuatorCommand::SET;
+    command.value = map(level, 0, 100, 0, 255);
+  } else if (value.isString && value.equals("on")) {
+    command.action = ActuatorCommand::ON;
+  } else if (value.isString && value.equals("off")) {
+    command.action = ActuatorCommand::OFF;
+  } else if (value.isString && value.equals("toggle")) {
+    command.action = ActuatorCommand::TOGGLE;
+  } else {
+    return COMMAND_UNMATCHED;
   }
-  
-  // Immediately publish device state after command execution
-  if (stateChanged) {
-    publishDeviceState();
+  return queueCommand(command) ? COMMAND_DISPATCHED : COMMAND_REJECTED;
+}
+
+bool queueCommand(ActuatorCommand command) {
+  command.trace_slot = commandTrace.current();
+  command.receivedUs = micros();
+  if (!commandQueue.push(command)) {
+    Serial.println("Command queue full, command dropped");
+    return false;
   }
+  return true;
+}
+
+// Runs on the actuator task: a toggle flips the intended state, not the relay
+void foldCommand(ActuatorIntent& intent, const ActuatorCommand& command) {
+  ActuatorState& state = intent.channels[command.channel];
+  if (command.action == ActuatorCommand::SET) {
+    state.level = command.value;
+  } else {
+    state.on = command.action == ActuatorCommand::TOGGLE ? !state.on : command.action == ActuatorCommand::ON;
+  }
+}
+
+// Writes the channels that differ from the intent; true if the device state
+// changed (a burst that ends where it started changes nothing)
+bool applyIntent(const ActuatorIntent& intent) {
+  bool changed = false;
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    if (intent.channels[i] != actuators.state(i)) {
+      actuators.set(i, intent.channels[i]);
+      ActuatorOutput::write(ACTUATORS[i], intent.channels[i]);
+      changed = true;
+    }
+  }
+  return changed;
 }
 
 // =============================================================================
 // PUBLISHING FUNCTIONS
 // =============================================================================
 
-void publishSensorData() {
-  if (!mqttClient.connected()) return;
-  
+// Runs on the sensor task
+void readSensor() {
   // Generate fake sensor data (replace with real sensor readings)
   float temperature = 20.0 + random(-50, 100) / 10.0;  // 15.0 to 25.0°C
   float humidity = 50.0 + random(-200, 200) / 10.0;    // 30.0 to 70.0%
   int lightLevel = 100 + random(-50, 200);             // 50 to 300 lux
   
-  // Create JSON payload
-  JsonDocument doc;
-  doc["ts"] = WiFi.getTime();
-  doc["temp_c"] = round(temperature * 10) / 10.0;  // Round to 1 decimal
-  doc["hum_pct"] = round(humidity * 10) / 10.0;
-  doc["lux"] = lightLevel;
+  // The MQTT outbox is filling up (slow or stalled broker): skip the
+  // reading rather than queue more than the network task can send
+  if (mqttOutbox.backpressure()) {
+    sensorThrottled.store(sensorThrottled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  
+  SensorSample sample;
+  sample.ts = (uint32_t)time(nullptr);
+  sample.temp10 = (int16_t)lroundf(temperature * 10);  // Round to 1 decimal
+  sample.hum10 = (uint16_t)lroundf(humidity * 10);
+  sample.lux = lightLevel;
+  
+  if (sampleQueue.push(sample)) {
+    wakeNetworkTask();
+  }
+}
+
+void publishSensorData(const SensorSample& sample) {
+  if (!mqttClient.connected()) return;
   
-  String payload;
-  serializeJson(doc, payload);
+  // Create JSON payload
+  JsonDocument doc(&jsonArena);
+  doc["ts"] = sample.ts;
+  doc["temp_c"] = sample.temp10 / 10.0;
+  doc["hum_pct"] = sample.hum10 / 10.0;
+  doc["lux"] = sample.lux;
   
-  if (mqttClient.publish(topicSensorState.c_str(), payload.c_str(), false)) {
-    Serial.printf("Sensor data published: %s\n", payload.c_str());
+  if (publishJson(topicSensorState, doc, false)) {
+    Serial.print("Sensor data published: ");
+    Serial.println(payloadBuffer);
   } else {
     Serial.println("Failed to publish sensor data!");
   }
@@ -407,66 +1040,266 @@ void publishDeviceState() {
   if (!mqttClient.connected()) return;
   
   // Create JSON payload
-  JsonDocument doc;
-  doc["ts"] = WiFi.getTime();
-  doc["light"] = lightState ? "on" : "off";
-  doc["fan"] = fanState ? "on" : "off";
+  JsonDocument doc(&jsonArena);
+  doc["ts"] = (uint32_t)time(nullptr);
+  // One field per ACTUATORS row (plus the level of rows with a level key)
+  for (size_t i = 0; i < ACTUATOR_COUNT; i++) {
+    ActuatorState state = actuators.state(i);
+    doc[ACTUATORS[i].name] = state.on ? "on" : "off";
+    if (ACTUATORS[i].levelKey) {
+      doc[ACTUATORS[i].levelKey] = state.on ? state.level : 0;
+    }
+  }
   doc["rssi"] = WiFi.RSSI();
   doc["fw"] = FIRMWARE_VERSION;
   
-  String payload;
-  serializeJson(doc, payload);
-  
   // Publish with retain flag for UI synchronization
-  if (mqttClient.publish(topicDeviceState.c_str(), payload.c_str(), true)) {
-    Serial.printf("Device state published: %s\n", payload.c_str());
+  if (publishJson(topicDeviceState, doc, true)) {
+    Serial.print("Device state published: ");
+    Serial.println(payloadBuffer);
   } else {
     Serial.println("Failed to publish device state!");
   }
 }
 
+// device/ack: one message per traced command, device clock in micros()
+// (rx_us: callback entry, act_us: last relay write, pub_us: just before publish)
+void publishCommandAcks(uint32_t readySlots) {
+  for (uint8_t i = 0; readySlots != 0; i++, readySlots >>= 1) {
+    if (!(readySlots & 1)) continue;
+    
+    const auto& slot = commandTrace.slot(i);
+    JsonDocument doc(&jsonArena);
+    if (slot.idIsString) {
+      doc["id"] = slot.id;
+    } else {
+      doc["id"] = serialized(slot.id);
+    }
+    if (slot.sentTs[0] != '\0') {
+      if (slot.sentTsIsString) {
+        doc["ts"] = slot.sentTs;
+      } else {
+        doc["ts"] = serialized(slot.sentTs);
+      }
+    }
+    doc["ok"] = slot.ok();
+    doc["rx_us"] = slot.receivedUs;
+    if (slot.ok()) {
+      doc["act_us"] = slot.actuatedUs.load();
+    }
+    doc["pub_us"] = micros();
+    if (!publishJson(topicDeviceAck, doc, false)) {
+      Serial.println("Failed to publish command ack!");
+    }
+    
+    commandTrace.release(i);
+  }
+}
+
 void publishOnlineStatus(bool online) {
   if (!mqttClient.connected()) return;
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonArena);
   doc["online"] = online;
+  doc["loop_max_us"] = loopStats.maxUs();
+  doc["cmd_latency_max_us"] = commandLatencyMaxUs.load();
+  doc["sample_queue_dropped"] = sampleQueue.dropped();
+  doc["sensor_throttled"] = sensorThrottled.load();
+  doc["ack_overflow"] = commandTrace.overflowed();
+  doc["cmd_duplicates"] = commandDedup.duplicates();
+  doc["cmd_coalesced"] = commandsCoalesced.load();
+  doc["wifi_reconnects"] = netLink.wifiReconnects();
+  doc["mqtt_reconnects"] = netLink.mqttReconnects();
   
-  String payload;
-  serializeJson(doc, payload);
+  // Boot timeline in ms since the app started (bootloader not included);
+  // sys/online is published right after CONNACK
+  if (online && bootFirstPublishMs == 0) {
+    bootFirstPublishMs = millis();
+  }
+  const NetLink::BootTimes& bootTimes = netLink.bootTimes();
+  JsonObject boot = doc["boot"].to<JsonObject>();
+  boot["wifi_ms"] = bootTimes.wifiMs;
+  boot["ip_ms"] = bootTimes.ipMs;
+  boot["mqtt_ms"] = bootTimes.mqttMs;
+  boot["publish_ms"] = bootFirstPublishMs;
+  boot["cached_ap"] = bootTimes.cachedAp;
+  boot["cached_ip"] = bootTimes.cachedIp;
+  boot["fallbacks"] = netLink.cacheFallbacks();
+  
+  // TLS handshakes of this boot: the last one, and the last full / resumed one
+  if (mqttTls.enabled()) {
+    JsonObject tls = doc["tls"].to<JsonObject>();
+    tls["resumed"] = mqttTls.lastResumed();
+    tls["handshake_ms"] = mqttTls.lastHandshakeMs();
+    tls["full_ms"] = mqttTls.fullMs();
+    tls["resumed_ms"] = mqttTls.resumedMs();
+    tls["full"] = mqttTls.fullHandshakes();
+    tls["resumptions"] = mqttTls.resumedHandshakes();
+    tls["failures"] = mqttTls.handshakeFailures();
+    tls["step_max_ms"] = mqttTls.maxStepMs();  // Longest single handshake step (ECC), blocks the task
+    tls["cached"] = mqttTls.sessionCached();
+  }
   
   // Publish with retain flag
-  if (mqttClient.publish(topicSysOnline.c_str(), payload.c_str(), true)) {
-    Serial.printf("Online status published: %s\n", payload.c_str());
+  if (publishJson(topicSysOnline, doc, true)) {
+    Serial.print("Online status published: ");
+    Serial.println(payloadBuffer);
   } else {
     Serial.println("Failed to publish online status!");
   }
 }
 
+// sys/ota/status: where the update stands (the sender resends from
+// "offset"), its error, and time / throughput since "begin"
+void publishOtaStatus() {
+  uint32_t nowMs = millis();
+  JsonDocument doc(&jsonArena);
+  doc["state"] = otaStateName(otaUpdater.state());
+  doc["offset"] = otaUpdater.offset();
+  doc["size"] = otaUpdater.size();
+  doc["chunk"] = otaUpdater.chunkSize();
+  doc["dropped"] = otaUpdater.chunksDropped();
+  if (otaUpdater.error()) {
+    doc["error"] = otaUpdater.error();
+  }
+  doc["ms"] = otaUpdater.elapsedMs(nowMs);
+  doc["kb_per_s"] = roundf(otaUpdater.kbPerSecond(nowMs) * 10.0f) / 10.0f;
+  if (publishJson(topicSysOtaStatus, doc, false)) {
+    otaUpdater.statusSent();
+  }
+}
+
+// Runtime health, published every METRICS_INTERVAL while online. Collecting
+// it is a few counters, the heap getters and one stack scan per task.
+void publishMetrics() {
+  if (!mqttClient.connected()) return;
+  
+  JsonDocument doc(&jsonArena);
+  doc["uptime_s"] = millis() / 1000;
+  doc["heap_free"] = ESP.getFreeHeap();
+  doc["heap_min"] = ESP.getMinFreeHeap();
+  doc["heap_largest"] = ESP.getMaxAllocHeap();
+  
+  // Unused stack in bytes (high-water mark)
+  JsonObject stackFree = doc["stack_free"].to<JsonObject>();
+  stackFree["network"] = uxTaskGetStackHighWaterMark(networkTaskHandle);
+  stackFree["sensor"] = uxTaskGetStackHighWaterMark(sensorTaskHandle);
+  stackFree["actuator"] = uxTaskGetStackHighWaterMark(actuatorTaskHandle);
+  
+  doc["wifi_reconnects"] = netLink.wifiReconnects();
+  doc["mqtt_reconnects"] = netLink.mqttReconnects();
+  doc["publish_failures"] = publishFailures;
+  
+  // Network task CPU share and why it woke up (tickless loop)
+  unsigned long windowMs = millis() - metricsWindowStart;
+  doc["busy_permille"] = windowMs > 0 ? (uint32_t)(loopStats.busyUs() / windowMs) : 0;
+  JsonObject wakeups = doc["wakeups"].to<JsonObject>();
+  wakeups["timer"] = loopWaker.timeouts();
+  wakeups["event"] = loopWaker.wakes();
+  wakeups["socket"] = loopWaker.socketWakes();
+  
+  // Timed jobs: runs, worst start delay past the deadline, periods skipped
+  JsonObject timers = doc["timers"].to<JsonObject>();
+  timers["runs"] = networkTimers.runs();
+  timers["late_max_ms"] = networkTimers.lateMaxMs();
+  timers["missed"] = networkTimers.missed();
+  
+  // Device state in NVS: writes since boot / ever, updates folded into a write
+  JsonObject nvs = doc["nvs"].to<JsonObject>();
+  nvs["writes"] = deviceStateStore.writes();
+  nvs["lifetime"] = deviceStateStore.lifetimeWrites();
+  nvs["coalesced"] = deviceStateStore.coalesced();
+  nvs["failures"] = deviceStateStore.failures();
+  
+  // MQTT outbox: depth now and worst, QoS1 window, counters and PUBACK
+  // round trip since the last metrics message
+  JsonObject outbox = doc["outbox"].to<JsonObject>();
+  outbox["queued"] = mqttOutbox.pending();
+  outbox["bytes"] = mqttOutbox.pendingBytes();
+  outbox["depth_max"] = mqttOutbox.depthMax();
+  outbox["inflight"] = mqttOutbox.inFlight();
+  outbox["window"] = mqttOutbox.window();
+  outbox["sent"] = mqttOutbox.sent();
+  outbox["acked"] = mqttOutbox.acked();
+  outbox["resent"] = mqttOutbox.resent();
+  outbox["rejected"] = mqttOutbox.rejected();
+  outbox["backpressure"] = mqttOutbox.backpressureEvents();
+  const LatencyHistogram& ackTimes = mqttOutbox.ackRttUs();
+  JsonObject ackUs = outbox["ack_us"].to<JsonObject>();
+  ackUs["n"] = ackTimes.count();
+  ackUs["p50"] = ackTimes.percentile(50);
+  ackUs["p99"] = ackTimes.percentile(99);
+  ackUs["max"] = ackTimes.maxUs();
+  
+  // Network loop iteration time since the last metrics message
+  const LatencyHistogram& loopTimes = loopStats.histogram();
+  JsonObject loopUs = doc["loop_us"].to<JsonObject>();
+  loopUs["n"] = loopTimes.count();
+  loopUs["p50"] = loopTimes.percentile(50);
+  loopUs["p90"] = loopTimes.percentile(90);
+  loopUs["p99"] = loopTimes.percentile(99);
+  loopUs["p999"] = loopTimes.percentile(99.9f);
+  loopUs["max"] = loopTimes.maxUs();
+  if (loopTimes.formatCounts(metricsHistogramText, sizeof(metricsHistogramText)) > 0) {
+    loopUs["hist"] = serialized(metricsHistogramText);
+  }
+  
+  if (publishJson(topicSysMetrics, doc, false)) {
+    loopStats.resetHistogram();
+    loopWaker.resetCounts();
+    networkTimers.resetStats();
+    mqttOutbox.resetStats();
+    metricsWindowStart = millis();
+  } else {
+    Serial.println("Failed to publish metrics!");
+  }
+}
+
+// Serialize straight into the static payload buffer and queue it in the
+// outbox (no heap, written without blocking)
+bool publishJson(const char* topic, const JsonDocument& doc, bool retained) {
+  size_t length = serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+  if (doc.overflowed() || length == 0 || length >= sizeof(payloadBuffer) - 1) {
+    Serial.printf("Payload too large for %s\n", topic);
+    publishFailures++;
+    return false;
+  }
+  
+  if (!mqttOutbox.publish(topic, (const uint8_t*)payloadBuffer, length, retained, MQTT_PUBLISH_QOS)) {
+    publishFailures++;
+    return false;
+  }
+  return true;
+}
+
 // =============================================================================
 // UTILITY FUNCTIONS
 // =============================================================================
 
 void updateStatusLED() {
-  static unsigned long lastBlink = 0;
-  static bool ledState = false;
-  unsigned long currentTime = millis();
-  
-  if (WiFi.status() == WL_CONNECTED && mqttClient.connected()) {
+  if (statusBlinkInterval() == 0) {
     // Solid ON when everything is connected
-    digitalWrite(STATUS_LED_PIN, HIGH);
-  } else if (WiFi.status() == WL_CONNECTED) {
-    // Fast blink when WiFi connected but MQTT disconnected
-    if (currentTime - lastBlink >= 250) {
-      ledState = !ledState;
-      digitalWrite(STATUS_LED_PIN, ledState ? HIGH : LOW);
-      lastBlink = currentTime;
-    }
-  } else {
-    // Slow blink when WiFi disconnected
-    if (currentTime - lastBlink >= 1000) {
-      ledState = !ledState;
-      digitalWrite(STATUS_LED_PIN, ledState ? HIGH : LOW);
-      lastBlink = currentTime;
-    }
+    networkTimers.stop(blinkTimer);
+    BoardPins::setStatusLed(true);
+  } else if (!networkTimers.pending(blinkTimer)) {
+    toggleStatusLED();
   }
+}
+
+// blinkTimer job: toggles and rearms with the interval for the current state
+void toggleStatusLED() {
+  static bool ledState = false;
+  unsigned long blinkInterval = statusBlinkInterval();
+  if (blinkInterval == 0) return;
+  
+  ledState = !ledState;
+  BoardPins::setStatusLed(ledState);
+  networkTimers.start(blinkTimer, blinkInterval);
+}
+
+// 0 = solid ON (online); fast blink when WiFi connected but MQTT disconnected,
+// slow blink when WiFi disconnected
+unsigned long statusBlinkInterval() {
+  if (netLink.online()) return 0;
+  return netLink.wifiUp() ? 250 : 1000;
 }
\ No newline at end of file
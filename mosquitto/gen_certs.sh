@@ -0,0 +1,52 @@
+#!/bin/sh
+# Test CA and broker certificate for the TLS listener (config/mosquitto_tls.conf)
+#
+# Every key is ECDSA P-256: the firmware (TlsClient) only offers
+# ECDHE-ECDSA suites on that curve. The broker certificate is issued for
+# SERVER_NAME (the firmware's MQTT_TLS_SERVER_NAME); the device connects by
+# IP but checks this name. The CA is printed at the end, ready to paste into
+# MQTT_TLS_CA_CERT.
+#
+# Usage:
+#   sh mosquitto/gen_certs.sh                      # CA + broker certificate
+#   sh mosquitto/gen_certs.sh --device esp32c3_real  # + device certificate
+#   SERVER_NAME=broker.lan DAYS=365 sh mosquitto/gen_certs.sh
+
+set -e
+
+SERVER_NAME=${SERVER_NAME:-mosquitto.local}
+DAYS=${DAYS:-825}
+DIR=$(dirname "$0")/config/certs
+
+mkdir -p "$DIR"
+cd "$DIR"
+
+if [ ! -f ca.key ]; then
+    openssl ecparam -name prime256v1 -genkey -noout -out ca.key
+    openssl req -new -x509 -sha256 -key ca.key -days "$DAYS" -subj "/CN=IoT test CA" -out ca.crt
+    echo "🔑 New CA (devices must get the new MQTT_TLS_CA_CERT)"
+fi
+
+openssl ecparam -name prime256v1 -genkey -noout -out server.key
+openssl req -new -sha256 -key server.key -subj "/CN=$SERVER_NAME" -out server.csr
+printf 'subjectAltName=DNS:%s\nextendedKeyUsage=serverAuth\n' "$SERVER_NAME" > server.ext
+openssl x509 -req -sha256 -in server.csr -CA ca.crt -CAkey ca.key -CAcreateserial \
+    -days "$DAYS" -extfile server.ext -out server.crt
+rm -f server.csr server.ext
+chmod 644 server.key # read by the mosquitto user in the container
+echo "✅ Broker certificate for $SERVER_NAME: $DIR/server.crt"
+
+if [ "$1" = "--device" ] && [ -n "$2" ]; then
+    openssl ecparam -name prime256v1 -genkey -noout -out "$2.key"
+    openssl req -new -sha256 -key "$2.key" -subj "/CN=$2" -out "$2.csr"
+    printf 'extendedKeyUsage=clientAuth\n' > "$2.ext"
+    openssl x509 -req -sha256 -in "$2.csr" -CA ca.crt -CAkey ca.key -CAcreateserial \
+        -days "$DAYS" -extfile "$2.ext" -out "$2.crt"
+    rm -f "$2.csr" "$2.ext"
+    echo "✅ Device certificate: $DIR/$2.crt, key $DIR/$2.key (MQTT_TLS_CLIENT_CERT / _KEY)"
+fi
+
+echo
+echo "// MQTT_TLS_CA_CERT (main.cpp)"
+echo 'const char *MQTT_TLS_CA_CERT = R"PEM('"$(cat ca.crt)"
+echo ')PEM";'
@@ -8,9 +8,15 @@ import json
 import time
 import random
 import threading
+from collections import deque
 from datetime import datetime
 import paho.mqtt.client as mqtt
 
+try:
+    import msgpack  # only needed when MSGPACK_PAYLOADS = True
+except ImportError:
+    msgpack = None
+
 # Configuration - Using local Mosquitto broker in Docker
 MQTT_BROKER = "localhost"
 MQTT_PORT = 1883
@@ -18,6 +24,10 @@ TOPIC_NS = "demo/room1"
 DEVICE_ID = "esp32_simulator"
 FIRMWARE_VERSION = "sim-1.0.0"
 
+# Also publish compact MessagePack arrays on sensor/state/mp and
+# device/state/mp, ahead of the JSON ones (same as the firmware's MSGPACK_PAYLOADS)
+MSGPACK_PAYLOADS = False
+
 # Device state
 device_state = {
     "light": "off",
@@ -25,8 +35,12 @@ device_state = {
     "online": True
 }
 
-# MQTT client
-client = mqtt.Client(client_id=f"{DEVICE_ID}_{int(time.time())}")
+# MQTT client: stable id + persistent session like the firmware, so the
+# broker queues QoS1 commands while the simulator is down
+client = mqtt.Client(client_id=DEVICE_ID, clean_session=False)
+
+# Recent command "seq" values: a QoS1 redelivery must not toggle twice
+recent_seqs = deque(maxlen=16)
 
 def on_connect(client, userdata, flags, rc):
     if rc == 0:
@@ -49,22 +63,33 @@ def on_connect(client, userdata, flags, rc):
     else:
         print(f"❌ Failed to connect to MQTT broker, code: {rc}")
 
+def micros():
+    """Device clock for device/ack (like micros() on the ESP32)"""
+    return (time.monotonic_ns() // 1000) & 0xFFFFFFFF
+
 def on_message(client, userdata, msg):
+    received_us = micros()
     try:
         topic = msg.topic
         payload = msg.payload.decode('utf-8')
         print(f"📥 Received [{topic}]: {payload}")
         
         if topic == f"{TOPIC_NS}/device/cmd":
-            handle_device_command(payload)
+            handle_device_command(payload, received_us)
             
     except Exception as e:
         print(f"❌ Error handling message: {e}")
 
-def handle_device_command(payload):
+def handle_device_command(payload, received_us):
     """Handle device control commands"""
     try:
         cmd = json.loads(payload)
+        if "seq" in cmd:
+            seq = json.dumps(cmd["seq"])
+            if seq in recent_seqs:
+                print(f"🔁 Duplicate command seq {seq}, ignored")
+                return
+            recent_seqs.append(seq)
         state_changed = False
         
         # Handle light command
@@ -98,8 +123,13 @@ def handle_device_command(payload):
             print(f"🌀 Fan: {device_state['fan'].upper()}")
         
         # Publish updated device state immediately
+        applied_us = micros()
         if state_changed:
             publish_device_state()
+
+        # Acknowledge traced commands (same format as the firmware)
+        if "id" in cmd:
+            publish_command_ack(cmd, state_changed, received_us, applied_us)
             
     except json.JSONDecodeError as e:
         print(f"❌ Invalid JSON command: {e}")
@@ -120,11 +150,15 @@ def publish_sensor_data():
         "lux": lux
     }
     
+    if MSGPACK_PAYLOADS:
+        # [ts, temp x10, humidity x10, rssi (none), lux]
+        packed = msgpack.packb([data["ts"], round(temp_c * 10), round(hum_pct * 10), None, lux])
+        client.publish(topic + "/mp", packed, qos=0)
     payload = json.dumps(data)
     result = client.publish(topic, payload, qos=0)
     
     if result.rc == mqtt.MQTT_ERR_SUCCESS:
-        print(f"🌡️  Sensor: {temp_c}°C, {hum_pct}%, {lux}lux")
+        print(f"🌡️  Sensor: {temp_c}°C, {hum_pct}%, {lux}lux ({len(payload)} bytes)")
     else:
         print(f"❌ Failed to publish sensor data")
 
@@ -143,6 +177,10 @@ def publish_device_state():
         "fw": FIRMWARE_VERSION
     }
     
+    if MSGPACK_PAYLOADS:
+        # [ts, light on, fan on, rssi]
+        packed = msgpack.packb([data["ts"], data["light"] == "on", data["fan"] == "on", rssi])
+        client.publish(topic + "/mp", packed, qos=1, retain=True)
     payload = json.dumps(data)
     result = client.publish(topic, payload, qos=1, retain=True)
     
@@ -151,6 +189,18 @@ def publish_device_state():
     else:
         print(f"❌ Failed to publish device state")
 
+def publish_command_ack(cmd, ok, received_us, applied_us):
+    """Publish device/ack for a command carrying an "id" (times in device micros)"""
+    ack = {"id": cmd["id"]}
+    if "ts" in cmd:
+        ack["ts"] = cmd["ts"]
+    ack["ok"] = ok
+    ack["rxUs"] = received_us
+    if ok:
+        ack["actUs"] = applied_us
+    ack["pubUs"] = micros()
+    client.publish(f"{TOPIC_NS}/device/ack", json.dumps(ack), qos=0)
+
 def publish_online_status(online):
     """Publish online status (retained)"""
     topic = f"{TOPIC_NS}/sys/online"
@@ -196,6 +246,9 @@ def main():
     print(f"📡 MQTT Broker: {MQTT_BROKER}:{MQTT_PORT}")
     print(f"🏠 Topic Namespace: {TOPIC_NS}")
     print(f"🆔 Device ID: {DEVICE_ID}")
+    if MSGPACK_PAYLOADS and msgpack is None:
+        print("❌ MSGPACK_PAYLOADS needs: pip install msgpack")
+        return
     print("─" * 50)
     
     # Setup MQTT callbacks
@@ -8,6 +8,11 @@ import json
 import time
 import paho.mqtt.client as mqtt
 
+try:
+    import msgpack  # only needed for device/state/mp
+except ImportError:
+    msgpack = None
+
 # Configuration
 MQTT_BROKER = "broker.hivemq.com"
 MQTT_PORT = 1883
@@ -34,6 +39,7 @@ def on_connect(client, userdata, flags, rc):
         online_topic = f"{TOPIC_NS}/sys/online"
         
         client.subscribe(device_topic, qos=1)
+        client.subscribe(device_topic + "/mp", qos=1)
         client.subscribe(online_topic, qos=1)
         
         print(f"📡 Subscribed to: {device_topic}")
@@ -45,6 +51,20 @@ def on_connect(client, userdata, flags, rc):
 def on_message(client, userdata, msg):
     try:
         topic = msg.topic
+
+        # Binary MessagePack state: [ts, light_on, fan_on, rssi]
+        if topic == f"{TOPIC_NS}/device/state/mp":
+            if msgpack is None:
+                print("⚠️  msgpack not installed, ignoring device/state/mp")
+                return
+            ts, light, fan, rssi = (list(msgpack.unpackb(msg.payload)) + [None] * 4)[:4]
+            handle_device_state(json.dumps({
+                "light": "on" if light else "off",
+                "fan": "on" if fan else "off",
+                "rssi": rssi or 0,
+            }))
+            return
+
         payload = msg.payload.decode('utf-8')
         
         if topic == f"{TOPIC_NS}/device/state":
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""
+Command Latency Script
+End-to-end command latency from device/ack (p50 / p99 / p99.9)
+
+Each command carries an "id" and the sender's "ts" (ms since epoch). The
+device answers on device/ack with its own micros() timestamps:
+rxUs (command received), actUs (GPIO written), pubUs (ack published).
+
+Per command the script splits the round trip into:
+- uplink:    ts -> command seen again on device/cmd (sender -> broker -> this script)
+- device:    pubUs - rxUs (parse, actuator task, device/state publish)
+- actuation: actUs - rxUs (receive -> GPIO)
+- broker:    total - device (broker -> device and device -> broker -> this script)
+- total:     ts -> ack received
+
+Active mode (default) sends the commands itself, so every timestamp comes from
+one clock. --passive only listens to commands sent by the web/Flutter apps;
+uplink and total then assume the sender's clock is in sync with this machine.
+
+Usage:
+    python command_latency.py --count 200 --interval 0.3
+    python command_latency.py --passive --duration 300
+"""
+
+import argparse
+import json
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+# MQTT Configuration
+BROKER_HOST = "localhost"
+BROKER_PORT = 1883
+TOPIC_NAMESPACE = "demo/room1"
+
+# Commands within one device/state coalescing window (100 ms, both boards)
+# share a publish and their acks wait for it: stay well apart to time
+# single commands
+DEFAULT_INTERVAL_S = 0.3
+ACK_TIMEOUT_S = 5.0
+
+lock = threading.Lock()
+sent = {}      # id -> sender ts (ms)
+seen = {}      # id -> ms when the command came back from the broker
+acks = {}      # id -> (ms when the ack arrived, ack payload)
+
+
+def now_ms():
+    return time.time() * 1000.0
+
+
+def on_connect(client, userdata, flags, rc):
+    if rc == 0:
+        print("✅ Connected to MQTT broker")
+        client.subscribe(f"{userdata['ns']}/device/cmd", qos=0)
+        client.subscribe(f"{userdata['ns']}/device/ack", qos=0)
+    else:
+        print(f"❌ Failed to connect: {rc}")
+
+
+def on_message(client, userdata, msg):
+    received = now_ms()
+    try:
+        data = json.loads(msg.payload.decode("utf-8"))
+    except (UnicodeDecodeError, json.JSONDecodeError):
+        return
+    if not isinstance(data, dict) or "id" not in data:
+        return
+
+    command_id = str(data["id"])
+    with lock:
+        if msg.topic.endswith("/device/cmd"):
+            seen.setdefault(command_id, received)
+            if userdata["passive"] and isinstance(data.get("ts"), (int, float)):
+                sent.setdefault(command_id, float(data["ts"]))
+        elif msg.topic.endswith("/device/ack"):
+            acks.setdefault(command_id, (received, data))
+
+
+def device_us(ack, name):
+    """Read a device timestamp (C3 camelCase or S3 snake_case key)"""
+    value = ack.get(name + "Us")
+    if value is None:
+        value = ack.get(name + "_us")
+    return value
+
+
+def elapsed_ms(start_us, end_us):
+    # micros() wraps every ~71 minutes
+    return ((end_us - start_us) & 0xFFFFFFFF) / 1000.0
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of a sorted list"""
+    rank = max(1, int(-(-p * len(values) // 100)))
+    return values[min(rank, len(values)) - 1]
+
+
+def collect():
+    samples = {"uplink": [], "device": [], "actuation": [], "broker": [], "total": []}
+    failed = 0
+    with lock:
+        for command_id, ts in sent.items():
+            if command_id not in acks:
+                continue
+            ack_rx, ack = acks[command_id]
+            if not ack.get("ok", False):
+                failed += 1
+                continue
+
+            rx_us = device_us(ack, "rx")
+            act_us = device_us(ack, "act")
+            pub_us = device_us(ack, "pub")
+            total = ack_rx - ts
+            device = elapsed_ms(rx_us, pub_us)
+            samples["total"].append(total)
+            samples["device"].append(device)
+            samples["actuation"].append(elapsed_ms(rx_us, act_us))
+            samples["broker"].append(total - device)
+            if command_id in seen:
+                samples["uplink"].append(seen[command_id] - ts)
+    return samples, failed
+
+
+def report(samples, failed):
+    with lock:
+        total_sent = len(sent)
+        missing = sum(1 for command_id in sent if command_id not in acks)
+
+    print()
+    print(f"📊 Commands: {total_sent} sent, {len(samples['total'])} acked, "
+          f"{failed} rejected (ok=false), {missing} without ack")
+    if not samples["total"]:
+        print("⚠️  No acknowledged commands")
+        return
+
+    print(f"{'hop (ms)':<12}{'n':>6}{'p50':>10}{'p99':>10}{'p99.9':>10}{'max':>10}")
+    for name in ("uplink", "broker", "device", "actuation", "total"):
+        values = sorted(samples[name])
+        if not values:
+            continue
+        print(f"{name:<12}{len(values):>6}"
+              f"{percentile(values, 50):>10.1f}{percentile(values, 99):>10.1f}"
+              f"{percentile(values, 99.9):>10.1f}{values[-1]:>10.1f}")
+
+
+def run_active(client, args):
+    topic = f"{args.ns}/device/cmd"
+    prefix = f"lat-{int(time.time()) % 100000}"
+    print(f"🔄 Sending {args.count} '{args.device}: toggle' commands every {args.interval}s")
+
+    for i in range(args.count):
+        ts = int(now_ms())
+        command_id = f"{prefix}-{i}"
+        with lock:
+            sent[command_id] = ts
+        payload = json.dumps({args.device: "toggle", "id": command_id, "ts": ts})
+        client.publish(topic, payload, qos=args.qos)
+        time.sleep(args.interval)
+
+    # Wait for the last acks
+    deadline = time.time() + ACK_TIMEOUT_S
+    while time.time() < deadline:
+        with lock:
+            if all(command_id in acks for command_id in sent):
+                break
+        time.sleep(0.1)
+
+
+def run_passive(args):
+    print(f"👀 Observing commands for {args.duration}s (sender clock assumed in sync)")
+    time.sleep(args.duration)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Command latency percentiles from device/ack")
+    parser.add_argument("--host", default=BROKER_HOST)
+    parser.add_argument("--port", type=int, default=BROKER_PORT)
+    parser.add_argument("--ns", default=TOPIC_NAMESPACE, help="topic namespace")
+    parser.add_argument("--count", type=int, default=100, help="commands to send")
+    parser.add_argument("--interval", type=float, default=DEFAULT_INTERVAL_S, help="seconds between commands")
+    parser.add_argument("--device", default="light", choices=["light", "fan"])
+    parser.add_argument("--qos", type=int, default=0, choices=[0, 1])
+    parser.add_argument("--passive", action="store_true", help="only observe commands sent by other clients")
+    parser.add_argument("--duration", type=float, default=120, help="passive mode: seconds to observe")
+    args = parser.parse_args()
+
+    print("🚀 Command Latency Test Starting...")
+    client = mqtt.Client(client_id=f"latency_probe_{int(time.time())}",
+                         userdata={"ns": args.ns, "passive": args.passive})
+    client.on_connect = on_connect
+    client.on_message = on_message
+
+    print(f"🔄 Connecting to {args.host}...")
+    client.connect(args.host, args.port, 60)
+    client.loop_start()
+    time.sleep(1)  # let the subscriptions settle
+
+    try:
+        if args.passive:
+            run_passive(args)
+        else:
+            run_active(client, args)
+    except KeyboardInterrupt:
+        print("\n🛑 Interrupted")
+    finally:
+        client.loop_stop()
+        client.disconnect()
+
+    report(*collect())
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+OTA Push Script
+Streams a firmware image to the ESP32 over MQTT (sys/ota, see OtaUpdater.h)
+
+1. {"cmd":"begin","size":...,"sha256":...} on sys/ota (QoS1)
+2. The image on sys/ota/data: 4-byte little-endian offset + one chunk per
+   message, at most --window chunks ahead of the offset the device reported
+   on sys/ota/status. The device writes each chunk straight to flash.
+3. A chunk the device did not get (its "dropped" count goes up) is resent
+   from the reported offset. When the status stays silent (connection lost,
+   device reconnecting) "begin" is repeated: the device answers with the
+   offset it reached and the transfer resumes there.
+4. "done": the device verified the SHA-256 and restarts into the new image.
+   The script then waits for the new image's sys/online.
+
+Prints the transfer throughput (KB/s, as measured here and by the device),
+the transfer time and the total update time up to the new sys/online.
+
+Usage:
+    python ota_push.py firmware_esp32c3/.pio/build/esp32-c3-devkitm-1/firmware.bin
+    python ota_push.py firmware.bin --host 192.168.1.10 --window 8
+"""
+
+import argparse
+import hashlib
+import json
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+# MQTT Configuration
+BROKER_HOST = "localhost"
+BROKER_PORT = 1883
+TOPIC_NAMESPACE = "demo/room1"
+
+DEFAULT_WINDOW = 4          # chunks in flight
+STATUS_TIMEOUT_S = 5.0      # no status for this long: repeat "begin" (resume)
+ONLINE_TIMEOUT_S = 120.0    # restart -> new image on sys/online
+
+
+class Transfer:
+    def __init__(self, image):
+        self.image = image
+        self.cond = threading.Condition()
+        self.status = None          # last sys/ota/status payload
+        self.status_at = 0.0
+        self.dropped = 0
+        self.online = None          # last sys/online payload
+        self.connected = False
+
+
+def boot_publish_ms(online):
+    """Boot timeline mark of a sys/online message (C3 camelCase or S3 snake_case)"""
+    boot = online.get("boot") or {}
+    return boot.get("publishMs", boot.get("publish_ms"))
+
+
+def device_rate(status):
+    return status.get("kBps", status.get("kb_per_s"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stream a firmware image over MQTT")
+    parser.add_argument("image", help="firmware .bin (PlatformIO: .pio/build/<env>/firmware.bin)")
+    parser.add_argument("--host", default=BROKER_HOST)
+    parser.add_argument("--port", type=int, default=BROKER_PORT)
+    parser.add_argument("--ns", default=TOPIC_NAMESPACE, help="topic namespace")
+    parser.add_argument("--window", type=int, default=DEFAULT_WINDOW, help="chunks in flight")
+    parser.add_argument("--no-wait-online", action="store_true", help="stop once the device reports done")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    digest = hashlib.sha256(image).hexdigest()
+    print(f"📦 {args.image}: {len(image)} bytes, sha256 {digest[:16]}…")
+
+    topic_ota = f"{args.ns}/sys/ota"
+    topic_data = f"{args.ns}/sys/ota/data"
+    topic_status = f"{args.ns}/sys/ota/status"
+    topic_online = f"{args.ns}/sys/online"
+    begin = json.dumps({"cmd": "begin", "size": len(image), "sha256": digest})
+
+    transfer = Transfer(image)
+
+    def on_connect(client, userdata, flags, rc):
+        if rc != 0:
+            print(f"❌ Failed to connect: {rc}")
+            return
+        print("✅ Connected to MQTT broker")
+        client.subscribe(topic_status, qos=0)
+        client.subscribe(topic_online, qos=0)
+        with transfer.cond:
+            transfer.connected = True
+            transfer.cond.notify_all()
+
+    def on_disconnect(client, userdata, rc):
+        with transfer.cond:
+            transfer.connected = False
+
+    def on_message(client, userdata, msg):
+        try:
+            data = json.loads(msg.payload.decode("utf-8"))
+        except (UnicodeDecodeError, json.JSONDecodeError):
+            return
+        if not isinstance(data, dict):
+            return
+        with transfer.cond:
+            if msg.topic == topic_status:
+                transfer.status = data
+                transfer.status_at = time.time()
+            else:
+                transfer.online = data
+            transfer.cond.notify_all()
+
+    client = mqtt.Client(client_id=f"ota_push_{int(time.time())}")
+    client.on_connect = on_connect
+    client.on_disconnect = on_disconnect
+    client.on_message = on_message
+    client.reconnect_delay_set(min_delay=1, max_delay=5)
+    print(f"🔄 Connecting to {args.host}:{args.port}...")
+    client.connect(args.host, args.port, 30)
+    client.loop_start()
+
+    with transfer.cond:
+        transfer.cond.wait_for(lambda: transfer.connected, timeout=10)
+    time.sleep(0.5)  # retained sys/online of the running image
+    with transfer.cond:
+        old_boot = boot_publish_ms(transfer.online) if transfer.online else None
+
+    started = time.time()
+    client.publish(topic_ota, begin, qos=1)
+    last_begin = started
+    next_offset = 0
+    chunk = None
+    resends = 0
+    resume = True  # the next status says where the device is
+
+    while True:
+        with transfer.cond:
+            transfer.cond.wait(timeout=0.05)
+            status = transfer.status
+            fresh = status is not None and transfer.status_at >= last_begin
+            connected = transfer.connected
+
+        if fresh and status.get("size") == len(image):
+            state = status.get("state")
+            if state == "done":
+                break
+            if state == "failed":
+                print(f"\n❌ Update failed on the device: {status.get('error')} at {status.get('offset')}")
+                client.loop_stop()
+                sys.exit(1)
+            if state == "receiving":
+                chunk = chunk or int(status.get("chunk", 1024))
+                acked = int(status.get("offset", 0))
+                dropped = int(status.get("dropped", 0))
+                if resume or dropped > transfer.dropped:
+                    # Answer to "begin", or a chunk was lost: continue where the device is
+                    resume = False
+                    transfer.dropped = dropped
+                    if next_offset != acked:
+                        resends += 1
+                    next_offset = acked
+                while connected and next_offset < len(image) and next_offset - acked < args.window * chunk:
+                    data = image[next_offset:next_offset + chunk]
+                    client.publish(topic_data, struct.pack("<I", next_offset) + data, qos=0)
+                    next_offset += len(data)
+                print(f"\r⬆️  {acked * 100 // len(image):3d}%  {acked}/{len(image)}", end="", flush=True)
+
+        # Silent device: lost connection or lost status; ask where it is
+        now = time.time()
+        if connected and now - max(last_begin, transfer.status_at) > STATUS_TIMEOUT_S:
+            print("\n🔁 No status, resuming")
+            client.publish(topic_ota, begin, qos=1)
+            last_begin = now
+            resume = True
+
+    transfer_s = time.time() - started
+    print(f"\n✅ Image verified by the device in {status.get('ms')} ms")
+    print(f"📊 Transfer: {transfer_s:.1f} s, {len(image) / 1024 / transfer_s:.1f} KB/s here, "
+          f"{device_rate(status)} KB/s on the device, {resends} resyncs")
+
+    if not args.no_wait_online:
+        print("⏳ Waiting for the new image on sys/online...")
+        with transfer.cond:
+            came_back = transfer.cond.wait_for(
+                lambda: transfer.online is not None and transfer.online.get("online") is True
+                and boot_publish_ms(transfer.online) != old_boot,
+                timeout=ONLINE_TIMEOUT_S)
+            online = transfer.online
+        if came_back:
+            print(f"🟢 Online again (firmware {online.get('firmware', '?')}), "
+                  f"total update time {time.time() - started:.1f} s")
+        else:
+            print(f"⚠️  No new sys/online within {ONLINE_TIMEOUT_S:.0f} s")
+
+    client.loop_stop()
+    client.disconnect()
+
+
+if __name__ == "__main__":
+    main()
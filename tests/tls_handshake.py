@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""
+TLS Handshake Script
+Full vs resumed TLS handshake time against the broker's TLS listener
+
+Connects to the 8883 listener (mosquitto/config/mosquitto_tls.conf) with the
+same offer as the firmware's TlsClient: TLS 1.2, ECDHE-ECDSA on P-256. Each
+round does one full handshake (no session) and one resumed handshake
+(the session of the previous connection: ticket or session id), then
+optionally an MQTT CONNECT -> CONNACK over the resumed connection.
+
+Prints p50 / p90 / max per kind, how many resumptions the broker accepted
+and the negotiated suite. The device reports its own numbers in sys/online
+("tls": fullMs / resumedMs, S3: full_ms / resumed_ms).
+
+Usage:
+    python tls_handshake.py --cafile mosquitto/config/certs/ca.crt
+    python tls_handshake.py --host 192.168.1.12 --cafile ca.crt -n 50 --mqtt
+"""
+
+import argparse
+import socket
+import ssl
+import struct
+import time
+
+# MQTT Configuration
+BROKER_HOST = "localhost"
+BROKER_PORT = 8883
+SERVER_NAME = "mosquitto.local"  # Name in the broker certificate (gen_certs.sh)
+
+DEFAULT_ROUNDS = 20
+CIPHERS = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES128-SHA256"
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of a sorted list"""
+    rank = max(1, int(-(-p * len(values) // 100)))
+    return values[min(rank, len(values)) - 1]
+
+
+def make_context(args):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.minimum_version = ssl.TLSVersion.TLSv1_2
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.set_ciphers(CIPHERS)
+    context.set_ecdh_curve("prime256v1")
+    context.load_verify_locations(args.cafile)
+    if args.cert:
+        context.load_cert_chain(args.cert, args.key)
+    return context
+
+
+def handshake(context, args, session=None):
+    """Connects and handshakes; returns (tls socket, handshake ms)"""
+    raw = socket.create_connection((args.host, args.port), timeout=5)
+    raw.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    started = time.perf_counter()
+    tls = context.wrap_socket(raw, server_hostname=args.server_name, session=session,
+                              do_handshake_on_connect=False)
+    tls.do_handshake()
+    return tls, (time.perf_counter() - started) * 1000
+
+
+def mqtt_connect_ms(tls):
+    """CONNECT (clean session, keepalive 30) -> CONNACK round trip in ms"""
+    client_id = f"tls_probe_{int(time.time() * 1000) % 100000}".encode()
+    variable = b"\x00\x04MQTT\x04\x02\x00\x1e"
+    payload = struct.pack("!H", len(client_id)) + client_id
+    remaining = len(variable) + len(payload)
+    started = time.perf_counter()
+    tls.sendall(bytes([0x10, remaining]) + variable + payload)
+    connack = tls.recv(4)
+    elapsed = (time.perf_counter() - started) * 1000
+    if len(connack) < 4 or connack[0] != 0x20 or connack[3] != 0:
+        raise RuntimeError(f"CONNACK refused: {connack.hex()}")
+    tls.sendall(b"\xe0\x00")  # DISCONNECT
+    return elapsed
+
+
+def close(tls):
+    try:
+        tls.unwrap()
+    except (OSError, ssl.SSLError):
+        pass
+    tls.close()
+
+
+def report(name, values):
+    if not values:
+        print(f"{name:<12}{'-':>10}")
+        return
+    values = sorted(values)
+    print(f"{name:<12}{percentile(values, 50):>10.1f}{percentile(values, 90):>10.1f}{values[-1]:>10.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Full vs resumed TLS handshake time")
+    parser.add_argument("--host", default=BROKER_HOST)
+    parser.add_argument("--port", type=int, default=BROKER_PORT)
+    parser.add_argument("--cafile", required=True, help="CA certificate (mosquitto/config/certs/ca.crt)")
+    parser.add_argument("--server-name", default=SERVER_NAME, help="name checked in the broker certificate")
+    parser.add_argument("--cert", help="client certificate (require_certificate true)")
+    parser.add_argument("--key", help="client key")
+    parser.add_argument("-n", "--rounds", type=int, default=DEFAULT_ROUNDS)
+    parser.add_argument("--mqtt", action="store_true", help="also time CONNECT -> CONNACK")
+    args = parser.parse_args()
+
+    context = make_context(args)
+    full, resumed, connack = [], [], []
+    reused = 0
+    cipher = None
+
+    print(f"🔒 {args.host}:{args.port} as {args.server_name}, {args.rounds} rounds")
+    for _ in range(args.rounds):
+        tls, ms = handshake(context, args)
+        full.append(ms)
+        cipher = tls.cipher()[0]
+        # TLS 1.2: the ticket / session id is known right after the handshake
+        session = tls.session
+        close(tls)
+
+        tls, ms = handshake(context, args, session)
+        if tls.session_reused:
+            reused += 1
+            resumed.append(ms)
+        else:
+            full.append(ms)  # the broker did not know the session
+        if args.mqtt:
+            connack.append(mqtt_connect_ms(tls))
+        close(tls)
+
+    print(f"\n{'ms':<12}{'p50':>10}{'p90':>10}{'max':>10}")
+    report("full", full)
+    report("resumed", resumed)
+    if args.mqtt:
+        report("connack", connack)
+    print(f"\n✅ {reused}/{args.rounds} resumptions accepted, suite {cipher}")
+    if full and resumed:
+        print(f"📊 Resumed handshake {percentile(sorted(full), 50) / percentile(sorted(resumed), 50):.1f}x "
+              f"faster (p50)")
+
+
+if __name__ == "__main__":
+    main()